@@ -0,0 +1,83 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <libparasheet/tokenizer.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+#define ROUNDS 20000
+
+// an arithmetic heavy formula before and after ASTOptimize, on both
+// evaluators
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+
+    SpreadSheetSetCell(&src, (v2u){0, 2}, (CellValue){.t = CT_FLOAT, .d.f = 1.5f});
+
+    EvalStack stack = {.mem = mem};
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+        .epoch = SheetNewEpoch(),
+        .stack = &stack,
+    };
+
+    const char* heavy =
+        "=let x : float = [0, 2]; let y : int = 3;"
+        "(x * (1 + 1 / 2.0) + y * (60 / 4 - 5)) * (x - 2 * 0.25)"
+        " + y * y * (2.5 * 4) - (3 * 4 * 5 + 60) / x + x * (2 + 3 * 4) - y / 3;";
+    AST hp = build(heavy, &str, mem);
+    AST ho = build(heavy, &str, mem);
+    ASTOptimize(&ho);
+
+    BCProgram cp = {.mem = mem};
+    BCProgram co = {.mem = mem};
+    assert(BCCompile(&hp, &cp) && BCCompile(&ho, &co));
+    print(stdout, "heavy: %d nodes / %d instructions, optimized %d / %d\n", hp.size,
+          cp.size, ho.size, co.size);
+
+    f64 start = BenchNow();
+    for (u32 r = 0; r < ROUNDS; r++) walk(&hp, ctx);
+    f64 before = BenchNow() - start;
+
+    start = BenchNow();
+    for (u32 r = 0; r < ROUNDS; r++) walk(&ho, ctx);
+    f64 after = BenchNow() - start;
+
+    print(stdout, "tree walker: %f s, optimized: %f s, speedup: %fx\n", before,
+          after, before / after);
+
+    start = BenchNow();
+    for (u32 r = 0; r < ROUNDS * 10; r++) BCRun(&cp, ctx);
+    before = BenchNow() - start;
+
+    start = BenchNow();
+    for (u32 r = 0; r < ROUNDS * 10; r++) BCRun(&co, ctx);
+    after = BenchNow() - start;
+
+    print(stdout, "bytecode: %f s, optimized: %f s, speedup: %fx\n", before,
+          after, before / after);
+
+    BCFree(&cp);
+    BCFree(&co);
+    ASTFree(&hp);
+    ASTFree(&ho);
+    Free(stack.mem, stack.data, stack.cap * sizeof(v2u));
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    StringFree(&str);
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+#define ROWS (1 << 18)
+#define ROUNDS 10
+
+// ints that are never 0, floats, and a column mixing both with
+// empty cells and errors
+static void fillInputs(SpreadSheet* sheet, u32 rows) {
+    for (u32 y = 0; y < rows; y++) {
+        i32 i = (i32)(y * 7919 % 2001) - 1000;
+        SpreadSheetSetCell(sheet, (v2u){0, y}, (CellValue){.t = CT_INT, .d.i = i ? i : 1});
+        SpreadSheetSetCell(sheet, (v2u){1, y}, (CellValue){.t = CT_FLOAT, .d.f = y * 0.37f - 50});
+
+        CellValue mixed = {0};
+        switch (y % 7) {
+            case 0: mixed = (CellValue){.t = CT_INT, .d.i = y}; break;
+            case 1: mixed = (CellValue){.t = CT_FLOAT, .d.f = y / 3.0f}; break;
+            case 2: break;
+            case 3: mixed = (CellValue){.t = CT_ERROR, .d.i = CE_NAME}; break;
+            default: mixed = (CellValue){.t = CT_INT, .d.i = -(i32)y}; break;
+        }
+        if (y < rows / 2) mixed = (CellValue){.t = CT_INT, .d.i = y % 3};
+        SpreadSheetSetCell(sheet, (v2u){2, y}, mixed);
+    }
+}
+
+// a long column of one formula, the lanes against BCRun per cell.
+// Constant reads in dependency order come from the output sheet.
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+    EvalStack stack = {.mem = mem};
+
+    fillInputs(&src, ROWS);
+    fillInputs(&out, ROWS);
+    StrID id = StringAdd(&str, (i8*)"=[0, 0] * 3 + [1, 0] * 2 - [0, 0] / 7 + [2, 0];");
+    SpreadSheetSetCell(&src, (v2u){4, 0}, (CellValue){.t = CT_TEXT, .d.index = id});
+
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+        .currentX = 4,
+        .stack = &stack,
+    };
+    EvaluateCell(ctx);
+    ctx.ordered = true;
+    FormulaSource* source = FormulaCacheGet(&src.formulas, id);
+    BCProgram* prog = &src.formulas.templates[source->template].code;
+    assert(prog->size);
+
+    v2u* anchors = Alloc(mem, ROWS * sizeof(v2u));
+    CellValue* lanes = Alloc(mem, ROWS * sizeof(CellValue));
+    CellValue* single = Alloc(mem, ROWS * sizeof(CellValue));
+    for (u32 y = 0; y < ROWS; y++) anchors[y] = (v2u){0, y};
+
+    f64 start = BenchNow();
+    for (u32 r = 0; r < ROUNDS; r++) {
+        for (u32 y = 0; y < ROWS; y++) {
+            ctx.anchor = anchors[y];
+            single[y] = BCRun(prog, ctx);
+        }
+    }
+    f64 scalar = BenchNow() - start;
+
+    start = BenchNow();
+    for (u32 r = 0; r < ROUNDS; r++) BCRunBatch(prog, ctx, anchors, ROWS, lanes);
+    f64 batched = BenchNow() - start;
+
+    for (u32 y = 0; y < ROWS; y++) {
+        assert(lanes[y].t == single[y].t && lanes[y].d.i == single[y].d.i);
+    }
+    print(stdout, "%d cells: BCRun %f ms, BCRunBatch %f ms, speedup: %fx\n", ROWS,
+          scalar * 1000 / ROUNDS, batched * 1000 / ROUNDS, scalar / batched);
+
+    Free(mem, anchors, ROWS * sizeof(v2u));
+    Free(mem, lanes, ROWS * sizeof(CellValue));
+    Free(mem, single, ROWS * sizeof(CellValue));
+    Free(stack.mem, stack.data, stack.cap * sizeof(v2u));
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    StringFree(&str);
+    return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <time.h>
+#include <util/util.h>
+
+// the formula and tree walker helpers the tests use
+#include "../../tests/libparasheet/fixture.h"
+
+// Seconds on the monotonic clock, for timing the loops in the benches
+static inline f64 BenchNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#endif
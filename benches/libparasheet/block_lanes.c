@@ -0,0 +1,53 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+#define ROWS (1 << 20)
+#define ROUNDS 20
+#define WIDTH 64
+
+static f64 sumRange(EvalContext ctx, i64 sum) {
+    f64 start = BenchNow();
+    for (u32 r = 0; r < ROUNDS; r++) {
+        CellStats stats;
+        CellStatsInit(&stats);
+        EvalRange(ctx, (v2u){0, 0}, (v2u){WIDTH - 1, ROWS / WIDTH - 1}, &stats);
+        assert(stats.isum == sum && stats.icount == ROWS);
+    }
+    return BenchNow() - start;
+}
+
+// a dense block of ints summed from the cells and from the lanes
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    SpreadSheet plain = {.mem = mem};
+    SpreadSheet columnar = {.mem = mem};
+    SpreadSheetColumnar(&columnar);
+    i64 sum = 0;
+    for (u32 x = 0; x < WIDTH; x++) {
+        for (u32 y = 0; y < ROWS / WIDTH; y++) {
+            CellValue v = {.t = CT_INT, .d.i = (i32)((x + y) % 1000) - 300};
+            SpreadSheetSetCell(&plain, (v2u){x, y}, v);
+            SpreadSheetSetCell(&columnar, (v2u){x, y}, v);
+            sum += v.d.i;
+        }
+    }
+
+    EvalContext ctx = {.mem = mem, .srcSheet = &plain, .outSheet = &plain};
+    f64 cells = sumRange(ctx, sum);
+    ctx.srcSheet = ctx.outSheet = &columnar;
+    f64 lanes = sumRange(ctx, sum);
+
+    print(stdout, "SUM of %d cells: cells %f ms, lanes %f ms, speedup: %fx\n", ROWS,
+          cells * 1000 / ROUNDS, lanes * 1000 / ROUNDS, cells / lanes);
+
+    SpreadSheetFree(&plain);
+    SpreadSheetFree(&columnar);
+    return 0;
+}
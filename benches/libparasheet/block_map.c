@@ -0,0 +1,44 @@
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+#define LOOKUPS 1600000
+
+static u32 seed = 31337;
+
+static u32 rnd(u32 n) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+}
+
+// lookups with the map just under its resize, half of them misses.
+// The ids don't need blocks behind them for this.
+int main() {
+    SpreadSheet full = {.mem = GlobalAllocatorCreate()};
+    u32 rows = 0;
+    for (;; rows++) {
+        u32 x = 0;
+        for (; x < 1024; x++) {
+            if (full.cap >= 1 << 16 && (full.size + 2) * 8 > full.cap * 7) break;
+            SheetBlockInsert(&full, (v2u){x, rows}, full.size);
+        }
+        if (x < 1024) break;
+    }
+
+    u32 hits = 0;
+    f64 start = BenchNow();
+    for (u32 i = 0; i < LOOKUPS; i++) {
+        hits += SheetBlockGet(&full, (v2u){rnd(1024), rnd(rows * 2)}) != UINT32_MAX;
+    }
+    f64 took = BenchNow() - start;
+    assert(hits > LOOKUPS / 4 && hits < LOOKUPS / 4 * 3);
+
+    print(stdout, "%d blocks in %d slots: %f ns per lookup\n", full.size, full.cap,
+          took * 1e9 / LOOKUPS);
+    SpreadSheetFree(&full);
+    return 0;
+}
@@ -0,0 +1,36 @@
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+static void setInt(SpreadSheet* sheet, u32 x, u32 y, i32 v) {
+    SpreadSheetSetCell(sheet, (v2u){x, y}, (CellValue){.t = CT_INT, .d.i = v});
+}
+
+// a new block for every cell written, then every block emptied again
+int main() {
+    SpreadSheet sheet = {.mem = GlobalAllocatorCreate()};
+
+    f64 start = BenchNow();
+    for (u32 y = 0; y < 400; y++) {
+        for (u32 x = 0; x < 100; x++) setInt(&sheet, x * BLOCK_SIZE, y * BLOCK_SIZE, (i32)(x + y));
+    }
+    f64 filling = BenchNow() - start;
+    BlockPoolUsage full = BlockPoolGetUsage();
+    assert(full.blocks == sheet.size);
+
+    start = BenchNow();
+    for (u32 y = 0; y < 400; y++) {
+        for (u32 x = 0; x < 100; x++) SpreadSheetClearCell(&sheet, (v2u){x * BLOCK_SIZE, y * BLOCK_SIZE});
+    }
+    f64 clearing = BenchNow() - start;
+    assert(!sheet.size && BlockPoolGetUsage().blocks == 0);
+
+    print(stdout, "%d blocks on %d pages of %d: filled in %f ms, cleared in %f ms\n",
+          (i32)full.blocks, full.pages, full.pageBlocks, filling * 1000, clearing * 1000);
+    SpreadSheetFree(&sheet);
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+#define COLS 64
+#define ROWS 16384
+
+// how many ints in lo..hi, skipping the blocks whose summary rules
+// them out
+static u32 countBetween(SpreadSheet* sheet, i32 lo, i32 hi, bool prune, u32* visited) {
+    u32 found = 0;
+    *visited = 0;
+    for (u32 i = 0; i < sheet->cap; i++) {
+        v2u key = sheet->keys[i];
+        if (key.x == UINT32_MAX) continue;
+
+        u32 bid = sheet->values[i];
+        if (prune && !SheetBlockMayHold(sheet, bid, CELL_TYPE_BIT(CT_INT), lo, hi)) continue;
+        (*visited)++;
+        Block* block = sheet->blockpool[bid];
+        for (u32 j = 0; j < BLOCK_SIZE * BLOCK_SIZE; j++) {
+            CellValue v = CellUnbox(block->cells[j]);
+            found += v.t == CT_INT && v.d.i >= lo && v.d.i <= hi;
+        }
+    }
+    return found;
+}
+
+// ints sorted down the rows: a narrow predicate with and without the
+// summaries, and MIN/MAX over the whole sheet against reading it
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    SpreadSheet sorted = {.mem = mem};
+    for (u32 x = 0; x < COLS; x++) {
+        for (u32 y = 0; y < ROWS; y++) {
+            SpreadSheetSetCell(&sorted, (v2u){x, y}, (CellValue){.t = CT_INT, .d.i = y * COLS + x});
+        }
+    }
+
+    u32 visited, pruned;
+    f64 start = BenchNow();
+    u32 want = countBetween(&sorted, 50000, 50999, false, &visited);
+    f64 full = BenchNow() - start;
+    start = BenchNow();
+    u32 got = countBetween(&sorted, 50000, 50999, true, &pruned);
+    f64 skipping = BenchNow() - start;
+    assert(got == want);
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &sorted,
+        .inSheet = &sorted,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+    };
+
+    StrID id = StringAdd(&str, (i8*)"=MIN([0, 0]:[63, 16383]);");
+    SpreadSheetSetCell(&sorted, (v2u){100, 0}, (CellValue){.t = CT_TEXT, .d.index = id});
+    id = StringAdd(&str, (i8*)"=MAX([0, 0]:[63, 16383]);");
+    SpreadSheetSetCell(&sorted, (v2u){100, 1}, (CellValue){.t = CT_TEXT, .d.index = id});
+    EvaluateDirty(ctx);
+
+    // the edit makes a block loose, the recalc tightens it first
+    SpreadSheetSetCell(&sorted, (v2u){0, 0}, (CellValue){.t = CT_INT, .d.i = 7});
+    start = BenchNow();
+    EvaluateDirty(ctx);
+    f64 summarized = BenchNow() - start;
+
+    start = BenchNow();
+    CellStats stats;
+    CellStatsInit(&stats);
+    ctx.ordered = true;
+    EvalRange(ctx, (v2u){0, 0}, (v2u){63, 16383}, &stats);
+    f64 scanned = BenchNow() - start;
+    assert(SpreadSheetGetCell(&out, (v2u){100, 0})->d.i == stats.imin);
+
+    print(stdout, "%d blocks: predicate scan %f ms, pruned %f ms, MIN and MAX %f ms, "
+                  "one range scanned %f ms\n",
+          visited, full * 1000, skipping * 1000, summarized * 1000, scanned * 1000);
+
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&out);
+    StringFree(&str);
+    SpreadSheetFree(&sorted);
+    return 0;
+}
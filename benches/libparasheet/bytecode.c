@@ -0,0 +1,98 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <libparasheet/tokenizer.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define ROUNDS 10000
+
+// the formulas tests/libparasheet/bytecode.c checks, timed on the tree
+// walker and the bytecode VM
+static const char* formulas[] = {
+    "=2+2;",
+    "=2+2;3+3;",
+    "=1 + 2 / 3 * 4;",
+    "=1.5 * 4 - 2;",
+    "=let x : int = 2; let y : int = 2; x + y;",
+    "=let x : int = 3; let y: int = 4; 2 * (x + y);",
+    "=let x : float = 3; let y : int = 2.75; x / y;",
+    "=let x : int = 1; { x = x + 41; } x;",
+    "=let x : int = 1; { let x : int = 7; x = 9; } x;",
+    "=if (1) 10; else 20;",
+    "=7; if (0) 10; ;",
+    "=let x : int = 5; if (x - 5) { x = 1; } else { x = 2.5; } x * 3;",
+    "=[0, 0] * 2;",
+    "=[0, 0] + [0, 1];",
+    "=[0, 1] / 2;",
+    "=[0, 0 + 1] * [0, 2];",
+    "=let x : int = [0, 2]; x + [0, 2 * 0];",
+    "=if ([0, 3]) [0, 0]; else [0, 1];",
+};
+
+#define COUNT (sizeof(formulas) / sizeof(formulas[0]))
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+
+    SpreadSheetSetCell(&src, (v2u){0, 0}, (CellValue){.t = CT_INT, .d.i = 21});
+    SpreadSheetSetCell(&src, (v2u){0, 1}, (CellValue){.t = CT_FLOAT, .d.f = 5.0f});
+    SpreadSheetSetCell(&src, (v2u){0, 2}, (CellValue){.t = CT_INT, .d.i = -3});
+
+    EvalStack stack = {.mem = mem};
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+        .epoch = SheetNewEpoch(),
+        .stack = &stack,
+    };
+
+    AST asts[COUNT];
+    BCProgram progs[COUNT];
+
+    for (u32 i = 0; i < COUNT; i++) {
+        asts[i] = build(formulas[i], &str, mem);
+
+        progs[i] = (BCProgram){.mem = mem};
+        assert(BCCompile(&asts[i], &progs[i]));
+    }
+
+    f64 start = BenchNow();
+    for (u32 r = 0; r < ROUNDS; r++) {
+        for (u32 i = 0; i < COUNT; i++) walk(&asts[i], ctx);
+    }
+    f64 walker = BenchNow() - start;
+
+    start = BenchNow();
+    for (u32 r = 0; r < ROUNDS; r++) {
+        for (u32 i = 0; i < COUNT; i++) BCRun(&progs[i], ctx);
+    }
+    f64 bytecode = BenchNow() - start;
+
+    print(stdout, "tree walker: %f s, bytecode: %f s, speedup: %fx\n", walker,
+          bytecode, walker / bytecode);
+
+    for (u32 i = 0; i < COUNT; i++) {
+        ASTFree(&asts[i]);
+        BCFree(&progs[i]);
+    }
+    Free(stack.mem, stack.data, stack.cap * sizeof(v2u));
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    StringFree(&str);
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+#define ROWS 200000
+
+// a filled down column: every source is different, but they all
+// point one column to the left and share one template
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+    };
+
+    f64 start = BenchNow();
+    for (u32 y = 0; y < ROWS; y++) {
+        SpreadSheetSetCell(&src, (v2u){0, y}, (CellValue){.t = CT_INT, .d.i = y % 1000});
+        setFormula(&src, &str, (v2u){1, y}, "=[0, %u] * 2 + 1;", y);
+    }
+    u32 ran = EvaluateDirty(ctx);
+    f64 fill = BenchNow() - start;
+    assert(ran == 2 * ROWS);
+
+    print(stdout, "%d filled down formulas in %f s (%f us per cell), %d templates\n", ROWS,
+          fill, fill * 1e6 / ROWS, src.formulas.tcount);
+
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    StringFree(&str);
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <libparasheet/tokenizer.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+#define ROUNDS 100000
+
+// literals and constant references only, so the JIT runs all of it
+static const char* hot =
+    "=2 * ([0, 0] * 3 + [0, 1]) * ([0, 2] - 1) / 2 + ([0, 0] - [0, 2]) * 4.5"
+    " - [0, 1] / ([0, 0] + 1) + ([0, 2] * [0, 2] - 6) * ([0, 1] + 0.25)"
+    " + ([0, 0] * 3 + [0, 1]) * ([0, 2] - 1) / 2 - ([0, 0] - [0, 2]) * 4.5"
+    " + (1 + 2) * [0, 0] - 3 / [0, 1];";
+
+// one optimized formula on the tree walker, the bytecode VM and the JIT
+int main() {
+    // nothing to time on builds without the JIT
+    if (!JitThreshold()) return 0;
+
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+
+    SpreadSheetSetCell(&src, (v2u){0, 0}, (CellValue){.t = CT_INT, .d.i = 21});
+    SpreadSheetSetCell(&src, (v2u){0, 1}, (CellValue){.t = CT_FLOAT, .d.f = 5.0f});
+    SpreadSheetSetCell(&src, (v2u){0, 2}, (CellValue){.t = CT_INT, .d.i = -3});
+
+    EvalStack stack = {.mem = mem};
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+        .epoch = SheetNewEpoch(),
+        .stack = &stack,
+    };
+
+    AST ast = build(hot, &str, mem);
+    ASTOptimize(&ast);
+
+    BCProgram prog = {.mem = mem};
+    JitCode jit;
+    assert(BCCompile(&ast, &prog) && JitCompile(&ast, &jit) && jit.walks == 0);
+    print(stdout, "hot: %d nodes, %d instructions, %d bytes of code\n", ast.size,
+          prog.size, jit.size);
+
+    f64 start = BenchNow();
+    for (u32 r = 0; r < ROUNDS; r++) walk(&ast, ctx);
+    f64 walker = BenchNow() - start;
+
+    start = BenchNow();
+    for (u32 r = 0; r < ROUNDS; r++) BCRun(&prog, ctx);
+    f64 bytecode = BenchNow() - start;
+
+    start = BenchNow();
+    for (u32 r = 0; r < ROUNDS; r++) JitRun(&jit, &ast, ctx);
+    f64 native = BenchNow() - start;
+
+    print(stdout, "tree walker: %f s, bytecode: %f s, jit: %f s, speedup: %fx / %fx\n",
+          walker, bytecode, native, walker / native, bytecode / native);
+
+    JitFree(&jit);
+    BCFree(&prog);
+    ASTFree(&ast);
+    Free(stack.mem, stack.data, stack.cap * sizeof(v2u));
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    StringFree(&str);
+    return 0;
+}
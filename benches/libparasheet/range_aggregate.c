@@ -0,0 +1,69 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+#define ROWS (1 << 20)
+#define ROUNDS 20
+
+// SUM over a column of ints with a hole of missing blocks, the range
+// against reading every cell on its own
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+    };
+
+    i64 sum = 0;
+    for (u32 y = 0; y < ROWS; y++) {
+        if (y >= 1000 && y < 5000) continue;
+        i32 v = (i32)(y % 1000) - 300;
+        SpreadSheetSetCell(&src, (v2u){0, y}, (CellValue){.t = CT_INT, .d.i = v});
+        sum += v;
+    }
+
+    f64 start = BenchNow();
+    for (u32 r = 0; r < ROUNDS; r++) {
+        CellStats stats;
+        CellStatsInit(&stats);
+        for (u32 y = 0; y < ROWS; y++) {
+            CellValue* c = SpreadSheetGetCell(&src, (v2u){0, y});
+            if (c) CellStatsAdd(&stats, *c);
+        }
+        assert(stats.isum == sum);
+    }
+    f64 cells = BenchNow() - start;
+
+    start = BenchNow();
+    for (u32 r = 0; r < ROUNDS; r++) {
+        CellStats stats;
+        CellStatsInit(&stats);
+        CellValue v = EvalRange(ctx, (v2u){0, 0}, (v2u){0, ROWS - 1}, &stats);
+        assert(v.t != CT_ERROR && stats.isum == sum);
+    }
+    f64 range = BenchNow() - start;
+
+    print(stdout, "SUM of %d rows: per cell %f ms, range %f ms, speedup: %fx\n", ROWS,
+          cells * 1000 / ROUNDS, range * 1000 / ROUNDS, cells / range);
+
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    SymbolTableFree(&sym);
+    StringFree(&str);
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+#define ROWS 100000
+#define WINDOW 10
+
+// a value column, a formula column reading it, sums over both and a
+// sum per WINDOW rows. A full recalc against one edit under them.
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+    };
+
+    for (u32 y = 0; y < ROWS; y++) {
+        SpreadSheetSetCell(&src, (v2u){0, y}, (CellValue){.t = CT_INT, .d.i = y % 100});
+        setFormula(&src, &str, (v2u){1, y}, "=[0, %u] * 2;", y, 0);
+    }
+    setFormula(&src, &str, (v2u){3, 0}, "=SUM([0, 0]:[0, %u]);", ROWS - 1, 0);
+    setFormula(&src, &str, (v2u){3, 1}, "=SUM([1, %u]:[1, 0]);", ROWS - 1, 0);
+    setFormula(&src, &str, (v2u){3, 2}, "=[3, 1] + 1;", 0, 0);
+    for (u32 y = 0; y < ROWS; y += WINDOW) {
+        setFormula(&src, &str, (v2u){5, y}, "=SUM([0, %u]:[0, %u]);", y, y + WINDOW - 1);
+    }
+
+    f64 start = BenchNow();
+    EvaluateDirty(ctx);
+    f64 full = BenchNow() - start;
+
+    start = BenchNow();
+    SpreadSheetSetCell(&src, (v2u){0, 5003}, (CellValue){.t = CT_INT, .d.i = 1000});
+    EvaluateDirty(ctx);
+    f64 edit = BenchNow() - start;
+
+    print(stdout, "%d rows, %d range formulas: full recalc %f ms, one edit %f ms\n", ROWS,
+          ROWS / WINDOW + 3, full * 1000, edit * 1000);
+
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    StringFree(&str);
+    return 0;
+}
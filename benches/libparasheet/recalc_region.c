@@ -0,0 +1,80 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+#define ROWS 50000
+
+// values, a formula per row and a running total down the column
+static void buildSheet(SpreadSheet* sheet, StringTable* str) {
+    for (u32 y = 0; y < ROWS; y++) {
+        SpreadSheetSetCell(sheet, (v2u){0, y}, (CellValue){.t = CT_INT, .d.i = y % 10});
+        setFormula(sheet, str, (v2u){1, y}, "=[0, %u] * 3;", y, 0);
+        if (y) setFormula(sheet, str, (v2u){2, y}, "=[2, %u] + [1, %u];", y - 1, y);
+    }
+    setFormula(sheet, str, (v2u){2, 0}, "=[1, %u];", 0, 0);
+}
+
+// a full recalc against the first screen of the same sheet, and the
+// screen below an edit halfway down
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+    SpreadSheet refSrc = {.mem = mem};
+    SpreadSheet refOut = {.mem = mem};
+
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+    };
+    EvalContext refCtx = ctx;
+    refCtx.srcSheet = refCtx.inSheet = &refSrc;
+    refCtx.outSheet = &refOut;
+
+    buildSheet(&src, &str);
+    buildSheet(&refSrc, &str);
+
+    f64 start = BenchNow();
+    EvaluateDirty(refCtx);
+    f64 full = BenchNow() - start;
+
+    Recalc rc;
+    start = BenchNow();
+    RecalcBegin(&rc, ctx);
+    u32 shown = RecalcRegion(&rc, (v2u){0, 0}, (v2u){7, 39});
+    f64 screen = BenchNow() - start;
+    assert(shown == 3 * 40);
+    while (!RecalcStep(&rc, 1000)) {}
+    RecalcFree(&rc);
+
+    SpreadSheetSetCell(&src, (v2u){0, 20000}, (CellValue){.t = CT_INT, .d.i = 100});
+    RecalcBegin(&rc, ctx);
+    start = BenchNow();
+    shown = RecalcRegion(&rc, (v2u){0, 20100}, (v2u){7, 20139});
+    f64 edit = BenchNow() - start;
+    assert(shown == 40);
+    RecalcFree(&rc);
+
+    print(stdout, "%d rows: full recalc %f ms, first screen %f ms, screen after an edit %f ms\n",
+          ROWS, full * 1000, screen * 1000, edit * 1000);
+
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    SpreadSheetFree(&refSrc);
+    SpreadSheetFree(&refOut);
+    StringFree(&str);
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+#define ROUNDS 200000
+
+// sixteen inputs spread over four blocks
+static const char* heavy =
+    "=[0, 0] + [1, 0] + [2, 0] + [3, 0] + [0, 20] + [1, 20] + [2, 20] + [3, 20]"
+    " + [20, 0] + [21, 0] + [22, 0] + [23, 0] + [20, 20] + [21, 20] + [22, 20] + [23, 20];";
+
+static const v2u inputs[] = {
+    {0, 0},  {1, 0},  {2, 0},  {3, 0},  {0, 20},  {1, 20},  {2, 20},  {3, 20},
+    {20, 0}, {21, 0}, {22, 0}, {23, 0}, {20, 20}, {21, 20}, {22, 20}, {23, 20},
+};
+
+#define INPUTS (sizeof(inputs) / sizeof(inputs[0]))
+
+// the same program with and without handles
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+    EvalStack stack = {.mem = mem};
+
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+    };
+
+    for (u32 i = 0; i < INPUTS; i++) {
+        SpreadSheetSetCell(&src, inputs[i], (CellValue){.t = CT_INT, .d.i = i + 1});
+    }
+    StrID id = StringAdd(&str, (i8*)heavy);
+    SpreadSheetSetCell(&src, (v2u){40, 40}, (CellValue){.t = CT_TEXT, .d.index = id});
+    EvaluateDirty(ctx);
+
+    FormulaSource* source = FormulaCacheGet(&src.formulas, id);
+    BCProgram* prog = &src.formulas.templates[source->template].code;
+    assert(source->handles && prog->size);
+    ctx.stack = &stack;
+    ctx.ordered = true;
+    ctx.anchor = source->anchor;
+
+    f64 start = BenchNow();
+    CellValue plain = {0};
+    for (u32 r = 0; r < ROUNDS; r++) plain = BCRun(prog, ctx);
+    f64 lookup = BenchNow() - start;
+
+    ctx.handles = source->handles;
+    start = BenchNow();
+    CellValue fast = {0};
+    for (u32 r = 0; r < ROUNDS; r++) fast = BCRun(prog, ctx);
+    f64 handled = BenchNow() - start;
+
+    assert(plain.t == fast.t && plain.d.i == fast.d.i);
+    print(stdout, "%d references: block lookups %f us, handles %f us, speedup: %fx\n", INPUTS,
+          lookup * 1e6 / ROUNDS, handled * 1e6 / ROUNDS, lookup / handled);
+
+    Free(stack.mem, stack.data, stack.cap * sizeof(v2u));
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    StringFree(&str);
+    return 0;
+}
@@ -0,0 +1,42 @@
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <stdio.h>
+
+#include "bench.h"
+
+#define COLS 64
+#define ROWS 16384
+
+static void fill(SpreadSheet* sheet) {
+    for (u32 x = 0; x < COLS; x++) {
+        for (u32 y = 0; y < ROWS; y++) {
+            SpreadSheetSetCell(sheet, (v2u){x, y}, (CellValue){.t = CT_INT, .d.i = x * ROWS + y});
+        }
+    }
+}
+
+// a million cells copied one by one against a clone
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    SpreadSheet src = {.mem = mem};
+    fill(&src);
+
+    f64 start = BenchNow();
+    SpreadSheet deep = {.mem = mem};
+    fill(&deep);
+    f64 copying = BenchNow() - start;
+
+    start = BenchNow();
+    SpreadSheet clone;
+    SpreadSheetClone(&clone, &src);
+    f64 cloning = BenchNow() - start;
+
+    print(stdout, "%d blocks: cell by cell copy %f ms, clone %f ms\n", src.size, copying * 1000,
+          cloning * 1000);
+    SpreadSheetFree(&clone);
+    SpreadSheetFree(&deep);
+    SpreadSheetFree(&src);
+    return 0;
+}
@@ -0,0 +1,39 @@
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+// a long sparse column: the iterator only pays for the cells,
+// probing every cell of the used range pays for its area
+int main() {
+    SpreadSheet sparse = {.mem = GlobalAllocatorCreate()};
+    for (u32 y = 0; y < 1 << 16; y += 331) {
+        SpreadSheetSetCell(&sparse, (v2u){y % 3 * 40, y}, (CellValue){.t = CT_INT, .d.i = 1});
+    }
+    v2u lo, hi;
+    assert(SpreadSheetUsedRange(&sparse, &lo, &hi));
+
+    f64 start = BenchNow();
+    u32 probed = 0;
+    for (u32 y = lo.y; y <= hi.y; y++) {
+        for (u32 x = lo.x; x <= hi.x; x++) probed += SpreadSheetGetCell(&sparse, (v2u){x, y}) != NULL;
+    }
+    f64 probing = BenchNow() - start;
+
+    start = BenchNow();
+    SheetIter it;
+    SheetIterBegin(&it, &sparse, SHEET_ROWS);
+    u32 walked = 0;
+    while (SheetIterNext(&it)) walked++;
+    SheetIterEnd(&it);
+    f64 iterating = BenchNow() - start;
+    assert(walked == sparse.cells && probed >= walked);
+
+    print(stdout, "%d cells over %d rows: probing %f ms, iterating %f ms\n", walked,
+          hi.y - lo.y + 1, probing * 1000, iterating * 1000);
+    SpreadSheetFree(&sparse);
+    return 0;
+}
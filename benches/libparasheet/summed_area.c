@@ -0,0 +1,105 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+#define COLS 128
+#define ROWS 2048
+#define REPORTS 400
+
+static u32 seed = 777;
+
+static u32 rnd(u32 n) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+}
+
+// ints only, the tables don't total floats
+static CellValue randomCell(void) {
+    switch (rnd(4)) {
+        case 0: return (CellValue){.t = CT_EMPTY};
+        default: return (CellValue){.t = CT_INT, .d.i = (i32)rnd(2000) - 1000};
+    }
+}
+
+static void fill(SpreadSheet* sheet) {
+    for (u32 x = 0; x < COLS; x++) {
+        for (u32 y = 0; y < ROWS; y++) {
+            CellValue v = randomCell();
+            if (v.t != CT_EMPTY) SpreadSheetSetCell(sheet, (v2u){x, y}, v);
+        }
+    }
+}
+
+// a dashboard: overlapping totals over a data sheet, all of them
+// over the middle cell. The same formulas go in both sheets.
+static void reports(SpreadSheet* sheet, SpreadSheet* ref, StringTable* str) {
+    for (u32 i = 0; i < REPORTS; i++) {
+        v2u lo = {rnd(COLS / 2), rnd(ROWS / 2)};
+        v2u hi = {COLS / 2 + rnd(COLS / 2), ROWS / 2 + rnd(ROWS / 2)};
+        const char* fn = i % 3 == 0 ? "SUM" : i % 3 == 1 ? "COUNT" : "AVERAGE";
+        const char* text = formulaText("=%s([%u, %u]:[%u, %u]);", fn, lo.x, lo.y, hi.x, hi.y);
+        CellValue v = {.t = CT_TEXT, .d.index = StringAdd(str, (i8*)text)};
+        SpreadSheetSetCell(sheet, (v2u){COLS + 100, i}, v);
+        SpreadSheetSetCell(ref, (v2u){COLS + 100, i}, v);
+    }
+}
+
+// every report recalculated after an edit in the middle, scanning the
+// cells against reading the summed-area tables
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+    SpreadSheet refSrc = {.mem = mem};
+    SpreadSheet refOut = {.mem = mem};
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+    };
+    EvalContext refCtx = ctx;
+    refCtx.srcSheet = refCtx.inSheet = &refSrc;
+    refCtx.outSheet = &refOut;
+
+    u32 s = seed;
+    fill(&src);
+    seed = s;
+    fill(&refSrc);
+    reports(&src, &refSrc, &str);
+    SpreadSheetSummed(&src);
+    EvaluateDirty(refCtx);
+    EvaluateDirty(ctx);
+
+    v2u middle = {COLS / 2, ROWS / 2};
+    SpreadSheetSetCell(&src, middle, (CellValue){.t = CT_INT, .d.i = 5000});
+    SpreadSheetSetCell(&refSrc, middle, (CellValue){.t = CT_INT, .d.i = 5000});
+    f64 start = BenchNow();
+    u32 ran = EvaluateDirty(refCtx);
+    f64 scanned = BenchNow() - start;
+    start = BenchNow();
+    ran += EvaluateDirty(ctx);
+    f64 summed = BenchNow() - start;
+    assert(ran == 2 * (REPORTS + 1));
+
+    print(stdout, "%d reports over %d cells: scanning %f ms, summed-area tables %f ms\n",
+          REPORTS, COLS * ROWS, scanned * 1000, summed * 1000);
+
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    SpreadSheetFree(&refSrc);
+    SpreadSheetFree(&refOut);
+    StringFree(&str);
+    return 0;
+}
@@ -34,6 +34,13 @@ int csv_parse_line(StringTable* str, const char* line, u32 linesize, CellValue*
  */
 bool csv_load_file(FILE* csv, StringTable* str, SpreadSheet* sheet);
 
+/**
+ * Writes the cells of a sheet from (0, 0) to the end of its used range
+ * as CSV. Only the nonempty blocks are read.
+ *
+ * @param filename  Path of the CSV file to write.
+ * @param sheet     Pointer to the SpreadSheet to export.
+ */
 void csv_export_file(Allocator a, const char* filename, SpreadSheet* sheet, StringTable* str);
 
 bool is_integer(const char* s);
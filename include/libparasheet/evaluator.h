@@ -3,6 +3,42 @@
 
 #include "lib_internal.h"
 #include "util/util.h"
+#include <stdbool.h>
+
+// Formula cells waiting to be evaluated, shared by everything
+// evaluated in one EvaluateCell/EvaluateDirty call
+typedef struct EvalStack {
+    Allocator mem;
+    v2u* data;
+    u32 size;
+    u32 cap;
+    // set when a computed reference read a cell that isn't done yet
+    bool blocked;
+} EvalStack;
+
+// Settings and results of iterative calculation. With one of these in
+// EvalContext.iterate, reference cycles are evaluated over and over
+// until no cell in them changes by more than epsilon, instead of
+// becoming #CYCLE! errors.
+typedef struct IterativeCalc {
+    Allocator mem;
+    u32 maxIterations;
+    f64 epsilon;
+
+    // Filled in by each recalc. residuals has one entry per iteration,
+    // the largest change of any cell in the cycle, with the cycles one
+    // after another in the order they were evaluated. iterations[c] is
+    // how many of them belong to cycle c.
+    f64* residuals;
+    u32 rsize;
+    u32 rcap;
+    u32* iterations;
+    u32 cycles;
+    u32 ccap;
+    u32 unconverged; // cycles that ran out of iterations
+} IterativeCalc;
+
+void IterativeCalcFree(IterativeCalc* iter);
 
 //EvalContext definition
 typedef struct EvalContext {
@@ -14,6 +50,25 @@ typedef struct EvalContext {
     SymbolTable* table;
     u32 currentX;
     u32 currentY;
+    // set by EvaluateDirty, constant references are already up to date
+    // in outSheet so they are read instead of evaluated again
+    bool ordered;
+    // recalc pass stamp, cells already done in this epoch are not
+    // evaluated again. 0 means EvaluateCell starts a new pass itself
+    u32 epoch;
+    // work stack, EvaluateCell makes its own if this is NULL
+    EvalStack* stack;
+    // cell the `#` offsets of references are added to, set per formula
+    v2u anchor;
+    // the running formula's handles, indexed by a reference's slot
+    // (see ASTNumberRefs). NULL looks every reference up
+    CellHandle* handles;
+    // set by a Recalc once it knows its cone: cells outside the last
+    // cone of this graph are up to date in outSheet and never pulled in
+    DepGraph* cone;
+    // iterate reference cycles found by EvaluateDirty and Recalc, NULL
+    // makes them #CYCLE! errors
+    IterativeCalc* iterate;
 } EvalContext;
 
 // Evaluates a single cell by walking its AST and computing the result.
@@ -24,5 +79,88 @@ void EvaluateCell(EvalContext ctx);
 
 CellValue evaluateNode(AST* tree, u32 index, EvalContext ctx);
 
+// Runs a compiled formula, see BCCompile. Gives the same result as
+// evaluateNode on the tree it was compiled from.
+CellValue BCRun(BCProgram* prog, EvalContext ctx);
+
+// Runs prog once per anchor, count cells sharing one template, with the
+// same results as count calls to BCRun. Only for ctx.ordered, the cells
+// it reads have to be done already.
+void BCRunBatch(BCProgram* prog, EvalContext ctx, v2u* anchors, u32 count, CellValue* out);
+
+// Runs code from JitCompile for the tree it was compiled from, with
+// the same result as evaluateNode
+CellValue JitRun(JitCode* jit, AST* tree, EvalContext ctx);
+
+// Shared between the tree walker, the bytecode and the JIT
+CellValue EvalBinaryOp(ASTNodeOp op, CellValue lhs, CellValue rhs);
+CellValue EvalReadCell(EvalContext ctx, v2u pos, bool constant);
+// EvalReadCell for the constant reference with handle slot `slot`, goes
+// through ctx.handles when the read comes from outSheet
+CellValue EvalReadRef(EvalContext ctx, v2u pos, u32 slot);
+u32 EvalRefCoord(CellValue v);
+// Position of a reference whose coordinates are literals or constant
+// `#` offsets from anchor, false if either one has to be computed
+bool EvalConstRef(AST* tree, ASTNode* ref, v2u anchor, v2u* pos);
+
+// Adds up every number in the rectangle lo..hi (inclusive) into stats.
+// Returns an error if a formula cell in it failed or isn't done yet,
+// the same way EvalReadCell does. With ctx.ordered every formula cell
+// in it is taken to be done.
+CellValue EvalRange(EvalContext ctx, v2u lo, v2u hi, CellStats* stats);
+
+// Re-evaluates only the cells changed since the last call and everything
+// that depends on them, in dependency order. Turns on dependency tracking
+// for srcSheet if it isn't already. Returns the number of cells evaluated.
+u32 EvaluateDirty(EvalContext ctx);
+
+// Same as EvaluateDirty, but cells that don't depend on each other are
+// evaluated as jobs on the pool. The calling thread takes part and is
+// the only one writing to the sheets.
+u32 EvaluateDirtyParallel(EvalContext ctx, JobPool* pool);
+
+typedef enum RecalcPhase {
+    RECALC_TRACK,   // marking the cells of a sheet that wasn't tracked
+    RECALC_REFRESH, // rebuilding the precedents of the dirty cells
+    RECALC_ORDER,   // ordering the cone, see DepGraphOrderStep
+    RECALC_SORT,    // sorting the ordered cone by level
+    RECALC_LEVELS,  // evaluating the cone level by level
+    RECALC_CYCLES,  // cells in or behind a cycle
+    RECALC_DONE,
+} RecalcPhase;
+
+// EvaluateDirty split into slices, so a caller can keep doing other
+// things in between and have the part of the sheet it needs first
+// evaluated ahead of the rest. Must not move once begun.
+typedef struct Recalc {
+    EvalContext ctx;
+    EvalStack stack;
+    RecalcPhase phase;
+    u32 next; // cone slot, order slot or sort step the phase is at
+    u32 level;
+    u32 depth;
+    u32* ids; // the cone in level order, see sortByLevel
+    u32* starts;
+    // with ctx.iterate, the components of the cycle phase (see
+    // DepGraphComponents) and the one it is at
+    u32* comps;
+    u32 ccount;
+    u32 comp;
+    u32 evaluated; // cells the slices evaluated, regions not included
+} Recalc;
+
+// Starts a recalc of everything changed since the last one finished.
+// Cells edited before it is done need a new one.
+void RecalcBegin(Recalc* rc, EvalContext ctx);
+// Does up to budget cells worth of work, true once all of it is done
+bool RecalcStep(Recalc* rc, u32 budget);
+// Evaluates the out of date cells in lo..hi (inclusive) and everything
+// they read right away. Returns how many cells of the region it ran.
+u32 RecalcRegion(Recalc* rc, v2u lo, v2u hi);
+// How far along the slices are: cone slots passed out of the whole
+// cone, or dirty cells refreshed while the cone isn't known yet
+void RecalcProgress(Recalc* rc, u32* done, u32* total);
+void RecalcFree(Recalc* rc);
+
 
 #endif // EVALUATOR_H
@@ -87,24 +87,583 @@ typedef enum CellType : u32 {
 	CT_TEXT,
 	CT_INT,
 	CT_FLOAT,
+	CT_ERROR, // d.i holds a CellError
 } CellType;
 
+#define CELL_TYPES (CT_ERROR + 1)
+#define CELL_TYPE_BIT(t) (1u << (t))
+
+typedef enum CellError : u32 {
+	CE_NONE = 0,
+	CE_CYCLE, // the cell is part of (or depends on) a reference cycle
+	CE_PENDING, // internal to the evaluator, a dependency isn't done yet
+	CE_NAME, // call to a function that doesn't exist
+	CE_DIV0, // division by zero, AVERAGE of no numbers
+} CellError;
+
+// Short display text for an error cell, "#CYCLE!" and so on
+const char* CellErrorString(CellError e);
+
+// Float cells are f32 unless the build has CELL_NANBOX (see below),
+// then they are f64. Everything that holds a float cell's value uses
+// this.
+#if defined(CELL_NANBOX)
+typedef f64 CellFloat;
+#else
+typedef f32 CellFloat;
+#endif
+
 typedef struct CellValue {
 	CellType t;
 	union {
 		i32 i;
-		f32 f;
+		CellFloat f;
 		StrID index; // index into external buffer
 	} d;
 } CellValue;
 
+/*
++--------------------------------------------------------+
+|   INFO: Cell Storage                                   |
+|                                                        |
+|   Blocks store CellSlots. By default a slot is just a  |
+|   CellValue: a 4 byte tag and an 8 byte union, 12      |
+|   bytes per cell. Building with -D CELL_NANBOX makes   |
+|   it a NaN-boxed 8 byte word instead and floats f64.   |
+|                                                        |
+|   A boxed slot is the f64 bits xor CELL_BOX_EMPTY, so  |
+|   zeroed memory is empty cells. After the xor every    |
+|   float has some of its top 13 bits set. Everything    |
+|   else is below 2^51: the type in bits 48-50 and a 48  |
+|   bit payload, an i32 or an idx and 16 bits of gen.    |
+|   Floats that are NaN are stored as the positive quiet |
+|   NaN so they can't be mistaken for a boxed value.     |
+|                                                        |
+|   CellBox/CellUnbox convert, CellSlotType reads the    |
+|   type without unboxing. Nothing outside these should  |
+|   look inside a slot.                                  |
++--------------------------------------------------------+
+*/
+
+#if defined(CELL_NANBOX)
+
+typedef u64 CellSlot;
+
+#define CELL_BOX_EMPTY 0xFFF8000000000000ull
+#define CELL_BOX_FLOATS (1ull << 51)
+#define CELL_BOX_PAYLOAD 0xFFFFFFFFFFFFull
+#define CELL_BOX_NAN 0x7FF8000000000000ull
+// the part of a StrID generation a boxed slot keeps
+#define CELL_BOX_GEN 0xFFFFu
+
+_Static_assert(CELL_TYPES <= 8, "a boxed slot has 3 bits of type");
+
+static inline CellType CellSlotType(CellSlot s) {
+	return s >= CELL_BOX_FLOATS ? CT_FLOAT : (CellType)(s >> 48);
+}
+
+static inline CellSlot CellBox(CellValue v) {
+	u64 bits;
+	switch (v.t) {
+		case CT_FLOAT: {
+			union { f64 f; u64 u; } f = {.f = v.d.f};
+			bits = f.u;
+			if ((bits ^ CELL_BOX_EMPTY) < CELL_BOX_FLOATS)
+				bits = CELL_BOX_NAN;
+			return bits ^ CELL_BOX_EMPTY;
+		}
+		case CT_TEXT:
+		case CT_CODE:
+			bits = ((u64)(v.d.index.gen & CELL_BOX_GEN) << 32) | v.d.index.idx;
+			break;
+		case CT_EMPTY:
+			return 0;
+		default:
+			bits = (u32)v.d.i;
+			break;
+	}
+	return ((u64)v.t << 48) | bits;
+}
+
+static inline CellValue CellUnbox(CellSlot s) {
+	CellValue v = {.t = CellSlotType(s)};
+	switch (v.t) {
+		case CT_FLOAT: {
+			union { f64 f; u64 u; } f = {.u = s ^ CELL_BOX_EMPTY};
+			v.d.f = f.f;
+		} break;
+		case CT_TEXT:
+		case CT_CODE:
+			v.d.index = (StrID){.idx = (u32)s, .gen = (u32)(s >> 32) & CELL_BOX_GEN};
+			break;
+		case CT_EMPTY:
+			break;
+		default:
+			v.d.i = (i32)(u32)s;
+			break;
+	}
+	return v;
+}
+
+#else
+
+typedef CellValue CellSlot;
+
+static inline CellType CellSlotType(CellSlot s) {
+	return s.t;
+}
+
+static inline CellSlot CellBox(CellValue v) {
+	return v;
+}
+
+static inline CellValue CellUnbox(CellSlot s) {
+	return s;
+}
+
+#endif
+
+// What a block holds, kept up to date by SpreadSheetSetCell so a scan
+// can tell from here whether the block can have anything it wants.
+// Overwriting the cell that held a minimum or maximum doesn't rescan
+// the block, it only makes the extremes loose: still bounds, just no
+// longer exact (see SheetSummariesTighten).
+typedef struct BlockSummary {
+	u16 counts[CELL_TYPES]; // nonempty cells of each type
+	u32 types;				// CELL_TYPE_BIT of every type with a count
+	// only meaningful while the count of that type isn't 0
+	i32 imin;
+	i32 imax;
+	CellFloat fmin;
+	CellFloat fmax;
+	u32 loose;
+} BlockSummary;
+
 typedef struct Block {
+	u32 refs; // sheets holding this block, a plain refcount, so sheets
+			  // sharing blocks must not be written or freed from
+			  // different threads at the same time
+	u32 page; // where BlockPoolFree gives it back to
 	u32 nonempty; // keeps track of nonempty cells,
 				  // when empty it gets marked as free
+	BlockSummary summary;
 
-	CellValue cells[BLOCK_SIZE * BLOCK_SIZE];
+	CellSlot cells[BLOCK_SIZE * BLOCK_SIZE];
 } Block;
 
+// Blocks of every sheet come from one pool of mmapped pages (see
+// pool.c). They are zeroed, never move while handed out, and a page
+// whose blocks are all freed is given back to the OS. Thread safe.
+typedef struct BlockPoolUsage {
+	u64 blocks;		// handed out
+	u32 pages;		// mapped
+	u32 resident;	// pages holding memory, the rest were given back
+	u32 pageBlocks; // blocks per page
+} BlockPoolUsage;
+
+Block* BlockPoolAlloc(void);
+void BlockPoolFree(Block* block);
+BlockPoolUsage BlockPoolGetUsage(void);
+// Asks for huge pages for new pages: MAP_HUGETLB where some are
+// reserved, transparent huge pages otherwise
+void BlockPoolHugePages(u32 on);
+
+// Evaluation stamps of one block. These are kept by the sheet next to
+// its block pointers, a block shared with a clone gets its own stamps
+// in each sheet.
+typedef struct BlockStamps {
+	// cells evaluated during recalc pass `epoch`, the bits are
+	// stale (all zero) whenever epoch isn't the current pass
+	u32 epoch;
+	u64 done[BLOCK_SIZE * BLOCK_SIZE / 64];
+	u64 busy[BLOCK_SIZE * BLOCK_SIZE / 64]; // started but not done
+} BlockStamps;
+
+// Where a cell was found in a sheet, so a formula reading it again
+// doesn't have to go through the block map. Block ids only change
+// meaning when a block is added or freed, which gives the sheet a new
+// version, so a handle is good as long as pos and version still match.
+typedef struct CellHandle {
+	v2u pos;
+	u32 version; // UINT32_MAX for a handle that was never resolved
+	u32 block;	 // UINT32_MAX when the cell's block doesn't exist
+	u32 index;	 // CELL_TO_INDEX within the block
+} CellHandle;
+
+/*
++--------------------------------------------------------+
+|   INFO: Block Lanes                                    |
+|                                                        |
+|   Optional columnar copy of the numbers in a block,    |
+|   kept in sync by SpreadSheetSetCell once the sheet    |
+|   has SHEET_COLUMNAR (see SpreadSheetColumnar). The    |
+|   cells array stays the real storage, the lanes only   |
+|   let kernels read numbers without the type tags.      |
+|                                                        |
+|   Cells are in CELL_TO_INDEX order like Block.cells,   |
+|   so a column of a block is 16 contiguous lane slots.  |
++--------------------------------------------------------+
+*/
+
+typedef enum LaneKind : u32 {
+	LANE_MIXED = 0,
+	LANE_INT,	// every nonempty cell is an int
+	LANE_FLOAT, // every nonempty cell is a float
+} LaneKind;
+
+typedef struct BlockLanes {
+	// one bit per cell for each kind of value
+	u64 ints[BLOCK_SIZE * BLOCK_SIZE / 64];
+	u64 floats[BLOCK_SIZE * BLOCK_SIZE / 64];
+	u64 formulas[BLOCK_SIZE * BLOCK_SIZE / 64];
+
+	u16 icount;
+	u16 fcount;
+	LaneKind kind;
+
+	// the value of every int (float) cell, 0 everywhere else, so
+	// sums can run over a lane without checking the bitmaps
+	i32 i[BLOCK_SIZE * BLOCK_SIZE];
+	CellFloat f[BLOCK_SIZE * BLOCK_SIZE];
+} BlockLanes;
+
+/*
++--------------------------------------------------------+
+|   INFO: Range Aggregation                              |
+|                                                        |
+|   Running totals used by the aggregate functions       |
+|   (SUM, MIN, MAX, COUNT, AVERAGE). Ints and floats are |
+|   kept apart so a range of ints stays an int.          |
+|                                                        |
+|   CellStatsAccumulate works on a run of cells straight |
+|   out of a Block and uses SIMD where it can. Formula   |
+|   cells are only counted, their values live in the     |
+|   output sheet and the caller adds them separately.    |
++--------------------------------------------------------+
+*/
+
+typedef struct CellStats {
+	i64 isum;
+	f64 fsum;
+	u32 icount;
+	u32 fcount;
+	i32 imin;
+	i32 imax;
+	CellFloat fmin;
+	CellFloat fmax;
+	u32 formulas; // CT_TEXT/CT_CODE cells seen, not in the totals
+} CellStats;
+
+void CellStatsInit(CellStats* stats);
+void CellStatsAdd(CellStats* stats, CellValue v);
+void CellStatsAccumulate(CellStats* stats, CellSlot* cells, u32 count);
+// Same as CellStatsAccumulate on cells[start..start+count) of the block
+void CellStatsAccumulateLanes(CellStats* stats, BlockLanes* lanes, u32 start, u32 count);
+// Counts, MIN and MAX of a whole block off its summary, which has to
+// be tight. The sums are left alone.
+void CellStatsAddSummary(CellStats* stats, BlockSummary* summary);
+
+/*
++--------------------------------------------------------+
+|   INFO: Summed-Area Tables                             |
+|                                                        |
+|   Optional totals for SUM/COUNT/AVERAGE over any       |
+|   rectangle, kept once the sheet has SHEET_SUMMED (see |
+|   SpreadSheetSummed). Every block has 2D prefix sums   |
+|   of its cells, and the sheet has a coarse table of    |
+|   prefix sums over the block totals. A rectangle is    |
+|   four corners of the coarse table for the blocks it   |
+|   covers whole, plus four corners in each block along  |
+|   its edges.                                           |
+|                                                        |
+|   SpreadSheetSetCell only marks the block and the      |
+|   coarse table dirty, both are rebuilt by the next     |
+|   SheetRangeSums that needs them.                      |
+|                                                        |
+|   Floats are only counted. Their total as a difference |
+|   of prefixes cancels, or turns into NaN next to an    |
+|   inf, so the evaluator scans ranges holding floats.   |
++--------------------------------------------------------+
+*/
+
+typedef struct BlockSums {
+	u32 dirty;
+	// entry CELL_TO_INDEX({x, y}) holds the totals of the cells
+	// [0..x] x [0..y] of the block
+	i64 isum[BLOCK_SIZE * BLOCK_SIZE];
+	u16 icount[BLOCK_SIZE * BLOCK_SIZE];
+	u16 fcount[BLOCK_SIZE * BLOCK_SIZE];
+	u16 formulas[BLOCK_SIZE * BLOCK_SIZE];
+} BlockSums;
+
+typedef struct SheetSums {
+	BlockSums* blocks; // blocks[bid] mirrors blockpool[bid]
+	u32 dirty;		   // a block was changed, added or freed
+
+	// every block is inside lo..hi. The coarse table has (w + 1) x
+	// (h + 1) entries, entry y * (w + 1) + x holds the totals of the
+	// blocks [lo.x, lo.x + x) x [lo.y, lo.y + y).
+	v2u lo;
+	v2u hi;
+	u32 w;
+	u32 h;
+	u32 coarse; // false when the blocks are too spread out for one
+	u32 cap;
+	i64* isum;
+	u32* icount;
+	u32* fcount;
+	u32* formulas;
+
+	u64 rebuilt; // block prefixes built so far
+} SheetSums;
+
+
+/*
++--------------------------------------------------------+
+|   INFO: Formula Cache                                  |
+|                                                        |
+|   Every code cell in a sheet points at an interned     |
+|   source string. Tokenizing and parsing that string    |
+|   on every evaluation is wasteful, so each sheet keeps |
+|   the built AST keyed by the source StrID. Since the   |
+|   StrID includes the generation a stale key can never  |
+|   match a reused string slot.                          |
+|                                                        |
+|   Sources don't own their compiled code. Filled down   |
+|   formulas only differ in the cells they point at, so  |
+|   once ASTAnchor has made their constant references    |
+|   relative the trees are the same. Each distinct tree  |
+|   is built into one template (AST, bytecode and JIT    |
+|   code, see further down) and a source only stores     |
+|   which template it uses and the anchor its relative   |
+|   references are resolved against.                     |
++--------------------------------------------------------+
+*/
+
+typedef struct Formula Formula;
+typedef struct AST AST;
+
+typedef struct FormulaSource {
+    u32 template;
+    u32 anchored; // otherwise relative to the cell being evaluated
+    v2u anchor;
+    // one per constant reference of the template, NULL if it has none
+    // or the source isn't anchored
+    CellHandle* handles;
+} FormulaSource;
+
+typedef struct FormulaCache {
+    Allocator mem;
+
+    StrID* keys;
+    FormulaSource* entries;
+    u32 size;
+    u32 cap;
+
+    // shared templates, slots with no refs are free and listed in tfree
+    Formula* templates;
+    u64* thashes;
+    u32* trefs;
+    u32 tsize;
+    u32 tcap;
+    u32* tfree;
+    u32 tfreesize;
+
+    // template index by ASTHash, UINT32_MAX when empty
+    u32* tslots;
+    u32 tscap;
+    u32 tcount; // templates in use
+
+    // cells holding each source, counted whether or not it has been
+    // compiled yet. An entry is only dropped once the last cell lets go.
+    StrID* ukeys;
+    u32* uses;
+    u32 usize;
+    u32 ucap;
+
+    // exposed so callers can see how well the cache is doing
+    u64 hits;
+    u64 misses;
+} FormulaCache;
+
+// NOTE: The returned pointer is only valid until the next insertion.
+// Template storage moves when templates are added, copy the Formula
+// struct out if you need it across an evaluation; the node and code
+// storage itself does not move.
+FormulaSource* FormulaCacheGet(FormulaCache* cache, StrID key);
+FormulaSource* FormulaCacheInsert(FormulaCache* cache, StrID key, FormulaSource source);
+void FormulaCacheDrop(FormulaCache* cache, StrID key);
+// A cell of the sheet started or stopped holding the source key,
+// Release drops the entry along with the last cell
+void FormulaCacheRetain(FormulaCache* cache, StrID key);
+void FormulaCacheRelease(FormulaCache* cache, StrID key);
+// Gives dst (without uses) the counts of src, for a clone of its sheet
+void FormulaCacheCopyUses(FormulaCache* dst, FormulaCache* src);
+// Index of a template equal to tree, UINT32_MAX if there is none
+u32 FormulaTemplateFind(FormulaCache* cache, AST* tree, u64 hash);
+// Takes ownership of formula, it has no sources until one is inserted
+u32 FormulaTemplateAdd(FormulaCache* cache, Formula formula, u64 hash);
+void FormulaCacheFree(FormulaCache* cache);
+
+/*
++--------------------------------------------------------+
+|   INFO: Dependency Graph                               |
+|                                                        |
+|   Precedent/dependent edges between cells, built from  |
+|   the cell references in each formula. Cells get a     |
+|   node the first time they are touched and keep it,    |
+|   edges are replaced whenever a formula is rebuilt.    |
+|                                                        |
+|   Formulas whose references can't be resolved without  |
+|   running them (computed coordinates) are marked       |
+|   volatile and are part of every recalc.               |
+|                                                        |
+|   Ranges with constant corners don't become edges, a   |
+|   single one can cover a million cells. They go into   |
+|   an interval tree over rows instead, and a changed    |
+|   cell finds the formulas whose ranges cover it with   |
+|   DepGraphCovering.                                    |
++--------------------------------------------------------+
+*/
+
+typedef enum DepNodeFlags : u32 {
+    DN_DIRTY = 1 << 0,
+    DN_VOLATILE = 1 << 1,
+    DN_RANGES = 1 << 2, // has entries in graph->ranges
+    DN_FRESH = 1 << 3,  // dirty, and its precedents have been refreshed
+} DepNodeFlags;
+
+typedef struct DepNode {
+    v2u pos;
+    u32 flags;
+    u32 mark;  // recalc serial, set when the node is part of the cone
+    u32 indeg; // scratch for topological ordering and DepGraphComponents
+    u32 level; // longest precedent chain inside the cone, set by DepGraphOrder
+
+    // node ids of the cells this one reads
+    u32* prec;
+    u32 psize;
+    u32 pcap;
+
+    // node ids of the cells reading this one
+    u32* deps;
+    u32 dsize;
+    u32 dcap;
+
+    u32 rgen; // bumped when its ranges are replaced, older entries are dead
+    u32 rlive; // entries of the current rgen in graph->ranges
+    // formulas with a range covering this cell, graph->rdeps[rfirst..]
+    // (only set for nodes in the cone of the last DepGraphOrder)
+    u32 rfirst;
+    u32 rcount;
+} DepNode;
+
+typedef struct DepRange {
+    v2u lo;
+    v2u hi;
+    u32 node; // formula reading the range
+    u32 gen;  // node's rgen when it was added
+    u32 max;  // largest hi.y in its subtree of the interval tree
+} DepRange;
+
+typedef struct DepGraph {
+    Allocator mem;
+
+    // map from cell position to node id
+    v2u* keys;
+    u32* values;
+    u32 size;
+    u32 cap;
+
+    DepNode* nodes;
+    u32 nsize;
+    u32 ncap;
+
+    // node ids changed since the last recalc. dirty[0..refreshed) have
+    // been looked at by the refresh, one edited again since is pushed
+    // again.
+    u32* dirty;
+    u32 dirtysize;
+    u32 dirtycap;
+    u32 refreshed;
+
+    // node ids of volatile formulas (lazily compacted)
+    u32* volatiles;
+    u32 vsize;
+    u32 vcap;
+
+    // constant ranges of every formula. ranges[0..rbuilt) are sorted by
+    // lo.y and laid out as an implicit interval tree, the ones added
+    // since are scanned until there are enough of them to rebuild.
+    DepRange* ranges;
+    u32 rsize;
+    u32 rcap;
+    u32 rlevels;
+    u32 rbuilt;
+    u32 rdead; // entries whose node has moved on since
+
+    // range dependents of the cone, see DepNode.rfirst
+    u32* rdeps;
+    u32 rdsize;
+    u32 rdcap;
+
+    // the dirty cone in evaluation order, filled by DepGraphOrder
+    u32* order;
+    u32 osize;
+    u32 ocap;
+    u32 ordered; // order[0..ordered) is topological, the rest are cycles
+    u32 levels;  // one more than the deepest DepNode.level in the ordered part
+
+    // where DepGraphOrderStep is at, and the order it is building
+    u32 ostage;
+    u32 onext;
+    u32 okeep;
+    u32* queue;
+    u32 qsize;
+    u32 qcap;
+
+    u32 serial;
+} DepGraph;
+
+u32 DepGraphNode(DepGraph* graph, v2u pos);
+u32 DepGraphFind(DepGraph* graph, v2u pos);
+void DepGraphMarkDirty(DepGraph* graph, v2u pos);
+void DepGraphSetPrecedents(DepGraph* graph, u32 node, v2u* prec, u32 count, u32 isvolatile);
+// Replaces the ranges a node reads, count lo/hi pairs (inclusive)
+void DepGraphSetRanges(DepGraph* graph, u32 node, v2u* ranges, u32 count);
+// Appends the node of every formula whose range covers pos to ids,
+// once per range
+void DepGraphCovering(DepGraph* graph, v2u pos, u32** ids, u32* size, u32* cap);
+void DepGraphOrder(DepGraph* graph);
+// DepGraphOrder a slice at a time. After DepGraphOrderBegin, every
+// DepGraphOrderStep does about *budget nodes and edges worth of work
+// and takes what it did off *budget. Non-zero once the order is done.
+// Starting over just needs another DepGraphOrderBegin.
+void DepGraphOrderBegin(DepGraph* graph);
+u32 DepGraphOrderStep(DepGraph* graph, u32* budget);
+// Sorts the unordered part of the last DepGraphOrder, order[ordered..
+// osize), into strongly connected components that can be evaluated one
+// after the other. Component c is order[starts[c]..starts[c + 1]).
+// Returns how many there are. starts holds osize - ordered + 1 entries
+// and belongs to the caller.
+u32 DepGraphComponents(DepGraph* graph, u32** starts);
+// Whether order[first..first + size), a component, is a real cycle
+// rather than one node behind a cycle
+u32 DepGraphOnCycle(DepGraph* graph, u32 first, u32 size);
+void DepGraphClearDirty(DepGraph* graph);
+void DepGraphFree(DepGraph* graph);
+
+typedef enum SheetFlags : u32 {
+    // record edits in sheet->deps so EvaluateDirty can do incremental recalc
+    SHEET_TRACK_DEPS = 1 << 0,
+    // keep sheet->lanes up to date next to the blocks
+    SHEET_COLUMNAR = 1 << 1,
+    // keep sheet->sums for SheetRangeSums
+    SHEET_SUMMED = 1 << 2,
+    // SpreadSheetTrackSome is still marking the cells from before
+    // SHEET_TRACK_DEPS was set, up to map slot sheet->tracked
+    SHEET_TRACKING = 1 << 3,
+} SheetFlags;
 
 //TODO(ELI): In future organize to minimize padding
 //rn things are split based on usage but this should be
@@ -112,15 +671,24 @@ typedef struct Block {
 typedef struct SpreadSheet {
 	Allocator mem; // probably should be global allocator but
 				   //  might as well give ourselves options
-	// main cell map
+	// main cell map, a Swiss table (see spreadsheet.c). Slots that
+	// don't hold a block have Invalid or Tomb keys, so the keys can be
+	// walked directly.
 	u32* values;
 	v2u* keys;
+	u8* ctrl; // one control byte per slot
 	u32 size;
     u32 tomb;
-    u32 cap;
-
-	// pool of reusable blocks
-	Block* blockpool;
+    u32 cap; // a power of two, 0 or at least one group
+
+	// pool of reusable block slots, NULL where a slot is free. Blocks
+	// are shared with clones of the sheet until one side writes.
+	Block** blockpool;
+    BlockStamps* stamps; // stamps[bid] belongs to blockpool[bid]
+    // lanes[bid] mirrors blockpool[bid], only with SHEET_COLUMNAR
+    BlockLanes* lanes;
+    // summed-area tables, only with SHEET_SUMMED
+    SheetSums sums;
     i32* freestatus;
 	u32 bsize;
     u32 fsize;
@@ -130,6 +698,36 @@ typedef struct SpreadSheet {
     u32 ssize;
     u32 scap;
 
+    // compiled formulas for the code cells in this sheet,
+    // entries are dropped when SpreadSheetSetCell replaces the source
+    FormulaCache formulas;
+
+    // precedents/dependents of the cells in this sheet, only
+    // maintained when SHEET_TRACK_DEPS is set
+    DepGraph deps;
+    u32 flags;
+    u32 tracked; // see SHEET_TRACKING
+
+    // evaluations skipped because the cell was already done this pass
+    u64 avoided;
+
+    // new every time a block is added or freed, see CellHandle
+    u32 version;
+    // stale handles SheetHandleGet had to look up in the block map
+    u64 resolved;
+    // shared blocks that had to be copied before a write
+    u64 copies;
+    // blocks whose summary has loose extremes
+    u32 loose;
+
+    // nonempty cells, and their bounds (inclusive) while there are any.
+    // Clearing a cell on the edge only makes the bounds loose, they
+    // still hold every cell (see SpreadSheetUsedRange).
+    u32 cells;
+    v2u usedLo;
+    v2u usedHi;
+    u32 usedLoose;
+
 } SpreadSheet;
 
 void SpreadSheetSetCell(SpreadSheet* sheet, v2u pos, CellValue value);
@@ -138,6 +736,97 @@ CellValue* SpreadSheetGetCell(SpreadSheet* sheet, v2u pos);
 void SpreadSheetClearCell(SpreadSheet* sheet, v2u pos);
 void SpreadSheetFree(SpreadSheet* sheet);
 
+// Makes dst (empty or freed) hold the same cells as src. The blocks are
+// shared, not copied, until either sheet writes to one. Only the cells
+// come along: dst starts without flags, formula cache or dependencies,
+// and allocates from src's allocator. Blocks come from the block pool,
+// so either sheet may free one.
+void SpreadSheetClone(SpreadSheet* dst, SpreadSheet* src);
+// Exchanges the contents of two sheets, pointers and counts only
+void SpreadSheetSwap(SpreadSheet* a, SpreadSheet* b);
+
+// The smallest rectangle lo..hi (inclusive) holding every nonempty
+// cell, false when there are none. Loose bounds are tightened first,
+// which only reads the blocks on the edge.
+u32 SpreadSheetUsedRange(SpreadSheet* sheet, v2u* lo, v2u* hi);
+
+typedef enum SheetOrder : u32 {
+    SHEET_ROWS,    // block rows top to bottom, cells row by row
+    SHEET_COLUMNS, // block columns left to right, cells column by column
+} SheetOrder;
+
+typedef struct SheetBlockRef {
+    v2u pos; // CELL_TO_BLOCK of its cells
+    u32 bid;
+} SheetBlockRef;
+
+// Walks the nonempty blocks of a sheet in order and the nonempty cells
+// inside each one, so a pass over the sheet costs its cells and not
+// its area. Cells are yielded a block at a time: with SHEET_ROWS all
+// of a block's cells come before the block to its right. Changing the
+// sheet while walking it invalidates the iterator.
+typedef struct SheetIter {
+    SpreadSheet* sheet;
+    SheetBlockRef* blocks; // nonempty blocks in walk order
+    u32 count;
+    u32 order;
+    u32 next; // index into blocks
+
+    // current block, set by SheetIterNextBlock
+    SheetBlockRef at;
+    Block* block;
+    u32 left; // its cells not yielded yet
+    u32 step; // walk position inside the block
+
+    // current cell, set by SheetIterNext
+    v2u pos;
+    CellValue value;
+} SheetIter;
+
+void SheetIterBegin(SheetIter* it, SpreadSheet* sheet, SheetOrder order);
+// Moves to the next block, its cells are what SheetIterNext yields next
+u32 SheetIterNextBlock(SheetIter* it);
+// Moves to the next nonempty cell, false once there are no more
+u32 SheetIterNext(SheetIter* it);
+void SheetIterEnd(SheetIter* it);
+
+// Sets SHEET_TRACK_DEPS and marks every existing cell dirty
+void SpreadSheetTrackDeps(SpreadSheet* sheet);
+// The same a bounded amount at a time: sets SHEET_TRACK_DEPS and marks
+// about budget cells' worth of the sheet. Returns how much it used,
+// SHEET_TRACKING is cleared once every cell is marked.
+u32 SpreadSheetTrackSome(SpreadSheet* sheet, u32 budget);
+
+// Sets SHEET_COLUMNAR and builds the lanes of every existing block
+void SpreadSheetColumnar(SpreadSheet* sheet);
+
+// Whether block bid can hold a cell whose type is in `types` (a mask of
+// CELL_TYPE_BIT) and, for ints and floats, whose value is in lo..hi.
+// False means a scan looking for such cells can skip the whole block.
+u32 SheetBlockMayHold(SpreadSheet* sheet, u32 bid, u32 types, f64 lo, f64 hi);
+// Rescans the blocks whose extremes went loose. This writes to the
+// blocks, so it's for the thread that owns the sheet.
+void SheetSummariesTighten(SpreadSheet* sheet);
+
+// Sets SHEET_SUMMED, the tables are built by the first SheetRangeSums
+void SpreadSheetSummed(SpreadSheet* sheet);
+// Adds the int sum and the counts of the rectangle lo..hi (inclusive)
+// to stats. fsum and MIN/MAX are left alone, so a rectangle holding
+// floats needs a scan for its total. False without SHEET_SUMMED.
+u32 SheetRangeSums(SpreadSheet* sheet, v2u lo, v2u hi, CellStats* stats);
+// Brings the tables up to date. SheetRangeSums does this itself, call
+// it first when several threads are going to query the sheet.
+void SheetSumsUpdate(SpreadSheet* sheet);
+void SheetSumsFree(SheetSums* sums, Allocator mem, u32 bcap);
+
+// Per block evaluation stamps. A cell counts as done only for the
+// epoch it was marked in, so starting a new pass is just a new epoch.
+u32 SheetNewEpoch(void);
+u32 SheetCellDone(SpreadSheet* sheet, v2u pos, u32 epoch);
+void SheetCellSetDone(SpreadSheet* sheet, v2u pos, u32 epoch);
+u32 SheetCellBusy(SpreadSheet* sheet, v2u pos, u32 epoch);
+void SheetCellSetBusy(SpreadSheet* sheet, v2u pos, u32 epoch);
+
 // INFO(ELI): I decided to have these return indicies
 // since indicies are mostly stable and remain
 // valid even after a resize.
@@ -146,6 +835,14 @@ void SpreadSheetFree(SpreadSheet* sheet);
 // reuse empty blocks.
 u32 SheetBlockInsert(SpreadSheet* sheet, v2u pos, u32 bid);
 u32 SheetBlockGet(SpreadSheet* sheet, v2u pos);
+
+// The block in a slot, copied first if another sheet shares it.
+// Anything that writes to a block has to get it through here.
+Block* SheetBlockWritable(SpreadSheet* sheet, u32 bid);
+
+// Same as SpreadSheetGetCell, but only probes the block map when the
+// handle is stale, and then updates it
+CellValue* SheetHandleGet(SpreadSheet* sheet, CellHandle* handle, v2u pos);
 void SheetBlockDelete(SpreadSheet* sheet, v2u pos);
 
 /*
@@ -186,6 +883,17 @@ typedef enum ASTNodeType : u32 {
 	AST_COORD_TRANSFORM, // #
 	AST_RANGE, // :
 
+	// Typed ops, only emitted by ASTOptimize once both operands
+	// are known to have that type. They never check the tags.
+	AST_ADD_INT,
+	AST_SUB_INT,
+	AST_MUL_INT,
+	AST_DIV_INT,
+	AST_ADD_FLOAT,
+	AST_SUB_FLOAT,
+	AST_MUL_FLOAT,
+	AST_DIV_FLOAT,
+
 	// Control Flow
 	AST_SEQ,
 	AST_IF_ELSE,
@@ -200,6 +908,8 @@ typedef enum ASTNodeType : u32 {
 	AST_HEADER_ARGS,
 	AST_CALL,
 	AST_FUNC_ARGS,
+
+	AST_OP_COUNT,
 } ASTNodeOp;
 
 typedef enum ASTValueType : u32 {
@@ -225,7 +935,7 @@ typedef struct ASTNode {
 	// Union for storing literal values
 	union {
 		u32 i; // Symbols use this as an index
-		f32 f;
+		CellFloat f;
         StrID s;
 	} data;
 
@@ -249,6 +959,155 @@ u32 ASTCreateNode(AST* tree, ASTNodeOp op, u32 lchild, u32 mchild, u32 rchild);
 void ASTPrint(FILE* fd, AST* tree);
 void ASTFree(AST* tree);
 
+// Hash and equality over the shape of a tree: the ops, the children and
+// whatever data each op uses. Used to find formula templates.
+u64 ASTHash(AST* tree);
+u32 ASTEqual(AST* a, AST* b);
+
+// Rebuilds the tree with the types of literals and declared variables
+// propagated: mixed arithmetic gets explicit conversion nodes, fully
+// typed arithmetic uses the typed ops and constant subtrees are folded
+// into literals. Run between BuildASTFromTokens and evaluation.
+void ASTOptimize(AST* tree);
+
+// Turns every reference with literal coordinates in an optimized tree
+// into `#` offsets from the first one, whose position goes in anchor.
+// Trees that only differ in where they point end up equal. Returns 0
+// and leaves the tree alone when it has no such reference, or when it
+// already has `#` references, which are relative to the current cell.
+u32 ASTAnchor(AST* tree, v2u* anchor);
+
+// Numbers the references with constant coordinates (literals or
+// constant `#` offsets) in node order, storing the number in their
+// data.i, and returns how many there are. These are the slots of
+// FormulaSource.handles.
+u32 ASTNumberRefs(AST* tree);
+
+/*
++--------------------------------------------------------+
+|   INFO: Bytecode                                       |
+|                                                        |
+|   Formulas are compiled from the AST into a flat       |
+|   register program which the evaluator runs in a       |
+|   single dispatch loop instead of walking the tree.    |
+|   Variables get fixed registers at compile time so     |
+|   running a program never touches the symbol table.    |
+|                                                        |
+|   Register 0 is always empty. Trees using something    |
+|   the compiler doesn't handle produce an empty         |
+|   program and are run by the tree walker instead.      |
++--------------------------------------------------------+
+*/
+
+typedef enum BCOp : u16 {
+	BC_HALT = 0,
+	BC_LOADK, // dst = constant, a holds the CellType
+	BC_MOV,	  // dst = a
+	BC_I2F,	  // dst = (CellFloat)a, a is known to be an int
+	BC_F2I,	  // dst = (i32)a, a is known to be a float
+
+	// both operands statically known to be ints/floats
+	BC_ADD_II,
+	BC_SUB_II,
+	BC_MUL_II,
+	BC_DIV_II,
+	BC_ADD_FF,
+	BC_SUB_FF,
+	BC_MUL_FF,
+	BC_DIV_FF,
+
+	// operand types only known at run time (cell references)
+	BC_ADD,
+	BC_SUB,
+	BC_MUL,
+	BC_DIV,
+
+	BC_CELL,   // dst = cell [k.u, y], bits 1/2 of a add the anchor to x/y
+			   // and b is the handle slot (UINT16_MAX for none)
+	BC_CELL_R, // dst = cell [a, b], computed coordinates
+	BC_SEQ,	   // dst = b if b isn't empty, otherwise a
+	BC_JMP,	   // jump to k.u
+	BC_JMPF,   // jump to k.u if a is not truthy
+	BC_CONV_I, // dst = a stored into an int variable
+	BC_CONV_F, // dst = a stored into a float variable
+
+	BC_OP_COUNT,
+} BCOp;
+
+typedef struct BCInstr {
+	BCOp op;
+	u16 dst;
+	u16 a;
+	u16 b;
+	union {
+		i32 i;
+		CellFloat f;
+		u32 u;
+	} k;
+	u32 y;
+} BCInstr;
+
+typedef struct BCProgram {
+	Allocator mem;
+	BCInstr* code;
+	u32 size; // 0 when the tree couldn't be compiled
+	u32 cap;
+	u32 regs;
+	u32 result; // register holding the value of the formula
+} BCProgram;
+
+// Compiles the tree into prog. Returns 0 (and leaves prog empty)
+// if the tree uses anything the bytecode doesn't support.
+u32 BCCompile(AST* tree, BCProgram* prog);
+void BCPrint(FILE* fd, BCProgram* prog);
+void BCFree(BCProgram* prog);
+
+/*
++--------------------------------------------------------+
+|   INFO: JIT                                            |
+|                                                        |
+|   Formulas that keep getting looked up are translated  |
+|   from the AST into x86-64 machine code (Linux only,   |
+|   left out with -D PARASHEET_NO_JIT, and with boxed    |
+|   cells since it emits f32 math). Every AST node gets  |
+|   a CellValue slot, like a bytecode register.          |
+|   Nodes the JIT doesn't translate are handed to        |
+|   evaluateNode from the generated code.                |
++--------------------------------------------------------+
+*/
+
+typedef struct JitCode {
+	u8* code;  // in a read/exec arena chunk, NULL when nothing was compiled
+	u32 size;  // bytes of code
+	u32 chunk; // arena chunk the code is in
+	u32 slots; // one per AST node
+	u32 walks; // subtrees left to the tree walker
+} JitCode;
+
+// Formulas get compiled on their `threshold`th lookup, 0 turns the
+// JIT off. With `check` set every JIT run is repeated on the tree
+// walker and a different result panics.
+void JitConfigure(u32 threshold, u32 check);
+u32 JitThreshold(void); // 0 when off or not available on this target
+u32 JitChecking(void);
+
+// Returns 0 (and leaves jit empty) when nothing could be compiled
+u32 JitCompile(AST* tree, JitCode* jit);
+void JitFree(JitCode* jit);
+
+// What the formula cache stores for every template
+typedef struct Formula {
+	AST ast;
+	BCProgram code;
+	JitCode jit;
+	u32 runs; // lookups so far, for the JIT threshold
+	u32 refs; // constant references, see ASTNumberRefs
+	// cell `#` offsets are relative to and the source's handles, only
+	// set on the copies the evaluator makes for a source
+	v2u anchor;
+	CellHandle* handles;
+} Formula;
+
 
 /*
 +-----------------------------------------------+
@@ -294,9 +1153,13 @@ void SymbolMapFree(SymbolMap* map);
 
 void SymbolInsert(SymbolTable* table, StrID key, SymbolEntry entry);
 SymbolEntry SymbolGet(SymbolTable* table, StrID key);
+// Overwrites the innermost existing entry, returns 0 if there is none
+u32 SymbolSet(SymbolTable* table, StrID key, SymbolEntry entry);
 
 void SymbolPushScope(SymbolTable* table);
 void SymbolPopScope(SymbolTable* table);
+// Pops whatever scopes are left and frees the scope stack
+void SymbolTableFree(SymbolTable* table);
 
 
 #endif
@@ -66,7 +66,7 @@ typedef enum TokenType : u32 {
 union TokenData {
 	StrID s;
 	i32 i;
-	f32 f;
+	CellFloat f;
 };
 
 typedef struct Token {
@@ -242,6 +242,43 @@ u64 hash(u8* buf, u64 size);
 #define CLAMP(t, min, max) \
     MAX(MIN(t, max), min)
 
+/*
++------------------------------------------------------+
+|   INFO:                                              |
+|                                                      |
+|   Job system. A fixed pool of worker threads, each   |
+|   with its own deque of jobs. Workers pop from the   |
+|   back of their own deque and steal from the front   |
+|   of the others when theirs runs dry.                |
+|                                                      |
+|   Jobs are grouped so a caller can wait for just     |
+|   the work it submitted. Waiting doesn't block, the  |
+|   waiting thread runs queued jobs until the group    |
+|   is done.                                           |
++------------------------------------------------------+
+*/
+
+typedef struct JobPool JobPool;
+
+typedef struct JobGroup {
+	_Atomic u32 pending; // zero initialize, counts unfinished jobs
+} JobGroup;
+
+// scratch is an arena owned by the worker running the job. It is reset
+// before every job the worker picks up on its own, so nothing in it
+// survives the job. Jobs that call JobWait must leave it alone since
+// the jobs they end up running share the same arena.
+typedef void (*job_func)(void* arg, Allocator scratch);
+
+// threads counts the calling thread, which takes part through JobWait.
+// 0 picks one thread per core.
+JobPool* JobPoolCreate(Allocator a, u32 threads, u64 scratchsize);
+void JobPoolDestroy(JobPool* pool);
+u32 JobPoolThreads(JobPool* pool);
+
+void JobSubmit(JobPool* pool, JobGroup* group, job_func f, void* arg);
+void JobWait(JobPool* pool, JobGroup* group);
+
 #define KB(x) (x * 1024)
 #define MB(x) (x * 1024 * 1024)
 #define GB(x) (x * 1024 * 1024 * 1024)
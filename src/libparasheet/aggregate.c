@@ -0,0 +1,535 @@
+#include <math.h> // before util.h, which defines log
+#include <libparasheet/lib_internal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <util/util.h>
+
+// boxed cells (CELL_NANBOX) are not three u32s, they take the scalar loop
+#if defined(CELL_NANBOX)
+#define AGG_SCALAR
+#endif
+
+#if defined(__SSE2__) && !defined(AGG_SCALAR)
+#define AGG_SSE2
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__) && !defined(AGG_SCALAR)
+#define AGG_NEON
+#include <arm_neon.h>
+#endif
+
+/*
++---------------------------------------------------+
+|   INFO:                                           |
+|   Kernels behind SUM/MIN/MAX/COUNT/AVERAGE. A     |
+|   CellValue is the type tag followed by an 8 byte |
+|   union, so a run of cells is a stream of three   |
+|   u32s per cell: tag, value, unused. The kernels  |
+|   pull the tags and values apart into lanes,      |
+|   build int/float masks from the tags and add     |
+|   everything up without branching per cell.       |
+|                                                   |
+|   x86-64 always has SSE2, AVX2 is picked at run   |
+|   time when the cpu has it. AArch64 uses NEON.    |
+|   Anything else, and any build with boxed cells,  |
+|   runs the scalar loop.                           |
++---------------------------------------------------+
+*/
+
+#if !defined(AGG_SCALAR)
+_Static_assert(sizeof(CellSlot) == 12 && offsetof(CellValue, d) == 4,
+			   "the aggregate kernels assume a 12 byte CellValue");
+#endif
+
+#if defined(AGG_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define AGG_AVX2
+#endif
+
+void CellStatsInit(CellStats* stats) {
+	*stats = (CellStats){
+		.imin = INT32_MAX,
+		.imax = INT32_MIN,
+		.fmin = INFINITY,
+		.fmax = -INFINITY,
+	};
+}
+
+void CellStatsAdd(CellStats* stats, CellValue v) {
+	switch (v.t) {
+		case CT_INT:
+			stats->isum += v.d.i;
+			stats->icount++;
+			stats->imin = MIN(stats->imin, v.d.i);
+			stats->imax = MAX(stats->imax, v.d.i);
+			break;
+		case CT_FLOAT:
+			stats->fsum += v.d.f;
+			stats->fcount++;
+			stats->fmin = MIN(stats->fmin, v.d.f);
+			stats->fmax = MAX(stats->fmax, v.d.f);
+			break;
+		case CT_TEXT:
+		case CT_CODE:
+			stats->formulas++;
+			break;
+		default:
+			break;
+	}
+}
+
+void CellStatsAddSummary(CellStats* stats, BlockSummary* summary) {
+	u32 icount = summary->counts[CT_INT];
+	u32 fcount = summary->counts[CT_FLOAT];
+	stats->icount += icount;
+	stats->fcount += fcount;
+	stats->formulas += summary->counts[CT_TEXT] + summary->counts[CT_CODE];
+	if (icount) {
+		stats->imin = MIN(stats->imin, summary->imin);
+		stats->imax = MAX(stats->imax, summary->imax);
+	}
+	if (fcount) {
+		stats->fmin = MIN(stats->fmin, summary->fmin);
+		stats->fmax = MAX(stats->fmax, summary->fmax);
+	}
+}
+
+static void AccumulateScalar(CellStats* stats, CellSlot* cells, u32 count) {
+	for (u32 i = 0; i < count; i++) {
+		CellStatsAdd(stats, CellUnbox(cells[i]));
+	}
+}
+
+#if !defined(AGG_SCALAR)
+
+// Folds the per lane results of a vector kernel into the stats
+static void MergeLanes(CellStats* stats, i64* isum, f64* fsum, u32 nsum,
+					   u32* icount, u32* fcount, u32* formulas, i32* imin,
+					   i32* imax, f32* fmin, f32* fmax, u32 nlanes) {
+	for (u32 i = 0; i < nsum; i++) {
+		stats->isum += isum[i];
+		stats->fsum += fsum[i];
+	}
+	for (u32 i = 0; i < nlanes; i++) {
+		stats->icount += icount[i];
+		stats->fcount += fcount[i];
+		stats->formulas += formulas[i];
+		stats->imin = MIN(stats->imin, imin[i]);
+		stats->imax = MAX(stats->imax, imax[i]);
+		stats->fmin = MIN(stats->fmin, fmin[i]);
+		stats->fmax = MAX(stats->fmax, fmax[i]);
+	}
+}
+
+#endif
+
+#if defined(AGG_SSE2)
+
+// Four cells are three vectors:
+//     v0 = t0 d0 g0 t1, v1 = d1 g1 t2 d2, v2 = g2 t3 d3 g3
+// q holds the last two cells so four shuffles split out tags and values
+#define DEINTERLEAVE4(shuffle, v0, v1, v2, t, d)                           \
+	do {                                                                   \
+		__typeof__(v0) q = shuffle(v1, v2, _MM_SHUFFLE(2, 1, 3, 2));       \
+		__typeof__(v0) x = shuffle(v0, v1, _MM_SHUFFLE(0, 0, 1, 1));       \
+		t = shuffle(v0, q, _MM_SHUFFLE(2, 0, 3, 0));                       \
+		d = shuffle(x, q, _MM_SHUFFLE(3, 1, 2, 0));                        \
+	} while (0)
+
+static void AccumulateSSE2(CellStats* stats, CellSlot* cells, u32 count) {
+	const __m128i tint = _mm_set1_epi32(CT_INT);
+	const __m128i tfloat = _mm_set1_epi32(CT_FLOAT);
+	const __m128i ttext = _mm_set1_epi32(CT_TEXT);
+	const __m128i tcode = _mm_set1_epi32(CT_CODE);
+	const __m128i imaxv = _mm_set1_epi32(INT32_MAX);
+	const __m128i iminv = _mm_set1_epi32(INT32_MIN);
+	const __m128i finf = _mm_castps_si128(_mm_set1_ps(INFINITY));
+	const __m128i fninf = _mm_castps_si128(_mm_set1_ps(-INFINITY));
+
+	__m128i isum = _mm_setzero_si128();
+	__m128d fsum0 = _mm_setzero_pd();
+	__m128d fsum1 = _mm_setzero_pd();
+	__m128i icount = _mm_setzero_si128();
+	__m128i fcount = _mm_setzero_si128();
+	__m128i formulas = _mm_setzero_si128();
+	__m128i imin = imaxv;
+	__m128i imax = iminv;
+	__m128 fmin = _mm_castsi128_ps(finf);
+	__m128 fmax = _mm_castsi128_ps(fninf);
+
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const f32* p = (const f32*)&cells[i];
+		__m128 v0 = _mm_loadu_ps(p);
+		__m128 v1 = _mm_loadu_ps(p + 4);
+		__m128 v2 = _mm_loadu_ps(p + 8);
+
+		__m128 tf, df;
+		DEINTERLEAVE4(_mm_shuffle_ps, v0, v1, v2, tf, df);
+		__m128i t = _mm_castps_si128(tf);
+		__m128i d = _mm_castps_si128(df);
+
+		// the masks are all ones, so subtracting counts up by one
+		__m128i mi = _mm_cmpeq_epi32(t, tint);
+		__m128i mf = _mm_cmpeq_epi32(t, tfloat);
+		__m128i mp = _mm_or_si128(_mm_cmpeq_epi32(t, ttext), _mm_cmpeq_epi32(t, tcode));
+		icount = _mm_sub_epi32(icount, mi);
+		fcount = _mm_sub_epi32(fcount, mf);
+		formulas = _mm_sub_epi32(formulas, mp);
+
+		// sign extend the ints to 64 bits before adding
+		__m128i di = _mm_and_si128(d, mi);
+		__m128i sign = _mm_srai_epi32(di, 31);
+		isum = _mm_add_epi64(isum, _mm_unpacklo_epi32(di, sign));
+		isum = _mm_add_epi64(isum, _mm_unpackhi_epi32(di, sign));
+
+		// no pminsd before SSE4.1, select with the compare masks
+		__m128i c = _mm_or_si128(di, _mm_andnot_si128(mi, imaxv));
+		__m128i lt = _mm_cmplt_epi32(c, imin);
+		imin = _mm_or_si128(_mm_and_si128(lt, c), _mm_andnot_si128(lt, imin));
+		c = _mm_or_si128(di, _mm_andnot_si128(mi, iminv));
+		__m128i gt = _mm_cmpgt_epi32(c, imax);
+		imax = _mm_or_si128(_mm_and_si128(gt, c), _mm_andnot_si128(gt, imax));
+
+		// masked out lanes are 0.0f for the sum and +-inf for min/max
+		__m128i dm = _mm_and_si128(d, mf);
+		__m128 fv = _mm_castsi128_ps(dm);
+		fsum0 = _mm_add_pd(fsum0, _mm_cvtps_pd(fv));
+		fsum1 = _mm_add_pd(fsum1, _mm_cvtps_pd(_mm_movehl_ps(fv, fv)));
+		fmin = _mm_min_ps(fmin, _mm_castsi128_ps(_mm_or_si128(dm, _mm_andnot_si128(mf, finf))));
+		fmax = _mm_max_ps(fmax, _mm_castsi128_ps(_mm_or_si128(dm, _mm_andnot_si128(mf, fninf))));
+	}
+
+	i64 is[2];
+	f64 fs[2];
+	u32 ic[4], fc[4], pc[4];
+	i32 imn[4], imx[4];
+	f32 fmn[4], fmx[4];
+	_mm_storeu_si128((__m128i*)is, isum);
+	_mm_storeu_pd(fs, _mm_add_pd(fsum0, fsum1));
+	_mm_storeu_si128((__m128i*)ic, icount);
+	_mm_storeu_si128((__m128i*)fc, fcount);
+	_mm_storeu_si128((__m128i*)pc, formulas);
+	_mm_storeu_si128((__m128i*)imn, imin);
+	_mm_storeu_si128((__m128i*)imx, imax);
+	_mm_storeu_ps(fmn, fmin);
+	_mm_storeu_ps(fmx, fmax);
+	MergeLanes(stats, is, fs, 2, ic, fc, pc, imn, imx, fmn, fmx, 4);
+
+	AccumulateScalar(stats, cells + i, count - i);
+}
+
+#endif
+
+#if defined(AGG_AVX2)
+
+// Same as the SSE2 kernel with eight cells per loop, the low 128 bits
+// hold cells 0-3 and the high 128 bits cells 4-7
+__attribute__((target("avx2"))) static void
+AccumulateAVX2(CellStats* stats, CellSlot* cells, u32 count) {
+	const __m256i tint = _mm256_set1_epi32(CT_INT);
+	const __m256i tfloat = _mm256_set1_epi32(CT_FLOAT);
+	const __m256i ttext = _mm256_set1_epi32(CT_TEXT);
+	const __m256i tcode = _mm256_set1_epi32(CT_CODE);
+	const __m256i imaxv = _mm256_set1_epi32(INT32_MAX);
+	const __m256i iminv = _mm256_set1_epi32(INT32_MIN);
+	const __m256 finf = _mm256_set1_ps(INFINITY);
+	const __m256 fninf = _mm256_set1_ps(-INFINITY);
+
+	__m256i isum0 = _mm256_setzero_si256();
+	__m256i isum1 = _mm256_setzero_si256();
+	__m256d fsum0 = _mm256_setzero_pd();
+	__m256d fsum1 = _mm256_setzero_pd();
+	__m256i icount = _mm256_setzero_si256();
+	__m256i fcount = _mm256_setzero_si256();
+	__m256i formulas = _mm256_setzero_si256();
+	__m256i imin = imaxv;
+	__m256i imax = iminv;
+	__m256 fmin = finf;
+	__m256 fmax = fninf;
+
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const f32* p = (const f32*)&cells[i];
+		__m256 v0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)),
+										 _mm_loadu_ps(p + 12), 1);
+		__m256 v1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 4)),
+										 _mm_loadu_ps(p + 16), 1);
+		__m256 v2 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 8)),
+										 _mm_loadu_ps(p + 20), 1);
+
+		__m256 tf, df;
+		DEINTERLEAVE4(_mm256_shuffle_ps, v0, v1, v2, tf, df);
+		__m256i t = _mm256_castps_si256(tf);
+		__m256i d = _mm256_castps_si256(df);
+
+		__m256i mi = _mm256_cmpeq_epi32(t, tint);
+		__m256i mf = _mm256_cmpeq_epi32(t, tfloat);
+		__m256i mp = _mm256_or_si256(_mm256_cmpeq_epi32(t, ttext),
+									 _mm256_cmpeq_epi32(t, tcode));
+		icount = _mm256_sub_epi32(icount, mi);
+		fcount = _mm256_sub_epi32(fcount, mf);
+		formulas = _mm256_sub_epi32(formulas, mp);
+
+		__m256i di = _mm256_and_si256(d, mi);
+		isum0 = _mm256_add_epi64(isum0, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(di)));
+		isum1 = _mm256_add_epi64(isum1, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(di, 1)));
+		imin = _mm256_min_epi32(imin, _mm256_blendv_epi8(imaxv, d, mi));
+		imax = _mm256_max_epi32(imax, _mm256_blendv_epi8(iminv, d, mi));
+
+		__m256 fv = _mm256_castsi256_ps(_mm256_and_si256(d, mf));
+		fsum0 = _mm256_add_pd(fsum0, _mm256_cvtps_pd(_mm256_castps256_ps128(fv)));
+		fsum1 = _mm256_add_pd(fsum1, _mm256_cvtps_pd(_mm256_extractf128_ps(fv, 1)));
+		__m256 mfs = _mm256_castsi256_ps(mf);
+		fmin = _mm256_min_ps(fmin, _mm256_blendv_ps(finf, df, mfs));
+		fmax = _mm256_max_ps(fmax, _mm256_blendv_ps(fninf, df, mfs));
+	}
+
+	i64 is[4];
+	f64 fs[4];
+	u32 ic[8], fc[8], pc[8];
+	i32 imn[8], imx[8];
+	f32 fmn[8], fmx[8];
+	_mm256_storeu_si256((__m256i*)is, _mm256_add_epi64(isum0, isum1));
+	_mm256_storeu_pd(fs, _mm256_add_pd(fsum0, fsum1));
+	_mm256_storeu_si256((__m256i*)ic, icount);
+	_mm256_storeu_si256((__m256i*)fc, fcount);
+	_mm256_storeu_si256((__m256i*)pc, formulas);
+	_mm256_storeu_si256((__m256i*)imn, imin);
+	_mm256_storeu_si256((__m256i*)imx, imax);
+	_mm256_storeu_ps(fmn, fmin);
+	_mm256_storeu_ps(fmx, fmax);
+
+	// the rest is plain SSE, which stalls on dirty upper halves
+	_mm256_zeroupper();
+	MergeLanes(stats, is, fs, 4, ic, fc, pc, imn, imx, fmn, fmx, 8);
+
+	AccumulateSSE2(stats, cells + i, count - i);
+}
+
+#endif
+
+#if defined(AGG_NEON)
+
+// vld3 splits tag, value and the unused word into separate vectors
+static void AccumulateNEON(CellStats* stats, CellSlot* cells, u32 count) {
+	const uint32x4_t tint = vdupq_n_u32(CT_INT);
+	const uint32x4_t tfloat = vdupq_n_u32(CT_FLOAT);
+	const uint32x4_t ttext = vdupq_n_u32(CT_TEXT);
+	const uint32x4_t tcode = vdupq_n_u32(CT_CODE);
+	const int32x4_t imaxv = vdupq_n_s32(INT32_MAX);
+	const int32x4_t iminv = vdupq_n_s32(INT32_MIN);
+	const float32x4_t finf = vdupq_n_f32(INFINITY);
+	const float32x4_t fninf = vdupq_n_f32(-INFINITY);
+
+	int64x2_t isum = vdupq_n_s64(0);
+	float64x2_t fsum = vdupq_n_f64(0);
+	uint32x4_t icount = vdupq_n_u32(0);
+	uint32x4_t fcount = vdupq_n_u32(0);
+	uint32x4_t formulas = vdupq_n_u32(0);
+	int32x4_t imin = imaxv;
+	int32x4_t imax = iminv;
+	float32x4_t fmin = finf;
+	float32x4_t fmax = fninf;
+
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		uint32x4x3_t v = vld3q_u32((const u32*)&cells[i]);
+		uint32x4_t t = v.val[0];
+		uint32x4_t d = v.val[1];
+
+		uint32x4_t mi = vceqq_u32(t, tint);
+		uint32x4_t mf = vceqq_u32(t, tfloat);
+		uint32x4_t mp = vorrq_u32(vceqq_u32(t, ttext), vceqq_u32(t, tcode));
+		icount = vsubq_u32(icount, mi);
+		fcount = vsubq_u32(fcount, mf);
+		formulas = vsubq_u32(formulas, mp);
+
+		int32x4_t di = vreinterpretq_s32_u32(vandq_u32(d, mi));
+		isum = vaddw_s32(isum, vget_low_s32(di));
+		isum = vaddw_high_s32(isum, di);
+		imin = vminq_s32(imin, vbslq_s32(mi, vreinterpretq_s32_u32(d), imaxv));
+		imax = vmaxq_s32(imax, vbslq_s32(mi, vreinterpretq_s32_u32(d), iminv));
+
+		float32x4_t fv = vreinterpretq_f32_u32(vandq_u32(d, mf));
+		fsum = vaddq_f64(fsum, vcvt_f64_f32(vget_low_f32(fv)));
+		fsum = vaddq_f64(fsum, vcvt_high_f64_f32(fv));
+		fmin = vminq_f32(fmin, vbslq_f32(mf, vreinterpretq_f32_u32(d), finf));
+		fmax = vmaxq_f32(fmax, vbslq_f32(mf, vreinterpretq_f32_u32(d), fninf));
+	}
+
+	i64 is[2];
+	f64 fs[2];
+	u32 ic[4], fc[4], pc[4];
+	i32 imn[4], imx[4];
+	f32 fmn[4], fmx[4];
+	vst1q_s64(is, isum);
+	vst1q_f64(fs, fsum);
+	vst1q_u32(ic, icount);
+	vst1q_u32(fc, fcount);
+	vst1q_u32(pc, formulas);
+	vst1q_s32(imn, imin);
+	vst1q_s32(imx, imax);
+	vst1q_f32(fmn, fmin);
+	vst1q_f32(fmx, fmax);
+	MergeLanes(stats, is, fs, 2, ic, fc, pc, imn, imx, fmn, fmx, 4);
+
+	AccumulateScalar(stats, cells + i, count - i);
+}
+
+#endif
+
+void CellStatsAccumulate(CellStats* stats, CellSlot* cells, u32 count) {
+#if defined(AGG_AVX2)
+	if (__builtin_cpu_supports("avx2")) {
+		AccumulateAVX2(stats, cells, count);
+		return;
+	}
+#endif
+#if defined(AGG_SSE2)
+	AccumulateSSE2(stats, cells, count);
+#elif defined(AGG_NEON)
+	AccumulateNEON(stats, cells, count);
+#else
+	AccumulateScalar(stats, cells, count);
+#endif
+}
+
+/*
++---------------------------------------------------+
+|   INFO:                                           |
+|   The same totals off the columnar lanes. Sums    |
+|   and counts never look at a cell type: other     |
+|   cells are 0 in a lane and the counts are        |
+|   popcounts of the bitmaps. Only MIN/MAX of a run |
+|   that isn't all one type walks the set bits.     |
+|   The plain loops are left to the compiler to     |
+|   vectorize.                                      |
++---------------------------------------------------+
+*/
+
+// The bits of bitmap word w that fall inside start..start+count
+static u64 RunMask(u32 w, u32 start, u32 count) {
+	u32 lo = MAX(start, w * 64);
+	u32 hi = MIN(start + count, w * 64 + 64);
+	if (lo >= hi)
+		return 0;
+
+	u32 n = hi - lo;
+	u64 bits = n == 64 ? ~(u64)0 : ((u64)1 << n) - 1;
+	return bits << (lo - w * 64);
+}
+
+static u32 CountRun(const u64* bits, u32 start, u32 count) {
+	u32 n = 0;
+	for (u32 w = start / 64; w * 64 < start + count; w++) {
+		n += __builtin_popcountll(bits[w] & RunMask(w, start, count));
+	}
+	return n;
+}
+
+// Sum, min and max of a dense run in one pass. Written as plain loops
+// so the same code is vectorized once for the baseline and once for AVX2.
+static inline __attribute__((always_inline)) void
+StreamInts(CellStats* stats, const i32* v, u32 count) {
+	i64 sum = 0;
+	i32 lo = stats->imin, hi = stats->imax;
+	for (u32 i = 0; i < count; i++) {
+		sum += v[i];
+		lo = MIN(lo, v[i]);
+		hi = MAX(hi, v[i]);
+	}
+	stats->isum += sum;
+	stats->imin = lo;
+	stats->imax = hi;
+}
+
+static inline __attribute__((always_inline)) void
+StreamFloats(CellStats* stats, const CellFloat* v, u32 count) {
+	// four partial sums, a single one is a serial chain of adds
+	f64 sum[4] = {0};
+	CellFloat lo = stats->fmin, hi = stats->fmax;
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		for (u32 j = 0; j < 4; j++) {
+			sum[j] += v[i + j];
+			lo = MIN(lo, v[i + j]);
+			hi = MAX(hi, v[i + j]);
+		}
+	}
+	for (; i < count; i++) {
+		sum[0] += v[i];
+		lo = MIN(lo, v[i]);
+		hi = MAX(hi, v[i]);
+	}
+	stats->fsum += (sum[0] + sum[1]) + (sum[2] + sum[3]);
+	stats->fmin = lo;
+	stats->fmax = hi;
+}
+
+static void StreamLanes(CellStats* stats, const i32* iv, const CellFloat* fv, u32 count) {
+	if (iv) StreamInts(stats, iv, count);
+	if (fv) StreamFloats(stats, fv, count);
+}
+
+#if defined(AGG_AVX2)
+__attribute__((target("avx2"))) static void
+StreamLanesAVX2(CellStats* stats, const i32* iv, const CellFloat* fv, u32 count) {
+	if (iv) StreamInts(stats, iv, count);
+	if (fv) StreamFloats(stats, fv, count);
+}
+#endif
+
+void CellStatsAccumulateLanes(CellStats* stats, BlockLanes* lanes, u32 start, u32 count) {
+	u32 icount = CountRun(lanes->ints, start, count);
+	u32 fcount = CountRun(lanes->floats, start, count);
+	stats->icount += icount;
+	stats->fcount += fcount;
+	stats->formulas += CountRun(lanes->formulas, start, count);
+
+	// runs holding a single type (the usual case) stream their lane
+	const i32* iv = icount == count ? &lanes->i[start] : NULL;
+	const CellFloat* fv = fcount == count ? &lanes->f[start] : NULL;
+	if (iv || fv) {
+#if defined(AGG_AVX2)
+		if (__builtin_cpu_supports("avx2")) {
+			StreamLanesAVX2(stats, iv, fv, count);
+			return;
+		}
+#endif
+		StreamLanes(stats, iv, fv, count);
+		return;
+	}
+
+	// mixed runs still sum the whole lane, the other cells are 0,
+	// but MIN/MAX have to skip them
+	if (icount) {
+		i64 sum = 0;
+		for (u32 i = 0; i < count; i++) {
+			sum += lanes->i[start + i];
+		}
+		stats->isum += sum;
+
+		for (u32 w = start / 64; w * 64 < start + count; w++) {
+			for (u64 b = lanes->ints[w] & RunMask(w, start, count); b; b &= b - 1) {
+				i32 v = lanes->i[w * 64 + __builtin_ctzll(b)];
+				stats->imin = MIN(stats->imin, v);
+				stats->imax = MAX(stats->imax, v);
+			}
+		}
+	}
+
+	if (fcount) {
+		f64 sum = 0;
+		for (u32 i = 0; i < count; i++) {
+			sum += lanes->f[start + i];
+		}
+		stats->fsum += sum;
+
+		for (u32 w = start / 64; w * 64 < start + count; w++) {
+			for (u64 b = lanes->floats[w] & RunMask(w, start, count); b; b &= b - 1) {
+				CellFloat v = lanes->f[w * 64 + __builtin_ctzll(b)];
+				stats->fmin = MIN(stats->fmin, v);
+				stats->fmax = MAX(stats->fmax, v);
+			}
+		}
+	}
+}
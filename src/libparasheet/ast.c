@@ -23,6 +23,7 @@ u32 ASTPush(AST* tree) {
 u32 ASTCreateNode(AST* tree, ASTNodeOp op, u32 lchild, u32 mchild, u32 rchild) {
 	u32 new_node_index = ASTPush(tree);
 	tree->nodes[new_node_index].op = op;
+	memset(&tree->nodes[new_node_index].data, 0, sizeof(tree->nodes[new_node_index].data));
 
 	tree->nodes[new_node_index].lchild = lchild;
 	tree->nodes[new_node_index].mchild = mchild;
@@ -57,6 +58,14 @@ SString nodeops[] = {
 	sstring("INT -> FLOAT"),
 	sstring("#"),
 	sstring(":"),
+	sstring("+ (int)"),
+	sstring("- (int)"),
+	sstring("* (int)"),
+	sstring("/ (int)"),
+	sstring("+ (float)"),
+	sstring("- (float)"),
+	sstring("* (float)"),
+	sstring("/ (float)"),
 
 	// Control Flow
 	sstring("SEQ"),
@@ -88,7 +97,14 @@ static void ASTPrintNode(FILE* fd, AST* tree, ASTNode* node, u32 indent) {
 		err("AST node operation invalid!");
 		panic();
 	}
-	print(fd, "%s\n", nodeops[node->op]);
+	if (node->op == AST_INT_LITERAL)
+		print(fd, "%s %d\n", nodeops[node->op], node->data.i);
+	else if (node->op == AST_FLOAT_LITERAL)
+		print(fd, "%s %f\n", nodeops[node->op], node->data.f);
+	else if (node->op == AST_COORD_TRANSFORM && node->lchild == UINT32_MAX)
+		print(fd, "%s %d\n", nodeops[node->op], (i32)node->data.i);
+	else
+		print(fd, "%s\n", nodeops[node->op]);
 
 	if (node->lchild != UINT32_MAX) {
 		ASTPrintNode(fd, tree, &tree->nodes[node->lchild], indent + 1);
@@ -108,3 +124,67 @@ void ASTPrint(FILE* fd, AST* tree) {
 void ASTFree(AST* tree) {
 	Free(tree->mem, tree->nodes, tree->cap * sizeof(ASTNode));
 }
+
+// The fields of a node that matter for its meaning. The parser doesn't
+// initialize vt for ops that don't use it, and the data of a reference
+// is its handle slot, which follows from the shape anyway.
+typedef struct NodeShape {
+	ASTNodeOp op;
+	ASTValueType vt;
+	StrID data;
+	u32 lchild;
+	u32 mchild;
+	u32 rchild;
+} NodeShape;
+
+static NodeShape ShapeOf(ASTNode* node) {
+	NodeShape shape = {
+		.op = node->op,
+		.lchild = node->lchild,
+		.mchild = node->mchild,
+		.rchild = node->rchild,
+	};
+
+	switch (node->op) {
+	case AST_INT_LITERAL:
+	case AST_COORD_TRANSFORM:
+		shape.data.idx = node->data.i;
+		break;
+	case AST_FLOAT_LITERAL:
+		// all of its bits, a CellFloat can be wider than idx
+		memcpy(&shape.data, &node->data.f, sizeof(node->data.f));
+		break;
+	case AST_DECLARE_VARIABLE:
+		shape.vt = node->vt;
+		shape.data = node->data.s;
+		break;
+	case AST_ID:
+		shape.data = node->data.s;
+		break;
+	default:
+		break;
+	}
+	return shape;
+}
+
+u64 ASTHash(AST* tree) {
+	u64 h = tree->size;
+	for (u32 i = 0; i < tree->size; i++) {
+		NodeShape shape = ShapeOf(&tree->nodes[i]);
+		h = h * 31 + hash((u8*)&shape, sizeof(NodeShape));
+	}
+	return h;
+}
+
+u32 ASTEqual(AST* a, AST* b) {
+	if (a->size != b->size)
+		return 0;
+
+	for (u32 i = 0; i < a->size; i++) {
+		NodeShape x = ShapeOf(&a->nodes[i]);
+		NodeShape y = ShapeOf(&b->nodes[i]);
+		if (memcmp(&x, &y, sizeof(NodeShape)))
+			return 0;
+	}
+	return 1;
+}
@@ -0,0 +1,373 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/util.h>
+
+/*
++---------------------------------------------------+
+|   INFO:                                           |
+|   Batched bytecode. A filled down column runs     |
+|   the same template on every row, so instead of   |
+|   one BCRun per cell each instruction is run over |
+|   up to BATCH_LANES cells at once. A register     |
+|   holds a tag and a 4 byte value per lane, split  |
+|   into two arrays, which makes the typed ops      |
+|   plain loops over arrays that the compiler turns |
+|   into SIMD (the release build is -O3).           |
+|                                                   |
+|   Registers also remember when every lane has the |
+|   same type. Generic ops on two registers that    |
+|   are all ints or all floats then take the same   |
+|   array loops (an int side promoted to float like |
+|   EvalBinaryOp does), anything mixed within a     |
+|   register goes through EvalBinaryOp one lane at  |
+|   a time, so the results match BCRun's exactly.   |
+|   Lanes that divide by zero get #DIV/0! and leave |
+|   their register mixed.                           |
+|                                                   |
+|   Lanes that don't agree on a jump, or read a     |
+|   cell that isn't a number, empty or an error,    |
+|   are handed back and run on BCRun one by one.    |
++---------------------------------------------------+
+*/
+
+#define BATCH_LANES 64
+#define MIXED UINT32_MAX
+
+static const CellValue DivZero = {.t = CT_ERROR, .d.i = CE_DIV0};
+
+typedef struct Lanes {
+	u32 kind; // CellType shared by every lane, MIXED otherwise
+	u32 t[BATCH_LANES];
+#if defined(CELL_NANBOX)
+	// f64 lanes are twice as wide, sharing would overlap lanes
+	i32 i[BATCH_LANES];
+	CellFloat f[BATCH_LANES];
+#else
+	union {
+		i32 i[BATCH_LANES];
+		CellFloat f[BATCH_LANES];
+	};
+#endif
+} Lanes;
+
+static void SetKind(Lanes* r, u32 kind, u32 n) {
+	r->kind = kind;
+	for (u32 l = 0; l < n; l++)
+		r->t[l] = kind;
+}
+
+static void FindKind(Lanes* r, u32 n) {
+	r->kind = r->t[0];
+	for (u32 l = 1; l < n; l++) {
+		if (r->t[l] != r->kind) {
+			r->kind = MIXED;
+			return;
+		}
+	}
+}
+
+static CellValue LaneGet(Lanes* r, u32 l) {
+	if (r->t[l] == CT_FLOAT)
+		return (CellValue){.t = CT_FLOAT, .d.f = r->f[l]};
+	return (CellValue){.t = r->t[l], .d.i = r->i[l]};
+}
+
+static void LaneSet(Lanes* r, u32 l, CellValue v) {
+	r->t[l] = v.t;
+	if (v.t == CT_FLOAT)
+		r->f[l] = v.d.f;
+	else
+		r->i[l] = v.d.i;
+}
+
+// The typed ops, also used by the generic ones when the kinds line up
+static void ArithInt(BCOp op, Lanes* d, Lanes* a, Lanes* b, u32 n) {
+	switch (op) {
+	case BC_ADD_II:
+		for (u32 l = 0; l < n; l++)
+			d->i[l] = a->i[l] + b->i[l];
+		break;
+	case BC_SUB_II:
+		for (u32 l = 0; l < n; l++)
+			d->i[l] = a->i[l] - b->i[l];
+		break;
+	case BC_MUL_II:
+		for (u32 l = 0; l < n; l++)
+			d->i[l] = a->i[l] * b->i[l];
+		break;
+	case BC_DIV_II: {
+		u32 zero = 0;
+		for (u32 l = 0; l < n; l++)
+			zero |= !b->i[l];
+		if (zero) {
+			// same as BCRun, those lanes get #DIV/0!
+			for (u32 l = 0; l < n; l++) {
+				i32 rhs = b->i[l];
+				LaneSet(d, l, rhs ? (CellValue){.t = CT_INT, .d.i = a->i[l] / rhs} : DivZero);
+			}
+			FindKind(d, n);
+			return;
+		}
+		for (u32 l = 0; l < n; l++)
+			d->i[l] = a->i[l] / b->i[l];
+		break;
+	}
+	default:
+		panic();
+	}
+	SetKind(d, CT_INT, n);
+}
+
+static void ArithFloat(BCOp op, Lanes* d, Lanes* a, Lanes* b, u32 n) {
+	switch (op) {
+	case BC_ADD_FF:
+		for (u32 l = 0; l < n; l++)
+			d->f[l] = a->f[l] + b->f[l];
+		break;
+	case BC_SUB_FF:
+		for (u32 l = 0; l < n; l++)
+			d->f[l] = a->f[l] - b->f[l];
+		break;
+	case BC_MUL_FF:
+		for (u32 l = 0; l < n; l++)
+			d->f[l] = a->f[l] * b->f[l];
+		break;
+	case BC_DIV_FF: {
+		u32 zero = 0;
+		for (u32 l = 0; l < n; l++)
+			zero |= b->f[l] == 0.0f;
+		if (zero) {
+			for (u32 l = 0; l < n; l++) {
+				CellFloat rhs = b->f[l];
+				LaneSet(d, l, rhs != 0.0f ? (CellValue){.t = CT_FLOAT, .d.f = a->f[l] / rhs} : DivZero);
+			}
+			FindKind(d, n);
+			return;
+		}
+		for (u32 l = 0; l < n; l++)
+			d->f[l] = a->f[l] / b->f[l];
+		break;
+	}
+	default:
+		panic();
+	}
+	SetKind(d, CT_FLOAT, n);
+}
+
+// Cells are read straight out of the blocks of outSheet, which is all
+// EvalReadCell does for constant references in dependency order. Lanes
+// next to each other usually fall in the same block.
+static u32 Gather(EvalContext ctx, BCInstr* ip, v2u* anchors, Lanes* d, u32 n) {
+	SpreadSheet* sheet = ctx.outSheet;
+	v2u last = {UINT32_MAX, UINT32_MAX};
+	Block* block = NULL;
+
+	for (u32 l = 0; l < n; l++) {
+		v2u pos = {
+			ip->k.u + (ip->a & 1 ? anchors[l].x : 0),
+			ip->y + (ip->a & 2 ? anchors[l].y : 0),
+		};
+
+		v2u bpos = CELL_TO_BLOCK(pos);
+		if (!CMPV2(bpos, last)) {
+			last = bpos;
+			u32 id = SheetBlockGet(sheet, bpos);
+			block = id == UINT32_MAX ? NULL : sheet->blockpool[id];
+		}
+
+		CellValue v = {0};
+		if (block) {
+			v2u offset = CELL_TO_OFFSET(pos);
+			v = CellUnbox(block->cells[CELL_TO_INDEX(offset)]);
+		}
+		if (v.t != CT_EMPTY && v.t != CT_INT && v.t != CT_FLOAT && v.t != CT_ERROR)
+			return 0;
+		LaneSet(d, l, v);
+	}
+
+	FindKind(d, n);
+	return 1;
+}
+
+static u32 IsNumber(u32 kind) {
+	return kind == CT_INT || kind == CT_FLOAT;
+}
+
+static Lanes* Promote(Lanes* r, Lanes* scratch, u32 n) {
+	if (r->kind == CT_FLOAT)
+		return r;
+	for (u32 l = 0; l < n; l++)
+		scratch->f[l] = (CellFloat)r->i[l];
+	return scratch;
+}
+
+static u32 Truthy(Lanes* r, u32 l) {
+	return r->t[l] == CT_INT ? r->i[l] != 0 : (r->t[l] == CT_FLOAT && r->f[l] != 0.0f);
+}
+
+// Runs one group of lanes, 0 if they have to be run one at a time
+static u32 RunLanes(BCProgram* prog, EvalContext ctx, Lanes* r, v2u* anchors, u32 n,
+					CellValue* out) {
+	// every register starts out empty, like BCRun's
+	memset(r, 0, prog->regs * sizeof(Lanes));
+	Lanes promoted[2];
+
+	BCInstr* ip = prog->code;
+	for (;;) {
+		Lanes* d = &r[ip->dst];
+		Lanes* a = &r[ip->a];
+		Lanes* b = &r[ip->b];
+
+		switch (ip->op) {
+		case BC_HALT:
+			for (u32 l = 0; l < n; l++)
+				out[l] = LaneGet(&r[prog->result], l);
+			return 1;
+
+		case BC_LOADK:
+			for (u32 l = 0; l < n; l++) {
+				if (ip->a == CT_FLOAT)
+					d->f[l] = ip->k.f;
+				else
+					d->i[l] = ip->k.i;
+			}
+			SetKind(d, ip->a, n);
+			break;
+		case BC_MOV:
+			*d = *a;
+			break;
+		case BC_I2F:
+			for (u32 l = 0; l < n; l++)
+				d->f[l] = (CellFloat)a->i[l];
+			SetKind(d, CT_FLOAT, n);
+			break;
+		case BC_F2I:
+			for (u32 l = 0; l < n; l++)
+				d->i[l] = (i32)a->f[l];
+			SetKind(d, CT_INT, n);
+			break;
+
+		case BC_ADD_II:
+		case BC_SUB_II:
+		case BC_MUL_II:
+		case BC_DIV_II:
+			ArithInt(ip->op, d, a, b, n);
+			break;
+		case BC_ADD_FF:
+		case BC_SUB_FF:
+		case BC_MUL_FF:
+		case BC_DIV_FF:
+			ArithFloat(ip->op, d, a, b, n);
+			break;
+
+		case BC_ADD:
+		case BC_SUB:
+		case BC_MUL:
+		case BC_DIV: {
+			u32 k = ip->op - BC_ADD;
+			if (a->kind == CT_INT && b->kind == CT_INT) {
+				ArithInt(BC_ADD_II + k, d, a, b, n);
+			} else if (IsNumber(a->kind) && IsNumber(b->kind)) {
+				// the int side goes to float, like in EvalBinaryOp
+				Lanes* fa = Promote(a, &promoted[0], n);
+				Lanes* fb = Promote(b, &promoted[1], n);
+				ArithFloat(BC_ADD_FF + k, d, fa, fb, n);
+			} else {
+				ASTNodeOp op = AST_ADD + k;
+				for (u32 l = 0; l < n; l++)
+					LaneSet(d, l, EvalBinaryOp(op, LaneGet(a, l), LaneGet(b, l)));
+				FindKind(d, n);
+			}
+			break;
+		}
+
+		case BC_CELL:
+			if (!Gather(ctx, ip, anchors, d, n))
+				return 0;
+			break;
+		case BC_CELL_R:
+			// computed references make the cell volatile, which never
+			// gets batched
+			return 0;
+
+		case BC_SEQ:
+			if (b->kind == CT_EMPTY) {
+				*d = *a;
+			} else if (b->kind != MIXED) {
+				*d = *b;
+			} else {
+				for (u32 l = 0; l < n; l++)
+					LaneSet(d, l, LaneGet(b->t[l] == CT_EMPTY ? a : b, l));
+				FindKind(d, n);
+			}
+			break;
+
+		case BC_JMP:
+			ip = prog->code + ip->k.u;
+			continue;
+		case BC_JMPF: {
+			u32 cond = Truthy(a, 0);
+			for (u32 l = 1; l < n; l++) {
+				if (Truthy(a, l) != cond)
+					return 0;
+			}
+			if (!cond) {
+				ip = prog->code + ip->k.u;
+				continue;
+			}
+			break;
+		}
+
+		case BC_CONV_I:
+			for (u32 l = 0; l < n; l++) {
+				if (a->t[l] != CT_INT)
+					d->i[l] = (i32)a->f[l];
+				else
+					d->i[l] = a->i[l];
+			}
+			SetKind(d, CT_INT, n);
+			break;
+		case BC_CONV_F:
+			for (u32 l = 0; l < n; l++) {
+				if (a->t[l] != CT_FLOAT)
+					d->f[l] = (CellFloat)a->i[l];
+				else
+					d->f[l] = a->f[l];
+			}
+			SetKind(d, CT_FLOAT, n);
+			break;
+
+		default:
+			panic();
+		}
+		ip++;
+	}
+}
+
+void BCRunBatch(BCProgram* prog, EvalContext ctx, v2u* anchors, u32 count, CellValue* out) {
+	// NOTE: outside of dependency order a read can find a cell that
+	// isn't done, which only the per cell path knows how to wait for
+	if (!ctx.ordered) {
+		err("BCRunBatch needs the cells it reads to be done");
+		panic();
+	}
+
+	Lanes* r = Alloc(ctx.mem, prog->regs * sizeof(Lanes));
+
+	for (u32 start = 0; start < count; start += BATCH_LANES) {
+		u32 n = MIN(BATCH_LANES, count - start);
+		if (RunLanes(prog, ctx, r, anchors + start, n, out + start))
+			continue;
+
+		for (u32 l = start; l < start + n; l++) {
+			ctx.anchor = anchors[l];
+			out[l] = BCRun(prog, ctx);
+		}
+	}
+
+	Free(ctx.mem, r, prog->regs * sizeof(Lanes));
+}
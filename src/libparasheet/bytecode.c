@@ -0,0 +1,610 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/util.h>
+
+/*
++---------------------------------------------------+
+|   INFO:                                           |
+|   AST to bytecode compiler. Every node gets its   |
+|   own register and variables get a register for  |
+|   their whole scope, so the program is a single   |
+|   pass over the tree in post order.               |
+|                                                   |
+|   Literals and variables have a type known at     |
+|   compile time, which lets arithmetic on them use |
+|   the typed ops. Anything read from a cell can be |
+|   of any type and goes through the generic ops.   |
++---------------------------------------------------+
+*/
+
+#define EPS UINT32_MAX
+#define MAX_REGS UINT16_MAX
+
+typedef enum StaticType : u32 {
+	ST_DYN = 0,
+	ST_EMPTY,
+	ST_INT,
+	ST_FLOAT,
+} StaticType;
+
+typedef struct Operand {
+	u16 reg;
+	StaticType type;
+} Operand;
+
+typedef struct Variable {
+	StrID name;
+	u16 reg;
+	StaticType type;
+	u32 depth;
+} Variable;
+
+typedef struct Compiler {
+	AST* tree;
+	BCProgram* prog;
+
+	Variable* vars;
+	u32 vsize;
+	u32 vcap;
+
+	u32 depth; // scope depth, the top level scope is 1
+	u32 failed;
+} Compiler;
+
+static u32 Emit(Compiler* c, BCInstr instr) {
+	BCProgram* prog = c->prog;
+	if (prog->size + 1 > prog->cap) {
+		u32 oldsize = prog->cap;
+		prog->cap = prog->cap ? prog->cap * 2 : 16;
+		prog->code = Realloc(prog->mem, prog->code, oldsize * sizeof(BCInstr),
+							 prog->cap * sizeof(BCInstr));
+	}
+	prog->code[prog->size] = instr;
+	return prog->size++;
+}
+
+static u16 NewReg(Compiler* c) {
+	if (c->prog->regs >= MAX_REGS) {
+		c->failed = 1;
+		return 0;
+	}
+	return c->prog->regs++;
+}
+
+static Variable* FindVar(Compiler* c, StrID name) {
+	for (i32 i = c->vsize - 1; i >= 0; i--) {
+		if (StringCmp(c->vars[i].name, name))
+			return &c->vars[i];
+	}
+	return NULL;
+}
+
+static u16 LoadZero(Compiler* c, StaticType type) {
+	u16 reg = NewReg(c);
+	Emit(c, (BCInstr){
+				.op = BC_LOADK,
+				.dst = reg,
+				.a = type == ST_FLOAT ? CT_FLOAT : CT_INT,
+			});
+	return reg;
+}
+
+static Operand CompileNode(Compiler* c, u32 index);
+
+// A division can give #DIV/0! unless it divides by a literal other
+// than zero, then whatever uses it has to go through the generic ops
+static StaticType DivType(Compiler* c, ASTNode* node, StaticType type) {
+	if (node->op != AST_DIV && node->op != AST_DIV_INT && node->op != AST_DIV_FLOAT)
+		return type;
+	ASTNode* r = &ASTGet(c->tree, node->mchild);
+	if (r->op == AST_INT_LITERAL && r->data.i != 0)
+		return type;
+	if (r->op == AST_FLOAT_LITERAL && r->data.f != 0.0f)
+		return type;
+	return ST_DYN;
+}
+
+static Operand CompileArith(Compiler* c, ASTNode* node) {
+	Operand l = CompileNode(c, node->lchild);
+	Operand r = CompileNode(c, node->mchild);
+
+	u32 offset = node->op - AST_ADD;
+	u16 dst = NewReg(c);
+
+	u32 lnum = l.type == ST_INT || l.type == ST_FLOAT;
+	u32 rnum = r.type == ST_INT || r.type == ST_FLOAT;
+	if (!lnum || !rnum) {
+		Emit(c, (BCInstr){.op = BC_ADD + offset, .dst = dst, .a = l.reg, .b = r.reg});
+		return (Operand){dst, ST_DYN};
+	}
+
+	if (l.type == ST_INT && r.type == ST_INT) {
+		Emit(c, (BCInstr){.op = BC_ADD_II + offset, .dst = dst, .a = l.reg, .b = r.reg});
+		return (Operand){dst, DivType(c, node, ST_INT)};
+	}
+
+	// mixed operands, widen the int side
+	if (l.type == ST_INT) {
+		u16 reg = NewReg(c);
+		Emit(c, (BCInstr){.op = BC_I2F, .dst = reg, .a = l.reg});
+		l.reg = reg;
+	}
+	if (r.type == ST_INT) {
+		u16 reg = NewReg(c);
+		Emit(c, (BCInstr){.op = BC_I2F, .dst = reg, .a = r.reg});
+		r.reg = reg;
+	}
+
+	Emit(c, (BCInstr){.op = BC_ADD_FF + offset, .dst = dst, .a = l.reg, .b = r.reg});
+	return (Operand){dst, DivType(c, node, ST_FLOAT)};
+}
+
+// The tree walker only knows which branch ran at run time, so a branch
+// must not leave declarations behind or change the scope depth.
+static Operand CompileBranch(Compiler* c, u32 index) {
+	u32 vsize = c->vsize;
+	u32 depth = c->depth;
+
+	Operand res = CompileNode(c, index);
+
+	if (c->vsize != vsize || c->depth != depth)
+		c->failed = 1;
+	return res;
+}
+
+// A literal coordinate or a constant `#` offset from the anchor
+static u32 IsConstCoord(ASTNode* node) {
+	return node->op == AST_INT_LITERAL ||
+		   (node->op == AST_COORD_TRANSFORM && node->lchild == EPS);
+}
+
+static Operand CompileNode(Compiler* c, u32 index) {
+	if (index == EPS || c->failed)
+		return (Operand){0, ST_EMPTY};
+
+	ASTNode* node = &ASTGet(c->tree, index);
+
+	switch (node->op) {
+	case AST_INT_LITERAL: {
+		u16 dst = NewReg(c);
+		Emit(c, (BCInstr){.op = BC_LOADK, .dst = dst, .a = CT_INT, .k.i = node->data.i});
+		return (Operand){dst, ST_INT};
+	}
+	case AST_FLOAT_LITERAL: {
+		u16 dst = NewReg(c);
+		Emit(c, (BCInstr){.op = BC_LOADK, .dst = dst, .a = CT_FLOAT, .k.f = node->data.f});
+		return (Operand){dst, ST_FLOAT};
+	}
+
+	case AST_GET_CELL_REF: {
+		ASTNode* x = &ASTGet(c->tree, node->lchild);
+		ASTNode* y = &ASTGet(c->tree, node->mchild);
+
+		if (IsConstCoord(x) && IsConstCoord(y)) {
+			u16 dst = NewReg(c);
+			u16 relative = (x->op == AST_COORD_TRANSFORM) | (y->op == AST_COORD_TRANSFORM) << 1;
+			Emit(c, (BCInstr){
+						.op = BC_CELL,
+						.dst = dst,
+						.a = relative,
+						.b = node->data.i < UINT16_MAX ? node->data.i : UINT16_MAX,
+						.k.u = x->data.i,
+						.y = y->data.i,
+					});
+			return (Operand){dst, ST_DYN};
+		}
+
+		Operand cx = CompileNode(c, node->lchild);
+		Operand cy = CompileNode(c, node->mchild);
+		u16 dst = NewReg(c);
+		Emit(c, (BCInstr){.op = BC_CELL_R, .dst = dst, .a = cx.reg, .b = cy.reg});
+		return (Operand){dst, ST_DYN};
+	}
+
+	case AST_ADD:
+	case AST_SUB:
+	case AST_MUL:
+	case AST_DIV:
+		return CompileArith(c, node);
+
+	// already typed by ASTOptimize
+	case AST_ADD_INT:
+	case AST_SUB_INT:
+	case AST_MUL_INT:
+	case AST_DIV_INT:
+	case AST_ADD_FLOAT:
+	case AST_SUB_FLOAT:
+	case AST_MUL_FLOAT:
+	case AST_DIV_FLOAT: {
+		Operand l = CompileNode(c, node->lchild);
+		Operand r = CompileNode(c, node->mchild);
+		u16 dst = NewReg(c);
+		Emit(c, (BCInstr){.op = BC_ADD_II + (node->op - AST_ADD_INT), .dst = dst, .a = l.reg, .b = r.reg});
+		return (Operand){dst, DivType(c, node, node->op < AST_ADD_FLOAT ? ST_INT : ST_FLOAT)};
+	}
+
+	case AST_INT_TO_FLOAT:
+	case AST_FLOAT_TO_INT: {
+		Operand v = CompileNode(c, node->lchild);
+		u16 dst = NewReg(c);
+		if (node->op == AST_INT_TO_FLOAT) {
+			Emit(c, (BCInstr){.op = BC_I2F, .dst = dst, .a = v.reg});
+			return (Operand){dst, ST_FLOAT};
+		}
+		Emit(c, (BCInstr){.op = BC_F2I, .dst = dst, .a = v.reg});
+		return (Operand){dst, ST_INT};
+	}
+
+	case AST_SEQ: {
+		Operand a = CompileNode(c, node->lchild);
+		Operand b = CompileNode(c, node->mchild);
+
+		// the choice between the two is only needed at run time
+		// when b could be empty
+		if (b.type == ST_INT || b.type == ST_FLOAT)
+			return b;
+		if (b.type == ST_EMPTY)
+			return a;
+
+		u16 dst = NewReg(c);
+		Emit(c, (BCInstr){.op = BC_SEQ, .dst = dst, .a = a.reg, .b = b.reg});
+		return (Operand){dst, ST_DYN};
+	}
+
+	case AST_IF_ELSE: {
+		Operand cond = CompileNode(c, node->lchild);
+		u16 dst = NewReg(c);
+
+		u32 jelse = Emit(c, (BCInstr){.op = BC_JMPF, .a = cond.reg});
+		Operand t = CompileBranch(c, node->mchild);
+		Emit(c, (BCInstr){.op = BC_MOV, .dst = dst, .a = t.reg});
+		u32 jend = Emit(c, (BCInstr){.op = BC_JMP});
+
+		c->prog->code[jelse].k.u = c->prog->size;
+		Operand e = CompileBranch(c, node->rchild);
+		Emit(c, (BCInstr){.op = BC_MOV, .dst = dst, .a = e.reg});
+		c->prog->code[jend].k.u = c->prog->size;
+
+		return (Operand){dst, t.type == e.type ? t.type : ST_DYN};
+	}
+
+	case AST_RETURN:
+		return CompileNode(c, node->lchild);
+
+	case AST_DECLARE_VARIABLE: {
+		if (node->vt != V_INT && node->vt != V_FLOAT) {
+			c->failed = 1;
+			break;
+		}
+
+		if (c->vsize + 1 > c->vcap) {
+			u32 oldsize = c->vcap;
+			c->vcap = c->vcap ? c->vcap * 2 : 8;
+			c->vars = Realloc(c->prog->mem, c->vars, oldsize * sizeof(Variable),
+							  c->vcap * sizeof(Variable));
+		}
+
+		StaticType type = node->vt == V_INT ? ST_INT : ST_FLOAT;
+		c->vars[c->vsize++] = (Variable){
+			.name = node->data.s,
+			.reg = LoadZero(c, type),
+			.type = type,
+			.depth = c->depth,
+		};
+
+		// the declaration itself evaluates to a zero of its type
+		return (Operand){LoadZero(c, type), type};
+	}
+
+	case AST_ASSIGN_VALUE: {
+		ASTNode* lhs = &ASTGet(c->tree, node->lchild);
+		if (lhs->op != AST_ID && lhs->op != AST_DECLARE_VARIABLE) {
+			c->failed = 1;
+			break;
+		}
+
+		CompileNode(c, node->lchild);
+		Operand rhs = CompileNode(c, node->mchild);
+
+		Variable* var = FindVar(c, lhs->data.s);
+		if (!var || c->failed) {
+			c->failed = 1;
+			break;
+		}
+
+		BCOp op = var->type == ST_INT ? BC_CONV_I : BC_CONV_F;
+		if (rhs.type == var->type)
+			op = BC_MOV;
+		else if (rhs.type == ST_INT && var->type == ST_FLOAT)
+			op = BC_I2F;
+		else if (rhs.type == ST_FLOAT && var->type == ST_INT)
+			op = BC_F2I;
+
+		Emit(c, (BCInstr){.op = op, .dst = var->reg, .a = rhs.reg});
+
+		// copied so later assignments don't change this result
+		u16 dst = NewReg(c);
+		Emit(c, (BCInstr){.op = BC_MOV, .dst = dst, .a = var->reg});
+		return (Operand){dst, var->type};
+	}
+
+	case AST_ID: {
+		Variable* var = FindVar(c, node->data.s);
+		if (!var) {
+			c->failed = 1;
+			break;
+		}
+
+		u16 dst = NewReg(c);
+		Emit(c, (BCInstr){.op = BC_MOV, .dst = dst, .a = var->reg});
+		return (Operand){dst, var->type};
+	}
+
+	case AST_SCOPE_BEGIN:
+		c->depth++;
+		return (Operand){0, ST_EMPTY};
+
+	case AST_SCOPE_END:
+		if (!c->depth) {
+			c->failed = 1;
+			break;
+		}
+		while (c->vsize && c->vars[c->vsize - 1].depth == c->depth) {
+			c->vsize--;
+		}
+		c->depth--;
+		return (Operand){0, ST_EMPTY};
+
+	default:
+		// loops, ranges, calls... left to the tree walker
+		c->failed = 1;
+		break;
+	}
+
+	return (Operand){0, ST_EMPTY};
+}
+
+u32 BCCompile(AST* tree, BCProgram* prog) {
+	if (!tree->size)
+		return 0;
+
+	Compiler c = {
+		.tree = tree,
+		.prog = prog,
+		.depth = 1,
+	};
+
+	prog->size = 0;
+	prog->regs = 1; // register 0 is the empty value
+
+	Operand res = CompileNode(&c, tree->size - 1);
+	Emit(&c, (BCInstr){.op = BC_HALT});
+	prog->result = res.reg;
+
+	Free(prog->mem, c.vars, c.vcap * sizeof(Variable));
+
+	if (c.failed) {
+		BCFree(prog);
+		return 0;
+	}
+	return 1;
+}
+
+/*
++---------------------------------------------------+
+|   INFO:                                           |
+|   The interpreter. With GCC/Clang every handler   |
+|   jumps straight to the next one through a label  |
+|   table (computed goto), which gives each opcode  |
+|   its own indirect branch for the predictor. The  |
+|   switch fallback is the same code for any other  |
+|   compiler.                                       |
++---------------------------------------------------+
+*/
+
+// formulas needing more registers than this allocate them
+#define LOCAL_REGS 64
+
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_START() DISPATCH();
+#define VM_OP(op) op_##op:
+#define DISPATCH() goto* labels[ip->op]
+#else
+#define VM_START() \
+	dispatch:      \
+	switch (ip->op)
+#define VM_OP(op) case op:
+#define DISPATCH() goto dispatch
+#endif
+
+#define NEXT() \
+	ip++;      \
+	DISPATCH()
+
+#define ARITH(op, T, type, field, expr)                           \
+	VM_OP(op) {                                                   \
+		T lhs = r[ip->a].d.field;                                 \
+		T rhs = r[ip->b].d.field;                                 \
+		r[ip->dst] = (CellValue){.t = type, .d.field = (expr)}; \
+		NEXT();                                                   \
+	}
+
+// same as the tree walker
+static const CellValue DivZero = {.t = CT_ERROR, .d.i = CE_DIV0};
+
+CellValue BCRun(BCProgram* prog, EvalContext ctx) {
+	CellValue local[LOCAL_REGS];
+	CellValue* r = local;
+	if (prog->regs > LOCAL_REGS) {
+		r = Alloc(ctx.mem, prog->regs * sizeof(CellValue));
+	}
+	memset(r, 0, prog->regs * sizeof(CellValue));
+
+	BCInstr* ip = prog->code;
+
+#if defined(__GNUC__) || defined(__clang__)
+	static void* labels[BC_OP_COUNT] = {
+		[BC_HALT] = &&op_BC_HALT,	  [BC_LOADK] = &&op_BC_LOADK,
+		[BC_MOV] = &&op_BC_MOV,		  [BC_I2F] = &&op_BC_I2F,
+		[BC_F2I] = &&op_BC_F2I,		  [BC_ADD_II] = &&op_BC_ADD_II,
+		[BC_SUB_II] = &&op_BC_SUB_II, [BC_MUL_II] = &&op_BC_MUL_II,
+		[BC_DIV_II] = &&op_BC_DIV_II, [BC_ADD_FF] = &&op_BC_ADD_FF,
+		[BC_SUB_FF] = &&op_BC_SUB_FF, [BC_MUL_FF] = &&op_BC_MUL_FF,
+		[BC_DIV_FF] = &&op_BC_DIV_FF, [BC_ADD] = &&op_BC_ADD,
+		[BC_SUB] = &&op_BC_SUB,		  [BC_MUL] = &&op_BC_MUL,
+		[BC_DIV] = &&op_BC_DIV,		  [BC_CELL] = &&op_BC_CELL,
+		[BC_CELL_R] = &&op_BC_CELL_R, [BC_SEQ] = &&op_BC_SEQ,
+		[BC_JMP] = &&op_BC_JMP,		  [BC_JMPF] = &&op_BC_JMPF,
+		[BC_CONV_I] = &&op_BC_CONV_I, [BC_CONV_F] = &&op_BC_CONV_F,
+	};
+#endif
+
+	VM_START() {
+		VM_OP(BC_LOADK) {
+			// the constant's bits, whichever member they are
+			r[ip->dst] = (CellValue){.t = ip->a};
+			memcpy(&r[ip->dst].d, &ip->k, sizeof(ip->k));
+			NEXT();
+		}
+		VM_OP(BC_MOV) {
+			r[ip->dst] = r[ip->a];
+			NEXT();
+		}
+		VM_OP(BC_I2F) {
+			r[ip->dst] = (CellValue){.t = CT_FLOAT, .d.f = (CellFloat)r[ip->a].d.i};
+			NEXT();
+		}
+		VM_OP(BC_F2I) {
+			r[ip->dst] = (CellValue){.t = CT_INT, .d.i = (i32)r[ip->a].d.f};
+			NEXT();
+		}
+
+		ARITH(BC_ADD_II, i32, CT_INT, i, lhs + rhs)
+		ARITH(BC_SUB_II, i32, CT_INT, i, lhs - rhs)
+		ARITH(BC_MUL_II, i32, CT_INT, i, lhs * rhs)
+		VM_OP(BC_DIV_II) {
+			i32 rhs = r[ip->b].d.i;
+			r[ip->dst] = rhs ? (CellValue){.t = CT_INT, .d.i = r[ip->a].d.i / rhs} : DivZero;
+			NEXT();
+		}
+		ARITH(BC_ADD_FF, CellFloat, CT_FLOAT, f, lhs + rhs)
+		ARITH(BC_SUB_FF, CellFloat, CT_FLOAT, f, lhs - rhs)
+		ARITH(BC_MUL_FF, CellFloat, CT_FLOAT, f, lhs * rhs)
+		VM_OP(BC_DIV_FF) {
+			CellFloat rhs = r[ip->b].d.f;
+			r[ip->dst] = rhs != 0.0f ? (CellValue){.t = CT_FLOAT, .d.f = r[ip->a].d.f / rhs} : DivZero;
+			NEXT();
+		}
+
+		VM_OP(BC_ADD)
+		VM_OP(BC_SUB)
+		VM_OP(BC_MUL)
+		VM_OP(BC_DIV) {
+			ASTNodeOp op = AST_ADD + (ip->op - BC_ADD);
+			r[ip->dst] = EvalBinaryOp(op, r[ip->a], r[ip->b]);
+			NEXT();
+		}
+
+		VM_OP(BC_CELL) {
+			v2u pos = {
+				ip->k.u + (ip->a & 1 ? ctx.anchor.x : 0),
+				ip->y + (ip->a & 2 ? ctx.anchor.y : 0),
+			};
+			r[ip->dst] = EvalReadRef(ctx, pos, ip->b == UINT16_MAX ? UINT32_MAX : ip->b);
+			NEXT();
+		}
+		VM_OP(BC_CELL_R) {
+			v2u pos = {EvalRefCoord(r[ip->a]), EvalRefCoord(r[ip->b])};
+			r[ip->dst] = EvalReadCell(ctx, pos, false);
+			NEXT();
+		}
+
+		VM_OP(BC_SEQ) {
+			r[ip->dst] = r[ip->b].t == CT_EMPTY ? r[ip->a] : r[ip->b];
+			NEXT();
+		}
+		VM_OP(BC_JMP) {
+			ip = prog->code + ip->k.u;
+			DISPATCH();
+		}
+		VM_OP(BC_JMPF) {
+			CellValue c = r[ip->a];
+			bool cond = (c.t == CT_INT) ? (c.d.i != 0) : (c.t == CT_FLOAT && c.d.f != 0.0f);
+			if (cond) {
+				NEXT();
+			}
+			ip = prog->code + ip->k.u;
+			DISPATCH();
+		}
+
+		VM_OP(BC_CONV_I) {
+			CellValue v = r[ip->a];
+			if (v.t != CT_INT)
+				v = (CellValue){.t = CT_INT, .d.i = (i32)v.d.f};
+			r[ip->dst] = v;
+			NEXT();
+		}
+		VM_OP(BC_CONV_F) {
+			CellValue v = r[ip->a];
+			if (v.t != CT_FLOAT)
+				v = (CellValue){.t = CT_FLOAT, .d.f = (CellFloat)v.d.i};
+			r[ip->dst] = v;
+			NEXT();
+		}
+
+		VM_OP(BC_HALT) {
+			goto halt;
+		}
+
+#if !defined(__GNUC__) && !defined(__clang__)
+	default:
+		panic();
+#endif
+	}
+
+halt:;
+	CellValue result = r[prog->result];
+	if (r != local) {
+		Free(ctx.mem, r, prog->regs * sizeof(CellValue));
+	}
+	return result;
+}
+
+static const char* OpNames[BC_OP_COUNT] = {
+	[BC_HALT] = "halt",		[BC_LOADK] = "loadk",	  [BC_MOV] = "mov",
+	[BC_I2F] = "i2f",		[BC_F2I] = "f2i",		  [BC_ADD_II] = "add.ii",
+	[BC_SUB_II] = "sub.ii", [BC_MUL_II] = "mul.ii",	  [BC_DIV_II] = "div.ii",
+	[BC_ADD_FF] = "add.ff", [BC_SUB_FF] = "sub.ff",	  [BC_MUL_FF] = "mul.ff",
+	[BC_DIV_FF] = "div.ff", [BC_ADD] = "add",		  [BC_SUB] = "sub",
+	[BC_MUL] = "mul",		[BC_DIV] = "div",		  [BC_CELL] = "cell",
+	[BC_CELL_R] = "cell.r", [BC_SEQ] = "seq",		  [BC_JMP] = "jmp",
+	[BC_JMPF] = "jmpf",		[BC_CONV_I] = "conv.i", [BC_CONV_F] = "conv.f",
+};
+
+void BCPrint(FILE* fd, BCProgram* prog) {
+	for (u32 i = 0; i < prog->size; i++) {
+		BCInstr* in = &prog->code[i];
+		print(fd, "%d\t%n\tr%d r%d r%d", i, (i8*)OpNames[in->op], in->dst, in->a, in->b);
+
+		if (in->op == BC_LOADK && in->a == CT_FLOAT)
+			print(fd, "\t%f", in->k.f);
+		else if (in->op == BC_LOADK)
+			print(fd, "\t%d", in->k.i);
+		else if (in->op == BC_CELL)
+			print(fd, "\t[%n%d, %n%d]", (i8*)(in->a & 1 ? "#" : ""), in->k.u,
+				  (i8*)(in->a & 2 ? "#" : ""), in->y);
+		else if (in->op == BC_JMP || in->op == BC_JMPF)
+			print(fd, "\t-> %d", in->k.u);
+		print(fd, "\n");
+	}
+	print(fd, "result: r%d (%d registers)\n", prog->result, prog->regs);
+}
+
+void BCFree(BCProgram* prog) {
+	Free(prog->mem, prog->code, prog->cap * sizeof(BCInstr));
+	*prog = (BCProgram){.mem = prog->mem};
+}
@@ -54,7 +54,7 @@ int csv_parse_line(StringTable* str, const char* line, u32 linesize, CellValue*
             v.d.i = atoi(token);
         } else if (is_float(token)) {
             v.t = CT_FLOAT;
-            v.d.f = (float)atof(token);
+            v.d.f = (CellFloat)atof(token);
         } else {
             v.t = CT_TEXT;
             i8* copy = Alloc(str->mem, strlen(token));
@@ -127,53 +127,87 @@ bool csv_load_file(FILE* csv, StringTable* str, SpreadSheet* sheet) {
 
 // === Export CSV File ===
 
+// Makes room for `need` more bytes after cursor, returns the cursor
+// in the (possibly moved) buffer
+static i8* csv_reserve(Allocator a, SString* out, u64* cap, i8* cursor, u64 need) {
+    u64 used = (u64)(cursor - out->data);
+    if (used + need <= *cap) return cursor;
+
+    u64 grown = *cap;
+    while (used + need > grown) grown *= 2;
+    out->data = Realloc(a, out->data, *cap, grown);
+    *cap = grown;
+    return out->data + used;
+}
+
+// Rows are written a band of blocks at a time: the blocks come sorted
+// by block row from the iterator and only those are read, so the cost
+// is the nonempty blocks plus the separators of the used range.
 void csv_export_file(Allocator a, const char* filename, SpreadSheet* sheet, StringTable* str) {
-	SString out = {.data = Alloc(a, MB(1)), .size = 0};
+	u64 cap = MB(1);
+	SString out = {.data = Alloc(a, cap), .size = 0};
 	i8* cursor = out.data;
 
-	u32 maxx = 0;
-	u32 maxy = 0;
-  v2u Invalid = {UINT32_MAX, UINT32_MAX};
-
-	for (u32 i = 0; i < sheet->cap; i++) {
-		if (!CMPV2(sheet->keys[i], Invalid)) {
-			v2u pos = sheet->keys[i];
-			if (pos.x * BLOCK_SIZE > maxx) maxx = pos.x * BLOCK_SIZE;
-			if (pos.y * BLOCK_SIZE > maxy) maxy = pos.y * BLOCK_SIZE;
-		}
+	v2u lo, hi;
+	if (!SpreadSheetUsedRange(sheet, &lo, &hi)) {
+		WriteFileS(filename, out);
+		Free(a, out.data, cap);
+		return;
 	}
-	maxx += BLOCK_SIZE;
-	maxy += BLOCK_SIZE;
 
-	for (u32 y = 0; y < maxy; y++) {
-		for (u32 x = 0; x < maxx; x++) {
-			v2u pos = {.x = x, .y = y};
-			CellValue* val = SpreadSheetGetCell(sheet, pos);
-
-			if (val && val->t != CT_EMPTY) {
-				switch (val->t) {
+	SheetIter it;
+	SheetIterBegin(&it, sheet, SHEET_ROWS);
+
+	u32 first = 0;
+	for (u32 y = 0; y <= hi.y; y++) {
+		// the blocks holding row y are first..last
+		while (first < it.count && it.blocks[first].pos.y < y / BLOCK_SIZE) first++;
+		u32 last = first;
+		while (last < it.count && it.blocks[last].pos.y == y / BLOCK_SIZE) last++;
+
+		u32 column = 0;
+		for (u32 b = first; b < last; b++) {
+			Block* block = sheet->blockpool[it.blocks[b].bid];
+			for (u32 ox = 0; ox < BLOCK_SIZE; ox++) {
+				CellValue val = CellUnbox(block->cells[ox * BLOCK_SIZE + y % BLOCK_SIZE]);
+				if (val.t == CT_EMPTY) continue;
+
+				u32 x = it.blocks[b].pos.x * BLOCK_SIZE + ox;
+				SString text = {0};
+				if (val.t == CT_TEXT) text = StringGet(str, val.d.index);
+				// %f of the largest float is a few hundred digits
+				cursor = csv_reserve(a, &out, &cap, cursor, x - column + text.size + 400);
+				memset(cursor, ',', x - column);
+				cursor += x - column;
+				column = x;
+
+				switch (val.t) {
 					case CT_INT:
-						cursor += sprintf((char *)cursor, "%d", val->d.i);
+						cursor += sprintf((char *)cursor, "%d", val.d.i);
 						break;
 					case CT_FLOAT:
-						cursor += sprintf((char *)cursor, "%f", val->d.f);
+						cursor += sprintf((char *)cursor, "%f", val.d.f);
 						break;
-                    case CT_TEXT: {
-                        SString text = StringGet(str, val->d.index);
+                    case CT_ERROR:
+                        cursor += sprintf((char *)cursor, "%s", CellErrorString(val.d.i));
+                        break;
+                    case CT_TEXT:
                         cursor += sprintf((char *)cursor, "%.*s", text.size, text.data);
-                    } break;
+                        break;
 					default:
 						break;
 				}
 			}
-
-			if (x + 1 < maxx)
-				*cursor++ = ',';
 		}
+
+		cursor = csv_reserve(a, &out, &cap, cursor, hi.x - column + 1);
+		memset(cursor, ',', hi.x - column);
+		cursor += hi.x - column;
 		*cursor++ = '\n';
 	}
 
+	SheetIterEnd(&it);
 	out.size = (u32)(cursor - out.data);
 	WriteFileS(filename, out);
-	Free(a, out.data, MB(1));
+	Free(a, out.data, cap);
 }
@@ -0,0 +1,741 @@
+#include <libparasheet/lib_internal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/util.h>
+
+/*
++---------------------------------------------------+
+|   INFO:                                           |
+|   Cell dependency graph used for incremental      |
+|   recalculation. Positions map to node ids        |
+|   through a linear probing map, and the nodes     |
+|   keep both directions of every edge so that      |
+|   replacing a formula only touches its own        |
+|   precedents.                                     |
+|                                                   |
+|   Nodes are never removed, a cleared cell just    |
+|   ends up with no precedents.                     |
++---------------------------------------------------+
+*/
+
+const static v2u Invalid = {UINT32_MAX, UINT32_MAX};
+
+static void PushID(Allocator mem, u32** arr, u32* size, u32* cap, u32 id) {
+	if (*size + 1 > *cap) {
+		u32 oldsize = *cap;
+		*cap = *cap ? *cap * 2 : 4;
+		*arr = Realloc(mem, *arr, oldsize * sizeof(u32), *cap * sizeof(u32));
+	}
+	(*arr)[(*size)++] = id;
+}
+
+static void RemoveID(u32* arr, u32* size, u32 id) {
+	for (u32 i = 0; i < *size; i++) {
+		if (arr[i] == id) {
+			arr[i] = arr[--(*size)];
+			return;
+		}
+	}
+}
+
+static void DepGraphResize(DepGraph* graph) {
+	u32 oldsize = graph->cap;
+	v2u* okeys = graph->keys;
+	u32* ovalues = graph->values;
+
+	graph->cap = graph->cap ? graph->cap * 2 : 16;
+	graph->keys = Alloc(graph->mem, graph->cap * sizeof(v2u));
+	graph->values = Alloc(graph->mem, graph->cap * sizeof(u32));
+
+	for (u32 i = 0; i < graph->cap; i++) {
+		graph->keys[i] = Invalid;
+	}
+
+	for (u32 i = 0; i < oldsize; i++) {
+		if (CMPV2(okeys[i], Invalid))
+			continue;
+
+		u32 idx = hash((u8*)&okeys[i], sizeof(v2u)) % graph->cap;
+		while (!CMPV2(graph->keys[idx], Invalid)) {
+			idx = (idx + 1) % graph->cap;
+		}
+		graph->keys[idx] = okeys[i];
+		graph->values[idx] = ovalues[i];
+	}
+
+	Free(graph->mem, okeys, oldsize * sizeof(v2u));
+	Free(graph->mem, ovalues, oldsize * sizeof(u32));
+}
+
+u32 DepGraphFind(DepGraph* graph, v2u pos) {
+	if (!graph->cap)
+		return -1;
+
+	u32 idx = hash((u8*)&pos, sizeof(v2u)) % graph->cap;
+	for (u32 i = 0; i < graph->cap; i++) {
+		v2u curr = graph->keys[idx];
+		if (CMPV2(curr, pos))
+			return graph->values[idx];
+		if (CMPV2(curr, Invalid))
+			return -1;
+		idx = (idx + 1) % graph->cap;
+	}
+
+	return -1;
+}
+
+// Gets or creates the node for a cell
+u32 DepGraphNode(DepGraph* graph, v2u pos) {
+	if (graph->size + 1 >= graph->cap * MAX_LOAD_FACTOR) {
+		DepGraphResize(graph);
+	}
+
+	u32 idx = hash((u8*)&pos, sizeof(v2u)) % graph->cap;
+	for (u32 i = 0; i < graph->cap; i++) {
+		v2u curr = graph->keys[idx];
+		if (CMPV2(curr, pos))
+			return graph->values[idx];
+		if (CMPV2(curr, Invalid))
+			break;
+		idx = (idx + 1) % graph->cap;
+	}
+
+	if (graph->nsize + 1 > graph->ncap) {
+		u32 oldsize = graph->ncap;
+		graph->ncap = graph->ncap ? graph->ncap * 2 : 16;
+		graph->nodes = Realloc(graph->mem, graph->nodes, oldsize * sizeof(DepNode),
+							   graph->ncap * sizeof(DepNode));
+	}
+
+	u32 id = graph->nsize++;
+	graph->nodes[id] = (DepNode){.pos = pos};
+
+	graph->keys[idx] = pos;
+	graph->values[idx] = id;
+	graph->size++;
+	return id;
+}
+
+void DepGraphMarkDirty(DepGraph* graph, v2u pos) {
+	u32 id = DepGraphNode(graph, pos);
+	DepNode* node = &graph->nodes[id];
+
+	if ((node->flags & DN_DIRTY) && !(node->flags & DN_FRESH))
+		return;
+
+	// one that was refreshed already goes on the list again, its
+	// precedents may have changed since
+	node->flags = (node->flags | DN_DIRTY) & ~DN_FRESH;
+	PushID(graph->mem, &graph->dirty, &graph->dirtysize, &graph->dirtycap, id);
+}
+
+void DepGraphClearDirty(DepGraph* graph) {
+	for (u32 i = 0; i < graph->dirtysize; i++) {
+		graph->nodes[graph->dirty[i]].flags &= ~(DN_DIRTY | DN_FRESH);
+	}
+	graph->dirtysize = 0;
+	graph->refreshed = 0;
+}
+
+// Replaces every precedent edge of a node
+void DepGraphSetPrecedents(DepGraph* graph, u32 id, v2u* prec, u32 count,
+						   u32 isvolatile) {
+	DepNode* node = &graph->nodes[id];
+
+	for (u32 i = 0; i < node->psize; i++) {
+		DepNode* p = &graph->nodes[node->prec[i]];
+		RemoveID(p->deps, &p->dsize, id);
+	}
+	node->psize = 0;
+
+	for (u32 i = 0; i < count; i++) {
+		// NOTE: creating a node can move the node array
+		u32 pid = DepGraphNode(graph, prec[i]);
+		node = &graph->nodes[id];
+
+		u32 seen = 0;
+		for (u32 j = 0; j < node->psize; j++) {
+			if (node->prec[j] == pid) {
+				seen = 1;
+				break;
+			}
+		}
+		if (seen)
+			continue;
+
+		PushID(graph->mem, &node->prec, &node->psize, &node->pcap, pid);
+
+		DepNode* p = &graph->nodes[pid];
+		PushID(graph->mem, &p->deps, &p->dsize, &p->dcap, id);
+	}
+
+	node = &graph->nodes[id];
+	if (isvolatile && !(node->flags & DN_VOLATILE)) {
+		PushID(graph->mem, &graph->volatiles, &graph->vsize, &graph->vcap, id);
+	}
+
+	if (isvolatile)
+		node->flags |= DN_VOLATILE;
+	else
+		node->flags &= ~DN_VOLATILE;
+}
+
+/*
++---------------------------------------------------+
+|   INFO:                                           |
+|   Range index. Ranges are kept in an array sorted |
+|   by their first row, and the array doubles as a  |
+|   balanced binary tree: the node at index i sits  |
+|   at the level of its number of trailing 1 bits,  |
+|   so leaves are the even indices and the root is  |
+|   2^k - 1. Each entry keeps the largest last row  |
+|   below it, which lets a query skip any subtree   |
+|   that ends above the cell. A query is O(log n)   |
+|   plus the ranges it finds. Columns are only      |
+|   checked on the hits.                            |
+|                                                   |
+|   Edits don't touch the tree. Replacing a         |
+|   formula moves its node's rgen on, which leaves  |
+|   its old entries dead, and new entries go after  |
+|   the tree where every query scans them. Once     |
+|   about sqrt(n) of them have piled up, or half    |
+|   the entries are dead, the next query rebuilds:  |
+|   the live tree entries are still in order, so    |
+|   only the new ones are sorted and merged in.     |
++---------------------------------------------------+
+*/
+
+void DepGraphSetRanges(DepGraph* graph, u32 id, v2u* ranges, u32 count) {
+	DepNode* node = &graph->nodes[id];
+	if (!count && !(node->flags & DN_RANGES))
+		return;
+
+	node->rgen++;
+	if (count)
+		node->flags |= DN_RANGES;
+	else
+		node->flags &= ~DN_RANGES;
+	graph->rdead += node->rlive;
+	node->rlive = count;
+
+	for (u32 i = 0; i < count; i++) {
+		if (graph->rsize + 1 > graph->rcap) {
+			u32 oldsize = graph->rcap;
+			graph->rcap = graph->rcap ? graph->rcap * 2 : 16;
+			graph->ranges = Realloc(graph->mem, graph->ranges, oldsize * sizeof(DepRange),
+									graph->rcap * sizeof(DepRange));
+		}
+		graph->ranges[graph->rsize++] = (DepRange){
+			.lo = ranges[2 * i],
+			.hi = ranges[2 * i + 1],
+			.node = id,
+			.gen = node->rgen,
+		};
+	}
+}
+
+static int CompareRange(const void* a, const void* b) {
+	u32 x = ((const DepRange*)a)->lo.y;
+	u32 y = ((const DepRange*)b)->lo.y;
+	return (x > y) - (x < y);
+}
+
+static u32 RangeLive(DepGraph* graph, DepRange* r) {
+	return r->gen == graph->nodes[r->node].rgen;
+}
+
+static void RangeIndexBuild(DepGraph* graph) {
+	DepRange* a = graph->ranges;
+	u32 n = 0, built = 0;
+	for (u32 i = 0; i < graph->rsize; i++) {
+		if (RangeLive(graph, &a[i]))
+			a[n++] = a[i];
+		if (i + 1 == graph->rbuilt)
+			built = n;
+	}
+	graph->rsize = graph->rbuilt = n;
+	graph->rdead = 0;
+	graph->rlevels = 0;
+	if (!n)
+		return;
+
+	// the tree part is still sorted, the new entries are sorted on
+	// their own and merged in from the back
+	u32 added = n - built;
+	if (added) {
+		qsort(a + built, added, sizeof(DepRange), CompareRange);
+		DepRange* tail = Alloc(graph->mem, added * sizeof(DepRange));
+		memcpy(tail, a + built, added * sizeof(DepRange));
+		u32 i = built, j = added, k = n;
+		while (j) {
+			if (i && a[i - 1].lo.y > tail[j - 1].lo.y)
+				a[--k] = a[--i];
+			else
+				a[--k] = tail[--j];
+		}
+		Free(graph->mem, tail, added * sizeof(DepRange));
+	}
+
+	// leaves first, then every level from the bottom up. `last` is the
+	// max of the rightmost subtree built so far, which stands in for
+	// right children past the end of the array.
+	u32 last = 0, lasti = 0;
+	for (u32 i = 0; i < n; i += 2) {
+		a[i].max = a[i].hi.y;
+		last = a[i].max;
+		lasti = i;
+	}
+
+	u32 k = 1;
+	for (; (u64)1 << k <= n; k++) {
+		u32 x = 1u << (k - 1);
+		for (u32 i = (x << 1) - 1; i < n; i += x << 2) {
+			u32 left = a[i - x].max;
+			u32 right = i + x < n ? a[i + x].max : last;
+			a[i].max = MAX(a[i].hi.y, MAX(left, right));
+		}
+		lasti = (lasti >> k & 1) ? lasti : lasti + x;
+		if (lasti < n && a[lasti].max > last)
+			last = a[lasti].max;
+	}
+	graph->rlevels = k - 1;
+}
+
+// subtree rooted at x on level k, right is set once its left half
+// has been pushed
+typedef struct RangeFrame {
+	u32 k;
+	u32 x;
+	u32 right;
+} RangeFrame;
+
+static void RangeHit(DepGraph* graph, DepRange* r, v2u pos, u32** ids, u32* size, u32* cap) {
+	if (r->hi.y >= pos.y && r->lo.x <= pos.x && pos.x <= r->hi.x && RangeLive(graph, r))
+		PushID(graph->mem, ids, size, cap, r->node);
+}
+
+// How many entries can wait outside the tree, about sqrt(n) so that
+// the scans and the O(n) rebuilds cost about the same per edit
+static u32 RangeTailLimit(u32 n) {
+	u32 limit = 32;
+	while ((u64)limit * limit < n)
+		limit *= 2;
+	return limit;
+}
+
+void DepGraphCovering(DepGraph* graph, v2u pos, u32** ids, u32* size, u32* cap) {
+	if (graph->rsize - graph->rbuilt > RangeTailLimit(graph->rbuilt) ||
+		graph->rdead > graph->rsize / 2)
+		RangeIndexBuild(graph);
+
+	DepRange* a = graph->ranges;
+	for (u32 i = graph->rbuilt; i < graph->rsize; i++) {
+		if (a[i].lo.y <= pos.y)
+			RangeHit(graph, &a[i], pos, ids, size, cap);
+	}
+
+	u32 n = graph->rbuilt;
+	if (!n)
+		return;
+
+	RangeFrame stack[64];
+	u32 top = 0;
+	stack[top++] = (RangeFrame){graph->rlevels, (1u << graph->rlevels) - 1, 0};
+
+	while (top) {
+		RangeFrame z = stack[--top];
+
+		if (z.k <= 3) {
+			// small subtrees are cheaper to scan in order
+			u32 i0 = z.x >> z.k << z.k;
+			u32 i1 = MIN(i0 + (1u << (z.k + 1)) - 1, n);
+			for (u32 i = i0; i < i1 && a[i].lo.y <= pos.y; i++)
+				RangeHit(graph, &a[i], pos, ids, size, cap);
+		} else if (!z.right) {
+			u32 left = z.x - (1u << (z.k - 1));
+			stack[top++] = (RangeFrame){z.k, z.x, 1};
+			if (left >= n || a[left].max >= pos.y)
+				stack[top++] = (RangeFrame){z.k - 1, left, 0};
+		} else if (z.x < n && a[z.x].lo.y <= pos.y) {
+			RangeHit(graph, &a[z.x], pos, ids, size, cap);
+			stack[top++] = (RangeFrame){z.k - 1, z.x + (1u << (z.k - 1)), 0};
+		}
+	}
+}
+
+static void AddToCone(DepGraph* graph, u32 id) {
+	if (graph->nodes[id].mark == graph->serial)
+		return;
+	graph->nodes[id].mark = graph->serial;
+	PushID(graph->mem, &graph->order, &graph->osize, &graph->ocap, id);
+}
+
+// Collects the dirty cells, every volatile cell and all of their
+// transitive dependents (through ranges too) into graph->order,
+// sorted topologically.
+// Cells stuck in (or behind) a cycle end up after graph->ordered.
+void DepGraphOrder(DepGraph* graph) {
+	DepGraphOrderBegin(graph);
+	u32 budget = UINT32_MAX;
+	while (!DepGraphOrderStep(graph, &budget))
+		budget = UINT32_MAX;
+}
+
+/*
++---------------------------------------------------+
+|   INFO:                                           |
+|   The order is built in stages, each a pass over  |
+|   one array that DepGraphOrderStep can leave      |
+|   after any entry:                                |
+|                                                   |
+|   - seed the cone with the volatile formulas,     |
+|     dropping stale entries as it goes, and then   |
+|     with the dirty cells                          |
+|   - walk the dependents breadth first             |
+|   - count the in degrees. Every dependent of a    |
+|     cone node is in the cone, so only cone edges  |
+|     count.                                        |
+|   - Kahn's algorithm into graph->queue, which     |
+|     also pushes the levels forward                |
+|   - append what is left, the cycles               |
+|                                                   |
+|   The cone is marked with graph->serial, so a new |
+|   DepGraphOrderBegin just starts over.            |
++---------------------------------------------------+
+*/
+
+enum {
+	ORDER_VOLATILES,
+	ORDER_DIRTY,
+	ORDER_WALK,
+	ORDER_RESET,
+	ORDER_COUNT,
+	ORDER_ROOTS,
+	ORDER_KAHN,
+	ORDER_CYCLES,
+	ORDER_DONE,
+};
+
+void DepGraphOrderBegin(DepGraph* graph) {
+	graph->serial++;
+	graph->osize = 0;
+	graph->ordered = 0;
+	graph->levels = 0;
+	graph->rdsize = 0;
+
+	graph->ostage = ORDER_VOLATILES;
+	graph->onext = 0;
+	graph->okeep = 0;
+	// left over from an order that was started over
+	Free(graph->mem, graph->queue, graph->qcap * sizeof(u32));
+	graph->queue = NULL;
+	graph->qsize = 0;
+	graph->qcap = 0;
+}
+
+static void NextStage(DepGraph* graph) {
+	graph->ostage++;
+	graph->onext = 0;
+}
+
+static void PushQueue(DepGraph* graph, u32 id) {
+	graph->queue[graph->qsize++] = id;
+}
+
+u32 DepGraphOrderStep(DepGraph* graph, u32* budget) {
+	while (*budget && graph->ostage != ORDER_DONE) {
+		u32 i = graph->onext++;
+		u32 cost = 1;
+
+		switch (graph->ostage) {
+			case ORDER_VOLATILES: {
+				if (i == graph->vsize) {
+					graph->vsize = graph->okeep;
+					NextStage(graph);
+					break;
+				}
+				u32 id = graph->volatiles[i];
+				DepNode* node = &graph->nodes[id];
+				if (!(node->flags & DN_VOLATILE) || node->mark == graph->serial)
+					break;
+				graph->volatiles[graph->okeep++] = id;
+				AddToCone(graph, id);
+			} break;
+
+			case ORDER_DIRTY:
+				if (i == graph->dirtysize)
+					NextStage(graph);
+				else
+					AddToCone(graph, graph->dirty[i]);
+				break;
+
+			case ORDER_WALK: {
+				if (i == graph->osize) {
+					if (graph->osize)
+						NextStage(graph);
+					else
+						graph->ostage = ORDER_DONE;
+					break;
+				}
+				DepNode* node = &graph->nodes[graph->order[i]];
+				for (u32 j = 0; j < node->dsize; j++) {
+					AddToCone(graph, node->deps[j]);
+					node = &graph->nodes[graph->order[i]];
+				}
+
+				node->rfirst = graph->rdsize;
+				DepGraphCovering(graph, node->pos, &graph->rdeps, &graph->rdsize, &graph->rdcap);
+				node->rcount = graph->rdsize - node->rfirst;
+				for (u32 j = node->rfirst; j < graph->rdsize; j++) {
+					AddToCone(graph, graph->rdeps[j]);
+				}
+				cost += node->dsize + node->rcount;
+			} break;
+
+			case ORDER_RESET:
+				if (i == graph->osize) {
+					NextStage(graph);
+					break;
+				}
+				graph->nodes[graph->order[i]].indeg = 0;
+				graph->nodes[graph->order[i]].level = 0;
+				break;
+
+			case ORDER_COUNT: {
+				if (i == graph->osize) {
+					graph->qcap = graph->ocap;
+					graph->queue = Alloc(graph->mem, graph->qcap * sizeof(u32));
+					NextStage(graph);
+					break;
+				}
+				DepNode* node = &graph->nodes[graph->order[i]];
+				for (u32 j = 0; j < node->dsize; j++) {
+					graph->nodes[node->deps[j]].indeg++;
+				}
+				for (u32 j = node->rfirst; j < node->rfirst + node->rcount; j++) {
+					graph->nodes[graph->rdeps[j]].indeg++;
+				}
+				cost += node->dsize + node->rcount;
+			} break;
+
+			case ORDER_ROOTS:
+				if (i == graph->osize)
+					NextStage(graph);
+				else if (!graph->nodes[graph->order[i]].indeg)
+					PushQueue(graph, graph->order[i]);
+				break;
+
+			case ORDER_KAHN: {
+				if (i == graph->qsize) {
+					graph->ordered = graph->qsize;
+					NextStage(graph);
+					break;
+				}
+				// a node comes off the queue after all of its
+				// precedents, so its level is final by then
+				DepNode* node = &graph->nodes[graph->queue[i]];
+				u32 level = node->level + 1;
+				graph->levels = MAX(graph->levels, level);
+				for (u32 j = 0; j < node->dsize; j++) {
+					DepNode* d = &graph->nodes[node->deps[j]];
+					d->level = MAX(d->level, level);
+					if (--d->indeg == 0)
+						PushQueue(graph, node->deps[j]);
+				}
+				for (u32 j = node->rfirst; j < node->rfirst + node->rcount; j++) {
+					DepNode* d = &graph->nodes[graph->rdeps[j]];
+					d->level = MAX(d->level, level);
+					if (--d->indeg == 0)
+						PushQueue(graph, graph->rdeps[j]);
+				}
+				cost += node->dsize + node->rcount;
+			} break;
+
+			case ORDER_CYCLES:
+				if (i < graph->osize) {
+					if (graph->nodes[graph->order[i]].indeg)
+						PushQueue(graph, graph->order[i]);
+					break;
+				}
+				Free(graph->mem, graph->order, graph->ocap * sizeof(u32));
+				graph->order = graph->queue;
+				graph->ocap = graph->qcap;
+				graph->queue = NULL;
+				graph->qsize = 0;
+				graph->qcap = 0;
+				graph->ostage = ORDER_DONE;
+				break;
+		}
+
+		*budget -= MIN(cost, *budget);
+	}
+	return graph->ostage == ORDER_DONE;
+}
+
+// The dependents of a node, first the direct ones then the ones
+// reading it through a range
+static u32 EdgeCount(DepNode* node) {
+	return node->dsize + node->rcount;
+}
+
+static u32 EdgeGet(DepGraph* graph, DepNode* node, u32 e) {
+	return e < node->dsize ? node->deps[e] : graph->rdeps[node->rfirst + e - node->dsize];
+}
+
+/*
++---------------------------------------------------+
+|   INFO: Strongly connected components             |
+|                                                   |
+|   Tarjan's algorithm over the part of the cone    |
+|   Kahn's algorithm couldn't order, run with an    |
+|   explicit stack of frames like the evaluator so  |
+|   a long chain behind a cycle can't overflow the  |
+|   C stack. Every dependent of a stuck node is     |
+|   stuck too, so the walk never leaves the tail.   |
+|                                                   |
+|   Following dependents, a component is finished   |
+|   only after everything downstream of it, so the  |
+|   components come out last to first and are put   |
+|   back in order from the end.                     |
++---------------------------------------------------+
+*/
+
+u32 DepGraphComponents(DepGraph* graph, u32** starts) {
+	Allocator mem = graph->mem;
+	u32* tail = graph->order + graph->ordered;
+	u32 n = graph->osize - graph->ordered;
+
+	*starts = NULL;
+	if (!n)
+		return 0;
+
+	// indeg is free after Kahn's algorithm and nonzero for exactly the
+	// stuck nodes, it now holds their slot in the tail + 1
+	for (u32 k = 0; k < n; k++)
+		graph->nodes[tail[k]].indeg = k + 1;
+
+	u32* index = Alloc(mem, n * sizeof(u32));
+	u32* low = Alloc(mem, n * sizeof(u32));
+	u32* edge = Alloc(mem, n * sizeof(u32));
+	u32* onstack = Alloc(mem, n * sizeof(u32));
+	u32* stack = Alloc(mem, n * sizeof(u32));
+	u32* frames = Alloc(mem, n * sizeof(u32));
+	u32* result = Alloc(mem, n * sizeof(u32));
+	u32* bounds = Alloc(mem, (n + 1) * sizeof(u32));
+	memset(index, 0xFF, n * sizeof(u32));
+	memset(onstack, 0, n * sizeof(u32));
+
+	u32 counter = 0, ssize = 0, fsize = 0;
+	u32 fill = n, count = 0;
+
+	for (u32 root = 0; root < n; root++) {
+		if (index[root] != UINT32_MAX)
+			continue;
+
+		index[root] = low[root] = counter++;
+		edge[root] = 0;
+		stack[ssize++] = root;
+		onstack[root] = 1;
+		frames[fsize++] = root;
+
+		while (fsize) {
+			u32 k = frames[fsize - 1];
+			DepNode* node = &graph->nodes[tail[k]];
+
+			if (edge[k] < EdgeCount(node)) {
+				DepNode* d = &graph->nodes[EdgeGet(graph, node, edge[k]++)];
+				if (d->mark != graph->serial || !d->indeg)
+					continue;
+
+				u32 j = d->indeg - 1;
+				if (index[j] == UINT32_MAX) {
+					index[j] = low[j] = counter++;
+					edge[j] = 0;
+					stack[ssize++] = j;
+					onstack[j] = 1;
+					frames[fsize++] = j;
+				} else if (onstack[j]) {
+					low[k] = MIN(low[k], index[j]);
+				}
+				continue;
+			}
+
+			fsize--;
+			if (fsize) {
+				u32 parent = frames[fsize - 1];
+				low[parent] = MIN(low[parent], low[k]);
+			}
+			if (low[k] != index[k])
+				continue;
+
+			// k is the root of a component, which is everything
+			// above it on the stack
+			u32 j;
+			do {
+				j = stack[--ssize];
+				onstack[j] = 0;
+				result[--fill] = tail[j];
+			} while (j != k);
+			bounds[count++] = fill;
+		}
+	}
+
+	// bounds were found last to first as well
+	for (u32 i = 0; i < count / 2; i++) {
+		u32 t = bounds[i];
+		bounds[i] = bounds[count - 1 - i];
+		bounds[count - 1 - i] = t;
+	}
+	for (u32 i = 0; i < count; i++)
+		bounds[i] += graph->ordered;
+	bounds[count] = graph->osize;
+
+	memcpy(tail, result, n * sizeof(u32));
+
+	Free(mem, index, n * sizeof(u32));
+	Free(mem, low, n * sizeof(u32));
+	Free(mem, edge, n * sizeof(u32));
+	Free(mem, onstack, n * sizeof(u32));
+	Free(mem, stack, n * sizeof(u32));
+	Free(mem, frames, n * sizeof(u32));
+	Free(mem, result, n * sizeof(u32));
+
+	*starts = bounds;
+	return count;
+}
+
+u32 DepGraphOnCycle(DepGraph* graph, u32 first, u32 size) {
+	if (size > 1)
+		return 1;
+
+	u32 id = graph->order[first];
+	DepNode* node = &graph->nodes[id];
+	for (u32 e = 0; e < EdgeCount(node); e++) {
+		if (EdgeGet(graph, node, e) == id)
+			return 1;
+	}
+	return 0;
+}
+
+void DepGraphFree(DepGraph* graph) {
+	if (!graph->mem.a)
+		return;
+
+	for (u32 i = 0; i < graph->nsize; i++) {
+		DepNode* node = &graph->nodes[i];
+		Free(graph->mem, node->prec, node->pcap * sizeof(u32));
+		Free(graph->mem, node->deps, node->dcap * sizeof(u32));
+	}
+
+	Free(graph->mem, graph->nodes, graph->ncap * sizeof(DepNode));
+	Free(graph->mem, graph->keys, graph->cap * sizeof(v2u));
+	Free(graph->mem, graph->values, graph->cap * sizeof(u32));
+	Free(graph->mem, graph->dirty, graph->dirtycap * sizeof(u32));
+	Free(graph->mem, graph->volatiles, graph->vcap * sizeof(u32));
+	Free(graph->mem, graph->ranges, graph->rcap * sizeof(DepRange));
+	Free(graph->mem, graph->rdeps, graph->rdcap * sizeof(u32));
+	Free(graph->mem, graph->order, graph->ocap * sizeof(u32));
+	Free(graph->mem, graph->queue, graph->qcap * sizeof(u32));
+	*graph = (DepGraph){.mem = graph->mem};
+}
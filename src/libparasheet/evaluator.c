@@ -7,13 +7,16 @@
 #include <util/util.h>
 #include <assert.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 
 // Forward declarations
 static CellValue evaluateLiteral(ASTNode* node);
 static CellValue evaluateBinaryOp(AST* tree, ASTNode* node, EvalContext ctx);
 static CellValue evaluateCellRef(AST* tree, ASTNode* node, EvalContext ctx);
+static CellValue evaluateCall(AST* tree, ASTNode* node, EvalContext ctx);
 
 // Evaluator logic
 CellValue evaluateLiteral(ASTNode* node) {
@@ -35,15 +38,23 @@ CellValue evaluateLiteral(ASTNode* node) {
 static CellValue evaluateBinaryOp(AST* tree, ASTNode* node, EvalContext ctx) {
     CellValue lhs = evaluateNode(tree, node->lchild, ctx);
     CellValue rhs = evaluateNode(tree, node->mchild, ctx);
+    return EvalBinaryOp(node->op, lhs, rhs);
+}
+
+CellValue EvalBinaryOp(ASTNodeOp op, CellValue lhs, CellValue rhs) {
     CellValue result;
 
+    // errors (cycles, pending references) spread to whatever uses them
+    if (lhs.t == CT_ERROR) return lhs;
+    if (rhs.t == CT_ERROR) return rhs;
+
     bool isFloat = (lhs.t == CT_FLOAT || rhs.t == CT_FLOAT);
     result.t = isFloat ? CT_FLOAT : CT_INT;
 
-    float lf = lhs.t == CT_FLOAT ? lhs.d.f : (float)lhs.d.i;
-    float rf = rhs.t == CT_FLOAT ? rhs.d.f : (float)rhs.d.i;
+    CellFloat lf = lhs.t == CT_FLOAT ? lhs.d.f : (CellFloat)lhs.d.i;
+    CellFloat rf = rhs.t == CT_FLOAT ? rhs.d.f : (CellFloat)rhs.d.i;
 
-    switch (node->op) {
+    switch (op) {
         case AST_ADD:
             if (isFloat) result.d.f = lf + rf;
             else result.d.i = lhs.d.i + rhs.d.i;
@@ -60,16 +71,13 @@ static CellValue evaluateBinaryOp(AST* tree, ASTNode* node, EvalContext ctx) {
             break;
 
         case AST_DIV:
-            if (rf == 0.0f) {
-                fprintf(stderr, "Divide by zero\n");
-                exit(1);
-            }
+            if (rf == 0.0f) return (CellValue){.t = CT_ERROR, .d.i = CE_DIV0};
             if (isFloat) result.d.f = lf / rf;
             else result.d.i = lhs.d.i / rhs.d.i;
             break;
 
         default:
-            fprintf(stderr, "Unknown binary op: %u\n", node->op);
+            fprintf(stderr, "Unknown binary op: %u\n", op);
 			exit(1);
     }
 
@@ -77,6 +85,34 @@ static CellValue evaluateBinaryOp(AST* tree, ASTNode* node, EvalContext ctx) {
 }
 
 
+// Typed ops from ASTOptimize, both operands are known to be of the
+// op's type so the tags aren't looked at
+static CellValue evaluateTypedOp(AST* tree, ASTNode* node, EvalContext ctx) {
+    CellValue lhs = evaluateNode(tree, node->lchild, ctx);
+    CellValue rhs = evaluateNode(tree, node->mchild, ctx);
+
+    switch (node->op) {
+        case AST_ADD_INT: return (CellValue){.t = CT_INT, .d.i = lhs.d.i + rhs.d.i};
+        case AST_SUB_INT: return (CellValue){.t = CT_INT, .d.i = lhs.d.i - rhs.d.i};
+        case AST_MUL_INT: return (CellValue){.t = CT_INT, .d.i = lhs.d.i * rhs.d.i};
+        case AST_DIV_INT:
+            if (rhs.d.i == 0) break;
+            return (CellValue){.t = CT_INT, .d.i = lhs.d.i / rhs.d.i};
+
+        case AST_ADD_FLOAT: return (CellValue){.t = CT_FLOAT, .d.f = lhs.d.f + rhs.d.f};
+        case AST_SUB_FLOAT: return (CellValue){.t = CT_FLOAT, .d.f = lhs.d.f - rhs.d.f};
+        case AST_MUL_FLOAT: return (CellValue){.t = CT_FLOAT, .d.f = lhs.d.f * rhs.d.f};
+        case AST_DIV_FLOAT:
+            if (rhs.d.f == 0.0f) break;
+            return (CellValue){.t = CT_FLOAT, .d.f = lhs.d.f / rhs.d.f};
+
+        default:
+            panic();
+    }
+
+    return (CellValue){.t = CT_ERROR, .d.i = CE_DIV0};
+}
+
 // Core evaluator function that dispatches based on AST node type
 CellValue evaluateNode(AST* tree, u32 index, EvalContext ctx) {
     ASTNode* node = &ASTGet(tree, index);
@@ -89,12 +125,42 @@ CellValue evaluateNode(AST* tree, u32 index, EvalContext ctx) {
         case AST_GET_CELL_REF:
             return evaluateCellRef(tree, node, ctx);
 
+        case AST_CALL:
+            return evaluateCall(tree, node, ctx);
+
+        case AST_RANGE:
+            // only meaningful as an argument to an aggregate
+            return (CellValue){.t = CT_ERROR, .d.i = CE_NONE};
+
+        case AST_COORD_TRANSFORM:
+            // only meaningful as a reference coordinate
+            return (CellValue){.t = CT_ERROR, .d.i = CE_NONE};
+
         case AST_ADD:
         case AST_SUB:
         case AST_MUL:
         case AST_DIV:
             return evaluateBinaryOp(tree, node, ctx);
 
+        case AST_ADD_INT:
+        case AST_SUB_INT:
+        case AST_MUL_INT:
+        case AST_DIV_INT:
+        case AST_ADD_FLOAT:
+        case AST_SUB_FLOAT:
+        case AST_MUL_FLOAT:
+        case AST_DIV_FLOAT:
+            return evaluateTypedOp(tree, node, ctx);
+
+        case AST_INT_TO_FLOAT: {
+            CellValue v = evaluateNode(tree, node->lchild, ctx);
+            return (CellValue){.t = CT_FLOAT, .d.f = (CellFloat)v.d.i};
+        }
+        case AST_FLOAT_TO_INT: {
+            CellValue v = evaluateNode(tree, node->lchild, ctx);
+            return (CellValue){.t = CT_INT, .d.i = (i32)v.d.f};
+        }
+
         case AST_SEQ: {
             // Evaluate lchild and mchild sequentially; return result of mchild
             CellValue a = evaluateNode(tree, node->lchild, ctx);
@@ -111,8 +177,9 @@ CellValue evaluateNode(AST* tree, u32 index, EvalContext ctx) {
 
             if (cond)
                 return evaluateNode(tree, node->mchild, ctx);  // then branch
-            else
-                return evaluateNode(tree, node->rchild, ctx);  // else branch
+            if (node->rchild == UINT32_MAX)
+                return (CellValue){0};  // no else branch
+            return evaluateNode(tree, node->rchild, ctx);  // else branch
         }
 
         case AST_RETURN:
@@ -120,8 +187,8 @@ CellValue evaluateNode(AST* tree, u32 index, EvalContext ctx) {
 
         case AST_WHILE:
         case AST_FOR:
-            fprintf(stderr, "Control flow '%u' not implemented yet\n", node->op);
-            exit(1);
+            // loops aren't implemented yet
+            return (CellValue){.t = CT_ERROR, .d.i = CE_NONE};
 
         case AST_DECLARE_VARIABLE:
             {
@@ -153,16 +220,15 @@ CellValue evaluateNode(AST* tree, u32 index, EvalContext ctx) {
 
                 if (e.data.t == rhs.t) {
                     e.data = rhs;
-                    SymbolInsert(ctx.table, var, e);
-                    return e.data;
-                }
-
-                if (e.data.t == CT_INT) {
+                } else if (e.data.t == CT_INT) {
                     e.data.d.i = (i32)rhs.d.f;
                 } else if (e.data.t == CT_FLOAT) {
-                    e.data.d.f = (f32)rhs.d.i;
+                    e.data.d.f = (CellFloat)rhs.d.i;
                 }
 
+                // NOTE: the variable may live in an enclosing scope,
+                // inserting would shadow it instead of assigning
+                SymbolSet(ctx.table, var, e);
                 return e.data;
             } break;
         case AST_ID:
@@ -197,99 +263,1622 @@ CellValue evaluateNode(AST* tree, u32 index, EvalContext ctx) {
     }
 }
 
+// Looks up the compiled formula for a code cell, building and caching
+// it on a miss. The cache lives on the source sheet and owns the AST
+// and the code, which sources with the same tree once anchored share.
+static Formula compileFormula(SpreadSheet* srcSheet, StringTable* strTable, StrID source,
+                              v2u pos) {
+    FormulaCache* cache = &srcSheet->formulas;
+    if (!cache->mem.a) cache->mem = srcSheet->mem;
+
+    FormulaSource* cached = FormulaCacheGet(cache, source);
+    if (!cached) {
+        SString input = StringGet(strTable, source);
+
+        // invoke the tokenizer
+        TokenList* tokens = Tokenize((const char*)input.data, strTable, srcSheet->mem);
+        // run the parser on the tokens
+        AST ast = BuildASTFromTokens(tokens, strTable, srcSheet->mem);
+        DestroyTokenList(&tokens);
+
+        // NOTE: failed parses are cached too (as an empty tree) so a broken
+        // formula doesn't get re-lexed every time something references it.
+        ast.mem = srcSheet->mem;
+        ASTOptimize(&ast);
+
+        FormulaSource entry = {0};
+        entry.anchored = ASTAnchor(&ast, &entry.anchor);
+        u32 refs = ASTNumberRefs(&ast);
+
+        u64 hash = ASTHash(&ast);
+        entry.template = FormulaTemplateFind(cache, &ast, hash);
+        if (entry.template == UINT32_MAX) {
+            Formula formula = {.ast = ast, .code = {.mem = srcSheet->mem}, .refs = refs};
+            BCCompile(&formula.ast, &formula.code);
+            entry.template = FormulaTemplateAdd(cache, formula, hash);
+        } else {
+            ASTFree(&ast);
+        }
+        cached = FormulaCacheInsert(cache, source, entry);
+    }
+
+    // NOTE: lookups only happen on the thread that owns the sheet,
+    // the parallel path compiles before it hands out copies
+    Formula* template = &cache->templates[cached->template];
+    // runs stops at UINT32_MAX, so it never wraps around to a
+    // threshold of 0 (no JIT) or compiles a second time
+    if (template->runs < UINT32_MAX && ++template->runs == JitThreshold()) {
+        JitCompile(&template->ast, &template->jit);
+    }
+
+    Formula formula = *template;
+    formula.anchor = cached->anchored ? cached->anchor : pos;
+    formula.handles = cached->handles;
+    return formula;
+}
+
+static CellValue walkFormula(Formula* formula, EvalContext ctx) {
+    // NOTE: The parser closes the top level block with a
+    // scope end but never opens it, so the scope is pushed here.
+    u32 depth = ctx.table->size;
+    SymbolPushScope(ctx.table);
+
+    AST* ast = &formula->ast;
+    CellValue result = evaluateNode(ast, ast->size - 1, ctx);
+
+    while (ctx.table->size > depth) SymbolPopScope(ctx.table);
+    return result;
+}
+
+// Runs a compiled formula on the fastest tier that took it: native
+// code that never calls back into the walker, then the bytecode, then
+// native code with walked subtrees, and last the tree walker itself
+static CellValue runFormula(Formula* formula, EvalContext ctx) {
+    ctx.anchor = formula->anchor;
+    ctx.handles = formula->handles;
+
+    JitCode* jit = &formula->jit;
+    if (jit->code && (!jit->walks || !formula->code.size)) {
+        CellValue result = JitRun(jit, &formula->ast, ctx);
+        if (JitChecking()) {
+            CellValue want = walkFormula(formula, ctx);
+            if (want.t != result.t || want.d.i != result.d.i) {
+                err("JIT result %d/%d differs from the tree walker %d/%d\n",
+                    result.t, result.d.i, want.t, want.d.i);
+                panic();
+            }
+        }
+        return result;
+    }
+
+    if (formula->code.size) return BCRun(&formula->code, ctx);
+    return walkFormula(formula, ctx);
+}
+
+static bool isFormula(CellValue* cell) {
+    return cell && (cell->t == CT_TEXT || cell->t == CT_CODE);
+}
+
+// Done in this pass, or (with a Recalc under way) outside the cells it
+// has to redo, which are already up to date in outSheet
+static bool upToDate(EvalContext ctx, v2u pos) {
+    if (SheetCellDone(ctx.srcSheet, pos, ctx.epoch)) return true;
+    if (!ctx.cone) return false;
+
+    u32 id = DepGraphFind(ctx.cone, pos);
+    return id == UINT32_MAX || ctx.cone->nodes[id].mark != ctx.cone->serial;
+}
+
+static void stackPush(EvalStack* stack, v2u pos) {
+    if (stack->size + 1 > stack->cap) {
+        u32 oldsize = stack->cap;
+        stack->cap = stack->cap ? stack->cap * 2 : 64;
+        stack->data = Realloc(stack->mem, stack->data, oldsize * sizeof(v2u),
+                              stack->cap * sizeof(v2u));
+    }
+    stack->data[stack->size++] = pos;
+}
+
+// true if pos was pushed after index `from`
+static bool stackPushedSince(EvalStack* stack, u32 from, v2u pos) {
+    for (u32 i = from; i < stack->size; i++) {
+        if (CMPV2(stack->data[i], pos)) return true;
+    }
+    return false;
+}
+
+// The busy entries on the stack are exactly the chain of cells currently
+// being evaluated, so reaching a busy cell again means every busy entry
+// from it up to the top is part of a cycle.
+static void markCycle(EvalContext ctx, v2u pos) {
+    EvalStack* stack = ctx.stack;
+
+    i32 start = stack->size - 1;
+    while (start >= 0) {
+        if (CMPV2(stack->data[start], pos)) break;
+        start--;
+    }
+    if (start < 0) panic();
+
+    warn("reference cycle through cell [%d, %d]", pos.x, pos.y);
+
+    for (u32 i = start; i < stack->size; i++) {
+        v2u p = stack->data[i];
+        if (!SheetCellBusy(ctx.srcSheet, p, ctx.epoch)) continue;
+
+        SpreadSheetSetCell(ctx.outSheet, p, (CellValue){.t = CT_ERROR, .d.i = CE_CYCLE});
+        SheetCellSetDone(ctx.srcSheet, p, ctx.epoch);
+    }
+}
+
+// Tries to evaluate the formula cell on top of the stack. If some of its
+// precedents aren't done yet they are pushed above it instead, and the
+// cell is tried again once they are.
+static void evaluateTop(EvalContext ctx, v2u pos, CellValue* sourceCell) {
+    SpreadSheet* srcSheet = ctx.srcSheet;
+    EvalStack* stack = ctx.stack;
+
+    bool first = !SheetCellBusy(srcSheet, pos, ctx.epoch);
+    SheetCellSetBusy(srcSheet, pos, ctx.epoch);
+
+    // get (or build) the AST for it
+    Formula formula = compileFormula(srcSheet, ctx.str, sourceCell->d.index, pos);
+    AST ast = formula.ast;
+    if (!ast.size) {
+        // error checking
+        SheetCellSetDone(srcSheet, pos, ctx.epoch);
+        return;
+    }
+
+    // Constant references are known up front, so schedule all of them
+    // before evaluating instead of finding them one restart at a time.
+    if (!ctx.ordered) {
+        u32 round = stack->size;
+        bool waiting = false;
+
+        for (u32 i = 0; i < ast.size; i++) {
+            ASTNode* node = &ASTGet(&ast, i);
+            if (node->op != AST_GET_CELL_REF) continue;
+
+            v2u ref;
+            if (!EvalConstRef(&ast, node, formula.anchor, &ref)) continue;
+            if (!isFormula(SpreadSheetGetCell(srcSheet, ref))) continue;
+
+            if (upToDate(ctx, ref)) {
+                if (first) srcSheet->avoided++;
+                continue;
+            }
+
+            if (SheetCellBusy(srcSheet, ref, ctx.epoch)) {
+                markCycle(ctx, ref);
+                return;
+            }
+
+            if (stackPushedSince(stack, round, ref)) {
+                if (first) srcSheet->avoided++;
+            } else {
+                stackPush(stack, ref);
+            }
+            waiting = true;
+        }
+
+        if (waiting) return;
+    }
+
+    // run the evaluator on the ast
+    stack->blocked = false;
+    CellValue result = runFormula(&formula, ctx);
+
+    // a computed reference hit a cell that isn't done, try again later
+    // (unless that closed a cycle, which already set the error)
+    if (stack->blocked) return;
+
+    SpreadSheetSetCell(ctx.outSheet, pos, result);
+    SheetCellSetDone(srcSheet, pos, ctx.epoch);
+}
+
 // clarise TODO: add error checking, somehow?
 // maybe create a new cell value of "#ERROR!" lol
-// Evaluates a single cell in the spreadsheet, recursively if needed
+// Evaluates a single cell in the spreadsheet along with anything it
+// references. References are followed with an explicit stack rather
+// than recursion so long chains don't run out of C stack.
 void EvaluateCell(EvalContext ctx) {
 
     SpreadSheet* srcSheet = ctx.srcSheet;
-    SpreadSheet* inSheet = ctx.inSheet;
     SpreadSheet* outSheet = ctx.outSheet; 
-	u32 cellX = ctx.currentX; 
-    u32 cellY = ctx.currentY; 
-    StringTable* strTable = ctx.str;
-    Allocator allocator = ctx.mem;
 
-    v2u pos = { cellX, cellY };
+    v2u pos = { ctx.currentX, ctx.currentY };
+
+    // every top level call is its own pass, nested ones share it
+    if (!ctx.epoch) ctx.epoch = SheetNewEpoch();
+
+    // shared precedents (diamonds, repeated refs) are only evaluated once
+    if (SheetCellDone(srcSheet, pos, ctx.epoch)) {
+        srcSheet->avoided++;
+        return;
+    }
 	
 	CellValue* sourceCell = SpreadSheetGetCell(srcSheet, pos);
 	// Eli's code checks for numbers at entry into sheet from file.
 	// cell knows if it is a number (int/float) or a string. parse string.
+    if (!sourceCell || sourceCell->t == CT_EMPTY) {
+        SpreadSheetClearCell(outSheet, pos);
+        return;
+    }
 
-    EvalContext evalContext = (EvalContext) {
-        .srcSheet = srcSheet,
-        .inSheet = inSheet,
-        .outSheet = outSheet,
-        .currentX = cellX,
-        .currentY = cellY
-    };
+    if (!isFormula(sourceCell)) {
+        SpreadSheetSetCell(outSheet, pos, *sourceCell);
+        SheetCellSetDone(srcSheet, pos, ctx.epoch);
+        return;
+    }
 
-	switch (sourceCell->t) {
-		case CT_INT: 
-		case CT_FLOAT:
-			SpreadSheetSetCell(outSheet, pos, *sourceCell);
-			break;
-		default:
-            {
+    EvalStack local = {.mem = ctx.mem};
+    if (!ctx.stack) ctx.stack = &local;
 
-                SString input = StringGet(strTable, sourceCell->d.index);
-
-                // is a string	
-                // invoke the tokenizer
-                TokenList* tokens = Tokenize((const char*)input.data, strTable, allocator);
-                //			if (tokens)
-                // run the parser on the tokens
-                AST ast = BuildASTFromTokens(tokens, strTable, allocator);
-                // run the evaluator on the ast
-                CellValue result = evaluateNode(&ast, ast.size - 1, evalContext);
-                SpreadSheetSetCell(outSheet, pos, result);
-                // error checking
-            } break;
-	}
-	/*
-    // If already evaluated, return
-    CellValue* outCell = SpreadSheetGetCell(outSheet, pos);
-    if (outCell->t != CT_EMPTY) return;
-
-    // Get formula/code from source sheet
-    CellValue* srcCell = SpreadSheetGetCell(srcSheet, pos);
-
-    // If it's not code (e.g. it's a literal value), just copy it directly
-    if (srcCell->t != CT_CODE) {
-        *outCell = *srcCell;
-        return;
+    EvalStack* stack = ctx.stack;
+    u32 base = stack->size;
+    stackPush(stack, pos);
+
+    while (stack->size > base) {
+        v2u top = stack->data[stack->size - 1];
+
+        // duplicates and cycle members can already be finished
+        if (SheetCellDone(srcSheet, top, ctx.epoch)) {
+            stack->size--;
+            continue;
+        }
+
+        // Only the requested cell can rely on the dependency order,
+        // anything pulled in by a computed reference may be early.
+        EvalContext topctx = ctx;
+        topctx.ordered = ctx.ordered && stack->size - 1 == base;
+        evaluateTop(topctx, top, SpreadSheetGetCell(srcSheet, top));
     }
 
-    // 🔧 Reconstruct AST* from StrID
-    uintptr_t raw = ((uintptr_t)srcCell->d.index.gen << 32) | srcCell->d.index.idx;
-    AST* tree = (AST*)raw;
+    if (stack == &local) {
+        Free(local.mem, local.data, local.cap * sizeof(v2u));
+    }
+}
 
-    if (!tree) return;
+u32 EvalRefCoord(CellValue v) {
+    return v.t == CT_FLOAT ? (u32)v.d.f : (u32)v.d.i;
+}
 
-    u32 rootIndex = tree->size - 1;  // Root is always the last node
-	*/
-    //EvalContext ctx = {
-    //    .srcSheet = srcSheet,
-    //    .inSheet = inSheet,
-    //    .outSheet = outSheet,
-    //    .currentX = cellX,
-    //    .currentY = cellY,
-    //};
+static bool constCoord(ASTNode* node, u32 anchor, u32* coord) {
+    if (node->op == AST_INT_LITERAL) {
+        *coord = node->data.i;
+        return true;
+    }
+    if (node->op == AST_COORD_TRANSFORM && node->lchild == UINT32_MAX) {
+        *coord = anchor + node->data.i;
+        return true;
+    }
+    return false;
+}
 
-    //// ✅ Declare and assign result before use
-    //CellValue result = evaluateNode(tree, rootIndex, &ctx);
-    //SpreadSheetSetCell(outSheet, pos, result);
+bool EvalConstRef(AST* tree, ASTNode* ref, v2u anchor, v2u* pos) {
+    return constCoord(&ASTGet(tree, ref->lchild), anchor.x, &pos->x) &&
+           constCoord(&ASTGet(tree, ref->mchild), anchor.y, &pos->y);
 }
 
+// One coordinate of a computed reference, `#` adds the anchor
+static u32 refCoord(AST* tree, u32 index, u32 anchor, EvalContext ctx) {
+    ASTNode* node = &ASTGet(tree, index);
+    if (node->op != AST_COORD_TRANSFORM) {
+        return EvalRefCoord(evaluateNode(tree, index, ctx));
+    }
+    if (node->lchild == UINT32_MAX) return anchor + node->data.i;
+
+    CellValue offset = evaluateNode(tree, node->lchild, ctx);
+    return anchor + (offset.t == CT_FLOAT ? (i32)offset.d.f : offset.d.i);
+}
 
+static v2u refPosition(AST* tree, ASTNode* ref, EvalContext ctx) {
+    return (v2u){
+        refCoord(tree, ref->lchild, ctx.anchor.x, ctx),
+        refCoord(tree, ref->mchild, ctx.anchor.y, ctx),
+    };
+}
 
 static CellValue evaluateCellRef(AST* tree, ASTNode* node, EvalContext ctx) {
-    ctx.currentX = ASTGet(tree, node->lchild).data.i;
-    ctx.currentY = ASTGet(tree, node->mchild).data.i;
+    v2u pos;
+    if (EvalConstRef(tree, node, ctx.anchor, &pos)) {
+        return EvalReadRef(ctx, pos, node->data.i);
+    }
+    return EvalReadCell(ctx, refPosition(tree, node, ctx), false);
+}
+
+CellValue EvalReadRef(EvalContext ctx, v2u pos, u32 slot) {
+    if (!ctx.ordered || !ctx.handles || slot == UINT32_MAX) {
+        return EvalReadCell(ctx, pos, true);
+    }
+
+    // same read as EvalReadCell's for a done cell, minus the block lookup
+    CellValue* result = SheetHandleGet(ctx.outSheet, &ctx.handles[slot], pos);
+    if (!result) return (CellValue){0};
+    return *result;
+}
+
+CellValue EvalReadCell(EvalContext ctx, v2u pos, bool constant) {
+    // the dependency order (or the up front scheduling in evaluateTop)
+    // already guarantees these are done
+    bool ready = constant && ctx.ordered;
+
+    CellValue* sourceCell = SpreadSheetGetCell(ctx.srcSheet, pos);
+    if (!ready && !isFormula(sourceCell)) {
+        if (!sourceCell || sourceCell->t == CT_EMPTY) {
+            SpreadSheetClearCell(ctx.outSheet, pos);
+            return (CellValue){0};
+        }
+        SpreadSheetSetCell(ctx.outSheet, pos, *sourceCell);
+        return *sourceCell;
+    }
+
+    if (!ready && !upToDate(ctx, pos)) {
+        if (SheetCellBusy(ctx.srcSheet, pos, ctx.epoch)) {
+            markCycle(ctx, pos);
+        } else {
+            stackPush(ctx.stack, pos);
+        }
 
-    // Recursively evaluate the referenced cell
-    EvaluateCell(ctx);
+        ctx.stack->blocked = true;
+        return (CellValue){.t = CT_ERROR, .d.i = CE_PENDING};
+    }
 
     // Return the already-computed result
-    return *SpreadSheetGetCell(ctx.outSheet, (v2u){ctx.currentX, ctx.currentY});
+    CellValue* result = SpreadSheetGetCell(ctx.outSheet, pos);
+    if (!result) return (CellValue){0};
+    return *result;
+}
+
+/*
++---------------------------------------------------+
+|   INFO:                                           |
+|   Aggregate functions. Plain values are summed    |
+|   straight out of the source blocks a column run  |
+|   at a time (see aggregate.c), formula cells in   |
+|   the range are read from outSheet and, like a    |
+|   computed reference, pushed and retried later if |
+|   they aren't done yet.                           |
++---------------------------------------------------+
+*/
+
+typedef enum Aggregate {
+    AGG_SUM,
+    AGG_MIN,
+    AGG_MAX,
+    AGG_COUNT,
+    AGG_AVERAGE,
+    AGG_COUNT_,
+} Aggregate;
+
+static const char* aggregateNames[AGG_COUNT_] = {
+    "SUM", "MIN", "MAX", "COUNT", "AVERAGE",
+};
+
+static i32 lookupAggregate(SString name) {
+    for (i32 i = 0; i < AGG_COUNT_; i++) {
+        const char* n = aggregateNames[i];
+        u32 len = strlen(n);
+        if (name.size != len) continue;
+
+        u32 j = 0;
+        while (j < len && (name.data[j] & ~0x20) == n[j]) j++;
+        if (j == len) return i;
+    }
+    return -1;
+}
+
+// Adds the formula cells of a run, which the kernel only counted
+static void aggregateFormulas(EvalContext ctx, v2u origin, Block* block, u32 start,
+                              u32 count, CellStats* stats, CellValue* status) {
+    for (u32 i = start; i < start + count; i++) {
+        CellType t = CellSlotType(block->cells[i]);
+        if (t != CT_TEXT && t != CT_CODE) continue;
+
+        v2u pos = {origin.x + i / BLOCK_SIZE, origin.y + i % BLOCK_SIZE};
+        if (!ctx.ordered && !upToDate(ctx, pos)) {
+            if (SheetCellBusy(ctx.srcSheet, pos, ctx.epoch)) {
+                markCycle(ctx, pos);
+            } else {
+                stackPush(ctx.stack, pos);
+            }
+            ctx.stack->blocked = true;
+            *status = (CellValue){.t = CT_ERROR, .d.i = CE_PENDING};
+            continue;
+        }
+
+        CellValue* v = SpreadSheetGetCell(ctx.outSheet, pos);
+        if (!v) continue;
+        if (v->t == CT_ERROR) {
+            if (status->t != CT_ERROR) *status = *v;
+            continue;
+        }
+        CellStatsAdd(stats, *v);
+    }
+}
+
+static const u32 aggregatedTypes = CELL_TYPE_BIT(CT_INT) | CELL_TYPE_BIT(CT_FLOAT) |
+                                   CELL_TYPE_BIT(CT_TEXT) | CELL_TYPE_BIT(CT_CODE);
+static const u32 formulaTypes = CELL_TYPE_BIT(CT_TEXT) | CELL_TYPE_BIT(CT_CODE);
+
+// With `extremes` only the counts, MIN and MAX are wanted
+static void aggregateBlock(EvalContext ctx, v2u bpos, u32 bid, v2u lo, v2u hi,
+                           CellStats* stats, CellValue* status, bool extremes) {
+    Block* block = ctx.srcSheet->blockpool[bid];
+    BlockSummary* summary = &block->summary;
+    if (!(summary->types & aggregatedTypes)) return;
+
+    v2u origin = {bpos.x * BLOCK_SIZE, bpos.y * BLOCK_SIZE};
+    u32 x0 = MAX(lo.x, origin.x) - origin.x;
+    u32 x1 = MIN(hi.x, origin.x + BLOCK_SIZE - 1) - origin.x;
+    u32 y0 = MAX(lo.y, origin.y) - origin.y;
+    u32 y1 = MIN(hi.y, origin.y + BLOCK_SIZE - 1) - origin.y;
+
+    // a whole block of plain numbers has them in its summary
+    bool whole = x0 == 0 && y0 == 0 && x1 == BLOCK_SIZE - 1 && y1 == BLOCK_SIZE - 1;
+    if (extremes && whole && !summary->loose && !(summary->types & formulaTypes)) {
+        CellStatsAddSummary(stats, summary);
+        return;
+    }
+
+    // a column of a block is contiguous, and full columns are
+    // contiguous with each other
+    u32 runs = x1 - x0 + 1;
+    u32 len = y1 - y0 + 1;
+    if (len == BLOCK_SIZE) {
+        len *= runs;
+        runs = 1;
+    }
+
+    BlockLanes* lanes = ctx.srcSheet->lanes ? &ctx.srcSheet->lanes[bid] : NULL;
+
+    for (u32 r = 0; r < runs; r++) {
+        u32 start = (x0 + r) * BLOCK_SIZE + y0;
+        u32 formulas = stats->formulas;
+        if (lanes) {
+            CellStatsAccumulateLanes(stats, lanes, start, len);
+        } else {
+            CellStatsAccumulate(stats, &block->cells[start], len);
+        }
+        if (stats->formulas != formulas) {
+            aggregateFormulas(ctx, origin, block, start, len, stats, status);
+        }
+    }
+}
+
+static CellValue evalRange(EvalContext ctx, v2u lo, v2u hi, CellStats* stats, bool extremes) {
+    SpreadSheet* sheet = ctx.srcSheet;
+    CellValue status = {0};
+
+    // nothing is outside the used range, loose bounds included. It is
+    // widened to whole blocks so covered blocks still read summaries.
+    if (!sheet->cells) return status;
+    v2u blo = CELL_TO_BLOCK(lo);
+    v2u bhi = CELL_TO_BLOCK(hi);
+    blo = (v2u){MAX(blo.x, sheet->usedLo.x / BLOCK_SIZE), MAX(blo.y, sheet->usedLo.y / BLOCK_SIZE)};
+    bhi = (v2u){MIN(bhi.x, sheet->usedHi.x / BLOCK_SIZE), MIN(bhi.y, sheet->usedHi.y / BLOCK_SIZE)};
+    if (blo.x > bhi.x || blo.y > bhi.y) return status;
+    u64 blocks = (u64)(bhi.x - blo.x + 1) * (bhi.y - blo.y + 1);
+
+    // a range bigger than the sheet (whole columns and such) walks
+    // the blocks that exist instead of every block it covers
+    if (blocks > sheet->cap) {
+        for (u32 i = 0; i < sheet->cap; i++) {
+            v2u key = sheet->keys[i];
+            if (key.x < blo.x || key.x > bhi.x || key.y < blo.y || key.y > bhi.y) continue;
+            aggregateBlock(ctx, key, sheet->values[i], lo, hi, stats, &status, extremes);
+        }
+        return status;
+    }
+
+    // blocks are kilobytes apart, so the next one in the column is
+    // looked up (and prefetched) while this one is added up
+    for (u32 bx = blo.x; bx <= bhi.x; bx++) {
+        u32 bid = SheetBlockGet(sheet, (v2u){bx, blo.y});
+        for (u32 by = blo.y; by <= bhi.y; by++) {
+            u32 next = by < bhi.y ? SheetBlockGet(sheet, (v2u){bx, by + 1}) : UINT32_MAX;
+            if (next != UINT32_MAX) {
+                Block* b = sheet->blockpool[next];
+                u32 x = MAX(lo.x, bx * BLOCK_SIZE) - bx * BLOCK_SIZE;
+                __builtin_prefetch(b);
+                if (sheet->lanes) {
+                    BlockLanes* l = &sheet->lanes[next];
+                    __builtin_prefetch(l);
+                    __builtin_prefetch(&l->i[x * BLOCK_SIZE]);
+                    __builtin_prefetch(&l->f[x * BLOCK_SIZE]);
+                } else {
+                    __builtin_prefetch(&b->cells[x * BLOCK_SIZE]);
+                    __builtin_prefetch(&b->cells[x * BLOCK_SIZE] + 5);
+                    __builtin_prefetch(&b->cells[x * BLOCK_SIZE] + 10);
+                }
+            }
+            if (bid != UINT32_MAX) {
+                aggregateBlock(ctx, (v2u){bx, by}, bid, lo, hi, stats, &status, extremes);
+            }
+            bid = next;
+        }
+    }
+    return status;
+}
+
+CellValue EvalRange(EvalContext ctx, v2u lo, v2u hi, CellStats* stats) {
+    return evalRange(ctx, lo, hi, stats, false);
+}
+
+// SUM, COUNT and AVERAGE only need totals, which a sheet with
+// summed-area tables has for any rectangle. Formula cells are only
+// counted there, so ranges holding any go the long way, and so do
+// floats unless all that's needed is the count.
+static bool rangeSums(SpreadSheet* sheet, v2u lo, v2u hi, CellStats* stats, Aggregate fn) {
+    CellStats part;
+    CellStatsInit(&part);
+    if (!SheetRangeSums(sheet, lo, hi, &part) || part.formulas) return false;
+    if (part.fcount && fn != AGG_COUNT) return false;
+
+    stats->isum += part.isum;
+    stats->icount += part.icount;
+    stats->fcount += part.fcount;
+    return true;
+}
+
+static CellValue evaluateRange(AST* tree, ASTNode* node, EvalContext ctx, CellStats* stats,
+                               Aggregate fn) {
+    ASTNode* a = &ASTGet(tree, node->lchild);
+    ASTNode* b = &ASTGet(tree, node->mchild);
+    if (a->op != AST_GET_CELL_REF || b->op != AST_GET_CELL_REF) {
+        return (CellValue){.t = CT_ERROR, .d.i = CE_NONE};
+    }
+
+    // a range with constant corners is ordered by the dependency graph
+    // like a constant reference, a computed one has to check every cell
+    v2u p, q;
+    if (!EvalConstRef(tree, a, ctx.anchor, &p) || !EvalConstRef(tree, b, ctx.anchor, &q)) {
+        p = refPosition(tree, a, ctx);
+        q = refPosition(tree, b, ctx);
+        ctx.ordered = false;
+    }
+
+    v2u lo = {MIN(p.x, q.x), MIN(p.y, q.y)};
+    v2u hi = {MAX(p.x, q.x), MAX(p.y, q.y)};
+    bool extremes = fn == AGG_MIN || fn == AGG_MAX || fn == AGG_COUNT;
+    if (fn != AGG_MIN && fn != AGG_MAX && rangeSums(ctx.srcSheet, lo, hi, stats, fn)) {
+        return (CellValue){0};
+    }
+    return evalRange(ctx, lo, hi, stats, extremes);
+}
+
+static CellValue finishAggregate(Aggregate fn, CellStats* s) {
+    u32 count = s->icount + s->fcount;
+
+    switch (fn) {
+        case AGG_SUM:
+            // an int sum that doesn't fit an int cell comes back as a float
+            if (!s->fcount && s->isum >= INT32_MIN && s->isum <= INT32_MAX)
+                return (CellValue){.t = CT_INT, .d.i = (i32)s->isum};
+            return (CellValue){.t = CT_FLOAT, .d.f = (CellFloat)((f64)s->isum + s->fsum)};
+
+        case AGG_COUNT:
+            return (CellValue){.t = CT_INT, .d.i = count};
+
+        case AGG_AVERAGE:
+            if (!count) return (CellValue){.t = CT_ERROR, .d.i = CE_DIV0};
+            return (CellValue){.t = CT_FLOAT, .d.f = (CellFloat)(((f64)s->isum + s->fsum) / count)};
+
+        case AGG_MIN:
+            if (!count) return (CellValue){.t = CT_INT, .d.i = 0};
+            if (s->fcount && (!s->icount || s->fmin < (CellFloat)s->imin)) {
+                return (CellValue){.t = CT_FLOAT, .d.f = s->fmin};
+            }
+            return (CellValue){.t = CT_INT, .d.i = s->imin};
+
+        case AGG_MAX:
+            if (!count) return (CellValue){.t = CT_INT, .d.i = 0};
+            if (s->fcount && (!s->icount || s->fmax > (CellFloat)s->imax)) {
+                return (CellValue){.t = CT_FLOAT, .d.f = s->fmax};
+            }
+            return (CellValue){.t = CT_INT, .d.i = s->imax};
+
+        default:
+            return (CellValue){.t = CT_ERROR, .d.i = CE_NAME};
+    }
+}
+
+static CellValue evaluateCall(AST* tree, ASTNode* node, EvalContext ctx) {
+    SString name = StringGet(ctx.str, ASTGet(tree, node->lchild).data.s);
+    i32 fn = lookupAggregate(name);
+    if (fn < 0) {
+        warn("unknown function %s", name);
+        return (CellValue){.t = CT_ERROR, .d.i = CE_NAME};
+    }
+
+    CellStats stats;
+    CellStatsInit(&stats);
+
+    for (u32 arg = node->mchild; arg != UINT32_MAX; arg = ASTGet(tree, arg).mchild) {
+        u32 expr = ASTGet(tree, arg).lchild;
+
+        CellValue v;
+        if (ASTGet(tree, expr).op == AST_RANGE) {
+            v = evaluateRange(tree, &ASTGet(tree, expr), ctx, &stats, fn);
+        } else {
+            v = evaluateNode(tree, expr, ctx);
+            CellStatsAdd(&stats, v);
+        }
+        if (v.t == CT_ERROR) return v;
+    }
+
+    return finishAggregate(fn, &stats);
+}
+
+typedef struct Precedents {
+    v2u* cells;
+    u32 size;
+    u32 cap;
+
+    // lo/hi pairs of the constant ranges
+    v2u* ranges;
+    u32 rsize;
+    u32 rcap;
+} Precedents;
+
+static void pushPos(Allocator mem, v2u** arr, u32* size, u32* cap, v2u pos) {
+    if (*size + 1 > *cap) {
+        u32 oldsize = *cap;
+        *cap = *cap ? *cap * 2 : 8;
+        *arr = Realloc(mem, *arr, oldsize * sizeof(v2u), *cap * sizeof(v2u));
+    }
+    (*arr)[(*size)++] = pos;
+}
+
+// Collects the constant references and ranges of a formula. Returns
+// true if it also has a computed reference or range, which makes its
+// precedents unknowable.
+static bool collectPrecedents(AST* ast, v2u anchor, Precedents* prec, Allocator mem) {
+    bool isVolatile = false;
+    prec->size = 0;
+    prec->rsize = 0;
+
+    for (u32 i = 0; i < ast->size; i++) {
+        ASTNode* node = &ASTGet(ast, i);
+
+        if (node->op == AST_RANGE) {
+            ASTNode* a = &ASTGet(ast, node->lchild);
+            ASTNode* b = &ASTGet(ast, node->mchild);
+            v2u p, q;
+            if (a->op != AST_GET_CELL_REF || b->op != AST_GET_CELL_REF ||
+                !EvalConstRef(ast, a, anchor, &p) || !EvalConstRef(ast, b, anchor, &q)) {
+                isVolatile = true;
+                continue;
+            }
+            pushPos(mem, &prec->ranges, &prec->rsize, &prec->rcap,
+                    (v2u){MIN(p.x, q.x), MIN(p.y, q.y)});
+            pushPos(mem, &prec->ranges, &prec->rsize, &prec->rcap,
+                    (v2u){MAX(p.x, q.x), MAX(p.y, q.y)});
+            continue;
+        }
+        if (node->op != AST_GET_CELL_REF) continue;
+
+        v2u ref;
+        if (!EvalConstRef(ast, node, anchor, &ref)) {
+            isVolatile = true;
+            continue;
+        }
+        pushPos(mem, &prec->cells, &prec->size, &prec->cap, ref);
+    }
+
+    return isVolatile;
+}
+
+// Rebuilds the precedent edges of up to budget dirty cells from
+// graph->refreshed on, since an edited cell may reference different
+// cells now. Returns how many it went through.
+static u32 refreshDirty(EvalContext ctx, u32 budget) {
+    SpreadSheet* srcSheet = ctx.srcSheet;
+    DepGraph* graph = &srcSheet->deps;
+
+    Precedents prec = {0};
+    u32 count = MIN(budget, graph->dirtysize - graph->refreshed);
+    for (u32 i = graph->refreshed; i < graph->refreshed + count; i++) {
+        u32 id = graph->dirty[i];
+        // on the list twice, edited again after its first refresh
+        if (graph->nodes[id].flags & DN_FRESH) continue;
+        graph->nodes[id].flags |= DN_FRESH;
+        CellValue* cell = SpreadSheetGetCell(srcSheet, graph->nodes[id].pos);
+
+        bool isVolatile = false;
+        prec.size = 0;
+        prec.rsize = 0;
+        if (cell && (cell->t == CT_TEXT || cell->t == CT_CODE)) {
+            Formula formula = compileFormula(srcSheet, ctx.str, cell->d.index, graph->nodes[id].pos);
+            isVolatile = collectPrecedents(&formula.ast, formula.anchor, &prec, srcSheet->mem);
+        }
+
+        DepGraphSetPrecedents(graph, id, prec.cells, prec.size, isVolatile);
+        DepGraphSetRanges(graph, id, prec.ranges, prec.rsize / 2);
+    }
+    graph->refreshed += count;
+    Free(srcSheet->mem, prec.cells, prec.cap * sizeof(v2u));
+    Free(srcSheet->mem, prec.ranges, prec.rcap * sizeof(v2u));
+    return count;
+}
+
+/*
++---------------------------------------------------+
+|   NOTE:                                           |
+|   Buckets the ordered part of the dirty cone by   |
+|   the levels DepGraphOrder gave it, so cells of   |
+|   the same level never read each other. Level l   |
+|   is ids[starts[l]] up to ids[starts[l + 1]].     |
+|                                                   |
+|   A counting sort that can stop after any cell:   |
+|   `at` goes through the ordered cone twice, once  |
+|   counting the cells of each level and once       |
+|   filling them in.                                |
++---------------------------------------------------+
+*/
+
+static void levelSortBegin(DepGraph* graph, Allocator mem, u32** ids, u32** starts, u32* depth) {
+    *depth = graph->levels;
+    *starts = Alloc(mem, (*depth + 1) * sizeof(u32));
+    memset(*starts, 0, (*depth + 1) * sizeof(u32));
+    // nothing to order
+    *ids = *depth ? Alloc(mem, graph->ordered * sizeof(u32)) : NULL;
+}
+
+// Returns how much of budget it used, the sort is done once *at
+// reaches twice graph->ordered
+static u32 levelSortStep(DepGraph* graph, u32* ids, u32* starts, u32 depth, u32* at, u32 budget) {
+    u32 count = graph->ordered;
+    u32 used = 0;
+    while (used < budget && *at < 2 * count) {
+        u32 i = *at < count ? *at : *at - count;
+        u32 id = graph->order[i];
+        u32 level = graph->nodes[id].level;
+        if (*at < count) {
+            starts[level + 1]++;
+        } else {
+            // starts[level] runs up to where the next level begins
+            ids[starts[level]++] = id;
+        }
+        used++;
+        (*at)++;
+
+        if (*at == count) {
+            for (u32 l = 0; l < depth; l++) starts[l + 1] += starts[l];
+            used += depth;
+        } else if (*at == 2 * count) {
+            for (u32 l = depth; l > 0; l--) starts[l] = starts[l - 1];
+            starts[0] = 0;
+            used += depth;
+        }
+    }
+    return used;
+}
+
+static u32* sortByLevel(DepGraph* graph, Allocator mem, u32** starts, u32* depth) {
+    u32* ids;
+    u32 at = 0;
+    levelSortBegin(graph, mem, &ids, starts, depth);
+    while (at < 2 * graph->ordered) levelSortStep(graph, ids, *starts, *depth, &at, UINT32_MAX);
+    return ids;
+}
+
+/*
++---------------------------------------------------+
+|   INFO: Batched recalc                            |
+|                                                   |
+|   Within a level the formula cells are grouped by |
+|   the template they share. A group big enough is  |
+|   run through BCRunBatch, one instruction over    |
+|   many cells at a time, and everything else goes  |
+|   through EvaluateCell as before.                 |
++---------------------------------------------------+
+*/
+
+// smaller groups aren't worth setting up the lanes for
+#define BATCH_MIN 8
+
+typedef struct BatchCell {
+    BCProgram code; // template program, the sort key
+    v2u pos;
+    v2u anchor;
+} BatchCell;
+
+static int compareBatch(const void* a, const void* b) {
+    uintptr_t x = (uintptr_t)((const BatchCell*)a)->code.code;
+    uintptr_t y = (uintptr_t)((const BatchCell*)b)->code.code;
+    return (x > y) - (x < y);
+}
+
+static void evaluateLevel(EvalContext ctx, u32* ids, u32 count) {
+    SpreadSheet* srcSheet = ctx.srcSheet;
+    DepGraph* graph = &srcSheet->deps;
+
+    BatchCell* cells = Alloc(ctx.mem, count * sizeof(BatchCell));
+    u32 size = 0;
+    for (u32 i = 0; i < count; i++) {
+        DepNode* node = &graph->nodes[ids[i]];
+        CellValue* cell = SpreadSheetGetCell(srcSheet, node->pos);
+
+        // computed references can read anything in the level, so
+        // volatile cells go last
+        if (node->flags & DN_VOLATILE) continue;
+
+        if (isFormula(cell)) {
+            Formula formula = compileFormula(srcSheet, ctx.str, cell->d.index, node->pos);
+            if (formula.code.size) {
+                cells[size++] = (BatchCell){formula.code, node->pos, formula.anchor};
+                continue;
+            }
+        }
+
+        ctx.currentX = node->pos.x;
+        ctx.currentY = node->pos.y;
+        EvaluateCell(ctx);
+    }
+
+    qsort(cells, size, sizeof(BatchCell), compareBatch);
+
+    v2u* anchors = Alloc(ctx.mem, size * sizeof(v2u));
+    CellValue* results = Alloc(ctx.mem, size * sizeof(CellValue));
+    for (u32 start = 0, end; start < size; start = end) {
+        end = start + 1;
+        while (end < size && cells[end].code.code == cells[start].code.code) end++;
+
+        if (end - start < BATCH_MIN) {
+            for (u32 i = start; i < end; i++) {
+                ctx.currentX = cells[i].pos.x;
+                ctx.currentY = cells[i].pos.y;
+                EvaluateCell(ctx);
+            }
+            continue;
+        }
+
+        for (u32 i = start; i < end; i++) anchors[i] = cells[i].anchor;
+        BCRunBatch(&cells[start].code, ctx, anchors + start, end - start, results + start);
+
+        for (u32 i = start; i < end; i++) {
+            SpreadSheetSetCell(ctx.outSheet, cells[i].pos, results[i]);
+            SheetCellSetDone(srcSheet, cells[i].pos, ctx.epoch);
+        }
+    }
+
+    for (u32 i = 0; i < count; i++) {
+        DepNode* node = &graph->nodes[ids[i]];
+        if (!(node->flags & DN_VOLATILE)) continue;
+        ctx.currentX = node->pos.x;
+        ctx.currentY = node->pos.y;
+        EvaluateCell(ctx);
+    }
+
+    Free(ctx.mem, anchors, size * sizeof(v2u));
+    Free(ctx.mem, results, size * sizeof(CellValue));
+    Free(ctx.mem, cells, count * sizeof(BatchCell));
+}
+
+/*
++---------------------------------------------------+
+|   INFO: Iterative calculation                     |
+|                                                   |
+|   With ctx.iterate the cells Kahn's algorithm     |
+|   leaves over are split into strongly connected   |
+|   components and evaluated in dependency order.   |
+|   A component that isn't a cycle is one cell      |
+|   behind a cycle, evaluated once like any other.  |
+|                                                   |
+|   A cycle is run Jacobi style: every cell of it   |
+|   reads the previous iterate of the others out of |
+|   outSheet, the new values are collected on the   |
+|   side and only written back once all of them are |
+|   done, so the two buffers take turns. Nothing    |
+|   outside the cycle is touched while it runs.     |
+|                                                   |
+|   Cycles through computed references aren't in    |
+|   the graph and still end up as #CYCLE! errors.   |
++---------------------------------------------------+
+*/
+
+void IterativeCalcFree(IterativeCalc* iter) {
+    Free(iter->mem, iter->residuals, iter->rcap * sizeof(f64));
+    Free(iter->mem, iter->iterations, iter->ccap * sizeof(u32));
+    iter->residuals = NULL;
+    iter->iterations = NULL;
+    iter->rsize = iter->rcap = iter->cycles = iter->ccap = 0;
+    iter->unconverged = 0;
+}
+
+static void iterateReset(IterativeCalc* iter) {
+    if (!iter) return;
+    iter->rsize = 0;
+    iter->cycles = 0;
+    iter->unconverged = 0;
+}
+
+static void pushResidual(IterativeCalc* iter, f64 residual) {
+    if (iter->rsize + 1 > iter->rcap) {
+        u32 oldsize = iter->rcap;
+        iter->rcap = iter->rcap ? iter->rcap * 2 : 16;
+        iter->residuals = Realloc(iter->mem, iter->residuals, oldsize * sizeof(f64),
+                                  iter->rcap * sizeof(f64));
+    }
+    iter->residuals[iter->rsize++] = residual;
+}
+
+static void pushIterations(IterativeCalc* iter, u32 count) {
+    if (iter->cycles + 1 > iter->ccap) {
+        u32 oldsize = iter->ccap;
+        iter->ccap = iter->ccap ? iter->ccap * 2 : 4;
+        iter->iterations = Realloc(iter->mem, iter->iterations, oldsize * sizeof(u32),
+                                   iter->ccap * sizeof(u32));
+    }
+    iter->iterations[iter->cycles++] = count;
+}
+
+// How far apart two values of a cell are, anything but two numbers
+// only counts as settled when nothing changed at all
+static f64 cellChange(CellValue a, CellValue b) {
+    bool na = a.t == CT_INT || a.t == CT_FLOAT || a.t == CT_EMPTY;
+    bool nb = b.t == CT_INT || b.t == CT_FLOAT || b.t == CT_EMPTY;
+    if (na && nb) {
+        f64 x = a.t == CT_FLOAT ? a.d.f : a.t == CT_INT ? a.d.i : 0;
+        f64 y = b.t == CT_FLOAT ? b.d.f : b.t == CT_INT ? b.d.i : 0;
+        return x > y ? x - y : y - x;
+    }
+    // math.h would take log from util.h, this is infinity
+    return a.t == b.t && a.d.i == b.d.i ? 0 : 1.0 / 0.0;
+}
+
+static void iterateCycle(EvalContext ctx, u32* ids, u32 count) {
+    SpreadSheet* srcSheet = ctx.srcSheet;
+    DepGraph* graph = &srcSheet->deps;
+    IterativeCalc* iter = ctx.iterate;
+    EvalStack* stack = ctx.stack;
+
+    v2u* pos = Alloc(ctx.mem, count * sizeof(v2u));
+    Formula* formulas = Alloc(ctx.mem, count * sizeof(Formula));
+    CellValue* results = Alloc(ctx.mem, count * sizeof(CellValue));
+
+    // Every cell of the cycle counts as done from the start, reading
+    // one gives its previous iterate. Errors left by a recalc without
+    // iterate (or by a region that got here first) start over empty.
+    for (u32 i = 0; i < count; i++) {
+        pos[i] = graph->nodes[ids[i]].pos;
+        CellValue* cell = SpreadSheetGetCell(srcSheet, pos[i]);
+        formulas[i] = (Formula){0};
+        if (isFormula(cell)) formulas[i] = compileFormula(srcSheet, ctx.str, cell->d.index, pos[i]);
+
+        CellValue* old = SpreadSheetGetCell(ctx.outSheet, pos[i]);
+        if (old && old->t == CT_ERROR) SpreadSheetClearCell(ctx.outSheet, pos[i]);
+        SheetCellSetDone(srcSheet, pos[i], ctx.epoch);
+    }
+
+    ctx.ordered = true;
+    u32 done = 0;
+    bool settled = false;
+    while (done < iter->maxIterations && !settled) {
+        for (u32 i = 0; i < count; i++) {
+            CellValue* old = SpreadSheetGetCell(ctx.outSheet, pos[i]);
+            results[i] = old ? *old : (CellValue){0};
+            if (!formulas[i].ast.size) continue;
+
+            // a computed reference to a cell that isn't done goes
+            // around the graph, which makes it a cycle we can't see
+            u32 base = stack->size;
+            stack->blocked = false;
+            ctx.currentX = pos[i].x;
+            ctx.currentY = pos[i].y;
+            results[i] = runFormula(&formulas[i], ctx);
+            if (stack->blocked) {
+                stack->size = base;
+                results[i] = (CellValue){.t = CT_ERROR, .d.i = CE_CYCLE};
+            }
+        }
+
+        f64 residual = 0;
+        for (u32 i = 0; i < count; i++) {
+            CellValue* old = SpreadSheetGetCell(ctx.outSheet, pos[i]);
+            residual = MAX(residual, cellChange(old ? *old : (CellValue){0}, results[i]));
+            SpreadSheetSetCell(ctx.outSheet, pos[i], results[i]);
+        }
+
+        pushResidual(iter, residual);
+        done++;
+        settled = residual <= iter->epsilon;
+    }
+
+    pushIterations(iter, done);
+    if (!settled) iter->unconverged++;
+
+    Free(ctx.mem, pos, count * sizeof(v2u));
+    Free(ctx.mem, formulas, count * sizeof(Formula));
+    Free(ctx.mem, results, count * sizeof(CellValue));
+}
+
+// A cell behind a cycle. Its precedents are all done by now, but a
+// region may have got to it before the cycle settled, so it is run
+// whether it's done or not.
+static void evaluateBehind(EvalContext ctx, v2u pos) {
+    SpreadSheet* srcSheet = ctx.srcSheet;
+    EvalStack* stack = ctx.stack;
+
+    ctx.currentX = pos.x;
+    ctx.currentY = pos.y;
+
+    CellValue* cell = SpreadSheetGetCell(srcSheet, pos);
+    Formula formula = {0};
+    if (isFormula(cell)) formula = compileFormula(srcSheet, ctx.str, cell->d.index, pos);
+    if (!formula.ast.size) {
+        EvaluateCell(ctx);
+        return;
+    }
+
+    u32 base = stack->size;
+    stack->blocked = false;
+    ctx.ordered = true;
+    CellValue result = runFormula(&formula, ctx);
+    if (stack->blocked) {
+        // a computed reference got ahead, pull it in the usual way
+        stack->size = base;
+        ctx.ordered = false;
+        EvaluateCell(ctx);
+        return;
+    }
+
+    SpreadSheetSetCell(ctx.outSheet, pos, result);
+    SheetCellSetDone(srcSheet, pos, ctx.epoch);
+}
+
+static void evaluateComponent(EvalContext ctx, u32 first, u32 size) {
+    DepGraph* graph = &ctx.srcSheet->deps;
+
+    if (DepGraphOnCycle(graph, first, size)) {
+        iterateCycle(ctx, graph->order + first, size);
+    } else {
+        evaluateBehind(ctx, graph->nodes[graph->order[first]].pos);
+    }
+}
+
+/*
++---------------------------------------------------+
+|   INFO: Resumable recalc                          |
+|                                                   |
+|   EvaluateDirty cut into slices. RecalcStep does  |
+|   a bounded amount of work and returns, picking   |
+|   up where it left off next time. Every phase     |
+|   works in slices, finding the cone as much as    |
+|   evaluating it: first the sheet's cells are      |
+|   marked dirty if dependencies weren't tracked    |
+|   yet, then the dirty cells get their precedents  |
+|   rebuilt, the cone is ordered and sorted by      |
+|   level and evaluated level by level, then        |
+|   whatever is stuck in a cycle.                   |
+|                                                   |
+|   The marking and the refresh keep their place in |
+|   the sheet, so a recalc begun over after an edit |
+|   carries on with them. Only the order of the     |
+|   cone is found again.                            |
+|                                                   |
+|   In between, RecalcRegion evaluates one part of  |
+|   the sheet right away by pulling in what it      |
+|   reads, the same way EvaluateCell does. Once the |
+|   cone is known, cells outside it are left alone  |
+|   since outSheet already has them right. Cells a  |
+|   region finished are done in the recalc's epoch, |
+|   so the slices skip them later.                  |
++---------------------------------------------------+
+*/
+
+// with this few dirty cells a region finds the cone itself, as long
+// as that takes no more of the slices' work than RECALC_EAGER_WORK
+// (a few ms). A longer cone is left to the slices, the work spent
+// on it so far isn't lost.
+#define RECALC_EAGER 4096
+#define RECALC_EAGER_WORK (1 << 16)
+
+void RecalcBegin(Recalc* rc, EvalContext ctx) {
+    // MIN/MAX only take tight block summaries
+    SheetSummariesTighten(ctx.srcSheet);
+
+    *rc = (Recalc){.ctx = ctx, .stack = {.mem = ctx.mem}};
+    rc->ctx.stack = &rc->stack;
+    rc->ctx.epoch = SheetNewEpoch();
+    rc->ctx.cone = NULL;
+    iterateReset(ctx.iterate);
+
+    // a sheet that is tracked already starts with the refresh
+    u32 flags = ctx.srcSheet->flags;
+    if ((flags & SHEET_TRACK_DEPS) && !(flags & SHEET_TRACKING)) rc->phase = RECALC_REFRESH;
+}
+
+// Tracking starts here rather than in RecalcBegin, it has to visit
+// every cell of the sheet
+static u32 recalcTrack(Recalc* rc, u32 budget) {
+    SpreadSheet* srcSheet = rc->ctx.srcSheet;
+    u32 used = SpreadSheetTrackSome(srcSheet, budget);
+    if (!(srcSheet->flags & SHEET_TRACKING)) rc->phase = RECALC_REFRESH;
+    return used;
+}
+
+static u32 recalcRefresh(Recalc* rc, u32 budget) {
+    DepGraph* graph = &rc->ctx.srcSheet->deps;
+
+    u32 count = refreshDirty(rc->ctx, budget);
+    if (graph->refreshed < graph->dirtysize) return count;
+
+    DepGraphOrderBegin(graph);
+    rc->phase = RECALC_ORDER;
+    return count;
+}
+
+static u32 recalcOrder(Recalc* rc, u32 budget) {
+    DepGraph* graph = &rc->ctx.srcSheet->deps;
+
+    u32 left = budget;
+    if (DepGraphOrderStep(graph, &left)) {
+        levelSortBegin(graph, rc->ctx.mem, &rc->ids, &rc->starts, &rc->depth);
+        rc->phase = RECALC_SORT;
+        rc->next = 0;
+    }
+    return budget - left;
+}
+
+static u32 recalcSort(Recalc* rc, u32 budget) {
+    DepGraph* graph = &rc->ctx.srcSheet->deps;
+
+    u32 used = levelSortStep(graph, rc->ids, rc->starts, rc->depth, &rc->next, budget);
+    if (rc->next < 2 * graph->ordered) return used;
+
+    rc->ctx.cone = graph;
+    rc->phase = RECALC_LEVELS;
+    rc->level = 0;
+    rc->next = 0;
+    return used;
+}
+
+static u32 recalcLevel(Recalc* rc, u32 budget) {
+    SpreadSheet* srcSheet = rc->ctx.srcSheet;
+    DepGraph* graph = &srcSheet->deps;
+
+    if (rc->level == rc->depth) {
+        rc->phase = RECALC_CYCLES;
+        rc->next = graph->ordered;
+        return 0;
+    }
+
+    u32 end = rc->starts[rc->level + 1];
+    u32 count = MIN(budget, end - rc->next);
+
+    // cells a region already finished are left out, the rest of the
+    // slice is packed down in place
+    u32* ids = rc->ids + rc->next;
+    u32 size = 0;
+    for (u32 i = 0; i < count; i++) {
+        if (SheetCellDone(srcSheet, graph->nodes[ids[i]].pos, rc->ctx.epoch)) continue;
+        ids[size++] = ids[i];
+    }
+
+    EvalContext ctx = rc->ctx;
+    ctx.ordered = true;
+    if (size) evaluateLevel(ctx, ids, size);
+    rc->evaluated += size;
+
+    rc->next += count;
+    if (rc->next == end) rc->level++;
+    return count;
+}
+
+static void recalcFinish(Recalc* rc) {
+    DepGraph* graph = &rc->ctx.srcSheet->deps;
+
+    DepGraphClearDirty(graph);
+    Free(rc->ctx.mem, rc->ids, graph->ordered * sizeof(u32));
+    Free(rc->ctx.mem, rc->starts, (rc->depth + 1) * sizeof(u32));
+    Free(graph->mem, rc->comps, rc->comps ? (graph->osize - graph->ordered + 1) * sizeof(u32) : 0);
+    rc->ids = NULL;
+    rc->starts = NULL;
+    rc->comps = NULL;
+    rc->phase = RECALC_DONE;
+}
+
+// With ctx.iterate, one component at a time however big it is
+static u32 recalcComponents(Recalc* rc, u32 budget) {
+    DepGraph* graph = &rc->ctx.srcSheet->deps;
+
+    if (!rc->comps && rc->next < graph->osize) {
+        rc->ccount = DepGraphComponents(graph, &rc->comps);
+        rc->comp = 0;
+    }
+
+    u32 used = 0;
+    while (used < budget && rc->comp < rc->ccount) {
+        u32 first = rc->comps[rc->comp];
+        u32 size = rc->comps[rc->comp + 1] - first;
+        evaluateComponent(rc->ctx, first, size);
+
+        used += size;
+        rc->evaluated += size;
+        rc->next = first + size;
+        rc->comp++;
+    }
+
+    if (rc->comp == rc->ccount) recalcFinish(rc);
+    return used;
+}
+
+// Cells behind graph->ordered are in or after a cycle. They get
+// evaluated normally, which finds the cycle and marks its cells.
+static u32 recalcCycles(Recalc* rc, u32 budget) {
+    if (rc->ctx.iterate) return recalcComponents(rc, budget);
+
+    SpreadSheet* srcSheet = rc->ctx.srcSheet;
+    DepGraph* graph = &srcSheet->deps;
+
+    u32 count = MIN(budget, graph->osize - rc->next);
+    EvalContext ctx = rc->ctx;
+    ctx.ordered = false;
+    for (u32 i = rc->next; i < rc->next + count; i++) {
+        DepNode* node = &graph->nodes[graph->order[i]];
+        ctx.currentX = node->pos.x;
+        ctx.currentY = node->pos.y;
+        EvaluateCell(ctx);
+    }
+    rc->evaluated += count;
+    rc->next += count;
+
+    if (rc->next == graph->osize) recalcFinish(rc);
+    return count;
+}
+
+static u32 recalcPhase(Recalc* rc, u32 budget) {
+    switch (rc->phase) {
+        case RECALC_TRACK: return recalcTrack(rc, budget);
+        case RECALC_REFRESH: return recalcRefresh(rc, budget);
+        case RECALC_ORDER: return recalcOrder(rc, budget);
+        case RECALC_SORT: return recalcSort(rc, budget);
+        case RECALC_LEVELS: return recalcLevel(rc, budget);
+        case RECALC_CYCLES: return recalcCycles(rc, budget);
+        case RECALC_DONE: break;
+    }
+    return 0;
+}
+
+bool RecalcStep(Recalc* rc, u32 budget) {
+    while (budget && rc->phase != RECALC_DONE) {
+        u32 used = recalcPhase(rc, budget);
+        budget -= MIN(used, budget);
+    }
+    return rc->phase == RECALC_DONE;
+}
+
+// Without the cone a region would evaluate everything it reads. Once
+// tracking is done a cell only needs it if its precedents lead back
+// to a dirty cell, so the ones that don't are marked done in the
+// recalc's epoch and read as they are. Volatile formulas and ranges
+// could read anything and count as dirty, so does a cell whose
+// precedents loop back to it.
+static void regionClean(Recalc* rc, v2u lo, v2u hi) {
+    SpreadSheet* srcSheet = rc->ctx.srcSheet;
+    DepGraph* graph = &srcSheet->deps;
+    Allocator mem = rc->ctx.mem;
+
+    // 0 not seen yet, 1 being walked, 2 being walked and reads a
+    // stale cell, 3 clean, 4 stale
+    u8* state = Alloc(mem, graph->nsize);
+    memset(state, 0, graph->nsize);
+    u32 cap = 64, size = 0;
+    v2u* stack = Alloc(mem, cap * sizeof(v2u)); // {node, next precedent}
+
+    for (u32 x = lo.x; x <= hi.x; x++) {
+        for (u32 y = lo.y; y <= hi.y; y++) {
+            u32 root = DepGraphFind(graph, (v2u){x, y});
+            if (root == UINT32_MAX || state[root]) continue;
+            stack[size++] = (v2u){root, 0};
+            state[root] = 1;
+
+            while (size) {
+                v2u* top = &stack[size - 1];
+                DepNode* node = &graph->nodes[top->x];
+                if (node->flags & (DN_DIRTY | DN_VOLATILE | DN_RANGES)) state[top->x] = 2;
+
+                if (state[top->x] == 1 && top->y < node->psize) {
+                    u32 p = node->prec[top->y++];
+                    if (state[p] == 0) {
+                        if (size + 1 > cap) {
+                            stack = Realloc(mem, stack, cap * sizeof(v2u), 2 * cap * sizeof(v2u));
+                            cap *= 2;
+                        }
+                        stack[size++] = (v2u){p, 0};
+                        state[p] = 1;
+                    } else if (state[p] != 3) {
+                        state[top->x] = 2;
+                    }
+                    continue;
+                }
+
+                u32 clean = state[top->x] == 1;
+                state[top->x] = clean ? 3 : 4;
+                if (clean) SheetCellSetDone(srcSheet, node->pos, rc->ctx.epoch);
+                size--;
+                if (size && !clean) state[stack[size - 1].x] = 2;
+            }
+        }
+    }
+
+    Free(mem, stack, cap * sizeof(v2u));
+    Free(mem, state, graph->nsize);
+}
+
+u32 RecalcRegion(Recalc* rc, v2u lo, v2u hi) {
+    if (rc->phase == RECALC_DONE) return 0;
+
+    SpreadSheet* srcSheet = rc->ctx.srcSheet;
+    DepGraph* graph = &srcSheet->deps;
+    if ((rc->phase == RECALC_REFRESH && graph->dirtysize - graph->refreshed <= RECALC_EAGER) ||
+        rc->phase == RECALC_ORDER || rc->phase == RECALC_SORT) {
+        u32 budget = RECALC_EAGER_WORK;
+        while (budget && rc->phase < RECALC_LEVELS) budget -= MIN(recalcPhase(rc, budget), budget);
+    }
+    if (rc->phase >= RECALC_REFRESH && rc->phase < RECALC_LEVELS) regionClean(rc, lo, hi);
+
+    EvalContext ctx = rc->ctx;
+    ctx.ordered = false;
+
+    u32 count = 0;
+    for (u32 x = lo.x; x <= hi.x; x++) {
+        for (u32 y = lo.y; y <= hi.y; y++) {
+            // cleared cells are left for the slices to clear
+            v2u pos = {x, y};
+            CellValue* cell = SpreadSheetGetCell(srcSheet, pos);
+            if (!cell || cell->t == CT_EMPTY || upToDate(ctx, pos)) continue;
+
+            ctx.currentX = x;
+            ctx.currentY = y;
+            EvaluateCell(ctx);
+            count++;
+        }
+    }
+    return count;
+}
+
+void RecalcProgress(Recalc* rc, u32* done, u32* total) {
+    DepGraph* graph = &rc->ctx.srcSheet->deps;
+    switch (rc->phase) {
+        case RECALC_TRACK:
+            *done = rc->ctx.srcSheet->flags & SHEET_TRACKING ? rc->ctx.srcSheet->tracked : 0;
+            *total = rc->ctx.srcSheet->cap;
+            break;
+        case RECALC_REFRESH:
+            *done = graph->refreshed;
+            *total = graph->dirtysize;
+            break;
+        case RECALC_ORDER:
+        case RECALC_SORT:
+            // nothing of the cone has been evaluated yet
+            *done = 0;
+            *total = graph->osize;
+            break;
+        case RECALC_LEVELS:
+        case RECALC_CYCLES:
+            *done = rc->next;
+            *total = graph->osize;
+            break;
+        case RECALC_DONE:
+            *done = *total = graph->osize;
+            break;
+    }
+}
+
+void RecalcFree(Recalc* rc) {
+    // never begun
+    if (!rc->ctx.mem.a) return;
+
+    if (rc->phase != RECALC_DONE && rc->starts) {
+        DepGraph* graph = &rc->ctx.srcSheet->deps;
+        Free(rc->ctx.mem, rc->ids, graph->ordered * sizeof(u32));
+        Free(rc->ctx.mem, rc->starts, (rc->depth + 1) * sizeof(u32));
+        if (rc->comps) {
+            Free(graph->mem, rc->comps, (graph->osize - graph->ordered + 1) * sizeof(u32));
+        }
+    }
+    Free(rc->stack.mem, rc->stack.data, rc->stack.cap * sizeof(v2u));
+    *rc = (Recalc){0};
+}
+
+u32 EvaluateDirty(EvalContext ctx) {
+    Recalc rc;
+    RecalcBegin(&rc, ctx);
+    RecalcStep(&rc, UINT32_MAX);
+    RecalcFree(&rc);
+    return ctx.srcSheet->deps.osize;
+}
+
+/*
++---------------------------------------------------+
+|   INFO: Parallel recalc                           |
+|                                                   |
+|   The ordered part of the dirty cone is split     |
+|   into levels, a cell's level being one more than |
+|   its deepest precedent in the cone. Cells within |
+|   a level never read each other, so a level can   |
+|   be handed to the job pool in chunks while the   |
+|   sheets stay read only. The calling thread then  |
+|   writes the results back before the next level.  |
+|                                                   |
+|   Formulas are all compiled up front since the    |
+|   formula cache isn't safe to share, and volatile |
+|   cells are run by the calling thread because a   |
+|   computed reference can pull in any cell.        |
++---------------------------------------------------+
+*/
+
+#define LEVEL_CHUNK 64
+
+typedef struct LevelJob {
+    EvalContext ctx;
+    v2u* pos;
+    Formula* formulas;
+    CellValue* results;
+    bool* skip;
+    u32 count;
+} LevelJob;
+
+typedef struct LevelChunk {
+    LevelJob* job;
+    u32 start;
+} LevelChunk;
+
+static void evaluateChunk(void* arg, Allocator scratch) {
+    LevelChunk* chunk = arg;
+    LevelJob* job = chunk->job;
+    EvalContext ctx = job->ctx;
+
+    u32 end = MIN(chunk->start + LEVEL_CHUNK, job->count);
+    for (u32 i = chunk->start; i < end; i++) {
+        if (job->skip[i]) continue;
+
+        // symbols never outlive a cell, so the arena starts over each time
+        StackAllocatorReset(&scratch);
+        SymbolTable table = {.mem = scratch};
+
+        ctx.mem = scratch;
+        ctx.table = &table;
+        ctx.currentX = job->pos[i].x;
+        ctx.currentY = job->pos[i].y;
+
+        if (job->formulas[i].ast.size) {
+            job->results[i] = runFormula(&job->formulas[i], ctx);
+        } else {
+            CellValue* cell = SpreadSheetGetCell(ctx.srcSheet, job->pos[i]);
+            job->results[i] = cell ? *cell : (CellValue){0};
+        }
+    }
+}
+
+u32 EvaluateDirtyParallel(EvalContext ctx, JobPool* pool) {
+    SpreadSheet* srcSheet = ctx.srcSheet;
+    DepGraph* graph = &srcSheet->deps;
+
+    SpreadSheetTrackDeps(srcSheet);
+    refreshDirty(ctx, UINT32_MAX);
+    DepGraphOrder(graph);
+    // the workers only ever read the summed-area tables and the
+    // block summaries
+    SheetSumsUpdate(srcSheet);
+    SheetSummariesTighten(srcSheet);
+
+    EvalStack stack = {.mem = ctx.mem};
+    ctx.stack = &stack;
+    ctx.epoch = SheetNewEpoch();
+    ctx.ordered = true;
+    iterateReset(ctx.iterate);
+
+    u32 count = graph->ordered;
+    u32 depth;
+    u32* starts;
+    u32* ids = sortByLevel(graph, ctx.mem, &starts, &depth);
+
+    LevelJob job = {.ctx = ctx};
+    job.pos = Alloc(ctx.mem, count * sizeof(v2u));
+    job.formulas = Alloc(ctx.mem, count * sizeof(Formula));
+    job.results = Alloc(ctx.mem, count * sizeof(CellValue));
+    job.skip = Alloc(ctx.mem, count * sizeof(bool));
+
+    for (u32 slot = 0; slot < count; slot++) {
+        DepNode* node = &graph->nodes[ids[slot]];
+
+        job.pos[slot] = node->pos;
+        job.formulas[slot] = (Formula){0};
+        job.skip[slot] = node->flags & DN_VOLATILE;
+
+        // NOTE: copies of the cached formulas, the cache can't be
+        // touched from the workers
+        CellValue* cell = SpreadSheetGetCell(srcSheet, node->pos);
+        if (isFormula(cell)) {
+            job.formulas[slot] = compileFormula(srcSheet, ctx.str, cell->d.index, node->pos);
+            // NOTE: a source's handles are shared by every cell with the
+            // same text, the workers would write them at the same time
+            job.formulas[slot].handles = NULL;
+        }
+    }
+    Free(ctx.mem, ids, count * sizeof(u32));
+
+    // enough chunk slots for any level, they are reused level to level
+    u32 nchunks = (count + LEVEL_CHUNK - 1) / LEVEL_CHUNK;
+    LevelChunk* chunks = Alloc(ctx.mem, nchunks * sizeof(LevelChunk));
+
+    for (u32 level = 0; level < depth; level++) {
+        u32 first = starts[level];
+        u32 size = starts[level + 1] - first;
+
+        job.pos += first;
+        job.formulas += first;
+        job.results += first;
+        job.skip += first;
+        job.count = size;
+
+        JobGroup group = {0};
+        for (u32 i = 0; i * LEVEL_CHUNK < size; i++) {
+            chunks[i] = (LevelChunk){.job = &job, .start = i * LEVEL_CHUNK};
+            JobSubmit(pool, &group, evaluateChunk, &chunks[i]);
+        }
+        JobWait(pool, &group);
+
+        for (u32 i = 0; i < size; i++) {
+            if (job.skip[i]) continue;
+
+            CellValue* cell = SpreadSheetGetCell(srcSheet, job.pos[i]);
+            if (isFormula(cell) && !job.formulas[i].ast.size) {
+                // failed to parse, same as EvaluateCell
+            } else if (!cell || cell->t == CT_EMPTY) {
+                SpreadSheetClearCell(ctx.outSheet, job.pos[i]);
+            } else {
+                SpreadSheetSetCell(ctx.outSheet, job.pos[i], job.results[i]);
+            }
+            SheetCellSetDone(srcSheet, job.pos[i], ctx.epoch);
+        }
+
+        // volatile cells last like evaluateLevel, on this thread with
+        // the work stack, so they read the level's results
+        for (u32 i = 0; i < size; i++) {
+            if (!job.skip[i]) continue;
+            ctx.currentX = job.pos[i].x;
+            ctx.currentY = job.pos[i].y;
+            EvaluateCell(ctx);
+        }
+
+        job.pos -= first;
+        job.formulas -= first;
+        job.results -= first;
+        job.skip -= first;
+    }
+
+    Free(ctx.mem, chunks, nchunks * sizeof(LevelChunk));
+    Free(ctx.mem, job.pos, count * sizeof(v2u));
+    Free(ctx.mem, job.formulas, count * sizeof(Formula));
+    Free(ctx.mem, job.results, count * sizeof(CellValue));
+    Free(ctx.mem, job.skip, count * sizeof(bool));
+    Free(ctx.mem, starts, (depth + 1) * sizeof(u32));
+
+    // whatever is left is stuck in or behind a cycle
+    if (ctx.iterate) {
+        u32* comps;
+        u32 ncomps = DepGraphComponents(graph, &comps);
+        for (u32 c = 0; c < ncomps; c++) {
+            evaluateComponent(ctx, comps[c], comps[c + 1] - comps[c]);
+        }
+        Free(graph->mem, comps, comps ? (graph->osize - count + 1) * sizeof(u32) : 0);
+    } else {
+        ctx.ordered = false;
+        for (u32 i = count; i < graph->osize; i++) {
+            DepNode* node = &graph->nodes[graph->order[i]];
+            ctx.currentX = node->pos.x;
+            ctx.currentY = node->pos.y;
+            EvaluateCell(ctx);
+        }
+    }
+
+    Free(stack.mem, stack.data, stack.cap * sizeof(v2u));
+    DepGraphClearDirty(graph);
+    return graph->osize;
 }
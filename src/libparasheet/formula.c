@@ -0,0 +1,412 @@
+#include <libparasheet/lib_internal.h>
+#include <stdint.h>
+#include <string.h>
+#include <util/util.h>
+
+/*
++---------------------------------------------------+
+|   INFO:                                           |
+|   Per sheet cache of compiled formulas. It is a   |
+|   linear probing map from the source StrID of a   |
+|   code cell to the template built from it.        |
+|                                                   |
+|   Templates are refcounted by their sources and   |
+|   found by a second probing map keyed by ASTHash. |
+|   Both maps delete with backward shifting (same   |
+|   idea as the string table) so no tombstones pile |
+|   up when cells get edited over and over.         |
++---------------------------------------------------+
+*/
+
+#define EmptyKey(k) ((k).idx == UINT32_MAX && (k).gen == UINT32_MAX)
+
+static void FormulaFree(Formula* formula) {
+	ASTFree(&formula->ast);
+	BCFree(&formula->code);
+	JitFree(&formula->jit);
+}
+
+static u32 CacheSlot(FormulaCache* cache, StrID key) {
+	return hash((u8*)&key, sizeof(StrID)) % cache->cap;
+}
+
+static void FormulaCacheResize(FormulaCache* cache) {
+	u32 oldsize = cache->cap;
+	StrID* okeys = cache->keys;
+	FormulaSource* oentries = cache->entries;
+
+	cache->cap = cache->cap ? cache->cap * 2 : 8;
+	cache->keys = Alloc(cache->mem, cache->cap * sizeof(StrID));
+	cache->entries = Alloc(cache->mem, cache->cap * sizeof(FormulaSource));
+
+	memset(cache->keys, -1, cache->cap * sizeof(StrID));
+
+	for (u32 i = 0; i < oldsize; i++) {
+		if (EmptyKey(okeys[i]))
+			continue;
+
+		u32 idx = CacheSlot(cache, okeys[i]);
+		while (!EmptyKey(cache->keys[idx])) {
+			idx = (idx + 1) % cache->cap;
+		}
+		cache->keys[idx] = okeys[i];
+		cache->entries[idx] = oentries[i];
+	}
+
+	Free(cache->mem, okeys, oldsize * sizeof(StrID));
+	Free(cache->mem, oentries, oldsize * sizeof(FormulaSource));
+}
+
+static u32 FormulaCacheFind(FormulaCache* cache, StrID key) {
+	if (!cache->size)
+		return -1;
+
+	u32 idx = CacheSlot(cache, key);
+	for (u32 i = 0; i < cache->cap; i++) {
+		StrID curr = cache->keys[idx];
+		if (StringCmp(curr, key))
+			return idx;
+		if (EmptyKey(curr))
+			return -1;
+		idx = (idx + 1) % cache->cap;
+	}
+
+	return -1;
+}
+
+FormulaSource* FormulaCacheGet(FormulaCache* cache, StrID key) {
+	u32 idx = FormulaCacheFind(cache, key);
+	if (idx == UINT32_MAX) {
+		cache->misses++;
+		return NULL;
+	}
+
+	cache->hits++;
+	return &cache->entries[idx];
+}
+
+static u32 TemplateSlot(FormulaCache* cache, u64 hash) {
+	return hash % cache->tscap;
+}
+
+static void TemplateResize(FormulaCache* cache) {
+	u32 oldsize = cache->tscap;
+	u32* oslots = cache->tslots;
+
+	cache->tscap = cache->tscap ? cache->tscap * 2 : 8;
+	cache->tslots = Alloc(cache->mem, cache->tscap * sizeof(u32));
+	memset(cache->tslots, -1, cache->tscap * sizeof(u32));
+
+	for (u32 i = 0; i < oldsize; i++) {
+		if (oslots[i] == UINT32_MAX)
+			continue;
+
+		u32 idx = TemplateSlot(cache, cache->thashes[oslots[i]]);
+		while (cache->tslots[idx] != UINT32_MAX) {
+			idx = (idx + 1) % cache->tscap;
+		}
+		cache->tslots[idx] = oslots[i];
+	}
+
+	Free(cache->mem, oslots, oldsize * sizeof(u32));
+}
+
+u32 FormulaTemplateFind(FormulaCache* cache, AST* tree, u64 hash) {
+	if (!cache->tcount)
+		return UINT32_MAX;
+
+	u32 idx = TemplateSlot(cache, hash);
+	for (u32 i = 0; i < cache->tscap; i++) {
+		u32 t = cache->tslots[idx];
+		if (t == UINT32_MAX)
+			return UINT32_MAX;
+		if (cache->thashes[t] == hash && ASTEqual(&cache->templates[t].ast, tree))
+			return t;
+		idx = (idx + 1) % cache->tscap;
+	}
+
+	return UINT32_MAX;
+}
+
+u32 FormulaTemplateAdd(FormulaCache* cache, Formula formula, u64 hash) {
+	if (cache->tcount + 1 >= cache->tscap * MAX_LOAD_FACTOR) {
+		TemplateResize(cache);
+	}
+
+	u32 t;
+	if (cache->tfreesize) {
+		t = cache->tfree[--cache->tfreesize];
+	} else {
+		if (cache->tsize + 1 > cache->tcap) {
+			u32 oldsize = cache->tcap;
+			cache->tcap = cache->tcap ? cache->tcap * 2 : 8;
+			cache->templates = Realloc(cache->mem, cache->templates, oldsize * sizeof(Formula),
+									   cache->tcap * sizeof(Formula));
+			cache->thashes = Realloc(cache->mem, cache->thashes, oldsize * sizeof(u64),
+									 cache->tcap * sizeof(u64));
+			cache->trefs = Realloc(cache->mem, cache->trefs, oldsize * sizeof(u32),
+								   cache->tcap * sizeof(u32));
+			cache->tfree = Realloc(cache->mem, cache->tfree, oldsize * sizeof(u32),
+								   cache->tcap * sizeof(u32));
+		}
+		t = cache->tsize++;
+	}
+
+	cache->templates[t] = formula;
+	cache->thashes[t] = hash;
+	cache->trefs[t] = 0;
+	cache->tcount++;
+
+	u32 idx = TemplateSlot(cache, hash);
+	while (cache->tslots[idx] != UINT32_MAX) {
+		idx = (idx + 1) % cache->tscap;
+	}
+	cache->tslots[idx] = t;
+	return t;
+}
+
+// Drops a source's reference, the last one frees the template
+static void TemplateRelease(FormulaCache* cache, u32 t) {
+	if (--cache->trefs[t])
+		return;
+
+	u32 idx = TemplateSlot(cache, cache->thashes[t]);
+	while (cache->tslots[idx] != t) {
+		idx = (idx + 1) % cache->tscap;
+	}
+	cache->tslots[idx] = UINT32_MAX;
+
+	// shift back any templates which were displaced past the hole
+	u32 hole = idx;
+	u32 next = (idx + 1) % cache->tscap;
+	while (cache->tslots[next] != UINT32_MAX) {
+		u32 home = TemplateSlot(cache, cache->thashes[cache->tslots[next]]);
+
+		u32 dhole = (hole + cache->tscap - home) % cache->tscap;
+		u32 dnext = (next + cache->tscap - home) % cache->tscap;
+		if (dhole < dnext) {
+			cache->tslots[hole] = cache->tslots[next];
+			cache->tslots[next] = UINT32_MAX;
+			hole = next;
+		}
+		next = (next + 1) % cache->tscap;
+	}
+
+	FormulaFree(&cache->templates[t]);
+	cache->tfree[cache->tfreesize++] = t;
+	cache->tcount--;
+}
+
+// One handle per constant reference of the template, none resolved
+// yet. An unanchored source has `#` references relative to whichever
+// cell runs it, and every cell filled with the same text shares the
+// source, so its handles would be resolved again on every read.
+static CellHandle* HandlesAlloc(FormulaCache* cache, FormulaSource* source) {
+	u32 refs = cache->templates[source->template].refs;
+	if (!refs || !source->anchored)
+		return NULL;
+
+	CellHandle* handles = Alloc(cache->mem, refs * sizeof(CellHandle));
+	memset(handles, 0xFF, refs * sizeof(CellHandle));
+	return handles;
+}
+
+static void HandlesFree(FormulaCache* cache, FormulaSource* source) {
+	if (source->handles)
+		Free(cache->mem, source->handles,
+			 cache->templates[source->template].refs * sizeof(CellHandle));
+}
+
+static void SourceRelease(FormulaCache* cache, FormulaSource* source) {
+	HandlesFree(cache, source);
+	TemplateRelease(cache, source->template);
+}
+
+FormulaSource* FormulaCacheInsert(FormulaCache* cache, StrID key, FormulaSource source) {
+	if (cache->size + 1 >= cache->cap * MAX_LOAD_FACTOR) {
+		FormulaCacheResize(cache);
+	}
+	cache->trefs[source.template]++;
+	source.handles = HandlesAlloc(cache, &source);
+
+	u32 idx = CacheSlot(cache, key);
+	for (u32 i = 0; i < cache->cap; i++) {
+		StrID curr = cache->keys[idx];
+
+		if (StringCmp(curr, key)) {
+			// replacing an entry, drop its template
+			SourceRelease(cache, &cache->entries[idx]);
+			cache->entries[idx] = source;
+			return &cache->entries[idx];
+		}
+
+		if (EmptyKey(curr)) {
+			cache->keys[idx] = key;
+			cache->entries[idx] = source;
+			cache->size++;
+			return &cache->entries[idx];
+		}
+		idx = (idx + 1) % cache->cap;
+	}
+
+	panic();
+	return NULL;
+}
+
+void FormulaCacheDrop(FormulaCache* cache, StrID key) {
+	u32 idx = FormulaCacheFind(cache, key);
+	if (idx == UINT32_MAX)
+		return;
+
+	SourceRelease(cache, &cache->entries[idx]);
+	cache->keys[idx] = (StrID){UINT32_MAX, UINT32_MAX};
+	cache->size--;
+
+	// shift back any entries which were displaced past the hole
+	u32 hole = idx;
+	u32 next = (idx + 1) % cache->cap;
+	while (!EmptyKey(cache->keys[next])) {
+		u32 home = CacheSlot(cache, cache->keys[next]);
+
+		// distance from home slot to the hole vs to the current slot
+		u32 dhole = (hole + cache->cap - home) % cache->cap;
+		u32 dnext = (next + cache->cap - home) % cache->cap;
+		if (dhole < dnext) {
+			cache->keys[hole] = cache->keys[next];
+			cache->entries[hole] = cache->entries[next];
+			cache->keys[next] = (StrID){UINT32_MAX, UINT32_MAX};
+			hole = next;
+		}
+		next = (next + 1) % cache->cap;
+	}
+}
+
+static u32 UseSlot(FormulaCache* cache, StrID key) {
+	return hash((u8*)&key, sizeof(StrID)) % cache->ucap;
+}
+
+static void UsesResize(FormulaCache* cache) {
+	u32 oldsize = cache->ucap;
+	StrID* okeys = cache->ukeys;
+	u32* ouses = cache->uses;
+
+	cache->ucap = cache->ucap ? cache->ucap * 2 : 8;
+	cache->ukeys = Alloc(cache->mem, cache->ucap * sizeof(StrID));
+	cache->uses = Alloc(cache->mem, cache->ucap * sizeof(u32));
+	memset(cache->ukeys, -1, cache->ucap * sizeof(StrID));
+
+	for (u32 i = 0; i < oldsize; i++) {
+		if (EmptyKey(okeys[i]))
+			continue;
+
+		u32 idx = UseSlot(cache, okeys[i]);
+		while (!EmptyKey(cache->ukeys[idx])) {
+			idx = (idx + 1) % cache->ucap;
+		}
+		cache->ukeys[idx] = okeys[i];
+		cache->uses[idx] = ouses[i];
+	}
+
+	Free(cache->mem, okeys, oldsize * sizeof(StrID));
+	Free(cache->mem, ouses, oldsize * sizeof(u32));
+}
+
+void FormulaCacheRetain(FormulaCache* cache, StrID key) {
+	if (cache->usize + 1 >= cache->ucap * MAX_LOAD_FACTOR) {
+		UsesResize(cache);
+	}
+
+	u32 idx = UseSlot(cache, key);
+	while (!EmptyKey(cache->ukeys[idx])) {
+		if (StringCmp(cache->ukeys[idx], key)) {
+			cache->uses[idx]++;
+			return;
+		}
+		idx = (idx + 1) % cache->ucap;
+	}
+	cache->ukeys[idx] = key;
+	cache->uses[idx] = 1;
+	cache->usize++;
+}
+
+void FormulaCacheRelease(FormulaCache* cache, StrID key) {
+	u32 idx = UINT32_MAX;
+	if (cache->usize) {
+		idx = UseSlot(cache, key);
+		while (!EmptyKey(cache->ukeys[idx]) && !StringCmp(cache->ukeys[idx], key)) {
+			idx = (idx + 1) % cache->ucap;
+		}
+		if (EmptyKey(cache->ukeys[idx]))
+			idx = UINT32_MAX;
+	}
+
+	// a source nobody counted (cells set before the cache existed)
+	// is treated as having this one cell
+	if (idx != UINT32_MAX && --cache->uses[idx])
+		return;
+
+	if (idx != UINT32_MAX) {
+		cache->ukeys[idx] = (StrID){UINT32_MAX, UINT32_MAX};
+		cache->usize--;
+
+		u32 hole = idx;
+		u32 next = (idx + 1) % cache->ucap;
+		while (!EmptyKey(cache->ukeys[next])) {
+			u32 home = UseSlot(cache, cache->ukeys[next]);
+			u32 dhole = (hole + cache->ucap - home) % cache->ucap;
+			u32 dnext = (next + cache->ucap - home) % cache->ucap;
+			if (dhole < dnext) {
+				cache->ukeys[hole] = cache->ukeys[next];
+				cache->uses[hole] = cache->uses[next];
+				cache->ukeys[next] = (StrID){UINT32_MAX, UINT32_MAX};
+				hole = next;
+			}
+			next = (next + 1) % cache->ucap;
+		}
+	}
+
+	FormulaCacheDrop(cache, key);
+}
+
+void FormulaCacheCopyUses(FormulaCache* dst, FormulaCache* src) {
+	if (!src->ucap)
+		return;
+
+	dst->ukeys = Alloc(dst->mem, src->ucap * sizeof(StrID));
+	dst->uses = Alloc(dst->mem, src->ucap * sizeof(u32));
+	memcpy(dst->ukeys, src->ukeys, src->ucap * sizeof(StrID));
+	memcpy(dst->uses, src->uses, src->ucap * sizeof(u32));
+	dst->usize = src->usize;
+	dst->ucap = src->ucap;
+}
+
+void FormulaCacheFree(FormulaCache* cache) {
+	if (cache->ucap) {
+		Free(cache->mem, cache->ukeys, cache->ucap * sizeof(StrID));
+		Free(cache->mem, cache->uses, cache->ucap * sizeof(u32));
+		cache->ukeys = NULL;
+		cache->uses = NULL;
+		cache->usize = cache->ucap = 0;
+	}
+	if (!cache->cap)
+		return;
+
+	for (u32 i = 0; i < cache->cap; i++) {
+		if (EmptyKey(cache->keys[i]))
+			continue;
+		HandlesFree(cache, &cache->entries[i]);
+	}
+	for (u32 t = 0; t < cache->tsize; t++) {
+		if (cache->trefs[t])
+			FormulaFree(&cache->templates[t]);
+	}
+
+	Free(cache->mem, cache->keys, cache->cap * sizeof(StrID));
+	Free(cache->mem, cache->entries, cache->cap * sizeof(FormulaSource));
+	Free(cache->mem, cache->templates, cache->tcap * sizeof(Formula));
+	Free(cache->mem, cache->thashes, cache->tcap * sizeof(u64));
+	Free(cache->mem, cache->trefs, cache->tcap * sizeof(u32));
+	Free(cache->mem, cache->tfree, cache->tcap * sizeof(u32));
+	Free(cache->mem, cache->tslots, cache->tscap * sizeof(u32));
+	*cache = (FormulaCache){.mem = cache->mem};
+}
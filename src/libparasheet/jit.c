@@ -0,0 +1,772 @@
+// memfd_create, for the code arena's two views
+#define _GNU_SOURCE
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/util.h>
+
+/*
++---------------------------------------------------+
+|   INFO:                                           |
+|   AST to x86-64 translator. The generated code    |
+|   is one function                                 |
+|                                                   |
+|       void fn(JitFrame* frame, CellValue* slots)  |
+|                                                   |
+|   which keeps the frame in rbx and the slots in   |
+|   r13 and writes the value of node i to slots[i]. |
+|   Children are emitted before their parent, so    |
+|   it is the same post order the tree walker uses, |
+|   except that IF only runs the branch it takes.   |
+|                                                   |
+|   Literals, typed arithmetic, conversions, SEQ    |
+|   and IF are fully inline. Generic arithmetic has |
+|   inline int/int and float/float paths and calls  |
+|   EvalBinaryOp for everything else. Constant cell |
+|   loads call EvalReadCell. Any other node is      |
+|   handed to evaluateNode, subtree and all.        |
+|                                                   |
+|   The code is written into a plain buffer and     |
+|   then copied into the code arena below, which    |
+|   only ever runs it from a read/exec mapping.     |
++---------------------------------------------------+
+*/
+
+#if defined(__x86_64__) && defined(__linux__) && !defined(PARASHEET_NO_JIT) && \
+	!defined(CELL_NANBOX)
+#define JIT_AVAILABLE
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define EPS UINT32_MAX
+#define LOCAL_SLOTS 64
+
+static u32 threshold = 100;
+static u32 checking = 0;
+
+void JitConfigure(u32 runs, u32 check) {
+	threshold = runs;
+	checking = check;
+}
+
+u32 JitThreshold(void) {
+#if defined(JIT_AVAILABLE)
+	return threshold;
+#else
+	return 0;
+#endif
+}
+
+u32 JitChecking(void) {
+	return checking;
+}
+
+#if defined(JIT_AVAILABLE)
+
+typedef struct JitFrame {
+	AST* tree;
+	EvalContext ctx;
+	CellValue* slots;
+} JitFrame;
+
+/*
++---------------------------------------------------+
+|   NOTE:                                           |
+|   Helpers called from the generated code. They    |
+|   only take integer arguments so the calls are    |
+|   plain SysV calls with everything in registers.  |
++---------------------------------------------------+
+*/
+
+static void JitBinary(JitFrame* f, u32 op, u32 dst, u32 a, u32 b) {
+	f->slots[dst] = EvalBinaryOp(op, f->slots[a], f->slots[b]);
+}
+
+// bits 1/2 of relative add the anchor to x/y, same as BC_CELL. dst is
+// the reference node, which also carries its handle slot
+static void JitRead(JitFrame* f, u32 dst, u32 x, u32 y, u32 relative) {
+	v2u pos = {
+		x + (relative & 1 ? f->ctx.anchor.x : 0),
+		y + (relative & 2 ? f->ctx.anchor.y : 0),
+	};
+	f->slots[dst] = EvalReadRef(f->ctx, pos, ASTGet(f->tree, dst).data.i);
+}
+
+static void JitWalk(JitFrame* f, u32 node) {
+	f->slots[node] = evaluateNode(f->tree, node, f->ctx);
+}
+
+typedef void (*JitFn)(JitFrame* frame, CellValue* slots);
+
+typedef struct Assembler {
+	Allocator mem;
+	AST* tree;
+	u8* buf;
+	u32 size;
+	u32 cap;
+	u32 walks;	// subtrees handed to evaluateNode
+	u32 scoped; // scope nodes have to run on the walker too
+} Assembler;
+
+// x86 register numbers
+enum {
+	RAX = 0,
+	RCX = 1,
+	RDX = 2,
+	RBX = 3,
+	RSI = 6,
+	RDI = 7,
+	R8 = 8,
+	R13 = 13,
+};
+
+// condition codes for jcc
+enum {
+	CC_P = 0xA,
+	CC_E = 0x4,
+	CC_NE = 0x5,
+};
+
+static void Byte(Assembler* as, u8 b) {
+	if (as->size + 1 > as->cap) {
+		u32 oldsize = as->cap;
+		as->cap = as->cap ? as->cap * 2 : 256;
+		as->buf = Realloc(as->mem, as->buf, oldsize, as->cap);
+	}
+	as->buf[as->size++] = b;
+}
+
+static void Bytes(Assembler* as, const u8* b, u32 n) {
+	for (u32 i = 0; i < n; i++) {
+		Byte(as, b[i]);
+	}
+}
+
+static void Imm32(Assembler* as, u32 v) {
+	for (u32 i = 0; i < 4; i++) {
+		Byte(as, (v >> (i * 8)) & 0xFF);
+	}
+}
+
+static void Imm64(Assembler* as, u64 v) {
+	Imm32(as, (u32)v);
+	Imm32(as, (u32)(v >> 32));
+}
+
+// byte offset of a field of slot `node` from r13
+static u32 Slot(u32 node, u32 field) {
+	return node * sizeof(CellValue) + field;
+}
+
+#define TAG 0
+#define VAL 4
+
+// modrm for [r13 + disp32] with `reg` in the reg field
+static void SlotOperand(Assembler* as, u32 reg, u32 disp) {
+	Byte(as, 0x80 | ((reg & 7) << 3) | (R13 & 7));
+	Imm32(as, disp);
+}
+
+// mov dword [r13 + disp], imm32
+static void StoreImm(Assembler* as, u32 disp, u32 imm) {
+	Bytes(as, (u8[]){0x41, 0xC7}, 2);
+	SlotOperand(as, 0, disp);
+	Imm32(as, imm);
+}
+
+// mov r32, [r13 + disp]  (eax/ecx/edx only)
+static void Load32(Assembler* as, u32 reg, u32 disp) {
+	Bytes(as, (u8[]){0x41, 0x8B}, 2);
+	SlotOperand(as, reg, disp);
+}
+
+// mov [r13 + disp], r32
+static void Store32(Assembler* as, u32 disp, u32 reg) {
+	Bytes(as, (u8[]){0x41, 0x89}, 2);
+	SlotOperand(as, reg, disp);
+}
+
+// cmp dword [r13 + disp], imm8
+static void CmpImm(Assembler* as, u32 disp, u8 imm) {
+	Bytes(as, (u8[]){0x41, 0x83}, 2);
+	SlotOperand(as, 7, disp);
+	Byte(as, imm);
+}
+
+// movss xmm, [r13 + disp]
+static void LoadSS(Assembler* as, u32 xmm, u32 disp) {
+	Bytes(as, (u8[]){0xF3, 0x41, 0x0F, 0x10}, 4);
+	SlotOperand(as, xmm, disp);
+}
+
+// movss [r13 + disp], xmm
+static void StoreSS(Assembler* as, u32 disp, u32 xmm) {
+	Bytes(as, (u8[]){0xF3, 0x41, 0x0F, 0x11}, 4);
+	SlotOperand(as, xmm, disp);
+}
+
+// slots[dst] = slots[src], 12 bytes through rax and ecx
+static void CopySlot(Assembler* as, u32 dst, u32 src) {
+	if (dst == src)
+		return;
+	Bytes(as, (u8[]){0x49, 0x8B}, 2);
+	SlotOperand(as, RAX, Slot(src, 0));
+	Load32(as, RCX, Slot(src, 8));
+	Bytes(as, (u8[]){0x49, 0x89}, 2);
+	SlotOperand(as, RAX, Slot(dst, 0));
+	Store32(as, Slot(dst, 8), RCX);
+}
+
+static void StoreValue(Assembler* as, u32 dst, CellType t, u32 bits) {
+	StoreImm(as, Slot(dst, TAG), t);
+	StoreImm(as, Slot(dst, VAL), bits);
+}
+
+// jcc/jmp rel32 with the target patched in later, returns the
+// offset of the displacement
+static u32 Jump(Assembler* as, i32 cc) {
+	if (cc < 0) {
+		Byte(as, 0xE9);
+	} else {
+		Bytes(as, (u8[]){0x0F, 0x80 | cc}, 2);
+	}
+	Imm32(as, 0);
+	return as->size - 4;
+}
+
+static void Land(Assembler* as, u32 at) {
+	u32 rel = as->size - (at + 4);
+	memcpy(&as->buf[at], &rel, 4);
+}
+
+// mov r32, imm32 for the argument registers
+static void MovImm(Assembler* as, u32 reg, u32 imm) {
+	if (reg >= 8)
+		Byte(as, 0x41);
+	Byte(as, 0xB8 + (reg & 7));
+	Imm32(as, imm);
+}
+
+// helper(frame, args...), the frame pointer lives in rbx
+static void Call(Assembler* as, void* fn, const u32* args, u32 count) {
+	static const u32 regs[] = {RSI, RDX, RCX, R8};
+	Bytes(as, (u8[]){0x48, 0x89, 0xDF}, 3); // mov rdi, rbx
+	for (u32 i = 0; i < count; i++) {
+		MovImm(as, regs[i], args[i]);
+	}
+	Bytes(as, (u8[]){0x48, 0xB8}, 2); // mov rax, fn
+	Imm64(as, (u64)(uintptr_t)fn);
+	Bytes(as, (u8[]){0xFF, 0xD0}, 2); // call rax
+}
+
+static void Emit(Assembler* as, u32 index);
+
+// A literal coordinate or a constant `#` offset from the anchor
+static u32 IsConstCoord(ASTNode* node) {
+	return node->op == AST_INT_LITERAL ||
+		   (node->op == AST_COORD_TRANSFORM && node->lchild == EPS);
+}
+
+// Hands a whole subtree to evaluateNode
+static void EmitWalk(Assembler* as, u32 index) {
+	as->walks++;
+	Call(as, (void*)JitWalk, (u32[]){index}, 1);
+}
+
+// Division by zero stores #DIV/0! and jumps past the op, returns
+// the jump to land after it
+static u32 DivZero(Assembler* as, u32 dst) {
+	StoreValue(as, dst, CT_ERROR, CE_DIV0);
+	return Jump(as, -1);
+}
+
+static void IntOp(Assembler* as, ASTNodeOp op, u32 dst, u32 a, u32 b) {
+	Load32(as, RAX, Slot(a, VAL));
+	Load32(as, RCX, Slot(b, VAL));
+	u32 zero = EPS;
+	switch (op) {
+		case AST_ADD: Bytes(as, (u8[]){0x01, 0xC8}, 2); break; // add eax, ecx
+		case AST_SUB: Bytes(as, (u8[]){0x29, 0xC8}, 2); break; // sub eax, ecx
+		case AST_MUL: Bytes(as, (u8[]){0x0F, 0xAF, 0xC1}, 3); break; // imul eax, ecx
+		default: {
+			Bytes(as, (u8[]){0x85, 0xC9}, 2); // test ecx, ecx
+			u32 ok = Jump(as, CC_NE);
+			zero = DivZero(as, dst);
+			Land(as, ok);
+			Bytes(as, (u8[]){0x99, 0xF7, 0xF9}, 3); // cdq, idiv ecx
+		} break;
+	}
+	Store32(as, Slot(dst, VAL), RAX);
+	StoreImm(as, Slot(dst, TAG), CT_INT);
+	if (zero != EPS)
+		Land(as, zero);
+}
+
+static void FloatOp(Assembler* as, ASTNodeOp op, u32 dst, u32 a, u32 b) {
+	LoadSS(as, 0, Slot(a, VAL));
+	LoadSS(as, 1, Slot(b, VAL));
+	u8 code = 0x5E; // divss
+	u32 zero = EPS;
+	switch (op) {
+		case AST_ADD: code = 0x58; break;
+		case AST_SUB: code = 0x5C; break;
+		case AST_MUL: code = 0x59; break;
+		default: {
+			// NaN isn't zero, same as rf == 0.0f in the walker
+			Bytes(as, (u8[]){0x0F, 0x57, 0xD2}, 3); // xorps xmm2, xmm2
+			Bytes(as, (u8[]){0x0F, 0x2E, 0xCA}, 3); // ucomiss xmm1, xmm2
+			u32 nan = Jump(as, CC_P);
+			u32 ok = Jump(as, CC_NE);
+			zero = DivZero(as, dst);
+			Land(as, nan);
+			Land(as, ok);
+		} break;
+	}
+	Bytes(as, (u8[]){0xF3, 0x0F, code, 0xC1}, 4); // op xmm0, xmm1
+	StoreSS(as, Slot(dst, VAL), 0);
+	StoreImm(as, Slot(dst, TAG), CT_FLOAT);
+	if (zero != EPS)
+		Land(as, zero);
+}
+
+// Operand types are only known at run time. Matching ints or
+// floats run inline, mixed types and errors go to EvalBinaryOp.
+static void EmitGeneric(Assembler* as, ASTNode* node, u32 index) {
+	u32 a = node->lchild, b = node->mchild;
+	Emit(as, a);
+	Emit(as, b);
+
+	CmpImm(as, Slot(a, TAG), CT_INT);
+	u32 notInt = Jump(as, CC_NE);
+	CmpImm(as, Slot(b, TAG), CT_INT);
+	u32 slowInt = Jump(as, CC_NE);
+	IntOp(as, node->op, index, a, b);
+	u32 doneInt = Jump(as, -1);
+
+	Land(as, notInt);
+	CmpImm(as, Slot(a, TAG), CT_FLOAT);
+	u32 slowA = Jump(as, CC_NE);
+	CmpImm(as, Slot(b, TAG), CT_FLOAT);
+	u32 slowB = Jump(as, CC_NE);
+	FloatOp(as, node->op, index, a, b);
+	u32 doneFloat = Jump(as, -1);
+
+	Land(as, slowInt);
+	Land(as, slowA);
+	Land(as, slowB);
+	Call(as, (void*)JitBinary, (u32[]){node->op, index, a, b}, 4);
+
+	Land(as, doneInt);
+	Land(as, doneFloat);
+}
+
+static void EmitIf(Assembler* as, ASTNode* node, u32 index) {
+	u32 c = node->lchild;
+	Emit(as, c);
+
+	// truthy: a nonzero int or a nonzero (or NaN) float
+	CmpImm(as, Slot(c, TAG), CT_INT);
+	u32 notInt = Jump(as, CC_NE);
+	CmpImm(as, Slot(c, VAL), 0);
+	u32 thenInt = Jump(as, CC_NE);
+	u32 elseInt = Jump(as, -1);
+
+	Land(as, notInt);
+	CmpImm(as, Slot(c, TAG), CT_FLOAT);
+	u32 elseTag = Jump(as, CC_NE);
+	LoadSS(as, 0, Slot(c, VAL));
+	Bytes(as, (u8[]){0x0F, 0x57, 0xC9}, 3); // xorps xmm1, xmm1
+	Bytes(as, (u8[]){0x0F, 0x2E, 0xC1}, 3); // ucomiss xmm0, xmm1
+	u32 thenNan = Jump(as, CC_P);
+	u32 elseZero = Jump(as, CC_E);
+
+	Land(as, thenInt);
+	Land(as, thenNan);
+	Emit(as, node->mchild);
+	CopySlot(as, index, node->mchild);
+	u32 done = Jump(as, -1);
+
+	Land(as, elseInt);
+	Land(as, elseTag);
+	Land(as, elseZero);
+	if (node->rchild == EPS) {
+		StoreValue(as, index, CT_EMPTY, 0);
+	} else {
+		Emit(as, node->rchild);
+		CopySlot(as, index, node->rchild);
+	}
+	Land(as, done);
+}
+
+static void Emit(Assembler* as, u32 index) {
+	ASTNode* node = &ASTGet(as->tree, index);
+
+	switch (node->op) {
+		case AST_INT_LITERAL:
+			StoreValue(as, index, CT_INT, node->data.i);
+			return;
+		case AST_FLOAT_LITERAL: {
+			u32 bits;
+			memcpy(&bits, &node->data.f, 4);
+			StoreValue(as, index, CT_FLOAT, bits);
+			return;
+		}
+
+		case AST_ADD:
+		case AST_SUB:
+		case AST_MUL:
+		case AST_DIV:
+			EmitGeneric(as, node, index);
+			return;
+
+		case AST_ADD_INT:
+		case AST_SUB_INT:
+		case AST_MUL_INT:
+		case AST_DIV_INT:
+			Emit(as, node->lchild);
+			Emit(as, node->mchild);
+			IntOp(as, AST_ADD + (node->op - AST_ADD_INT), index, node->lchild, node->mchild);
+			return;
+
+		case AST_ADD_FLOAT:
+		case AST_SUB_FLOAT:
+		case AST_MUL_FLOAT:
+		case AST_DIV_FLOAT:
+			Emit(as, node->lchild);
+			Emit(as, node->mchild);
+			FloatOp(as, AST_ADD + (node->op - AST_ADD_FLOAT), index, node->lchild, node->mchild);
+			return;
+
+		case AST_INT_TO_FLOAT:
+			Emit(as, node->lchild);
+			Load32(as, RAX, Slot(node->lchild, VAL));
+			Bytes(as, (u8[]){0xF3, 0x0F, 0x2A, 0xC0}, 4); // cvtsi2ss xmm0, eax
+			StoreSS(as, Slot(index, VAL), 0);
+			StoreImm(as, Slot(index, TAG), CT_FLOAT);
+			return;
+
+		case AST_FLOAT_TO_INT:
+			Emit(as, node->lchild);
+			LoadSS(as, 0, Slot(node->lchild, VAL));
+			Bytes(as, (u8[]){0xF3, 0x0F, 0x2C, 0xC0}, 4); // cvttss2si eax, xmm0
+			Store32(as, Slot(index, VAL), RAX);
+			StoreImm(as, Slot(index, TAG), CT_INT);
+			return;
+
+		case AST_GET_CELL_REF: {
+			ASTNode* x = &ASTGet(as->tree, node->lchild);
+			ASTNode* y = &ASTGet(as->tree, node->mchild);
+			if (!IsConstCoord(x) || !IsConstCoord(y))
+				break;
+			u32 relative = (x->op == AST_COORD_TRANSFORM) | (y->op == AST_COORD_TRANSFORM) << 1;
+			Call(as, (void*)JitRead, (u32[]){index, x->data.i, y->data.i, relative}, 4);
+			return;
+		}
+
+		case AST_SEQ: {
+			Emit(as, node->lchild);
+			Emit(as, node->mchild);
+			CopySlot(as, index, node->mchild);
+			CmpImm(as, Slot(node->mchild, TAG), CT_EMPTY);
+			u32 done = Jump(as, CC_NE);
+			CopySlot(as, index, node->lchild);
+			Land(as, done);
+			return;
+		}
+
+		case AST_IF_ELSE:
+			EmitIf(as, node, index);
+			return;
+
+		case AST_RETURN:
+			Emit(as, node->lchild);
+			CopySlot(as, index, node->lchild);
+			return;
+
+		case AST_SCOPE_BEGIN:
+		case AST_SCOPE_END:
+			// scopes only matter to variables, which are all in
+			// walked subtrees when there are any
+			if (!as->scoped) {
+				StoreValue(as, index, CT_EMPTY, 0);
+				return;
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	EmitWalk(as, index);
+}
+
+/*
++---------------------------------------------------+
+|   INFO:                                           |
+|   Compiled code from every template is packed     |
+|   into shared chunks of JIT_CHUNK bytes, one      |
+|   mapping per chunk instead of one per template.  |
+|   A chunk is a memfd mapped twice: a read/write   |
+|   view the code is copied in through and a        |
+|   read/exec view it runs from. No page is ever    |
+|   writable and executable at once, and nothing    |
+|   has to be re-protected under code that another  |
+|   thread may be running.                          |
+|                                                   |
+|   New code goes into the open chunk. Once that    |
+|   is full its write view is unmapped and a new    |
+|   chunk is opened. A chunk goes back to the OS    |
+|   when the last function in it is freed.          |
++---------------------------------------------------+
+*/
+
+#define JIT_CHUNK MB(1)
+#define JIT_ALIGN 16
+
+typedef struct JitChunk {
+	u8* write; // NULL once the chunk is full
+	u8* exec;	// NULL for a free entry
+	u32 size;
+	u32 used;
+	u32 live; // functions still in it
+} JitChunk;
+
+static struct {
+	pthread_mutex_t lock;
+	JitChunk* chunks;
+	u32 count;
+	u32 cap;
+	u32 open; // where new code goes, UINT32_MAX for nowhere yet
+} arena = {.lock = PTHREAD_MUTEX_INITIALIZER, .open = UINT32_MAX};
+
+static u32 ChunkMap(JitChunk* chunk, u32 size) {
+	int fd = memfd_create("parasheet-jit", MFD_CLOEXEC);
+	if (fd < 0) {
+		warn("jit: memfd_create failed");
+		return 0;
+	}
+	u8* write = MAP_FAILED;
+	u8* exec = MAP_FAILED;
+	if (ftruncate(fd, size) == 0) {
+		write = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		exec = mmap(NULL, size, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+	}
+	// the mappings keep the memory alive
+	close(fd);
+	if (write == MAP_FAILED || exec == MAP_FAILED) {
+		warn("jit: mmap failed");
+		if (write != MAP_FAILED)
+			munmap(write, size);
+		if (exec != MAP_FAILED)
+			munmap(exec, size);
+		return 0;
+	}
+	*chunk = (JitChunk){.write = write, .exec = exec, .size = size};
+	return 1;
+}
+
+static void ChunkUnmap(JitChunk* chunk) {
+	if (chunk->write)
+		munmap(chunk->write, chunk->size);
+	munmap(chunk->exec, chunk->size);
+	*chunk = (JitChunk){0};
+}
+
+// Copies `size` bytes of code into the open chunk, opening a new one
+// when it doesn't fit. Returns where the code runs from, or NULL.
+static u8* ArenaPlace(const u8* code, u32 size, u32* index) {
+	pthread_mutex_lock(&arena.lock);
+
+	u32 at = 0;
+	if (arena.open != UINT32_MAX) {
+		JitChunk* open = &arena.chunks[arena.open];
+		at = (open->used + JIT_ALIGN - 1) / JIT_ALIGN * JIT_ALIGN;
+		if (at + size > open->size) {
+			munmap(open->write, open->size);
+			open->write = NULL;
+			if (!open->live)
+				ChunkUnmap(open);
+			arena.open = UINT32_MAX;
+		}
+	}
+
+	if (arena.open == UINT32_MAX) {
+		u32 c = 0;
+		while (c < arena.count && arena.chunks[c].exec)
+			c++;
+		if (c == arena.count) {
+			if (arena.count == arena.cap) {
+				Allocator mem = GlobalAllocatorCreate();
+				u32 cap = arena.cap ? arena.cap * 2 : 8;
+				arena.chunks = Realloc(mem, arena.chunks, arena.cap * sizeof(JitChunk),
+									   cap * sizeof(JitChunk));
+				arena.cap = cap;
+			}
+			arena.chunks[arena.count++] = (JitChunk){0};
+		}
+		// code bigger than a chunk gets a chunk of its own size
+		u32 page = 4096;
+		u32 bytes = MAX((u32)JIT_CHUNK, (size + page - 1) / page * page);
+		if (!ChunkMap(&arena.chunks[c], bytes)) {
+			pthread_mutex_unlock(&arena.lock);
+			return NULL;
+		}
+		arena.open = c;
+		at = 0;
+	}
+
+	JitChunk* chunk = &arena.chunks[arena.open];
+	memcpy(chunk->write + at, code, size);
+	chunk->used = at + size;
+	chunk->live++;
+	*index = arena.open;
+	u8* exec = chunk->exec + at;
+
+	pthread_mutex_unlock(&arena.lock);
+	return exec;
+}
+
+static void ArenaRelease(u32 index) {
+	pthread_mutex_lock(&arena.lock);
+	JitChunk* chunk = &arena.chunks[index];
+	if (--chunk->live == 0) {
+		// the open chunk is just filled again from the start
+		if (index == arena.open)
+			chunk->used = 0;
+		else
+			ChunkUnmap(chunk);
+	}
+	pthread_mutex_unlock(&arena.lock);
+}
+
+// Anything the walker has to run makes scopes real, so they are
+// walked as well. Finds out up front which case this tree is.
+static u32 NeedsWalker(AST* tree) {
+	for (u32 i = 0; i < tree->size; i++) {
+		ASTNode* node = &ASTGet(tree, i);
+		switch (node->op) {
+			case AST_INT_LITERAL:
+			case AST_FLOAT_LITERAL:
+			case AST_ADD:
+			case AST_SUB:
+			case AST_MUL:
+			case AST_DIV:
+			case AST_ADD_INT:
+			case AST_SUB_INT:
+			case AST_MUL_INT:
+			case AST_DIV_INT:
+			case AST_ADD_FLOAT:
+			case AST_SUB_FLOAT:
+			case AST_MUL_FLOAT:
+			case AST_DIV_FLOAT:
+			case AST_INT_TO_FLOAT:
+			case AST_FLOAT_TO_INT:
+			case AST_GET_CELL_REF:
+			case AST_SEQ:
+			case AST_IF_ELSE:
+			case AST_RETURN:
+			case AST_SCOPE_BEGIN:
+			case AST_SCOPE_END:
+				continue;
+			case AST_COORD_TRANSFORM:
+				if (node->lchild == EPS)
+					continue;
+				return 1;
+			default:
+				return 1;
+		}
+	}
+	return 0;
+}
+
+u32 JitCompile(AST* tree, JitCode* jit) {
+	*jit = (JitCode){0};
+	if (!tree->size)
+		return 0;
+
+	Assembler as = {.mem = tree->mem, .tree = tree};
+
+	as.scoped = NeedsWalker(tree);
+
+	Bytes(&as, (u8[]){0x53}, 1);				   // push rbx
+	Bytes(&as, (u8[]){0x41, 0x55}, 2);			   // push r13
+	Bytes(&as, (u8[]){0x48, 0x83, 0xEC, 0x08}, 4); // sub rsp, 8
+	Bytes(&as, (u8[]){0x48, 0x89, 0xFB}, 3);	   // mov rbx, rdi
+	Bytes(&as, (u8[]){0x49, 0x89, 0xF5}, 3);	   // mov r13, rsi
+
+	Emit(&as, tree->size - 1);
+
+	Bytes(&as, (u8[]){0x48, 0x83, 0xC4, 0x08}, 4); // add rsp, 8
+	Bytes(&as, (u8[]){0x41, 0x5D}, 2);			   // pop r13
+	Bytes(&as, (u8[]){0x5B, 0xC3}, 2);			   // pop rbx, ret
+
+	u32 chunk;
+	u8* code = ArenaPlace(as.buf, as.size, &chunk);
+	Free(as.mem, as.buf, as.cap);
+	if (!code)
+		return 0;
+
+	*jit = (JitCode){
+		.code = code,
+		.size = as.size,
+		.chunk = chunk,
+		.slots = tree->size,
+		.walks = as.walks,
+	};
+	return 1;
+}
+
+void JitFree(JitCode* jit) {
+	if (jit->code)
+		ArenaRelease(jit->chunk);
+	*jit = (JitCode){0};
+}
+
+CellValue JitRun(JitCode* jit, AST* tree, EvalContext ctx) {
+	CellValue local[LOCAL_SLOTS];
+	CellValue* slots = local;
+	if (jit->slots > LOCAL_SLOTS) {
+		slots = Alloc(ctx.mem, jit->slots * sizeof(CellValue));
+	}
+
+	// walked subtrees need the top level scope runFormula would push
+	u32 depth = ctx.table ? ctx.table->size : 0;
+	if (jit->walks)
+		SymbolPushScope(ctx.table);
+
+	JitFrame frame = {.tree = tree, .ctx = ctx, .slots = slots};
+	((JitFn)(void*)jit->code)(&frame, slots);
+
+	if (jit->walks) {
+		while (ctx.table->size > depth) SymbolPopScope(ctx.table);
+	}
+
+	CellValue result = slots[tree->size - 1];
+	if (slots != local) {
+		Free(ctx.mem, slots, jit->slots * sizeof(CellValue));
+	}
+	return result;
+}
+
+#else
+
+u32 JitCompile(AST* tree, JitCode* jit) {
+	*jit = (JitCode){0};
+	return 0;
+}
+
+void JitFree(JitCode* jit) {
+	*jit = (JitCode){0};
+}
+
+CellValue JitRun(JitCode* jit, AST* tree, EvalContext ctx) {
+	// never compiled on this target
+	panic();
+}
+
+#endif
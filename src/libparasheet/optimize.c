@@ -0,0 +1,449 @@
+#include <libparasheet/lib_internal.h>
+#include <stdint.h>
+#include <string.h>
+#include <util/util.h>
+
+/*
++---------------------------------------------------+
+|   INFO:                                           |
+|   Type inference and constant folding. The tree   |
+|   is copied into a fresh node array in post       |
+|   order, so the root stays the last node and a    |
+|   folded subtree can be dropped by truncating the |
+|   array back to where the subtree started.        |
+|                                                   |
+|   Only literals and declared variables have a     |
+|   known type. Cell references can hold anything   |
+|   so arithmetic on them keeps the generic ops.    |
++---------------------------------------------------+
+*/
+
+#define EPS UINT32_MAX
+
+typedef enum InferredType : u32 {
+	IT_DYN = 0,
+	IT_EMPTY,
+	IT_INT,
+	IT_FLOAT,
+} InferredType;
+
+typedef struct Typed {
+	u32 node;
+	InferredType type;
+} Typed;
+
+typedef struct TypedVar {
+	StrID name;
+	InferredType type;
+	u32 depth;
+} TypedVar;
+
+typedef struct Optimizer {
+	AST* tree;
+	AST out;
+
+	TypedVar* vars;
+	u32 vsize;
+	u32 vcap;
+
+	u32 depth;
+} Optimizer;
+
+static u32 EmitNode(Optimizer* o, ASTNode node) {
+	u32 idx = ASTPush(&o->out);
+	o->out.nodes[idx] = node;
+	return idx;
+}
+
+static u32 EmitInt(Optimizer* o, i32 v) {
+	return EmitNode(o, (ASTNode){
+						   .op = AST_INT_LITERAL,
+						   .data.i = v,
+						   .lchild = EPS,
+						   .mchild = EPS,
+						   .rchild = EPS,
+					   });
+}
+
+static u32 EmitFloat(Optimizer* o, CellFloat v) {
+	return EmitNode(o, (ASTNode){
+						   .op = AST_FLOAT_LITERAL,
+						   .data.f = v,
+						   .lchild = EPS,
+						   .mchild = EPS,
+						   .rchild = EPS,
+					   });
+}
+
+static ASTNode* OutNode(Optimizer* o, u32 idx) {
+	return &o->out.nodes[idx];
+}
+
+static u32 IsLiteral(Optimizer* o, Typed t) {
+	if (t.node == EPS)
+		return 0;
+	ASTNodeOp op = OutNode(o, t.node)->op;
+	return op == AST_INT_LITERAL || op == AST_FLOAT_LITERAL;
+}
+
+static u32 IsNonZeroLiteral(Optimizer* o, Typed t) {
+	if (!IsLiteral(o, t))
+		return 0;
+	ASTNode* lit = OutNode(o, t.node);
+	return lit->op == AST_INT_LITERAL ? lit->data.i != 0 : lit->data.f != 0.0f;
+}
+
+static TypedVar* FindTypedVar(Optimizer* o, StrID name) {
+	for (i32 i = o->vsize - 1; i >= 0; i--) {
+		if (StringCmp(o->vars[i].name, name))
+			return &o->vars[i];
+	}
+	return NULL;
+}
+
+// Converts an int or float operand to the other type, a literal is
+// converted in place instead of getting a conversion node
+static Typed Convert(Optimizer* o, Typed t, InferredType to) {
+	if (t.type == to)
+		return t;
+
+	if (IsLiteral(o, t)) {
+		ASTNode* lit = OutNode(o, t.node);
+		if (to == IT_FLOAT) {
+			*lit = (ASTNode){
+				.op = AST_FLOAT_LITERAL,
+				.data.f = (CellFloat)lit->data.i,
+				.lchild = EPS,
+				.mchild = EPS,
+				.rchild = EPS,
+			};
+		} else {
+			*lit = (ASTNode){
+				.op = AST_INT_LITERAL,
+				.data.i = (i32)lit->data.f,
+				.lchild = EPS,
+				.mchild = EPS,
+				.rchild = EPS,
+			};
+		}
+		return (Typed){t.node, to};
+	}
+
+	ASTNodeOp op = to == IT_FLOAT ? AST_INT_TO_FLOAT : AST_FLOAT_TO_INT;
+	u32 node = EmitNode(o, (ASTNode){.op = op, .lchild = t.node, .mchild = EPS, .rchild = EPS});
+	return (Typed){node, to};
+}
+
+static Typed Rewrite(Optimizer* o, u32 index);
+
+static Typed RewriteArith(Optimizer* o, ASTNode* node) {
+	u32 start = o->out.size;
+	Typed l = Rewrite(o, node->lchild);
+	Typed r = Rewrite(o, node->mchild);
+
+	u32 lnum = l.type == IT_INT || l.type == IT_FLOAT;
+	u32 rnum = r.type == IT_INT || r.type == IT_FLOAT;
+	if (!lnum || !rnum) {
+		ASTNode copy = *node;
+		copy.lchild = l.node;
+		copy.mchild = r.node;
+		return (Typed){EmitNode(o, copy), IT_DYN};
+	}
+
+	InferredType type = (l.type == IT_FLOAT || r.type == IT_FLOAT) ? IT_FLOAT : IT_INT;
+	l = Convert(o, l, type);
+	r = Convert(o, r, type);
+
+	u32 offset = node->op - AST_ADD;
+
+	// NOTE: division by zero is left in so it gives #DIV/0! at run
+	// time the same way it always has
+	if (IsLiteral(o, l) && IsLiteral(o, r)) {
+		ASTNode* a = OutNode(o, l.node);
+		ASTNode* b = OutNode(o, r.node);
+
+		if (type == IT_INT && !(node->op == AST_DIV && b->data.i == 0)) {
+			i32 x = a->data.i, y = b->data.i, v = 0;
+			switch (node->op) {
+			case AST_ADD: v = x + y; break;
+			case AST_SUB: v = x - y; break;
+			case AST_MUL: v = x * y; break;
+			default: v = x / y; break;
+			}
+			o->out.size = start;
+			return (Typed){EmitInt(o, v), IT_INT};
+		}
+
+		if (type == IT_FLOAT && !(node->op == AST_DIV && b->data.f == 0.0f)) {
+			CellFloat x = a->data.f, y = b->data.f, v = 0;
+			switch (node->op) {
+			case AST_ADD: v = x + y; break;
+			case AST_SUB: v = x - y; break;
+			case AST_MUL: v = x * y; break;
+			default: v = x / y; break;
+			}
+			o->out.size = start;
+			return (Typed){EmitFloat(o, v), IT_FLOAT};
+		}
+	}
+
+	ASTNodeOp op = (type == IT_INT ? AST_ADD_INT : AST_ADD_FLOAT) + offset;
+	u32 res = EmitNode(o, (ASTNode){.op = op, .lchild = l.node, .mchild = r.node, .rchild = EPS});
+
+	// a division can give #DIV/0! unless it divides by a literal
+	// other than zero, so what uses it goes through the generic ops
+	if (node->op == AST_DIV && !IsNonZeroLiteral(o, r))
+		return (Typed){res, IT_DYN};
+	return (Typed){res, type};
+}
+
+// Only one branch runs, so anything it declares has an unknown
+// type afterwards (it may not even exist)
+static Typed RewriteBranch(Optimizer* o, u32 index) {
+	u32 vsize = o->vsize;
+	Typed t = Rewrite(o, index);
+	for (u32 i = vsize; i < o->vsize; i++) {
+		o->vars[i].type = IT_DYN;
+	}
+	return t;
+}
+
+static Typed Rewrite(Optimizer* o, u32 index) {
+	if (index == EPS)
+		return (Typed){EPS, IT_EMPTY};
+
+	ASTNode* node = &ASTGet(o->tree, index);
+	ASTNode copy = *node;
+
+	switch (node->op) {
+	case AST_INT_LITERAL:
+		return (Typed){EmitNode(o, copy), IT_INT};
+	case AST_FLOAT_LITERAL:
+		return (Typed){EmitNode(o, copy), IT_FLOAT};
+
+	case AST_ADD:
+	case AST_SUB:
+	case AST_MUL:
+	case AST_DIV:
+		return RewriteArith(o, node);
+
+	case AST_INT_TO_FLOAT:
+	case AST_FLOAT_TO_INT: {
+		Typed t = Rewrite(o, node->lchild);
+		InferredType to = node->op == AST_INT_TO_FLOAT ? IT_FLOAT : IT_INT;
+		if (t.type == IT_INT || t.type == IT_FLOAT)
+			return Convert(o, t, to);
+
+		copy.lchild = t.node;
+		return (Typed){EmitNode(o, copy), to};
+	}
+
+	case AST_SEQ: {
+		Typed a = Rewrite(o, node->lchild);
+		Typed b = Rewrite(o, node->mchild);
+		copy.lchild = a.node;
+		copy.mchild = b.node;
+
+		InferredType type = IT_DYN;
+		if (b.type == IT_INT || b.type == IT_FLOAT)
+			type = b.type;
+		else if (b.type == IT_EMPTY)
+			type = a.type;
+		return (Typed){EmitNode(o, copy), type};
+	}
+
+	case AST_IF_ELSE: {
+		u32 start = o->out.size;
+		Typed cond = Rewrite(o, node->lchild);
+
+		// a constant condition keeps only the branch that runs,
+		// unless that is a missing else
+		if (IsLiteral(o, cond)) {
+			ASTNode* lit = OutNode(o, cond.node);
+			u32 taken = lit->op == AST_INT_LITERAL ? lit->data.i != 0 : lit->data.f != 0.0f;
+			u32 branch = taken ? node->mchild : node->rchild;
+			if (branch != EPS) {
+				o->out.size = start;
+				return Rewrite(o, branch);
+			}
+		}
+
+		Typed t = RewriteBranch(o, node->mchild);
+		Typed e = RewriteBranch(o, node->rchild);
+		copy.lchild = cond.node;
+		copy.mchild = t.node;
+		copy.rchild = e.node;
+		return (Typed){EmitNode(o, copy), t.type == e.type ? t.type : IT_DYN};
+	}
+
+	case AST_RETURN: {
+		Typed t = Rewrite(o, node->lchild);
+		copy.lchild = t.node;
+		return (Typed){EmitNode(o, copy), t.type};
+	}
+
+	case AST_DECLARE_VARIABLE: {
+		if (o->vsize + 1 > o->vcap) {
+			u32 oldsize = o->vcap;
+			o->vcap = o->vcap ? o->vcap * 2 : 8;
+			o->vars = Realloc(o->out.mem, o->vars, oldsize * sizeof(TypedVar),
+							  o->vcap * sizeof(TypedVar));
+		}
+
+		InferredType type = node->vt == V_FLOAT ? IT_FLOAT : IT_INT;
+		o->vars[o->vsize++] = (TypedVar){
+			.name = node->data.s,
+			.type = type,
+			.depth = o->depth,
+		};
+		return (Typed){EmitNode(o, copy), type};
+	}
+
+	case AST_ASSIGN_VALUE: {
+		Typed lhs = Rewrite(o, node->lchild);
+		Typed rhs = Rewrite(o, node->mchild);
+
+		TypedVar* var = FindTypedVar(o, ASTGet(o->tree, node->lchild).data.s);
+		InferredType type = var ? var->type : IT_DYN;
+
+		// the variable keeps its declared type, convert up front
+		u32 known = rhs.type == IT_INT || rhs.type == IT_FLOAT;
+		if (known && (type == IT_INT || type == IT_FLOAT))
+			rhs = Convert(o, rhs, type);
+
+		copy.lchild = lhs.node;
+		copy.mchild = rhs.node;
+		return (Typed){EmitNode(o, copy), type};
+	}
+
+	case AST_ID: {
+		TypedVar* var = FindTypedVar(o, node->data.s);
+		return (Typed){EmitNode(o, copy), var ? var->type : IT_DYN};
+	}
+
+	case AST_COORD_TRANSFORM: {
+		// `#` of a constant becomes one node holding the offset
+		Typed t = Rewrite(o, node->lchild);
+		if (IsLiteral(o, t) && t.type == IT_INT) {
+			ASTNode* lit = OutNode(o, t.node);
+			i32 offset = lit->data.i;
+			*lit = (ASTNode){
+				.op = AST_COORD_TRANSFORM,
+				.data.i = offset,
+				.lchild = EPS,
+				.mchild = EPS,
+				.rchild = EPS,
+			};
+			return (Typed){t.node, IT_DYN};
+		}
+		copy.lchild = t.node;
+		return (Typed){EmitNode(o, copy), IT_DYN};
+	}
+
+	case AST_SCOPE_BEGIN:
+		o->depth++;
+		return (Typed){EmitNode(o, copy), IT_EMPTY};
+
+	case AST_SCOPE_END:
+		while (o->vsize && o->vars[o->vsize - 1].depth == o->depth) {
+			o->vsize--;
+		}
+		if (o->depth)
+			o->depth--;
+		return (Typed){EmitNode(o, copy), IT_EMPTY};
+
+	default: {
+		// everything else is copied as is, children first
+		Typed l = Rewrite(o, node->lchild);
+		Typed m = Rewrite(o, node->mchild);
+		Typed r = Rewrite(o, node->rchild);
+		copy.lchild = l.node;
+		copy.mchild = m.node;
+		copy.rchild = r.node;
+		return (Typed){EmitNode(o, copy), IT_DYN};
+	}
+	}
+}
+
+void ASTOptimize(AST* tree) {
+	if (!tree->size)
+		return;
+
+	Optimizer o = {
+		.tree = tree,
+		.out = {.mem = tree->mem},
+		.depth = 1,
+	};
+
+	Rewrite(&o, tree->size - 1);
+
+	Free(o.out.mem, o.vars, o.vcap * sizeof(TypedVar));
+	ASTFree(tree);
+	*tree = o.out;
+}
+
+u32 ASTAnchor(AST* tree, v2u* anchor) {
+	u32 found = 0;
+	for (u32 i = 0; i < tree->size; i++) {
+		ASTNode* node = &ASTGet(tree, i);
+		if (node->op == AST_COORD_TRANSFORM)
+			return 0;
+		if (node->op != AST_GET_CELL_REF || found)
+			continue;
+
+		ASTNode* x = &ASTGet(tree, node->lchild);
+		ASTNode* y = &ASTGet(tree, node->mchild);
+		if (x->op == AST_INT_LITERAL && y->op == AST_INT_LITERAL) {
+			*anchor = (v2u){x->data.i, y->data.i};
+			found = 1;
+		}
+	}
+	if (!found)
+		return 0;
+
+	for (u32 i = 0; i < tree->size; i++) {
+		ASTNode* node = &ASTGet(tree, i);
+		if (node->op != AST_GET_CELL_REF)
+			continue;
+
+		ASTNode* x = &ASTGet(tree, node->lchild);
+		ASTNode* y = &ASTGet(tree, node->mchild);
+		if (x->op != AST_INT_LITERAL || y->op != AST_INT_LITERAL)
+			continue;
+
+		// offsets wrap around like the coordinates they are added to
+		*x = (ASTNode){
+			.op = AST_COORD_TRANSFORM,
+			.data.i = x->data.i - anchor->x,
+			.lchild = EPS,
+			.mchild = EPS,
+			.rchild = EPS,
+		};
+		*y = (ASTNode){
+			.op = AST_COORD_TRANSFORM,
+			.data.i = y->data.i - anchor->y,
+			.lchild = EPS,
+			.mchild = EPS,
+			.rchild = EPS,
+		};
+	}
+	return 1;
+}
+
+u32 ASTNumberRefs(AST* tree) {
+	u32 count = 0;
+	for (u32 i = 0; i < tree->size; i++) {
+		ASTNode* node = &ASTGet(tree, i);
+		if (node->op != AST_GET_CELL_REF)
+			continue;
+
+		ASTNode* x = &ASTGet(tree, node->lchild);
+		ASTNode* y = &ASTGet(tree, node->mchild);
+		u32 constant = (x->op == AST_INT_LITERAL ||
+						(x->op == AST_COORD_TRANSFORM && x->lchild == EPS)) &&
+					   (y->op == AST_INT_LITERAL ||
+						(y->op == AST_COORD_TRANSFORM && y->lchild == EPS));
+		node->data.i = constant ? count++ : UINT32_MAX;
+	}
+	return count;
+}
@@ -163,34 +163,58 @@ ASTNodeIndex ParseHeaderArgs(TokenList* tokens, AST* ast, u8* syntaxError, Strin
 	return ASTCreateNode(ast, AST_HEADER_ARGS, identifier, type, nextArgs);
 }
 
+// NOTE: Statements are collected first and chained into the SEQ list
+// afterwards, so a long block doesn't cost a C stack frame per statement.
+// The nodes are created in the same (post) order as the recursive version.
 ASTNodeIndex ParseBlock(TokenList* tokens, AST* ast, u8* syntaxError, StringTable* s) {
-	ASTNodeIndex statement = ParseStatement(tokens, ast, syntaxError, s);
-	CheckSyntaxError();
-	if (statement == EPS) {
-		return EPS;
+	ASTNodeIndex* statements = NULL;
+	u32 count = 0;
+	u32 cap = 0;
+
+	for (;;) {
+		ASTNodeIndex statement = ParseStatement(tokens, ast, syntaxError, s);
+		if (*syntaxError || statement == EPS) {
+			break;
+		}
+
+		if (count + 1 > cap) {
+			u32 oldsize = cap;
+			cap = cap ? cap * 2 : 8;
+			statements = Realloc(ast->mem, statements, oldsize * sizeof(ASTNodeIndex),
+								 cap * sizeof(ASTNodeIndex));
+		}
+		statements[count++] = statement;
 	}
 
-	ASTNodeIndex continueBlock = ParseBlock(tokens, ast, syntaxError, s);
-	CheckSyntaxError();
-	if (continueBlock == EPS) {
-        u32 scope_end = ASTCreateNode(ast, AST_SCOPE_END, EPS, EPS, EPS);
-        return ASTCreateNode(ast, AST_SEQ, statement, scope_end, EPS);
+	ASTNodeIndex block = EPS;
+	if (!*syntaxError && count) {
+		block = ASTCreateNode(ast, AST_SCOPE_END, EPS, EPS, EPS);
+		for (u32 i = count; i-- > 0;) {
+			block = ASTCreateNode(ast, AST_SEQ, statements[i], block, EPS);
+		}
 	}
 
-	return ASTCreateNode(ast, AST_SEQ, statement, continueBlock, EPS);
+	Free(ast->mem, statements, cap * sizeof(ASTNodeIndex));
+	return block;
 }
 
 ASTNodeIndex ParseStatement(TokenList* tokens, AST* ast, u8* syntaxError, StringTable* s) {
 	Token* nextToken = ConsumeToken(tokens);
+
+	// skip empty statements
+	while (nextToken != NULL && nextToken->type == TOKEN_CHAR_SEMICOLON) {
+		nextToken = ConsumeToken(tokens);
+	}
+
 	if (nextToken == NULL) {
 		return EPS;
 	}
     log("next: %s", getTokenErrorString(nextToken->type));
 	ASTNodeIndex tmp;
 	switch (nextToken->type) {
-	case TOKEN_CHAR_SEMICOLON:
-		return ParseStatement(tokens, ast, syntaxError, s);
 	case TOKEN_CHAR_CLOSE_BRACE:
+		// left for the enclosing statement to expect
+		UnconsumeToken(tokens);
 		return EPS;
 	case TOKEN_KEYWORD_IF:
 		return ParseIf(tokens, ast, syntaxError, s);
@@ -291,7 +315,7 @@ ASTNodeIndex ParseExpression(TokenList* tokens, AST* ast, u8* syntaxError, Strin
     Token* peek = PeekToken(tokens);
     if (peek->type == TOKEN_LITERAL_INT || peek->type == TOKEN_LITERAL_FLOAT ||
 			peek->type == TOKEN_LITERAL_STRING || peek->type == TOKEN_CHAR_OPEN_PAREN ||
-        peek->type == TOKEN_ID || peek->type == TOKEN_KEYWORD_LET){
+        peek->type == TOKEN_ID || peek->type == TOKEN_KEYWORD_LET || peek->type == TOKEN_CHAR_OPEN_BRACKET || peek->type == TOKEN_CHAR_OCTOTHORPE){
         ASTNodeIndex node = ParseSummation(tokens, ast, syntaxError, s);
         ASTNodeIndex node2 = ParseExpression2(tokens, ast, syntaxError, node, s);
 		return node2;
@@ -307,7 +331,7 @@ ASTNodeIndex ParseExpression2(TokenList* tokens, AST* ast, u8* syntaxError,
 		ASTNodeIndex curr = ASTCreateNode(ast, AST_ASSIGN_VALUE, inNode, node, EPS);
         ASTNodeIndex node2 = ParseExpression2(tokens, ast, syntaxError, curr, s);
         return node2;
-    } else if (peek->type == TOKEN_CHAR_SEMICOLON || peek->type == TOKEN_CHAR_CLOSE_PAREN){
+    } else if (peek->type == TOKEN_CHAR_SEMICOLON || peek->type == TOKEN_CHAR_CLOSE_PAREN || peek->type == TOKEN_CHAR_COMMMA || peek->type == TOKEN_CHAR_CLOSE_BRACKET){
         return inNode;
     } else {
 		return EPS;
@@ -316,7 +340,7 @@ ASTNodeIndex ParseExpression2(TokenList* tokens, AST* ast, u8* syntaxError,
 ASTNodeIndex ParseSummation(TokenList* tokens, AST* ast, u8* syntaxError, StringTable* s) {
     Token* peek = PeekToken(tokens);
     if (peek->type == TOKEN_LITERAL_INT || peek->type == TOKEN_LITERAL_FLOAT ||
-        peek->type == TOKEN_LITERAL_STRING || peek->type == TOKEN_CHAR_OPEN_PAREN || peek->type == TOKEN_ID || peek->type == TOKEN_KEYWORD_LET){
+        peek->type == TOKEN_LITERAL_STRING || peek->type == TOKEN_CHAR_OPEN_PAREN || peek->type == TOKEN_ID || peek->type == TOKEN_KEYWORD_LET || peek->type == TOKEN_CHAR_OPEN_BRACKET || peek->type == TOKEN_CHAR_OCTOTHORPE){
 		ASTNodeIndex node = ParseTerm(tokens, ast, syntaxError, s);
 		ASTNodeIndex node2 = ParseSummation2(tokens, ast, syntaxError, node, s);
 		return node2;
@@ -339,14 +363,14 @@ ASTNodeIndex ParseSummation2(TokenList* tokens, AST* ast, u8* syntaxError, ASTNo
         ASTNodeIndex node2 = ParseSummation2(tokens, ast, syntaxError, curr, s);
         return node2;
     }
-    if (peek->type == TOKEN_CHAR_SEMICOLON || peek->type == TOKEN_CHAR_CLOSE_PAREN || peek->type == TOKEN_CHAR_EQUALS){
+    if (peek->type == TOKEN_CHAR_SEMICOLON || peek->type == TOKEN_CHAR_CLOSE_PAREN || peek->type == TOKEN_CHAR_COMMMA || peek->type == TOKEN_CHAR_CLOSE_BRACKET || peek->type == TOKEN_CHAR_EQUALS){
         return inNode;
     }
 }
 ASTNodeIndex ParseTerm(TokenList* tokens, AST* ast, u8* syntaxError, StringTable* s) {
     Token* peek = PeekToken(tokens);
     if (peek->type == TOKEN_LITERAL_INT || peek->type == TOKEN_LITERAL_FLOAT ||
-        peek->type == TOKEN_LITERAL_STRING || peek->type == TOKEN_CHAR_OPEN_PAREN || peek->type == TOKEN_ID || peek->type == TOKEN_KEYWORD_LET){
+        peek->type == TOKEN_LITERAL_STRING || peek->type == TOKEN_CHAR_OPEN_PAREN || peek->type == TOKEN_ID || peek->type == TOKEN_KEYWORD_LET || peek->type == TOKEN_CHAR_OPEN_BRACKET || peek->type == TOKEN_CHAR_OCTOTHORPE){
         ASTNodeIndex node = ParseReference(tokens, ast, syntaxError, s);
         ASTNodeIndex node2 = ParseTerm2(tokens, ast, syntaxError, node, s);
         return node2;
@@ -369,7 +393,7 @@ ASTNodeIndex ParseTerm2(TokenList* tokens, AST* ast, u8* syntaxError, ASTNodeInd
         ASTNodeIndex node2 = ParseTerm2(tokens, ast, syntaxError, curr, s);
         return node2;
     }
-    if (peek->type == TOKEN_CHAR_SEMICOLON || peek->type == TOKEN_CHAR_CLOSE_PAREN || peek->type == TOKEN_CHAR_EQUALS || peek->type == TOKEN_CHAR_PLUS || peek->type == TOKEN_CHAR_MINUS){
+    if (peek->type == TOKEN_CHAR_SEMICOLON || peek->type == TOKEN_CHAR_CLOSE_PAREN || peek->type == TOKEN_CHAR_COMMMA || peek->type == TOKEN_CHAR_CLOSE_BRACKET || peek->type == TOKEN_CHAR_EQUALS || peek->type == TOKEN_CHAR_PLUS || peek->type == TOKEN_CHAR_MINUS){
         return inNode;
     }
 	return EPS;
@@ -377,7 +401,7 @@ ASTNodeIndex ParseTerm2(TokenList* tokens, AST* ast, u8* syntaxError, ASTNodeInd
 ASTNodeIndex ParseReference(TokenList* tokens, AST* ast, u8* syntaxError, StringTable* s) {
     Token* peek = PeekToken(tokens);
     if (peek->type == TOKEN_LITERAL_INT || peek->type == TOKEN_LITERAL_FLOAT ||
-        peek->type == TOKEN_LITERAL_STRING || peek->type == TOKEN_CHAR_OPEN_PAREN || peek->type == TOKEN_ID || peek->type == TOKEN_KEYWORD_LET){
+        peek->type == TOKEN_LITERAL_STRING || peek->type == TOKEN_CHAR_OPEN_PAREN || peek->type == TOKEN_ID || peek->type == TOKEN_KEYWORD_LET || peek->type == TOKEN_CHAR_OPEN_BRACKET || peek->type == TOKEN_CHAR_OCTOTHORPE){
         ASTNodeIndex node = ParseAbsolute(tokens, ast, syntaxError, s);
         ASTNodeIndex node2 = ParseReference2(tokens, ast, syntaxError, node, s);
         return node2;
@@ -393,7 +417,7 @@ ASTNodeIndex ParseReference2(TokenList* tokens, AST* ast, u8* syntaxError, ASTNo
         ASTNodeIndex node2 = ParseReference2(tokens, ast, syntaxError, curr, s);
         return node2;
     }
-    if (peek->type == TOKEN_CHAR_SEMICOLON || peek->type == TOKEN_CHAR_CLOSE_PAREN || peek->type == TOKEN_CHAR_EQUALS || peek->type == TOKEN_CHAR_PLUS || peek->type == TOKEN_CHAR_MINUS || peek->type == TOKEN_CHAR_ASTERISK || peek->type == TOKEN_CHAR_SLASH){
+    if (peek->type == TOKEN_CHAR_SEMICOLON || peek->type == TOKEN_CHAR_CLOSE_PAREN || peek->type == TOKEN_CHAR_COMMMA || peek->type == TOKEN_CHAR_CLOSE_BRACKET || peek->type == TOKEN_CHAR_EQUALS || peek->type == TOKEN_CHAR_PLUS || peek->type == TOKEN_CHAR_MINUS || peek->type == TOKEN_CHAR_ASTERISK || peek->type == TOKEN_CHAR_SLASH){
         return inNode;
     }
 	return EPS;
@@ -402,7 +426,7 @@ ASTNodeIndex ParseReference2(TokenList* tokens, AST* ast, u8* syntaxError, ASTNo
 ASTNodeIndex ParseAbsolute(TokenList* tokens, AST* ast, u8* syntaxError, StringTable* s) {
     Token* peek = PeekToken(tokens);
     if (peek->type == TOKEN_LITERAL_INT || peek->type == TOKEN_LITERAL_FLOAT ||
-        peek->type == TOKEN_LITERAL_STRING || peek->type == TOKEN_CHAR_OPEN_PAREN || peek->type == TOKEN_ID || peek->type == TOKEN_KEYWORD_LET){
+        peek->type == TOKEN_LITERAL_STRING || peek->type == TOKEN_CHAR_OPEN_PAREN || peek->type == TOKEN_ID || peek->type == TOKEN_KEYWORD_LET || peek->type == TOKEN_CHAR_OPEN_BRACKET){
         ASTNodeIndex node = ParseUnit(tokens, ast, syntaxError, s);
         return node;
     }
@@ -519,7 +543,16 @@ ASTNodeIndex ParseUnit(TokenList* tokens, AST* ast, u8* syntaxError, StringTable
 		return tmp;
 	case TOKEN_ID:
 		UnconsumeToken(tokens);
-		return ParseID(tokens, ast, syntaxError, s);
+		tmp = ParseID(tokens, ast, syntaxError, s);
+		CheckSyntaxError();
+		// a name followed by "(" calls a built in function
+		if (PeekToken(tokens)->type == TOKEN_CHAR_OPEN_PAREN) {
+			ConsumeToken(tokens);
+			return ParseFunctionCall(tmp, tokens, ast, syntaxError, s);
+		}
+		return tmp;
+	case TOKEN_CHAR_OPEN_BRACKET:
+		return ParseCellRef(tokens, ast, syntaxError, s);
 	default:
 		ThrowUnexpectedTokenError(unit, s);
 		return EPS;
@@ -544,7 +577,7 @@ ASTNodeIndex ParseFunctionArgs(TokenList* tokens, AST* ast, u8* syntaxError, Str
 		return EPS;
 	}
 	UnconsumeToken(tokens);
-	ASTNodeIndex arg = ParseID(tokens, ast, syntaxError, s);
+	ASTNodeIndex arg = ParseExpression(tokens, ast, syntaxError, s);
 	CheckSyntaxError();
 	nextToken = ConsumeToken(tokens);
 	CheckNull(nextToken, s);
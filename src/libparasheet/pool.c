@@ -0,0 +1,194 @@
+#include <libparasheet/lib_internal.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <util/util.h>
+
+// NOTE: only where MADV_DONTNEED is known to hand back zeroed pages,
+// on Darwin it doesn't
+#if defined(__linux__)
+#define POOL_MMAP
+#include <sys/mman.h>
+#endif
+
+/*
++---------------------------------------------------+
+|   INFO:                                           |
+|   Every sheet takes its blocks from this pool.    |
+|   Blocks are shared between clones and the last   |
+|   sheet holding one frees it, so the pool is one  |
+|   per process behind a lock. Taking a block only  |
+|   happens when a block is created or copied, not  |
+|   on every cell write.                            |
+|                                                   |
+|   Memory comes in pages of POOL_PAGE, mmapped on  |
+|   Linux. A block never moves once handed out, so  |
+|   a Block* stays good until the block is freed,   |
+|   whatever else the sheet does. New blocks go     |
+|   into the lowest page with room so the high      |
+|   pages can empty out, and a page with no blocks  |
+|   left goes back to the OS with MADV_DONTNEED. It |
+|   stays mapped and comes back as zeroes the next  |
+|   time it is needed. Elsewhere pages are plain    |
+|   allocations, freed when empty and zeroed when   |
+|   allocated again.                                |
++---------------------------------------------------+
+*/
+
+#define POOL_PAGE MB(2)
+#define POOL_BLOCKS (u32)(POOL_PAGE / sizeof(Block))
+
+typedef struct PoolPage {
+	u8* base;
+	Block* free; // blocks given back, linked through their first bytes
+				 // (memcpy, blocks are only 4 byte aligned)
+	u32 used;	 // blocks handed out
+	u32 fresh;	 // blocks at the front that were handed out since the
+				 // page was last zeroed, the rest are still zero
+	u32 resident;
+} PoolPage;
+
+static struct {
+	pthread_mutex_t lock;
+	PoolPage* pages;
+	u32 count;
+	u32 cap;
+	u32 hint; // no page below this one has room
+	u32 huge;
+	u64 blocks;
+	u32 resident;
+} pool = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+void BlockPoolHugePages(u32 on) {
+	pthread_mutex_lock(&pool.lock);
+	pool.huge = on;
+	pthread_mutex_unlock(&pool.lock);
+}
+
+static u8* MapPage(void) {
+#if defined(POOL_MMAP)
+	void* base = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+	// needs huge pages reserved by the admin, otherwise it just fails
+	if (pool.huge)
+		base = mmap(NULL, POOL_PAGE, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (base != MAP_FAILED)
+		return base;
+#endif
+
+	// twice the size so the page can be aligned to a huge page, which
+	// transparent huge pages need
+	u8* raw = mmap(NULL, 2 * POOL_PAGE, PROT_READ | PROT_WRITE,
+				   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED) {
+		err("block pool: mmap failed");
+		panic();
+	}
+	u8* page = (u8*)(((uintptr_t)raw + POOL_PAGE - 1) & ~(uintptr_t)(POOL_PAGE - 1));
+	if (page > raw)
+		munmap(raw, page - raw);
+	if (raw + POOL_PAGE > page)
+		munmap(page + POOL_PAGE, raw + POOL_PAGE - page);
+
+#if defined(MADV_HUGEPAGE)
+	if (pool.huge)
+		madvise(page, POOL_PAGE, MADV_HUGEPAGE);
+#endif
+	return page;
+#else
+	Allocator mem = GlobalAllocatorCreate();
+	u8* page = Alloc(mem, POOL_PAGE);
+	memset(page, 0, POOL_PAGE);
+	return page;
+#endif
+}
+
+// Hands the memory of an empty page back, the page reads as zeroes
+// after this
+static void ReleasePage(PoolPage* page) {
+#if defined(POOL_MMAP)
+	madvise(page->base, POOL_PAGE, MADV_DONTNEED);
+#else
+	Allocator mem = GlobalAllocatorCreate();
+	Free(mem, page->base, POOL_PAGE);
+	page->base = NULL;
+#endif
+	page->free = NULL;
+	page->fresh = 0;
+	page->resident = 0;
+	pool.resident--;
+}
+
+static void AddPage(void) {
+	if (pool.count == pool.cap) {
+		Allocator mem = GlobalAllocatorCreate();
+		u32 cap = pool.cap ? pool.cap * 2 : 16;
+		pool.pages = Realloc(mem, pool.pages, pool.cap * sizeof(PoolPage), cap * sizeof(PoolPage));
+		pool.cap = cap;
+	}
+	pool.pages[pool.count++] = (PoolPage){.base = MapPage(), .resident = 1};
+	pool.resident++;
+}
+
+Block* BlockPoolAlloc(void) {
+	pthread_mutex_lock(&pool.lock);
+
+	u32 p = pool.hint;
+	while (p < pool.count && pool.pages[p].used == POOL_BLOCKS)
+		p++;
+	if (p == pool.count)
+		AddPage();
+	pool.hint = p;
+
+	PoolPage* page = &pool.pages[p];
+	if (!page->resident) {
+		if (!page->base)
+			page->base = MapPage();
+		page->resident = 1;
+		pool.resident++;
+	}
+
+	Block* block;
+	if (page->free) {
+		block = page->free;
+		memcpy(&page->free, block, sizeof(Block*));
+		memset(block, 0, sizeof(Block));
+	} else {
+		block = (Block*)(page->base + page->fresh++ * sizeof(Block));
+	}
+	page->used++;
+	pool.blocks++;
+
+	pthread_mutex_unlock(&pool.lock);
+	block->page = p;
+	return block;
+}
+
+void BlockPoolFree(Block* block) {
+	u32 p = block->page;
+
+	pthread_mutex_lock(&pool.lock);
+	PoolPage* page = &pool.pages[p];
+	pool.blocks--;
+	if (--page->used == 0) {
+		ReleasePage(page);
+	} else {
+		memcpy(block, &page->free, sizeof(Block*));
+		page->free = block;
+	}
+	pool.hint = MIN(pool.hint, p);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+BlockPoolUsage BlockPoolGetUsage(void) {
+	pthread_mutex_lock(&pool.lock);
+	BlockPoolUsage usage = {
+		.blocks = pool.blocks,
+		.pages = pool.count,
+		.resident = pool.resident,
+		.pageBlocks = POOL_BLOCKS,
+	};
+	pthread_mutex_unlock(&pool.lock);
+	return usage;
+}
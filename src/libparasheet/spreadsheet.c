@@ -1,9 +1,17 @@
 #include <libparasheet/lib_internal.h>
 #include <limits.h>
+#include <stdatomic.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <util/util.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 /*
 +---------------------------------------------------+
 |   INFO(ELI):                                      |
@@ -17,14 +25,50 @@
 const static v2u Invalid = {UINT32_MAX, UINT32_MAX};
 const static v2u Tomb = {UINT32_MAX, 0};
 
+#if defined(CELL_NANBOX)
+#define CELL_VIEWS 64
+
+// Boxed cells have no CellValue to point at, so the getters hand out
+// a copy instead. Each thread cycles through CELL_VIEWS of them: the
+// pointer stays good for that many more lookups on the same thread.
+static CellValue* CellView(CellSlot* slot) {
+	static _Thread_local CellValue views[CELL_VIEWS];
+	static _Thread_local u32 next = 0;
+
+	CellValue* view = &views[next++ % CELL_VIEWS];
+	*view = CellUnbox(*slot);
+	return view;
+}
+#else
+#define CellView(slot) (slot)
+#endif
+
+// Versions come from one counter for every sheet, so a handle resolved
+// in one sheet never matches another. 0 is a sheet that never had a
+// block and UINT32_MAX a handle that was never resolved, both are
+// skipped when the counter wraps. Sheets on other threads (clones being
+// recalculated) take versions at the same time.
+static void NewVersion(SpreadSheet* sheet) {
+	static _Atomic u32 version = 0;
+
+	u32 v;
+	do {
+		v = atomic_fetch_add(&version, 1) + 1;
+	} while (v == 0 || v == UINT32_MAX);
+	sheet->version = v;
+}
+
 static void AllocBlock(SpreadSheet* sheet) {
 	u32 oldsize = sheet->bcap;
 
     sheet->bcap = sheet->bcap ? sheet->bcap * 2 : 2;
 
 	sheet->blockpool =
-		Realloc(sheet->mem, sheet->blockpool, oldsize * sizeof(Block),
-				sheet->bcap * sizeof(Block));
+		Realloc(sheet->mem, sheet->blockpool, oldsize * sizeof(Block*),
+				sheet->bcap * sizeof(Block*));
+	sheet->stamps =
+		Realloc(sheet->mem, sheet->stamps, oldsize * sizeof(BlockStamps),
+				sheet->bcap * sizeof(BlockStamps));
 	sheet->freestatus =
 		Realloc(sheet->mem, sheet->freestatus, oldsize * sizeof(i32),
 				sheet->bcap * sizeof(i32));
@@ -35,76 +79,308 @@ static void AllocBlock(SpreadSheet* sheet) {
 	}
 
 	memset(&sheet->blockpool[oldsize], 0,
-		   (sheet->bcap - oldsize) * sizeof(Block));
+		   (sheet->bcap - oldsize) * sizeof(Block*));
+	memset(&sheet->stamps[oldsize], 0,
+		   (sheet->bcap - oldsize) * sizeof(BlockStamps));
+
+	if (sheet->flags & SHEET_COLUMNAR) {
+		sheet->lanes =
+			Realloc(sheet->mem, sheet->lanes, oldsize * sizeof(BlockLanes),
+					sheet->bcap * sizeof(BlockLanes));
+		memset(&sheet->lanes[oldsize], 0,
+			   (sheet->bcap - oldsize) * sizeof(BlockLanes));
+	}
+
+	if (sheet->flags & SHEET_SUMMED) {
+		sheet->sums.blocks =
+			Realloc(sheet->mem, sheet->sums.blocks, oldsize * sizeof(BlockSums),
+					sheet->bcap * sizeof(BlockSums));
+	}
 }
 
 static u32 PickBlock(SpreadSheet* sheet) {
 	if (!sheet->fsize) AllocBlock(sheet);
-	return sheet->freestatus[--sheet->fsize];
+	u32 blockid = sheet->freestatus[--sheet->fsize];
+
+	Block* block = BlockPoolAlloc();
+	block->refs = 1;
+	sheet->blockpool[blockid] = block;
+	return blockid;
+}
+
+// Drops this sheet's reference, the last sheet holding the block frees it
+static void ReleaseBlock(SpreadSheet* sheet, Block* block) {
+	if (--block->refs == 0)
+		BlockPoolFree(block);
 }
 
 static void FreeBlock(SpreadSheet* sheet, u32 blockid) {
+	if (sheet->blockpool[blockid]->summary.loose)
+		sheet->loose--;
 	sheet->freestatus[sheet->fsize++] = blockid;
-	memset(&sheet->blockpool[blockid], 0, sizeof(Block));
+	ReleaseBlock(sheet, sheet->blockpool[blockid]);
+	sheet->blockpool[blockid] = NULL;
+	memset(&sheet->stamps[blockid], 0, sizeof(BlockStamps));
+	if (sheet->flags & SHEET_COLUMNAR)
+		memset(&sheet->lanes[blockid], 0, sizeof(BlockLanes));
+	sheet->sums.dirty = 1;
+}
+
+// NOTE: The copy keeps the slot, so block ids, the version and every
+// CellHandle into the sheet stay good.
+Block* SheetBlockWritable(SpreadSheet* sheet, u32 blockid) {
+	Block* block = sheet->blockpool[blockid];
+	if (block->refs == 1)
+		return block;
+
+	Block* copy = BlockPoolAlloc();
+	u32 page = copy->page;
+	memcpy(copy, block, sizeof(Block));
+	copy->refs = 1;
+	copy->page = page;
+	block->refs--;
+	sheet->blockpool[blockid] = copy;
+	sheet->copies++;
+	return copy;
+}
+
+// Moves one cell of the lanes from `old` to whatever the block holds now
+static void LanesUpdate(SpreadSheet* sheet, u32 blockid, u32 index, CellValue old) {
+	Block* block = sheet->blockpool[blockid];
+	BlockLanes* lanes = &sheet->lanes[blockid];
+	CellValue val = CellUnbox(block->cells[index]);
+	u64 bit = (u64)1 << (index % 64);
+	u32 word = index / 64;
+
+	if (old.t == CT_INT) lanes->icount--;
+	if (old.t == CT_FLOAT) lanes->fcount--;
+	lanes->ints[word] &= ~bit;
+	lanes->floats[word] &= ~bit;
+	lanes->formulas[word] &= ~bit;
+	lanes->i[index] = 0;
+	lanes->f[index] = 0;
+
+	switch (val.t) {
+		case CT_INT:
+			lanes->icount++;
+			lanes->ints[word] |= bit;
+			lanes->i[index] = val.d.i;
+			break;
+		case CT_FLOAT:
+			lanes->fcount++;
+			lanes->floats[word] |= bit;
+			lanes->f[index] = val.d.f;
+			break;
+		case CT_TEXT:
+		case CT_CODE:
+			lanes->formulas[word] |= bit;
+			break;
+		default:
+			break;
+	}
+
+	if (lanes->icount == block->nonempty)
+		lanes->kind = LANE_INT;
+	else if (lanes->fcount == block->nonempty)
+		lanes->kind = LANE_FLOAT;
+	else
+		lanes->kind = LANE_MIXED;
+}
+
+// Takes `old` out of the summary and puts `val` in. Only a cell that
+// held an extreme going away can't be undone without a rescan.
+static void SummaryUpdate(SpreadSheet* sheet, Block* block, CellValue old, CellValue val) {
+	BlockSummary* summary = &block->summary;
+	u32 loose = 0;
+
+	if (old.t != CT_EMPTY) {
+		if (--summary->counts[old.t] == 0) {
+			summary->types &= ~CELL_TYPE_BIT(old.t);
+		} else if (old.t == CT_INT) {
+			loose = old.d.i == summary->imin || old.d.i == summary->imax;
+		} else if (old.t == CT_FLOAT) {
+			loose = old.d.f == summary->fmin || old.d.f == summary->fmax;
+		}
+	}
+
+	if (val.t != CT_EMPTY) {
+		u32 first = summary->counts[val.t]++ == 0;
+		summary->types |= CELL_TYPE_BIT(val.t);
+		if (val.t == CT_INT) {
+			summary->imin = first ? val.d.i : MIN(summary->imin, val.d.i);
+			summary->imax = first ? val.d.i : MAX(summary->imax, val.d.i);
+		} else if (val.t == CT_FLOAT) {
+			summary->fmin = first ? val.d.f : MIN(summary->fmin, val.d.f);
+			summary->fmax = first ? val.d.f : MAX(summary->fmax, val.d.f);
+		}
+	}
+
+	if (loose && !summary->loose) {
+		summary->loose = 1;
+		sheet->loose++;
+	}
+}
+
+/*
++---------------------------------------------------+
+|   INFO:                                           |
+|   The block map is a Swiss table. Slots come in   |
+|   groups of MAP_GROUP, and next to the keys and   |
+|   values every slot has a control byte: empty,    |
+|   deleted, or the top 7 bits of the key's hash.   |
+|   A lookup hashes the key once, picks a group     |
+|   from the low bits and compares all 16 control   |
+|   bytes against the tag at once. Only slots whose |
+|   tag matches ever have their key read, and a     |
+|   group with an empty slot ends the search, so a  |
+|   lookup is usually one group of control bytes    |
+|   and one key.                                    |
+|                                                   |
+|   Groups are probed quadratically (1, 2, 3, ...   |
+|   groups on), which visits every group of a power |
+|   of two table. Deleting a slot only leaves a     |
+|   tombstone when its group is full, otherwise no  |
+|   probe could have gone past it.                  |
++---------------------------------------------------+
+*/
+
+#define MAP_GROUP 16
+#define CTRL_EMPTY 0x80
+#define CTRL_DELETED 0xFE
+
+// Keys are two small ints next to each other, so every bit of the
+// hash has to depend on all of them (murmur3's finalizer)
+static u64 HashPos(v2u pos) {
+	u64 h = (u64)pos.x << 32 | pos.y;
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDull;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+// One bit per slot of the group whose control byte is `ctrl`
+static u32 GroupMatch(const u8* group, u8 ctrl) {
+#if defined(__SSE2__)
+	__m128i bytes = _mm_loadu_si128((const __m128i*)group);
+	return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)ctrl)));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	// no movemask, weigh each matching byte by its bit and add up halves
+	static const u8 weights[MAP_GROUP] = {1, 2, 4, 8, 16, 32, 64, 128,
+										  1, 2, 4, 8, 16, 32, 64, 128};
+	uint8x16_t eq = vceqq_u8(vld1q_u8(group), vdupq_n_u8(ctrl));
+	uint8x16_t bits = vandq_u8(eq, vld1q_u8(weights));
+	return vaddv_u8(vget_low_u8(bits)) | (u32)vaddv_u8(vget_high_u8(bits)) << 8;
+#else
+	u32 mask = 0;
+	for (u32 i = 0; i < MAP_GROUP; i++)
+		mask |= (u32)(group[i] == ctrl) << i;
+	return mask;
+#endif
+}
+
+// Slots that are free to insert into, empty or deleted. Both have the
+// top bit set and tags never do.
+static u32 GroupFree(const u8* group) {
+#if defined(__SSE2__)
+	return (u32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+#else
+	return GroupMatch(group, CTRL_EMPTY) | GroupMatch(group, CTRL_DELETED);
+#endif
 }
 
 static void ResizeSheet(SpreadSheet* sheet) {
 	u32 oldsize = sheet->cap;
 
-	while (sheet->size + 1 >= (sheet->cap * MAX_LOAD_FACTOR)) {
-		sheet->cap = sheet->cap ? sheet->cap * 2 : 4;
+	// tombstones are dropped, so a map that is mostly those is rebuilt
+	// at the same size
+	sheet->cap = sheet->cap ? sheet->cap : MAP_GROUP;
+	while ((sheet->size + 1) * 2 > sheet->cap) {
+		sheet->cap *= 2;
 	}
 
 	u32* oldvalues = sheet->values;
 	v2u* oldkeys = sheet->keys;
+	u8* oldctrl = sheet->ctrl;
 
 	sheet->values = Alloc(sheet->mem, sheet->cap * sizeof(u32));
 	sheet->keys = Alloc(sheet->mem, sheet->cap * sizeof(v2u));
+	sheet->ctrl = Alloc(sheet->mem, sheet->cap);
 	sheet->size = 0;
     sheet->tomb = 0;
 
 	for (u32 i = 0; i < sheet->cap; i++) {
 		sheet->keys[i] = Invalid;
 	}
+	memset(sheet->ctrl, CTRL_EMPTY, sheet->cap);
 
 	for (u32 i = 0; i < oldsize; i++) {
-		if (!CMPV2(oldkeys[i], Invalid) && !CMPV2(oldkeys[i], Tomb)) {
-			log("reinsert: %d", oldvalues[i]);
+		if (oldctrl[i] < CTRL_EMPTY) {
 			SheetBlockInsert(sheet, oldkeys[i], oldvalues[i]);
 		}
 	}
 
 	Free(sheet->mem, oldvalues, oldsize * sizeof(u32));
 	Free(sheet->mem, oldkeys, oldsize * sizeof(v2u));
+	Free(sheet->mem, oldctrl, oldsize);
+
+	// the blocks SpreadSheetTrackSome hasn't got to have moved, it has
+	// to start over (marking a cell twice does nothing)
+	sheet->tracked = 0;
+}
+
+// The slot holding pos, or UINT32_MAX. With `free` it also gives the
+// first slot along the way that pos could be inserted into.
+static u32 FindSlot(SpreadSheet* sheet, v2u pos, u64 h, u32* free) {
+	u8 tag = h >> 57;
+	u32 mask = sheet->cap / MAP_GROUP - 1;
+	u32 group = (u32)h & mask;
+
+	for (u32 step = 1;; step++) {
+		u8* ctrl = &sheet->ctrl[group * MAP_GROUP];
+		for (u32 m = GroupMatch(ctrl, tag); m; m &= m - 1) {
+			u32 idx = group * MAP_GROUP + __builtin_ctz(m);
+			if (CMPV2(sheet->keys[idx], pos))
+				return idx;
+		}
+
+		if (free && *free == UINT32_MAX) {
+			u32 m = GroupFree(ctrl);
+			if (m)
+				*free = group * MAP_GROUP + __builtin_ctz(m);
+		}
+		if (GroupMatch(ctrl, CTRL_EMPTY))
+			return UINT32_MAX;
+
+		// the load factor keeps an empty slot around, so this ends
+		group = (group + step) & mask;
+	}
 }
 
 u32 SheetBlockInsert(SpreadSheet* sheet, v2u pos, u32 bid) {
-    if ((sheet->size + sheet->tomb + 1) >= sheet->cap * MAX_LOAD_FACTOR) {
+	// at most 7/8 of the slots hold a key or a tombstone
+    if ((sheet->size + sheet->tomb + 1) * 8 > sheet->cap * 7) {
         ResizeSheet(sheet);
     }
 
-	// maybe in future we just use power of 2 sizes?
-	u32 idx = hash((u8*)&pos, sizeof(pos)) % sheet->cap;
-
-	// search
-	for (u32 i = 0; i < sheet->cap; i++) {
-		v2u curr = sheet->keys[idx];
-		if (CMPV2(curr, pos)) {
-			return sheet->values[idx];
-		}
-
-		if (CMPV2(curr, Invalid)) {
-			break;
-		}
-		idx = (idx + 1) % sheet->cap; // using linear probing for now
+	u64 h = HashPos(pos);
+	u32 idx = UINT32_MAX;
+	u32 found = FindSlot(sheet, pos, h, &idx);
+	if (found != UINT32_MAX) {
+		return sheet->values[found];
 	}
 
+	if (sheet->ctrl[idx] == CTRL_DELETED)
+		sheet->tomb--;
+	sheet->ctrl[idx] = h >> 57;
 	sheet->keys[idx] = pos;
 
 	if (bid != UINT32_MAX)
 		sheet->values[idx] = bid;
 	else {
 		sheet->values[idx] = PickBlock(sheet);
+		NewVersion(sheet);
 	}
 
 	sheet->size++;
@@ -118,66 +394,122 @@ u32 SheetBlockGet(SpreadSheet* sheet, v2u pos) {
         return -1;
     }
 
+	u32 idx = FindSlot(sheet, pos, HashPos(pos), NULL);
+	return idx == UINT32_MAX ? UINT32_MAX : sheet->values[idx];
+}
 
-    u32 idx = hash((u8*)&pos, sizeof(pos)) % sheet->cap;
-
-	for (u32 i = 0; i < sheet->cap; i++) {
-		v2u curr = sheet->keys[idx];
-		if (CMPV2(curr, pos)) {
-			return sheet->values[idx];
-		}
-
-		if (CMPV2(curr, Invalid)) {
-			return -1;
-		}
-		idx = (idx + 1) % sheet->cap; // using linear probing for now
+CellValue* SheetHandleGet(SpreadSheet* sheet, CellHandle* handle, v2u pos) {
+	if (handle->version != sheet->version || !CMPV2(handle->pos, pos)) {
+		sheet->resolved++;
+		v2u offset = CELL_TO_OFFSET(pos);
+		*handle = (CellHandle){
+			.pos = pos,
+			.version = sheet->version,
+			.block = SheetBlockGet(sheet, CELL_TO_BLOCK(pos)),
+			.index = CELL_TO_INDEX(offset),
+		};
 	}
 
-	panic();
+	if (handle->block == UINT32_MAX)
+		return NULL;
+	return CellView(&sheet->blockpool[handle->block]->cells[handle->index]);
 }
 
 void SheetBlockDelete(SpreadSheet* sheet, v2u pos) {
-	u32 idx = hash((u8*)&pos, sizeof(pos)) % sheet->cap;
-
-	for (u32 i = 0; i < sheet->size; i++) {
-		v2u curr = sheet->keys[idx];
-		if (CMPV2(curr, pos)) {
-			FreeBlock(sheet, sheet->values[idx]);
-			sheet->keys[idx] = Tomb;
-            sheet->size--;
-            sheet->tomb++;
-			return;
-		}
+	if (!sheet->cap)
+		return;
 
-		if (CMPV2(curr, Invalid)) {
-			return;
-		}
-		idx = (idx + 1) % sheet->cap; // using linear probing for now
+	u32 idx = FindSlot(sheet, pos, HashPos(pos), NULL);
+	if (idx == UINT32_MAX)
+		return;
+
+	FreeBlock(sheet, sheet->values[idx]);
+	NewVersion(sheet);
+	sheet->size--;
+
+	// a probe only goes past a full group
+	u8* group = &sheet->ctrl[idx / MAP_GROUP * MAP_GROUP];
+	if (GroupMatch(group, CTRL_EMPTY)) {
+		sheet->ctrl[idx] = CTRL_EMPTY;
+		sheet->keys[idx] = Invalid;
+	} else {
+		sheet->ctrl[idx] = CTRL_DELETED;
+		sheet->keys[idx] = Tomb;
+		sheet->tomb++;
 	}
+}
 
-	panic();
+static void UsedRangeGrow(SpreadSheet* sheet, v2u pos) {
+	if (!sheet->cells++) {
+		sheet->usedLo = sheet->usedHi = pos;
+		sheet->usedLoose = 0;
+		return;
+	}
+	sheet->usedLo = (v2u){MIN(sheet->usedLo.x, pos.x), MIN(sheet->usedLo.y, pos.y)};
+	sheet->usedHi = (v2u){MAX(sheet->usedHi.x, pos.x), MAX(sheet->usedHi.y, pos.y)};
+}
+
+// The bounds only move in when asked for, a cell inside them going
+// away can't change them at all
+static void UsedRangeShrink(SpreadSheet* sheet, v2u pos) {
+	if (--sheet->cells && (pos.x == sheet->usedLo.x || pos.x == sheet->usedHi.x ||
+						   pos.y == sheet->usedLo.y || pos.y == sheet->usedHi.y))
+		sheet->usedLoose = 1;
 }
 
 void SpreadSheetSetCell(SpreadSheet* sheet, v2u pos, CellValue val) {
 	v2u blockpos = CELL_TO_BLOCK(pos);
 	u32 blockid = SheetBlockInsert(sheet, blockpos, UINT32_MAX);
-	Block* block = &sheet->blockpool[blockid];
+	Block* block = SheetBlockWritable(sheet, blockid);
 
     v2u offset = CELL_TO_OFFSET(pos);
     u32 index = CELL_TO_INDEX(offset);
 
+    // a compiled formula is kept while any cell still holds its source
+    CellValue old = CellUnbox(block->cells[index]);
+    u32 oldSource = old.t == CT_CODE || old.t == CT_TEXT;
+    u32 newSource = val.t == CT_CODE || val.t == CT_TEXT;
+    if (!(oldSource && old.t == val.t && StringCmp(old.d.index, val.d.index))) {
+        if (!sheet->formulas.mem.a)
+            sheet->formulas.mem = sheet->mem;
+        if (newSource)
+            FormulaCacheRetain(&sheet->formulas, val.d.index);
+        if (oldSource)
+            FormulaCacheRelease(&sheet->formulas, old.d.index);
+    }
+
+	if (sheet->flags & SHEET_TRACK_DEPS) {
+		DepGraphMarkDirty(&sheet->deps, pos);
+	}
+
 	// NOTE(ELI): Block Insert forces the block to exist if it doesn't already
 	// So this is always safe
 	if (val.t == CT_EMPTY) {
-		if (block->cells[index].t != CT_EMPTY) block->nonempty--;
-        if (block->nonempty <= 0) SheetBlockDelete(sheet, blockpos);
-        else block->cells[index] = val;
-		return;
-	} else if (block->cells[index].t == CT_EMPTY) {
+		if (old.t != CT_EMPTY) {
+			block->nonempty--;
+			UsedRangeShrink(sheet, pos);
+		}
+        if (block->nonempty <= 0) {
+            // freeing the block clears its lanes too
+            SheetBlockDelete(sheet, blockpos);
+            return;
+        }
+	} else if (old.t == CT_EMPTY) {
         block->nonempty++;
+        UsedRangeGrow(sheet, pos);
     }
 
-	block->cells[index] = val;
+	block->cells[index] = CellBox(val);
+	SummaryUpdate(sheet, block, old, val);
+
+	if (sheet->flags & SHEET_COLUMNAR) {
+		LanesUpdate(sheet, blockid, index, old);
+	}
+
+	if (sheet->flags & SHEET_SUMMED) {
+		sheet->sums.blocks[blockid].dirty = 1;
+		sheet->sums.dirty = 1;
+	}
 }
 
 // NOTE(ELI): This can be NULL because the Cell
@@ -185,6 +517,10 @@ void SpreadSheetSetCell(SpreadSheet* sheet, v2u pos, CellValue val) {
 // which would mean that calling this function could
 // actually cause memory allocations which is super
 // unintuitive.
+//
+// The cell may be shared with a clone of the sheet, so it is only to
+// be read. Writes go through SpreadSheetSetCell. With CELL_NANBOX it
+// is a decoded copy (see CellView).
 CellValue* SpreadSheetGetCell(SpreadSheet* sheet, v2u pos) {
 	v2u blockpos = CELL_TO_BLOCK(pos);
 	u32 blockid = SheetBlockGet(sheet, blockpos);
@@ -193,39 +529,405 @@ CellValue* SpreadSheetGetCell(SpreadSheet* sheet, v2u pos) {
 		return NULL;
 	}
 
-	Block* block = &sheet->blockpool[blockid];
+	Block* block = sheet->blockpool[blockid];
 	v2u offset = CELL_TO_OFFSET(pos);
     u32 index = CELL_TO_INDEX(offset);
-	return &block->cells[index];
+	return CellView(&block->cells[index]);
 }
 
 void SpreadSheetClearCell(SpreadSheet* sheet, v2u pos) {
-	v2u blockpos = CELL_TO_BLOCK(pos);
-	u32 blockid = SheetBlockInsert(sheet, blockpos, UINT32_MAX);
-	Block* block = &sheet->blockpool[blockid];
+	// ensure block exists, clearing should never allocate
+	if (SheetBlockGet(sheet, CELL_TO_BLOCK(pos)) == UINT32_MAX) {
+		return;
+	}
 
-	// ensure block exists
-	if (!block) {
+	// NOTE: Going through Set Cell keeps the nonempty count,
+	// the block free and the formula cache all in one place.
+	SpreadSheetSetCell(sheet, pos, (CellValue){.t = CT_EMPTY});
+}
+
+void SpreadSheetFree(SpreadSheet* sheet) {
+	for (u32 i = 0; i < sheet->bcap; i++) {
+		if (sheet->blockpool[i])
+			ReleaseBlock(sheet, sheet->blockpool[i]);
+	}
+	Free(sheet->mem, sheet->blockpool, sheet->bcap * sizeof(Block*));
+	Free(sheet->mem, sheet->stamps, sheet->bcap * sizeof(BlockStamps));
+	Free(sheet->mem, sheet->lanes, sheet->lanes ? sheet->bcap * sizeof(BlockLanes) : 0);
+	SheetSumsFree(&sheet->sums, sheet->mem, sheet->bcap);
+	Free(sheet->mem, sheet->freestatus, sheet->bcap * sizeof(u32));
+	Free(sheet->mem, sheet->keys, sheet->cap * sizeof(v2u));
+	Free(sheet->mem, sheet->values, sheet->cap * sizeof(u32));
+	Free(sheet->mem, sheet->ctrl, sheet->cap);
+	FormulaCacheFree(&sheet->formulas);
+	DepGraphFree(&sheet->deps);
+}
+
+static void* Duplicate(Allocator mem, void* data, u64 size) {
+	if (!size)
+		return NULL;
+	void* copy = Alloc(mem, size);
+	memcpy(copy, data, size);
+	return copy;
+}
+
+// O(blocks): the block map and the slot arrays are copied, the blocks
+// only get another reference.
+void SpreadSheetClone(SpreadSheet* dst, SpreadSheet* src) {
+	Allocator mem = src->mem;
+
+	*dst = (SpreadSheet){
+		.mem = mem,
+		.size = src->size,
+		.tomb = src->tomb,
+		.cap = src->cap,
+		.bsize = src->bsize,
+		.fsize = src->fsize,
+		.bcap = src->bcap,
+		.loose = src->loose, // the summaries come along with the blocks
+		.cells = src->cells,
+		.usedLo = src->usedLo,
+		.usedHi = src->usedHi,
+		.usedLoose = src->usedLoose,
+	};
+	dst->keys = Duplicate(mem, src->keys, src->cap * sizeof(v2u));
+	dst->values = Duplicate(mem, src->values, src->cap * sizeof(u32));
+	dst->ctrl = Duplicate(mem, src->ctrl, src->cap);
+	// no compiled formulas, but the same cells hold the same sources
+	dst->formulas.mem = mem;
+	FormulaCacheCopyUses(&dst->formulas, &src->formulas);
+	dst->blockpool = Duplicate(mem, src->blockpool, src->bcap * sizeof(Block*));
+	dst->freestatus = Duplicate(mem, src->freestatus, src->bcap * sizeof(i32));
+
+	// stamps are per sheet, the clone hasn't been evaluated yet
+	if (src->bcap) {
+		dst->stamps = Alloc(mem, src->bcap * sizeof(BlockStamps));
+		memset(dst->stamps, 0, src->bcap * sizeof(BlockStamps));
+	}
+
+	for (u32 i = 0; i < src->bcap; i++) {
+		if (src->blockpool[i])
+			src->blockpool[i]->refs++;
+	}
+
+	// same slots as src, but they go their own way from here
+	NewVersion(dst);
+}
+
+void SpreadSheetSwap(SpreadSheet* a, SpreadSheet* b) {
+	SpreadSheet t = *a;
+	*a = *b;
+	*b = t;
+}
+
+// Turns on dependency tracking. Every cell that already holds something
+// starts out dirty so the first EvaluateDirty builds the whole graph.
+void SpreadSheetTrackDeps(SpreadSheet* sheet) {
+	while (SpreadSheetTrackSome(sheet, UINT32_MAX))
+		;
+}
+
+// Edits are recorded from the first call on, the cells from before
+// that are marked one map slot at a time so a recalc can do it in
+// slices.
+u32 SpreadSheetTrackSome(SpreadSheet* sheet, u32 budget) {
+	if (!(sheet->flags & SHEET_TRACK_DEPS)) {
+		if (!sheet->deps.mem.a)
+			sheet->deps.mem = sheet->mem;
+		sheet->flags |= SHEET_TRACK_DEPS | SHEET_TRACKING;
+		sheet->tracked = 0;
+	}
+
+	u32 used = 0;
+	while ((sheet->flags & SHEET_TRACKING) && used < budget) {
+		if (sheet->tracked == sheet->cap) {
+			sheet->flags &= ~SHEET_TRACKING;
+			break;
+		}
+		u32 i = sheet->tracked++;
+		used++;
+
+		v2u key = sheet->keys[i];
+		if (CMPV2(key, Invalid) || CMPV2(key, Tomb))
+			continue;
+
+		Block* block = sheet->blockpool[sheet->values[i]];
+		for (u32 j = 0; j < BLOCK_SIZE * BLOCK_SIZE; j++) {
+			if (CellSlotType(block->cells[j]) == CT_EMPTY)
+				continue;
+
+			// inverse of CELL_TO_INDEX
+			v2u pos = {key.x * BLOCK_SIZE + j / BLOCK_SIZE,
+					   key.y * BLOCK_SIZE + j % BLOCK_SIZE};
+			DepGraphMarkDirty(&sheet->deps, pos);
+		}
+		used += BLOCK_SIZE * BLOCK_SIZE;
+	}
+	return used;
+}
+
+// Turns on the columnar lanes. Blocks that already exist are copied
+// over once, after that SpreadSheetSetCell keeps them in sync.
+void SpreadSheetColumnar(SpreadSheet* sheet) {
+	if (sheet->flags & SHEET_COLUMNAR)
 		return;
+
+	sheet->flags |= SHEET_COLUMNAR;
+	if (sheet->bcap) {
+		sheet->lanes = Alloc(sheet->mem, sheet->bcap * sizeof(BlockLanes));
+		memset(sheet->lanes, 0, sheet->bcap * sizeof(BlockLanes));
 	}
 
-    v2u offset = CELL_TO_OFFSET(pos);
-    u32 index = CELL_TO_INDEX(offset);
+	for (u32 i = 0; i < sheet->cap; i++) {
+		v2u key = sheet->keys[i];
+		if (CMPV2(key, Invalid) || CMPV2(key, Tomb))
+			continue;
+
+		u32 blockid = sheet->values[i];
+		Block* block = sheet->blockpool[blockid];
+		for (u32 j = 0; j < BLOCK_SIZE * BLOCK_SIZE; j++) {
+			if (CellSlotType(block->cells[j]) != CT_EMPTY)
+				LanesUpdate(sheet, blockid, j, (CellValue){0});
+		}
+	}
+}
+
+u32 SheetBlockMayHold(SpreadSheet* sheet, u32 bid, u32 types, f64 lo, f64 hi) {
+	BlockSummary* summary = &sheet->blockpool[bid]->summary;
+	u32 found = summary->types & types;
+
+	// loose extremes are still bounds, so these only ever say no when
+	// nothing can match
+	if ((found & CELL_TYPE_BIT(CT_INT)) && (summary->imax < lo || summary->imin > hi))
+		found &= ~CELL_TYPE_BIT(CT_INT);
+	if ((found & CELL_TYPE_BIT(CT_FLOAT)) && (summary->fmax < lo || summary->fmin > hi))
+		found &= ~CELL_TYPE_BIT(CT_FLOAT);
+	return found != 0;
+}
+
+void SheetSummariesTighten(SpreadSheet* sheet) {
+	for (u32 i = 0; i < sheet->cap && sheet->loose; i++) {
+		v2u key = sheet->keys[i];
+		if (CMPV2(key, Invalid) || CMPV2(key, Tomb))
+			continue;
+
+		u32 blockid = sheet->values[i];
+		if (!sheet->blockpool[blockid]->summary.loose)
+			continue;
+
+		// a clone sharing the block keeps its own loose copy
+		Block* block = SheetBlockWritable(sheet, blockid);
+		BlockSummary* summary = &block->summary;
+		u32 ints = 0, floats = 0;
+		for (u32 j = 0; j < BLOCK_SIZE * BLOCK_SIZE; j++) {
+			CellValue v = CellUnbox(block->cells[j]);
+			if (v.t == CT_INT) {
+				summary->imin = ints ? MIN(summary->imin, v.d.i) : v.d.i;
+				summary->imax = ints++ ? MAX(summary->imax, v.d.i) : v.d.i;
+			} else if (v.t == CT_FLOAT) {
+				summary->fmin = floats ? MIN(summary->fmin, v.d.f) : v.d.f;
+				summary->fmax = floats++ ? MAX(summary->fmax, v.d.f) : v.d.f;
+			}
+		}
+		summary->loose = 0;
+		sheet->loose--;
+	}
+}
+
+// The outermost cells can only be in the blocks on the edge of the
+// block bounds, so only those are read
+u32 SpreadSheetUsedRange(SpreadSheet* sheet, v2u* lo, v2u* hi) {
+	if (!sheet->cells)
+		return 0;
+
+	if (sheet->usedLoose) {
+		v2u blo = {UINT32_MAX, UINT32_MAX};
+		v2u bhi = {0, 0};
+		for (u32 i = 0; i < sheet->cap; i++) {
+			v2u key = sheet->keys[i];
+			if (CMPV2(key, Invalid) || CMPV2(key, Tomb))
+				continue;
+			blo = (v2u){MIN(blo.x, key.x), MIN(blo.y, key.y)};
+			bhi = (v2u){MAX(bhi.x, key.x), MAX(bhi.y, key.y)};
+		}
 
-	if (block->cells[index].t != CT_EMPTY) {
-		block->nonempty--;
+		v2u ulo = {UINT32_MAX, UINT32_MAX};
+		v2u uhi = {0, 0};
+		for (u32 i = 0; i < sheet->cap; i++) {
+			v2u key = sheet->keys[i];
+			if (CMPV2(key, Invalid) || CMPV2(key, Tomb))
+				continue;
+			if (key.x != blo.x && key.x != bhi.x && key.y != blo.y && key.y != bhi.y)
+				continue;
+
+			Block* block = sheet->blockpool[sheet->values[i]];
+			for (u32 j = 0; j < BLOCK_SIZE * BLOCK_SIZE; j++) {
+				if (CellSlotType(block->cells[j]) == CT_EMPTY)
+					continue;
+
+				v2u pos = {key.x * BLOCK_SIZE + j / BLOCK_SIZE,
+						   key.y * BLOCK_SIZE + j % BLOCK_SIZE};
+				if (key.x == blo.x) ulo.x = MIN(ulo.x, pos.x);
+				if (key.x == bhi.x) uhi.x = MAX(uhi.x, pos.x);
+				if (key.y == blo.y) ulo.y = MIN(ulo.y, pos.y);
+				if (key.y == bhi.y) uhi.y = MAX(uhi.y, pos.y);
+			}
+		}
+		sheet->usedLo = ulo;
+		sheet->usedHi = uhi;
+		sheet->usedLoose = 0;
 	}
 
-	if (block->nonempty > 0)
+	*lo = sheet->usedLo;
+	*hi = sheet->usedHi;
+	return 1;
+}
+
+static i32 CompareRows(const void* a, const void* b) {
+	v2u p = ((const SheetBlockRef*)a)->pos;
+	v2u q = ((const SheetBlockRef*)b)->pos;
+	if (p.y != q.y)
+		return p.y < q.y ? -1 : 1;
+	return p.x < q.x ? -1 : p.x > q.x;
+}
+
+static i32 CompareColumns(const void* a, const void* b) {
+	v2u p = ((const SheetBlockRef*)a)->pos;
+	v2u q = ((const SheetBlockRef*)b)->pos;
+	if (p.x != q.x)
+		return p.x < q.x ? -1 : 1;
+	return p.y < q.y ? -1 : p.y > q.y;
+}
+
+void SheetIterBegin(SheetIter* it, SpreadSheet* sheet, SheetOrder order) {
+	*it = (SheetIter){.sheet = sheet, .order = order};
+	if (!sheet->size)
 		return;
-	// if the block is completely empty
 
-	SheetBlockDelete(sheet, blockpos);
+	it->blocks = Alloc(sheet->mem, sheet->size * sizeof(SheetBlockRef));
+	for (u32 i = 0; i < sheet->cap; i++) {
+		v2u key = sheet->keys[i];
+		if (CMPV2(key, Invalid) || CMPV2(key, Tomb))
+			continue;
+		it->blocks[it->count++] = (SheetBlockRef){key, sheet->values[i]};
+	}
+	qsort(it->blocks, it->count, sizeof(SheetBlockRef),
+		  order == SHEET_ROWS ? CompareRows : CompareColumns);
 }
 
-void SpreadSheetFree(SpreadSheet* sheet) {
-	Free(sheet->mem, sheet->blockpool, sheet->bcap * sizeof(Block));
-	Free(sheet->mem, sheet->freestatus, sheet->bcap * sizeof(u32));
-	Free(sheet->mem, sheet->keys, sheet->cap * sizeof(v2u));
-	Free(sheet->mem, sheet->values, sheet->cap * sizeof(u32));
+u32 SheetIterNextBlock(SheetIter* it) {
+	if (it->next == it->count)
+		return 0;
+
+	it->at = it->blocks[it->next++];
+	it->block = it->sheet->blockpool[it->at.bid];
+	it->left = it->block->nonempty;
+	it->step = 0;
+	return 1;
+}
+
+u32 SheetIterNext(SheetIter* it) {
+	while (!it->left) {
+		if (!SheetIterNextBlock(it))
+			return 0;
+	}
+
+	// cells are stored column by column (CELL_TO_INDEX), rows stride
+	// through the block, which is only a few cache lines anyway
+	for (;;) {
+		u32 step = it->step++;
+		u32 index = it->order == SHEET_ROWS
+						? step % BLOCK_SIZE * BLOCK_SIZE + step / BLOCK_SIZE
+						: step;
+		CellSlot slot = it->block->cells[index];
+		if (CellSlotType(slot) == CT_EMPTY)
+			continue;
+
+		it->left--;
+		it->pos = (v2u){it->at.pos.x * BLOCK_SIZE + index / BLOCK_SIZE,
+						it->at.pos.y * BLOCK_SIZE + index % BLOCK_SIZE};
+		it->value = CellUnbox(slot);
+		return 1;
+	}
+}
+
+void SheetIterEnd(SheetIter* it) {
+	Free(it->sheet->mem, it->blocks, it->count * sizeof(SheetBlockRef));
+	it->blocks = NULL;
+}
+
+u32 SheetNewEpoch(void) {
+	static u32 epoch = 0;
+
+	// 0 is what fresh blocks start with, so it is never a real pass
+	if (++epoch == 0)
+		epoch++;
+	return epoch;
+}
+
+// Finds the stamps of a cell's block, clearing them if they are
+// from an older pass. NULL if the block doesn't exist.
+static BlockStamps* StampedBlock(SpreadSheet* sheet, v2u pos, u32 epoch, u32* index) {
+	u32 blockid = SheetBlockGet(sheet, CELL_TO_BLOCK(pos));
+	if (blockid == UINT32_MAX)
+		return NULL;
+
+	BlockStamps* block = &sheet->stamps[blockid];
+	if (block->epoch != epoch) {
+		memset(block->done, 0, sizeof(block->done));
+		memset(block->busy, 0, sizeof(block->busy));
+		block->epoch = epoch;
+	}
+
+	v2u offset = CELL_TO_OFFSET(pos);
+	*index = CELL_TO_INDEX(offset);
+	return block;
+}
+
+u32 SheetCellDone(SpreadSheet* sheet, v2u pos, u32 epoch) {
+	u32 index;
+	BlockStamps* block = StampedBlock(sheet, pos, epoch, &index);
+	if (!block)
+		return 0;
+	return (block->done[index / 64] >> (index % 64)) & 1;
+}
+
+void SheetCellSetDone(SpreadSheet* sheet, v2u pos, u32 epoch) {
+	u32 index;
+	BlockStamps* block = StampedBlock(sheet, pos, epoch, &index);
+	if (!block)
+		return;
+	block->done[index / 64] |= (u64)1 << (index % 64);
+	block->busy[index / 64] &= ~((u64)1 << (index % 64));
+}
+
+u32 SheetCellBusy(SpreadSheet* sheet, v2u pos, u32 epoch) {
+	u32 index;
+	BlockStamps* block = StampedBlock(sheet, pos, epoch, &index);
+	if (!block)
+		return 0;
+	return (block->busy[index / 64] >> (index % 64)) & 1;
+}
+
+void SheetCellSetBusy(SpreadSheet* sheet, v2u pos, u32 epoch) {
+	u32 index;
+	BlockStamps* block = StampedBlock(sheet, pos, epoch, &index);
+	if (!block)
+		return;
+	block->busy[index / 64] |= (u64)1 << (index % 64);
+}
+
+const char* CellErrorString(CellError e) {
+	switch (e) {
+		case CE_CYCLE:
+			return "#CYCLE!";
+		case CE_PENDING:
+			return "#PENDING!";
+		case CE_NAME:
+			return "#NAME?";
+		case CE_DIV0:
+			return "#DIV/0!";
+		default:
+			return "#ERROR!";
+	}
 }
@@ -165,6 +165,11 @@ SString StringDel(StringTable* table, StrID sid) {
 
     SString output = table->strings[index];
     table->gen[index]++;
+#if defined(CELL_NANBOX)
+    // boxed cells only have room for the low bits, an id read back out
+    // of a cell has to match
+    table->gen[index] &= CELL_BOX_GEN;
+#endif
 
     for (u32 i = 0; i < table->cap; i++) {
         u32 next = (idx + 1) % table->cap;
@@ -0,0 +1,294 @@
+#include <libparasheet/lib_internal.h>
+#include <string.h>
+#include <util/util.h>
+
+/*
++---------------------------------------------------+
+|   INFO:                                           |
+|   Summed-area tables behind SheetRangeSums. The   |
+|   prefixes of a block cost 256 adds to build, so  |
+|   edits don't patch them. They mark the block     |
+|   dirty and the next query that reaches it builds |
+|   it again. The coarse table is built over the    |
+|   bounding box of the blocks and is skipped when  |
+|   that box is mostly empty, queries then visit    |
+|   every block they cover, still at four lookups   |
+|   per block instead of a scan.                    |
++---------------------------------------------------+
+*/
+
+// coarse tables up to this many entries are always fine
+#define SUMS_MIN_TABLE 4096
+// bigger ones need this many entries or fewer per block
+#define SUMS_SPREAD 8
+
+// Empty and tombstone slots of the block map both have x == UINT32_MAX
+static u32 LiveKey(v2u key) {
+	return key.x != UINT32_MAX;
+}
+
+static void BuildBlock(BlockSums* sums, Block* block) {
+	// a column at a time, each entry is its column so far plus the
+	// same row of the previous column
+	for (u32 x = 0; x < BLOCK_SIZE; x++) {
+		i64 isum = 0;
+		u32 icount = 0, fcount = 0, formulas = 0;
+
+		for (u32 y = 0; y < BLOCK_SIZE; y++) {
+			u32 i = x * BLOCK_SIZE + y;
+			CellValue v = CellUnbox(block->cells[i]);
+			switch (v.t) {
+				case CT_INT:
+					isum += v.d.i;
+					icount++;
+					break;
+				case CT_FLOAT:
+					// only counted, see lib_internal.h
+					fcount++;
+					break;
+				case CT_TEXT:
+				case CT_CODE:
+					formulas++;
+					break;
+				default:
+					break;
+			}
+
+			u32 left = i - BLOCK_SIZE;
+			sums->isum[i] = isum + (x ? sums->isum[left] : 0);
+			sums->icount[i] = icount + (x ? sums->icount[left] : 0);
+			sums->fcount[i] = fcount + (x ? sums->fcount[left] : 0);
+			sums->formulas[i] = formulas + (x ? sums->formulas[left] : 0);
+		}
+	}
+	sums->dirty = 0;
+}
+
+// Adds (or takes away, with sign -1) the prefix entry for cells
+// [0..x] x [0..y] of a block, nothing if either one is -1
+static void AddCorner(CellStats* stats, BlockSums* sums, i32 x, i32 y, i32 sign) {
+	if (x < 0 || y < 0)
+		return;
+
+	u32 i = x * BLOCK_SIZE + y;
+	stats->isum += sign * sums->isum[i];
+	stats->icount += sign * sums->icount[i];
+	stats->fcount += sign * sums->fcount[i];
+	stats->formulas += sign * sums->formulas[i];
+}
+
+// The part of block `key` inside lo..hi
+static void AddBlock(SpreadSheet* sheet, v2u key, u32 bid, v2u lo, v2u hi,
+					 CellStats* stats) {
+	BlockSums* sums = &sheet->sums.blocks[bid];
+	if (sums->dirty) {
+		BuildBlock(sums, sheet->blockpool[bid]);
+		sheet->sums.rebuilt++;
+	}
+
+	v2u origin = {key.x * BLOCK_SIZE, key.y * BLOCK_SIZE};
+	i32 x0 = MAX(lo.x, origin.x) - origin.x;
+	i32 x1 = MIN(hi.x, origin.x + BLOCK_SIZE - 1) - origin.x;
+	i32 y0 = MAX(lo.y, origin.y) - origin.y;
+	i32 y1 = MIN(hi.y, origin.y + BLOCK_SIZE - 1) - origin.y;
+
+	AddCorner(stats, sums, x1, y1, 1);
+	AddCorner(stats, sums, x0 - 1, y1, -1);
+	AddCorner(stats, sums, x1, y0 - 1, -1);
+	AddCorner(stats, sums, x0 - 1, y0 - 1, 1);
+}
+
+static void FreeTable(SheetSums* sums, Allocator mem) {
+	Free(mem, sums->isum, sums->cap * sizeof(i64));
+	Free(mem, sums->icount, sums->cap * sizeof(u32));
+	Free(mem, sums->fcount, sums->cap * sizeof(u32));
+	Free(mem, sums->formulas, sums->cap * sizeof(u32));
+	sums->isum = NULL;
+	sums->icount = NULL;
+	sums->fcount = NULL;
+	sums->formulas = NULL;
+	sums->cap = 0;
+}
+
+void SheetSumsUpdate(SpreadSheet* sheet) {
+	SheetSums* sums = &sheet->sums;
+	if (!(sheet->flags & SHEET_SUMMED) || !sums->dirty)
+		return;
+
+	sums->lo = (v2u){UINT32_MAX, UINT32_MAX};
+	sums->hi = (v2u){0, 0};
+	for (u32 i = 0; i < sheet->cap; i++) {
+		v2u key = sheet->keys[i];
+		if (!LiveKey(key))
+			continue;
+
+		sums->lo = (v2u){MIN(sums->lo.x, key.x), MIN(sums->lo.y, key.y)};
+		sums->hi = (v2u){MAX(sums->hi.x, key.x), MAX(sums->hi.y, key.y)};
+
+		BlockSums* block = &sums->blocks[sheet->values[i]];
+		if (block->dirty) {
+			BuildBlock(block, sheet->blockpool[sheet->values[i]]);
+			sums->rebuilt++;
+		}
+	}
+	sums->dirty = 0;
+
+	sums->coarse = 0;
+	if (!sheet->size)
+		return;
+
+	u64 w = sums->hi.x - sums->lo.x + 1;
+	u64 h = sums->hi.y - sums->lo.y + 1;
+	u64 entries = (w + 1) * (h + 1);
+	if (entries > MAX(SUMS_MIN_TABLE, (u64)SUMS_SPREAD * sheet->size))
+		return;
+
+	if (entries > sums->cap) {
+		FreeTable(sums, sheet->mem);
+		sums->cap = entries;
+		sums->isum = Alloc(sheet->mem, entries * sizeof(i64));
+		sums->icount = Alloc(sheet->mem, entries * sizeof(u32));
+		sums->fcount = Alloc(sheet->mem, entries * sizeof(u32));
+		sums->formulas = Alloc(sheet->mem, entries * sizeof(u32));
+	}
+	sums->w = w;
+	sums->h = h;
+	sums->coarse = 1;
+
+	memset(sums->isum, 0, entries * sizeof(i64));
+	memset(sums->icount, 0, entries * sizeof(u32));
+	memset(sums->fcount, 0, entries * sizeof(u32));
+	memset(sums->formulas, 0, entries * sizeof(u32));
+
+	// the block totals go one row and column in, then the whole
+	// table is summed up in place
+	u32 last = BLOCK_SIZE * BLOCK_SIZE - 1;
+	for (u32 i = 0; i < sheet->cap; i++) {
+		v2u key = sheet->keys[i];
+		if (!LiveKey(key))
+			continue;
+
+		BlockSums* block = &sums->blocks[sheet->values[i]];
+		u32 e = (key.y - sums->lo.y + 1) * (w + 1) + (key.x - sums->lo.x + 1);
+		sums->isum[e] = block->isum[last];
+		sums->icount[e] = block->icount[last];
+		sums->fcount[e] = block->fcount[last];
+		sums->formulas[e] = block->formulas[last];
+	}
+
+	for (u32 y = 1; y <= h; y++) {
+		for (u32 x = 1; x <= w; x++) {
+			u32 e = y * (w + 1) + x;
+			u32 up = e - (w + 1);
+			sums->isum[e] += sums->isum[e - 1] + sums->isum[up] - sums->isum[up - 1];
+			sums->icount[e] += sums->icount[e - 1] + sums->icount[up] - sums->icount[up - 1];
+			sums->fcount[e] += sums->fcount[e - 1] + sums->fcount[up] - sums->fcount[up - 1];
+			sums->formulas[e] +=
+				sums->formulas[e - 1] + sums->formulas[up] - sums->formulas[up - 1];
+		}
+	}
+}
+
+// Blocks x0..x1 x y0..y1 (inclusive, relative to lo) off the coarse table
+static void AddBlocks(CellStats* stats, SheetSums* sums, u32 x0, u32 y0, u32 x1, u32 y1) {
+	u32 stride = sums->w + 1;
+	u32 a = y0 * stride + x0;
+	u32 b = y0 * stride + x1 + 1;
+	u32 c = (y1 + 1) * stride + x0;
+	u32 d = (y1 + 1) * stride + x1 + 1;
+
+	stats->isum += sums->isum[d] - sums->isum[b] - sums->isum[c] + sums->isum[a];
+	stats->icount += sums->icount[d] - sums->icount[b] - sums->icount[c] + sums->icount[a];
+	stats->fcount += sums->fcount[d] - sums->fcount[b] - sums->fcount[c] + sums->fcount[a];
+	stats->formulas +=
+		sums->formulas[d] - sums->formulas[b] - sums->formulas[c] + sums->formulas[a];
+}
+
+u32 SheetRangeSums(SpreadSheet* sheet, v2u lo, v2u hi, CellStats* stats) {
+	if (!(sheet->flags & SHEET_SUMMED))
+		return 0;
+
+	SheetSumsUpdate(sheet);
+	SheetSums* sums = &sheet->sums;
+	if (!sheet->size)
+		return 1;
+
+	// nothing outside the blocks' bounding box exists, so whole
+	// columns and rows shrink down to it first
+	v2u blo = CELL_TO_BLOCK(lo);
+	v2u bhi = CELL_TO_BLOCK(hi);
+	if (bhi.x < sums->lo.x || blo.x > sums->hi.x || bhi.y < sums->lo.y || blo.y > sums->hi.y)
+		return 1;
+	if (blo.x < sums->lo.x)
+		lo.x = sums->lo.x * BLOCK_SIZE;
+	if (blo.y < sums->lo.y)
+		lo.y = sums->lo.y * BLOCK_SIZE;
+	if (bhi.x > sums->hi.x)
+		hi.x = sums->hi.x * BLOCK_SIZE + BLOCK_SIZE - 1;
+	if (bhi.y > sums->hi.y)
+		hi.y = sums->hi.y * BLOCK_SIZE + BLOCK_SIZE - 1;
+	blo = CELL_TO_BLOCK(lo);
+	bhi = CELL_TO_BLOCK(hi);
+
+	// the blocks the rectangle covers whole, x0 > x1 (or y0 > y1) when
+	// there are none
+	i64 x0 = blo.x + (lo.x % BLOCK_SIZE != 0);
+	i64 x1 = (i64)bhi.x - (hi.x % BLOCK_SIZE != BLOCK_SIZE - 1);
+	i64 y0 = blo.y + (lo.y % BLOCK_SIZE != 0);
+	i64 y1 = (i64)bhi.y - (hi.y % BLOCK_SIZE != BLOCK_SIZE - 1);
+	u32 inner = sums->coarse && x0 <= x1 && y0 <= y1;
+	if (inner) {
+		AddBlocks(stats, sums, x0 - sums->lo.x, y0 - sums->lo.y, x1 - sums->lo.x,
+				  y1 - sums->lo.y);
+	}
+
+	// a spread out sheet without a coarse table, and a rectangle
+	// bigger than the block map
+	u64 blocks = (u64)(bhi.x - blo.x + 1) * (bhi.y - blo.y + 1);
+	if (!sums->coarse && blocks > sheet->cap) {
+		for (u32 i = 0; i < sheet->cap; i++) {
+			v2u key = sheet->keys[i];
+			if (key.x < blo.x || key.x > bhi.x || key.y < blo.y || key.y > bhi.y)
+				continue;
+			AddBlock(sheet, key, sheet->values[i], lo, hi, stats);
+		}
+		return 1;
+	}
+
+	// the partial blocks along the edges, the columns of whole blocks
+	// jump over the part the coarse table already added
+	for (u32 bx = blo.x; bx <= bhi.x; bx++) {
+		u32 skip = inner && bx >= x0 && bx <= x1;
+		for (u32 by = blo.y; by <= bhi.y; by++) {
+			if (skip && by == y0)
+				by = y1 + 1;
+			if (by > bhi.y)
+				break;
+
+			u32 bid = SheetBlockGet(sheet, (v2u){bx, by});
+			if (bid != UINT32_MAX)
+				AddBlock(sheet, (v2u){bx, by}, bid, lo, hi, stats);
+		}
+	}
+	return 1;
+}
+
+// Turns on the summed-area tables. Nothing is built until a query
+// needs it, so every existing block just starts out dirty.
+void SpreadSheetSummed(SpreadSheet* sheet) {
+	if (sheet->flags & SHEET_SUMMED)
+		return;
+
+	sheet->flags |= SHEET_SUMMED;
+	sheet->sums.blocks = Alloc(sheet->mem, sheet->bcap * sizeof(BlockSums));
+	for (u32 i = 0; i < sheet->bcap; i++) {
+		sheet->sums.blocks[i].dirty = 1;
+	}
+	sheet->sums.dirty = 1;
+}
+
+void SheetSumsFree(SheetSums* sums, Allocator mem, u32 bcap) {
+	Free(mem, sums->blocks, sums->blocks ? bcap * sizeof(BlockSums) : 0);
+	FreeTable(sums, mem);
+	sums->blocks = NULL;
+}
@@ -109,6 +109,18 @@ SymbolEntry SymbolGet(SymbolTable* table, StrID key) {
 	return (SymbolEntry){0};
 }
 
+u32 SymbolSet(SymbolTable* table, StrID key, SymbolEntry entry) {
+	for (i32 i = table->size - 1; i >= 0; i--) {
+		u32 e = SymbolMapGet(&table->scopes[i], key);
+		if (e != UINT32_MAX) {
+			table->scopes[i].entries[e] = entry;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 void SymbolPushScope(SymbolTable* table) {
 	if (table->size + 1 > table->cap) {
 		u32 oldsize = table->cap;
@@ -134,3 +146,11 @@ void SymbolPushScope(SymbolTable* table) {
 void SymbolPopScope(SymbolTable* table) {
 	SymbolMapFree(&table->scopes[--table->size]);
 }
+
+void SymbolTableFree(SymbolTable* table) {
+	while (table->size)
+		SymbolPopScope(table);
+	Free(table->mem, table->scopes, table->cap * sizeof(SymbolMap));
+	table->scopes = NULL;
+	table->cap = 0;
+}
@@ -1,6 +1,7 @@
 #include <libparasheet/lib_internal.h>
 #include <libparasheet/tokenizer_types.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <util/util.h>
 
@@ -134,8 +135,6 @@ void tokenizeNumberLiteral(const char* source, u32* i, TokenList* tokens,
 						   StringTable* table, u32 lineNumber) {
 	TokenType type = TOKEN_LITERAL_INT;
 	i32 number = 0;
-	f32 floatNum = 0;
-	f32 multiplier = 0.1;
 	union TokenData data;
 	u32 start = *i;
 	while (isdigit(source[*i])) {
@@ -146,14 +145,18 @@ void tokenizeNumberLiteral(const char* source, u32* i, TokenList* tokens,
 	data.i = number;
 	if (source[*i] == '.') {
 		type = TOKEN_LITERAL_FLOAT;
-		floatNum = (f32)number;
 		*i += 1;
 		while (isdigit(source[*i])) {
-			floatNum += (f32)(source[*i] - '0') * multiplier;
-			multiplier = multiplier * 0.1;
 			*i += 1;
 		}
-		data.f = floatNum;
+		// strtod on a copy of just the literal, so whatever follows it
+		// (an exponent, say) isn't read too. Digits past the buffer are
+		// far below an f64's precision
+		char digits[64];
+		u32 length = MIN(*i - start, (u32)sizeof(digits) - 1);
+		memcpy(digits, source + start, length);
+		digits[length] = '\0';
+		data.f = (CellFloat)strtod(digits, NULL);
         log("Parsed Float: %f", data.f);
 	} else {
         log("Parsed Int: %d", data.i);
@@ -1,4 +1,5 @@
 #include "libparasheet/lib_internal.h"
+#include "libparasheet/evaluator.h"
 #include "libparasheet/csv.h"
 #include <asm-generic/errno-base.h>
 #include <errno.h>
@@ -7,10 +8,13 @@
 #include <sys/stat.h>
 #include <util/util.h>
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <ncurses.h>
 
@@ -37,6 +41,12 @@
 #define MARGIN_TOP 1
 #define MARGIN_LEFT 2
 
+// cells the recalc thread evaluates before it checks whether the
+// render thread wants the sheet, which is the most a key waits
+#define RECALC_SLICE 256
+// how often the recalc thread asks for a redraw to show progress
+#define PROGRESS_MS 100
+
 // ASCII VALUES
 #define KEY_ESCAPE 27
 #define KEY_ENTER_REAL 10
@@ -49,7 +59,7 @@
 
 
 void drawBox(v2u pos, v2u size, SString str);
-SString cellDisplay(SpreadSheet* sheet, StringTable* str, v2u pos, u32 maxlen);
+SString cellDisplay(SpreadSheet* sheet, SpreadSheet* out, StringTable* str, v2u pos, u32 maxlen);
 
 // supplies the currently selected keybinds
 typedef struct KeyBinds {
@@ -126,6 +136,21 @@ typedef struct RenderHandler {
     EditorState state;
     SpreadSheet* sheet;
     StringTable* str;
+    // results of the formulas in sheet, visible cells are
+    // evaluated first and the rest on the recalc thread
+    EvalContext eval;
+    Recalc recalc;
+
+    //NOTE: sheet, out and recalc belong to whoever holds lock.
+    //The recalc thread holds it for one slice at a time and
+    //hands it over as soon as the render thread is waiting.
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    atomic_uint waiting;
+    bool quit;
+    i32 news[2]; //pipe the worker writes to when there is something to show
+
     KeyBinds keybinds;
     TypeBuffer type;
     u8 preferred_terminal[STRING_SIZE];
@@ -144,6 +169,56 @@ SString stateToString(EditorState state){
     }
 }
 
+// Throws away the recalc that is under way (if any) and starts
+// over with whatever changed since the last one that finished
+void sheetChanged(RenderHandler* handler) {
+    RecalcFree(&handler->recalc);
+    RecalcBegin(&handler->recalc, handler->eval);
+}
+
+void sheetLock(RenderHandler* handler) {
+    atomic_fetch_add(&handler->waiting, 1);
+    pthread_mutex_lock(&handler->lock);
+    atomic_fetch_sub(&handler->waiting, 1);
+}
+
+void sheetUnlock(RenderHandler* handler) {
+    pthread_cond_signal(&handler->wake);
+    pthread_mutex_unlock(&handler->lock);
+}
+
+u64 msNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Works through the recalc a slice at a time whenever there is one
+// and the render thread doesn't need the sheet. A new edit replaces
+// the recalc under way (see sheetChanged), so the worker never
+// finishes a stale one.
+void* recalcWorker(void* arg) {
+    RenderHandler* handler = arg;
+    u64 shown = 0;
+
+    pthread_mutex_lock(&handler->lock);
+    while (!handler->quit) {
+        if (handler->recalc.phase == RECALC_DONE || atomic_load(&handler->waiting)) {
+            pthread_cond_wait(&handler->wake, &handler->lock);
+            continue;
+        }
+
+        bool done = RecalcStep(&handler->recalc, RECALC_SLICE);
+        u64 now = msNow();
+        if (done || now - shown >= PROGRESS_MS) {
+            shown = now;
+            write(handler->news[1], "", 1);
+        }
+    }
+    pthread_mutex_unlock(&handler->lock);
+    return NULL;
+}
+
 void editCell(RenderHandler * handler){
     // somehow deduplicate open cells
     // create new tempfile for cell
@@ -248,6 +323,7 @@ void runCommand(RenderHandler* hand) {
         log("file: %p", csv);
         csv_load_file(csv, hand->str, hand->sheet);
         hand->sheetname = name;
+        sheetChanged(hand);
     }
 
 }
@@ -440,6 +516,7 @@ void ReadBuffer(RenderHandler* hand, SString name) {
         new.d.index = StringAdd(hand->str, (i8*)data);
     }
     SpreadSheetSetCell(hand->sheet, (v2u){x, y}, new);
+    sheetChanged(hand);
 }
 
 
@@ -469,6 +546,15 @@ int main(int argc, char* argv[]) {
         .mem = GlobalAllocatorCreate(),
     };
 
+    //what the formulas in it evaluate to
+    SpreadSheet out = (SpreadSheet){
+        .mem = GlobalAllocatorCreate(),
+    };
+
+    SymbolTable sym = (SymbolTable){
+        .mem = GlobalAllocatorCreate(),
+    };
+
     
     // if you want different keybinds u change that here
     RenderHandler handler = {
@@ -479,6 +565,14 @@ int main(int argc, char* argv[]) {
         .state = NORMAL,
         .sheet = &sheet,
         .str = &str,
+        .eval = {
+            .mem = GlobalAllocatorCreate(),
+            .srcSheet = &sheet,
+            .inSheet = &sheet,
+            .outSheet = &out,
+            .str = &str,
+            .table = &sym,
+        },
         .keybinds = keybinds_hjkl,
         .edit = {
             .notify = inotify_init1(IN_NONBLOCK),
@@ -518,11 +612,30 @@ int main(int argc, char* argv[]) {
     log("term: %n", handler.preferred_terminal);
     log("edit: %n", handler.preferred_text_editor);
 
-    
+    sheetChanged(&handler);
+
+    pthread_mutex_init(&handler.lock, NULL);
+    pthread_cond_init(&handler.wake, NULL);
+    if (pipe(handler.news)) {
+        err("pipe: %n", strerror(errno));
+    }
+    //neither side ever waits on the pipe itself
+    fcntl(handler.news[0], F_SETFL, O_NONBLOCK);
+    fcntl(handler.news[1], F_SETFL, O_NONBLOCK);
+    pthread_create(&handler.worker, NULL, recalcWorker, &handler);
+    sheetLock(&handler);
 
 
-    // rendering loop
+    // rendering loop, the render thread holds the sheet
+    // everywhere but in poll
     while (1) {
+        //NOTE: whatever is on screen gets evaluated before it is drawn,
+        //scrolling to cells the recalc hasn't reached yet included
+        u32 cols = (COLS - MARGIN_LEFT)/CELL_WIDTH + 1;
+        u32 rows = (LINES - MARGIN_TOP)/CELL_HEIGHT + 1;
+        RecalcRegion(&handler.recalc, (v2u){handler.base.x, handler.base.y},
+                     (v2u){handler.base.x + cols - 1, handler.base.y + rows - 1});
+
         erase();
         //rendering
 
@@ -546,7 +659,7 @@ int main(int argc, char* argv[]) {
                     continue;
                 }
 
-                SString info = cellDisplay(&sheet, &str,
+                SString info = cellDisplay(&sheet, &out, &str,
                                            (v2u){handler.base.x + i, handler.base.y + j},
                                            CELL_WIDTH - 2);
 
@@ -558,7 +671,7 @@ int main(int argc, char* argv[]) {
 
         // currently selected cell
         attron(A_REVERSE);
-        SString info = cellDisplay(&sheet, &str, (v2u)
+        SString info = cellDisplay(&sheet, &out, &str, (v2u)
                 {handler.cursor.x + handler.base.x, handler.cursor.y + handler.base.y}, CELL_WIDTH - 2);
 
         drawBox((v2u){(handler.cursor.x) * CELL_WIDTH + MARGIN_LEFT, (handler.cursor.y) * CELL_HEIGHT + MARGIN_TOP},
@@ -567,12 +680,17 @@ int main(int argc, char* argv[]) {
 
         mvprintw(LINES - 2, MARGIN_LEFT + 2, "%.*s Cursor (%d %d)  ch: %d State: %s", handler.sheetname.size, handler.sheetname.data, 
                 handler.cursor.x + handler.base.x, handler.cursor.y + handler.base.y, handler.ch, stateToString(handler.state).data);
+        if (handler.recalc.phase != RECALC_DONE) {
+            u32 done = 0, total = 0;
+            RecalcProgress(&handler.recalc, &done, &total);
+            printw("  calculating %d/%d", done, total);
+        }
         if (handler.state == TERMINAL) mvprintw(LINES - 3, MARGIN_LEFT + 2, ":%.*s", handler.type.top, handler.type.buf);
         refresh();
 
         //updating
         
-        struct pollfd fd[2] = {0};
+        struct pollfd fd[3] = {0};
         fd[0] = (struct pollfd) {
             .fd = 0,
             .events = POLLIN,
@@ -583,7 +701,14 @@ int main(int argc, char* argv[]) {
             .events = POLLIN
         };
 
-        u32 found = poll(fd, 2, -1);
+        fd[2] = (struct pollfd) {
+            .fd = handler.news[0],
+            .events = POLLIN
+        };
+
+        sheetUnlock(&handler);
+        u32 found = poll(fd, 3, -1);
+        sheetLock(&handler);
 
         if (!found) {
             continue;
@@ -613,17 +738,32 @@ int main(int argc, char* argv[]) {
             continue;
         }
 
+        if (fd[2].revents & POLLIN) {
+            u8 buf[64];
+            while (read(fd[2].fd, buf, sizeof(buf)) > 0);
+            continue;
+        }
+
     }
 
+    handler.quit = true;
+    sheetUnlock(&handler);
+    pthread_join(handler.worker, NULL);
 
     endwin();
     return 0;
 }
 
-SString cellDisplay(SpreadSheet* sheet, StringTable* str, v2u pos, u32 maxlen) {
+SString cellDisplay(SpreadSheet* sheet, SpreadSheet* out, StringTable* str, v2u pos, u32 maxlen) {
     static i8 buf[CELL_WIDTH + 2] = {0};
     CellValue* cell = SpreadSheetGetCell(sheet, pos);
 
+    //formulas show their result once they have one
+    if (cell && (cell->t == CT_TEXT || cell->t == CT_CODE)) {
+        CellValue* result = SpreadSheetGetCell(out, pos);
+        if (result && result->t != CT_EMPTY) cell = result;
+    }
+
     if (!cell) {
         return (SString){NULL, 0};
     }
@@ -640,6 +780,9 @@ SString cellDisplay(SpreadSheet* sheet, StringTable* str, v2u pos, u32 maxlen) {
         case CT_INT: { 
             value.size = snprintf((char*)value.data, CELL_WIDTH + 1, "%d", cell->d.i);
         } break;
+        case CT_ERROR: { 
+            value.size = snprintf((char*)value.data, CELL_WIDTH + 1, "%s", CellErrorString(cell->d.i));
+        } break;
         case CT_TEXT: {  
             SString data = StringGet(str, cell->d.index);
             value.size = snprintf((char*)value.data, maxlen, "%.*s", data.size, data.data);
@@ -376,35 +376,60 @@ Allocator GlobalAllocatorCreate() {
 
 // Stack/Bump Allocator
 
+// Allocations that didn't fit, taken from the parent allocator and
+// freed all together on reset
+typedef struct StackOverflow {
+	struct StackOverflow* next;
+	u64 size;
+	u64 data[];
+} StackOverflow;
+
 // inline because it requires less indirection
 typedef struct StackAllocator {
 	Allocator a; // for destruction
+	StackOverflow* overflow;
 	u64 cap;
 	u64 size;
 	u64 data[];
 } StackAllocator;
 
+static void* StackTake(StackAllocator* s, u64 size) {
+	if (s->size + size <= s->cap) {
+		void* out = (u8*)s->data + s->size;
+		s->size += size;
+		return out;
+	}
+
+	// a full arena is slower, not a crash for whoever holds it
+	StackOverflow* o = Alloc(s->a, sizeof(StackOverflow) + size);
+	o->next = s->overflow;
+	o->size = size;
+	s->overflow = o;
+	return o->data;
+}
+
+static void StackFreeOverflow(StackAllocator* s) {
+	while (s->overflow) {
+		StackOverflow* next = s->overflow->next;
+		Free(s->a, s->overflow, sizeof(StackOverflow) + s->overflow->size);
+		s->overflow = next;
+	}
+}
+
 static alloc_func_def(StackAllocate) {
 	StackAllocator* s = ctx;
 
-    if (oldsize == 0) {
-        if (s->size + newsize > s->cap)
-            return 0; // error
-        void *out = &s->data[s->size];
-        s->size += newsize;
+	// size is in bytes, keep every allocation 8 byte aligned
+	newsize = (newsize + 7) & ~(u64)7;
 
-		return out;
+    if (oldsize == 0) {
+		return StackTake(s, newsize);
 	}
 
   // realloc works via an alloc + memcpy
     if (ptr && oldsize && newsize) {
-        if (s->size + newsize > s->cap)
-            return ptr; // error
-
-        void* dst = &s->data[s->size];
-        s->size += newsize;
-
-		memcpy(dst, ptr, oldsize);
+        void* dst = StackTake(s, newsize);
+		memcpy(dst, ptr, MIN(oldsize, newsize));
 		return dst;
 	}
 
@@ -421,6 +446,7 @@ Allocator StackAllocatorCreate(const Allocator a, u64 minsize) {
 
 	StackAllocator* s = Alloc(a, sizeof(StackAllocator) + minsize);
 	s->a = a;
+	s->overflow = NULL;
 	s->size = 0;
 	s->cap = minsize;
 
@@ -432,11 +458,13 @@ Allocator StackAllocatorCreate(const Allocator a, u64 minsize) {
 
 void StackAllocatorReset(Allocator* a) {
 	StackAllocator* s = a->ctx;
+	StackFreeOverflow(s);
 	s->size = 0;
 }
 
 void StackAllocatorDestroy(const Allocator* a) {
 	StackAllocator* s = a->ctx;
+	StackFreeOverflow(s);
 	Free(s->a, s, sizeof(StackAllocator) + s->cap);
 }
 
@@ -486,3 +514,243 @@ u64 hash(u8* buf, u64 size) {
 	}
 	return hash;
 }
+
+// Job system
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+typedef struct Job {
+	job_func f;
+	void* arg;
+	JobGroup* group;
+} Job;
+
+// ring buffer, the owner uses the tail and thieves take the head
+typedef struct JobDeque {
+	pthread_mutex_t lock;
+	Job* jobs;
+	u32 head;
+	u32 size;
+	u32 cap;
+} JobDeque;
+
+typedef struct JobWorker {
+	JobPool* pool;
+	pthread_t thread;
+	u32 id;
+	u32 depth; // nested jobs running through JobWait
+	Allocator scratch;
+	JobDeque deque;
+} JobWorker;
+
+struct JobPool {
+	Allocator mem;
+	JobWorker* workers;
+	u32 count;
+
+	pthread_mutex_t sleeplock;
+	pthread_cond_t wake;
+	atomic_uint queued;
+	atomic_bool quit;
+	atomic_uint next; // round robin for submits from outside the pool
+};
+
+static _Thread_local JobWorker* currentWorker = NULL;
+
+static void JobPush(JobPool* pool, JobDeque* d, Job job) {
+	pthread_mutex_lock(&d->lock);
+	if (d->size + 1 > d->cap) {
+		u32 oldsize = d->cap;
+		Job* jobs = Alloc(pool->mem, (oldsize ? oldsize * 2 : 64) * sizeof(Job));
+
+		// unwrap the ring while copying
+		for (u32 i = 0; i < d->size; i++) {
+			jobs[i] = d->jobs[(d->head + i) % oldsize];
+		}
+		Free(pool->mem, d->jobs, oldsize * sizeof(Job));
+
+		d->jobs = jobs;
+		d->head = 0;
+		d->cap = oldsize ? oldsize * 2 : 64;
+	}
+	d->jobs[(d->head + d->size++) % d->cap] = job;
+	pthread_mutex_unlock(&d->lock);
+}
+
+static u32 JobPopBack(JobDeque* d, Job* out) {
+	u32 found = 0;
+	pthread_mutex_lock(&d->lock);
+	if (d->size) {
+		*out = d->jobs[(d->head + --d->size) % d->cap];
+		found = 1;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return found;
+}
+
+static u32 JobPopFront(JobDeque* d, Job* out) {
+	u32 found = 0;
+	pthread_mutex_lock(&d->lock);
+	if (d->size) {
+		*out = d->jobs[d->head];
+		d->head = (d->head + 1) % d->cap;
+		d->size--;
+		found = 1;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return found;
+}
+
+static u32 JobTake(JobWorker* self, Job* out) {
+	JobPool* pool = self->pool;
+
+	u32 found = JobPopBack(&self->deque, out);
+	for (u32 i = 1; !found && i < pool->count; i++) {
+		found = JobPopFront(&pool->workers[(self->id + i) % pool->count].deque, out);
+	}
+
+	if (found)
+		atomic_fetch_sub(&pool->queued, 1);
+	return found;
+}
+
+static void JobRun(JobWorker* self, Job job) {
+	if (!self->depth)
+		StackAllocatorReset(&self->scratch);
+
+	self->depth++;
+	job.f(job.arg, self->scratch);
+	self->depth--;
+
+	// the last job of a group wakes whoever is waiting on it
+	if (atomic_fetch_sub(&job.group->pending, 1) == 1) {
+		pthread_mutex_lock(&self->pool->sleeplock);
+		pthread_cond_broadcast(&self->pool->wake);
+		pthread_mutex_unlock(&self->pool->sleeplock);
+	}
+}
+
+static void* JobWorkerMain(void* arg) {
+	JobWorker* self = arg;
+	JobPool* pool = self->pool;
+	currentWorker = self;
+
+	while (!atomic_load(&pool->quit)) {
+		Job job;
+		if (JobTake(self, &job)) {
+			JobRun(self, job);
+			continue;
+		}
+
+		pthread_mutex_lock(&pool->sleeplock);
+		while (!atomic_load(&pool->queued) && !atomic_load(&pool->quit)) {
+			pthread_cond_wait(&pool->wake, &pool->sleeplock);
+		}
+		pthread_mutex_unlock(&pool->sleeplock);
+	}
+
+	return NULL;
+}
+
+JobPool* JobPoolCreate(Allocator a, u32 threads, u64 scratchsize) {
+	if (!threads)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!threads)
+		threads = 1;
+
+	JobPool* pool = Alloc(a, sizeof(JobPool));
+	memset(pool, 0, sizeof(JobPool));
+	pool->mem = a;
+	pool->count = threads;
+	pool->workers = Alloc(a, threads * sizeof(JobWorker));
+	memset(pool->workers, 0, threads * sizeof(JobWorker));
+
+	pthread_mutex_init(&pool->sleeplock, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+
+	for (u32 i = 0; i < threads; i++) {
+		JobWorker* w = &pool->workers[i];
+		w->pool = pool;
+		w->id = i;
+		w->scratch = StackAllocatorCreate(a, scratchsize);
+		pthread_mutex_init(&w->deque.lock, NULL);
+	}
+
+	// NOTE: worker 0 has no thread, it stands in for whoever calls JobWait
+	for (u32 i = 1; i < threads; i++) {
+		pthread_create(&pool->workers[i].thread, NULL, JobWorkerMain, &pool->workers[i]);
+	}
+
+	return pool;
+}
+
+void JobPoolDestroy(JobPool* pool) {
+	pthread_mutex_lock(&pool->sleeplock);
+	atomic_store(&pool->quit, 1);
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->sleeplock);
+
+	for (u32 i = 1; i < pool->count; i++) {
+		pthread_join(pool->workers[i].thread, NULL);
+	}
+
+	for (u32 i = 0; i < pool->count; i++) {
+		JobWorker* w = &pool->workers[i];
+		StackAllocatorDestroy(&w->scratch);
+		pthread_mutex_destroy(&w->deque.lock);
+		Free(pool->mem, w->deque.jobs, w->deque.cap * sizeof(Job));
+	}
+
+	pthread_mutex_destroy(&pool->sleeplock);
+	pthread_cond_destroy(&pool->wake);
+
+	Allocator a = pool->mem;
+	Free(a, pool->workers, pool->count * sizeof(JobWorker));
+	Free(a, pool, sizeof(JobPool));
+}
+
+u32 JobPoolThreads(JobPool* pool) {
+	return pool->count;
+}
+
+void JobSubmit(JobPool* pool, JobGroup* group, job_func f, void* arg) {
+	atomic_fetch_add(&group->pending, 1);
+
+	// workers keep their own jobs local, outside submits get spread out
+	JobWorker* target = currentWorker && currentWorker->pool == pool
+							? currentWorker
+							: &pool->workers[atomic_fetch_add(&pool->next, 1) % pool->count];
+	// counted before it can be taken, a thief decrements right away
+	atomic_fetch_add(&pool->queued, 1);
+	JobPush(pool, &target->deque, (Job){.f = f, .arg = arg, .group = group});
+
+	pthread_mutex_lock(&pool->sleeplock);
+	pthread_cond_signal(&pool->wake);
+	pthread_mutex_unlock(&pool->sleeplock);
+}
+
+// NOTE: Only one thread outside the pool may wait at a time, it borrows
+// worker 0 (and its scratch arena) while it helps out.
+void JobWait(JobPool* pool, JobGroup* group) {
+	JobWorker* self = currentWorker && currentWorker->pool == pool
+						  ? currentWorker
+						  : &pool->workers[0];
+
+	while (atomic_load(&group->pending)) {
+		Job job;
+		if (JobTake(self, &job)) {
+			JobRun(self, job);
+			continue;
+		}
+
+		// the rest is already running somewhere, sleep until the group
+		// is done or there is something to help with
+		pthread_mutex_lock(&pool->sleeplock);
+		while (atomic_load(&group->pending) && !atomic_load(&pool->queued)) {
+			pthread_cond_wait(&pool->wake, &pool->sleeplock);
+		}
+		pthread_mutex_unlock(&pool->sleeplock);
+	}
+}
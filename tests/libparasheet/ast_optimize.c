@@ -0,0 +1,151 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <libparasheet/tokenizer.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "fixture.h"
+
+static u32 countOp(AST* ast, ASTNodeOp op) {
+    u32 n = 0;
+    for (u32 i = 0; i < ast->size; i++) {
+        if (ASTGet(ast, i).op == op) n++;
+    }
+    return n;
+}
+
+static const char* formulas[] = {
+    "=1 + 2 * 3;",
+    "=let x : float = 1; x * 2 + 1;",
+    "=let i : int = 3; let f : float = 0.5; i * f;",
+    "=let i : int = 7.9; i / 2;",
+    "=[0, 1 + 1] * 2;",
+    "=if (1 - 1) 5; else 6;",
+    "=[0, 0] * 2.5 + 1;",
+    "=1 / 0 + [0, 0];",
+};
+
+#define COUNT (sizeof(formulas) / sizeof(formulas[0]))
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+
+    SpreadSheetSetCell(&src, (v2u){0, 0}, (CellValue){.t = CT_INT, .d.i = 4});
+    SpreadSheetSetCell(&src, (v2u){0, 2}, (CellValue){.t = CT_FLOAT, .d.f = 1.5f});
+
+    EvalStack stack = {.mem = mem};
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+        .epoch = SheetNewEpoch(),
+        .stack = &stack,
+    };
+
+    AST plain[COUNT];
+    AST opt[COUNT];
+    for (u32 i = 0; i < COUNT; i++) {
+        plain[i] = build(formulas[i], &str, mem);
+        opt[i] = build(formulas[i], &str, mem);
+        ASTOptimize(&opt[i]);
+
+        print(stdout, "%n\n", (i8*)formulas[i]);
+        ASTPrint(stdout, &opt[i]);
+    }
+
+    // folded down to the literal
+    assert(countOp(&opt[0], AST_ADD) + countOp(&opt[0], AST_MUL) == 0);
+    assert(countOp(&opt[0], AST_INT_LITERAL) == 1 && opt[0].size == 3);
+
+    // literals are converted in place, the variable gives the type
+    assert(countOp(&opt[1], AST_MUL_FLOAT) == 1 && countOp(&opt[1], AST_ADD_FLOAT) == 1);
+    assert(countOp(&opt[1], AST_INT_LITERAL) == 0);
+    assert(countOp(&opt[1], AST_INT_TO_FLOAT) == 0);
+
+    // a variable needs a conversion node
+    assert(countOp(&opt[2], AST_INT_TO_FLOAT) == 1 && countOp(&opt[2], AST_MUL_FLOAT) == 1);
+    assert(countOp(&opt[3], AST_FLOAT_LITERAL) == 0 && countOp(&opt[3], AST_DIV_INT) == 1);
+
+    // computed coordinates can fold into a constant reference
+    assert(countOp(&opt[4], AST_ADD) == 0 && countOp(&opt[4], AST_MUL) == 1);
+
+    // only the branch that runs is kept
+    assert(countOp(&opt[5], AST_IF_ELSE) == 0 && countOp(&opt[5], AST_INT_LITERAL) == 1);
+
+    // cell values keep the generic ops
+    assert(countOp(&opt[6], AST_MUL) == 1 && countOp(&opt[6], AST_ADD) == 1);
+
+    // division by zero is not folded away, and what uses it can't
+    // count on an int
+    assert(countOp(&opt[7], AST_DIV_INT) == 1 && countOp(&opt[7], AST_ADD) == 1);
+    CellValue div0 = walk(&opt[7], ctx);
+    assert(div0.t == CT_ERROR && div0.d.i == CE_DIV0);
+    AST typed = build("=let f : float = 2.5; let i : float = 0; f / i - 1;", &str, mem);
+    ASTOptimize(&typed);
+    assert(countOp(&typed, AST_DIV_FLOAT) == 1);
+    div0 = walk(&typed, ctx);
+    assert(div0.t == CT_ERROR && div0.d.i == CE_DIV0);
+    ASTFree(&typed);
+
+    // loops aren't evaluated yet, they give an error instead
+    AST loop = build("=while (1) 2;", &str, mem);
+    CellValue none = walk(&loop, ctx);
+    assert(none.t == CT_ERROR && none.d.i == CE_NONE);
+    ASTFree(&loop);
+
+    // both trees give the same result
+    for (u32 i = 0; i < COUNT; i++) {
+        CellValue a = walk(&plain[i], ctx);
+        CellValue b = walk(&opt[i], ctx);
+        print(stdout, "%n -> %d %d/%f\n", (i8*)formulas[i], b.t, b.d.i, b.d.f);
+        assert(a.t == b.t && a.d.i == b.d.i);
+    }
+
+    // an arithmetic heavy formula gives the same float optimized or
+    // not, on both evaluators
+    const char* heavy =
+        "=let a : float = [0, 2]; let n : int = 3;"
+        "(a * (1 + 1 / 2.0) + n * (60 / 4 - 5)) * (a - 2 * 0.25)"
+        " + n * n * (2.5 * 4) - (3 * 4 * 5 + 60) / a + a * (2 + 3 * 4) - n / 3;";
+    AST hp = build(heavy, &str, mem);
+    AST ho = build(heavy, &str, mem);
+    ASTOptimize(&ho);
+
+    BCProgram cp = {.mem = mem};
+    BCProgram co = {.mem = mem};
+    assert(BCCompile(&hp, &cp) && BCCompile(&ho, &co));
+    assert(ho.size < hp.size && co.size < cp.size);
+
+    CellValue a = walk(&hp, ctx);
+    CellValue b = walk(&ho, ctx);
+    assert(a.t == CT_FLOAT && b.t == CT_FLOAT && a.d.f == b.d.f);
+    b = BCRun(&co, ctx);
+    assert(b.t == CT_FLOAT && a.d.f == b.d.f);
+    b = BCRun(&cp, ctx);
+    assert(b.t == CT_FLOAT && a.d.f == b.d.f);
+
+    BCFree(&cp);
+    BCFree(&co);
+    for (u32 i = 0; i < COUNT; i++) {
+        ASTFree(&plain[i]);
+        ASTFree(&opt[i]);
+    }
+    ASTFree(&hp);
+    ASTFree(&ho);
+    Free(stack.mem, stack.data, stack.cap * sizeof(v2u));
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    StringFree(&str);
+    return 0;
+}
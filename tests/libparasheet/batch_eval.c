@@ -0,0 +1,164 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "fixture.h"
+
+#define ROWS 4096
+
+// every %u is the row, each formula is filled down its own column
+static const char* formulas[] = {
+    "=[0, %u] * 3 + [1, %u];",
+    "=[0, %u] - [2, %u] * 2;",
+    "=[1, %u] / [0, %u] + [2, %u];",
+    "=let a : int = [0, %u]; let b : float = [1, %u]; a * b + a / 2;",
+    "=if ([2, %u]) [0, %u]; else [1, %u] * 2;",
+    "=if ([0, %u] - [0, %u]) 1; else [0, %u] / 3;",
+    "=[0, %u] + [0, 0];",
+    "=let x : int = [2, %u]; x * 2 - [0, %u];",
+    // [2, y] is 0 on every third row of the first half, those lanes
+    // give #DIV/0! and the rest of the group carries on
+    "=[0, %u] / [2, %u] + 1;",
+    "=let a : int = [0, %u]; let d : int = [2, %u]; a / d * 2;",
+    "=let f : float = [1, %u]; let d : float = [2, %u]; f / d - 1;",
+};
+
+#define COUNT (sizeof(formulas) / sizeof(formulas[0]))
+
+// ints that are never 0, floats, and a column mixing both with
+// empty cells and errors
+static void fillInputs(SpreadSheet* sheet, u32 rows) {
+    for (u32 y = 0; y < rows; y++) {
+        i32 i = (i32)(y * 7919 % 2001) - 1000;
+        SpreadSheetSetCell(sheet, (v2u){0, y}, (CellValue){.t = CT_INT, .d.i = i ? i : 1});
+        SpreadSheetSetCell(sheet, (v2u){1, y}, (CellValue){.t = CT_FLOAT, .d.f = y * 0.37f - 50});
+
+        CellValue mixed = {0};
+        switch (y % 7) {
+            case 0: mixed = (CellValue){.t = CT_INT, .d.i = y}; break;
+            case 1: mixed = (CellValue){.t = CT_FLOAT, .d.f = y / 3.0f}; break;
+            case 2: break;
+            case 3: mixed = (CellValue){.t = CT_ERROR, .d.i = CE_NAME}; break;
+            default: mixed = (CellValue){.t = CT_INT, .d.i = -(i32)y}; break;
+        }
+        // long runs of one type, so both the fast and the mixed paths run
+        if (y < rows / 2) mixed = (CellValue){.t = CT_INT, .d.i = y % 3};
+        SpreadSheetSetCell(sheet, (v2u){2, y}, mixed);
+    }
+}
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+    };
+
+    fillInputs(&src, ROWS);
+    for (u32 f = 0; f < COUNT; f++) {
+        for (u32 y = 0; y < ROWS; y++) {
+            StrID id = StringAdd(&str, (i8*)formulaText(formulas[f], y, y, y));
+            SpreadSheetSetCell(&src, (v2u){4 + f, y}, (CellValue){.t = CT_TEXT, .d.index = id});
+        }
+    }
+    assert(EvaluateDirty(ctx) >= ROWS * COUNT);
+
+    // every batched result against BCRun on its own, to the bit
+    EvalStack stack = {.mem = mem};
+    ctx.stack = &stack;
+    ctx.ordered = true;
+    FormulaCache* cache = &src.formulas;
+    for (u32 f = 0; f < COUNT; f++) {
+        for (u32 y = 0; y < ROWS; y++) {
+            v2u pos = {4 + f, y};
+            FormulaSource* source = FormulaCacheGet(cache, SpreadSheetGetCell(&src, pos)->d.index);
+            Formula* formula = &cache->templates[source->template];
+            assert(formula->code.size);
+
+            ctx.anchor = source->anchored ? source->anchor : pos;
+            CellValue want = BCRun(&formula->code, ctx);
+            CellValue* got = SpreadSheetGetCell(&out, pos);
+            if (got->t != want.t || got->d.i != want.d.i) {
+                print(stderr, "%n at row %d: %d/%d, want %d/%d\n", (i8*)formulas[f], y,
+                      got->t, got->d.i, want.t, want.d.i);
+            }
+            assert(got->t == want.t && got->d.i == want.d.i);
+        }
+    }
+
+    CellValue* div0 = SpreadSheetGetCell(&out, (v2u){4 + COUNT - 3, 3});
+    assert(div0->t == CT_ERROR && div0->d.i == CE_DIV0);
+    div0 = SpreadSheetGetCell(&out, (v2u){4 + COUNT - 1, 6});
+    assert(div0->t == CT_ERROR && div0->d.i == CE_DIV0);
+
+    // a cell that isn't a number sends the whole group back to BCRun
+    {
+        Formula* formula = &cache->templates[FormulaCacheGet(cache,
+            SpreadSheetGetCell(&src, (v2u){4, 0})->d.index)->template];
+        v2u anchors[100];
+        CellValue results[100];
+        for (u32 y = 0; y < 100; y++) anchors[y] = (v2u){0, y};
+
+        SpreadSheetSetCell(&out, (v2u){1, 70}, (CellValue){.t = CT_CODE});
+        BCRunBatch(&formula->code, ctx, anchors, 100, results);
+        for (u32 y = 0; y < 100; y++) {
+            ctx.anchor = anchors[y];
+            CellValue want = BCRun(&formula->code, ctx);
+            assert(results[y].t == want.t && results[y].d.i == want.d.i);
+        }
+        assert(results[70].t == CT_ERROR || results[70].t == CT_INT);
+    }
+
+    // a long column of one formula, the lanes against BCRun per cell.
+    // Constant reads in dependency order come from the output sheet.
+    SpreadSheet column = {.mem = mem};
+    SpreadSheet columnOut = {.mem = mem};
+    fillInputs(&column, ROWS);
+    fillInputs(&columnOut, ROWS);
+    StrID id = StringAdd(&str, (i8*)"=[0, 0] * 3 + [1, 0] * 2 - [0, 0] / 7 + [2, 0];");
+    SpreadSheetSetCell(&column, (v2u){4, 0}, (CellValue){.t = CT_TEXT, .d.index = id});
+
+    ctx.srcSheet = ctx.inSheet = &column;
+    ctx.outSheet = &columnOut;
+    ctx.currentX = 4;
+    ctx.currentY = 0;
+    ctx.epoch = 0;
+    EvaluateCell(ctx);
+    FormulaSource* source = FormulaCacheGet(&column.formulas, id);
+    BCProgram* prog = &column.formulas.templates[source->template].code;
+
+    v2u* anchors = Alloc(mem, ROWS * sizeof(v2u));
+    CellValue* lanes = Alloc(mem, ROWS * sizeof(CellValue));
+    for (u32 y = 0; y < ROWS; y++) anchors[y] = (v2u){0, y};
+
+    BCRunBatch(prog, ctx, anchors, ROWS, lanes);
+    for (u32 y = 0; y < ROWS; y++) {
+        ctx.anchor = anchors[y];
+        CellValue single = BCRun(prog, ctx);
+        assert(lanes[y].t == single.t && lanes[y].d.i == single.d.i);
+    }
+
+    Free(mem, anchors, ROWS * sizeof(v2u));
+    Free(mem, lanes, ROWS * sizeof(CellValue));
+    Free(stack.mem, stack.data, stack.cap * sizeof(v2u));
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    SpreadSheetFree(&column);
+    SpreadSheetFree(&columnOut);
+    StringFree(&str);
+    return 0;
+}
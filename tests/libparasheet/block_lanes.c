@@ -0,0 +1,141 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ROWS (1 << 16)
+#define WIDTH 64
+#define EDITS 200000
+
+static CellValue randomCell(void) {
+    switch (rand() % 5) {
+        case 0: return (CellValue){0};
+        case 1: return (CellValue){.t = CT_TEXT};
+        case 2: return (CellValue){.t = CT_FLOAT, .d.f = (rand() % 2001 - 1000) / 4.0f};
+        default: return (CellValue){.t = CT_INT, .d.i = rand() % 20001 - 10000};
+    }
+}
+
+// every lane slot, bit and count has to match the cell it mirrors
+static void checkLanes(SpreadSheet* sheet) {
+    for (u32 k = 0; k < sheet->cap; k++) {
+        v2u key = sheet->keys[k];
+        if (key.x == UINT32_MAX) continue;
+
+        Block* block = sheet->blockpool[sheet->values[k]];
+        BlockLanes* lanes = &sheet->lanes[sheet->values[k]];
+        u32 icount = 0, fcount = 0;
+
+        for (u32 j = 0; j < BLOCK_SIZE * BLOCK_SIZE; j++) {
+            CellValue v = CellUnbox(block->cells[j]);
+            u32 isint = (lanes->ints[j / 64] >> (j % 64)) & 1;
+            u32 isfloat = (lanes->floats[j / 64] >> (j % 64)) & 1;
+            u32 isformula = (lanes->formulas[j / 64] >> (j % 64)) & 1;
+
+            assert(isint == (v.t == CT_INT) && isfloat == (v.t == CT_FLOAT));
+            assert(isformula == (v.t == CT_TEXT || v.t == CT_CODE));
+            assert(lanes->i[j] == (v.t == CT_INT ? v.d.i : 0));
+            assert(lanes->f[j] == (v.t == CT_FLOAT ? v.d.f : 0));
+            icount += isint;
+            fcount += isfloat;
+        }
+
+        assert(lanes->icount == icount && lanes->fcount == fcount);
+        LaneKind kind = icount == block->nonempty ? LANE_INT
+                        : fcount == block->nonempty ? LANE_FLOAT
+                                                    : LANE_MIXED;
+        assert(lanes->kind == kind);
+    }
+}
+
+static void sameStats(CellStats a, CellStats b) {
+    assert(a.isum == b.isum && a.icount == b.icount && a.fcount == b.fcount);
+    assert(a.formulas == b.formulas && a.fsum == b.fsum);
+    assert(a.imin == b.imin && a.imax == b.imax);
+    assert(a.fmin == b.fmin && a.fmax == b.fmax);
+}
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    // turned on half way, so both the initial copy and the
+    // updates from SpreadSheetSetCell get checked
+    SpreadSheet sheet = {.mem = mem};
+    for (u32 e = 0; e < EDITS; e++) {
+        if (e == EDITS / 2) {
+            SpreadSheetColumnar(&sheet);
+            checkLanes(&sheet);
+        }
+        v2u pos = {rand() % 64, rand() % 64};
+        SpreadSheetSetCell(&sheet, pos, randomCell());
+    }
+    checkLanes(&sheet);
+
+    // the lane kernel against the tagged one on every run shape
+    for (u32 k = 0; k < sheet.cap; k++) {
+        if (sheet.keys[k].x == UINT32_MAX) continue;
+        Block* block = sheet.blockpool[sheet.values[k]];
+        BlockLanes* lanes = &sheet.lanes[sheet.values[k]];
+
+        for (u32 start = 0; start < BLOCK_SIZE * BLOCK_SIZE; start += 7) {
+            for (u32 count = 0; start + count <= BLOCK_SIZE * BLOCK_SIZE; count += 13) {
+                CellStats a, b;
+                CellStatsInit(&a);
+                CellStatsInit(&b);
+                for (u32 i = 0; i < count; i++) CellStatsAdd(&a, CellUnbox(block->cells[start + i]));
+                CellStatsAccumulateLanes(&b, lanes, start, count);
+                sameStats(a, b);
+            }
+        }
+    }
+
+    // single typed blocks get flagged
+    SpreadSheet typed = {.mem = mem};
+    SpreadSheetColumnar(&typed);
+    assert(!typed.lanes);
+    for (u32 y = 0; y < BLOCK_SIZE; y++) {
+        SpreadSheetSetCell(&typed, (v2u){0, y}, (CellValue){.t = CT_INT, .d.i = y});
+        SpreadSheetSetCell(&typed, (v2u){BLOCK_SIZE, y}, (CellValue){.t = CT_FLOAT, .d.f = y});
+    }
+    assert(typed.lanes[SheetBlockGet(&typed, (v2u){0, 0})].kind == LANE_INT);
+    assert(typed.lanes[SheetBlockGet(&typed, (v2u){1, 0})].kind == LANE_FLOAT);
+    SpreadSheetSetCell(&typed, (v2u){1, 1}, (CellValue){.t = CT_FLOAT, .d.f = 1});
+    assert(typed.lanes[SheetBlockGet(&typed, (v2u){0, 0})].kind == LANE_MIXED);
+    SpreadSheetClearCell(&typed, (v2u){1, 1});
+    assert(typed.lanes[SheetBlockGet(&typed, (v2u){0, 0})].kind == LANE_INT);
+    checkLanes(&typed);
+
+    // a dense block of ints summed from the cells and from the lanes
+    SpreadSheet plain = {.mem = mem};
+    SpreadSheet columnar = {.mem = mem};
+    SpreadSheetColumnar(&columnar);
+    i64 sum = 0;
+    for (u32 x = 0; x < WIDTH; x++) {
+        for (u32 y = 0; y < ROWS / WIDTH; y++) {
+            CellValue v = {.t = CT_INT, .d.i = (i32)((x + y) % 1000) - 300};
+            SpreadSheetSetCell(&plain, (v2u){x, y}, v);
+            SpreadSheetSetCell(&columnar, (v2u){x, y}, v);
+            sum += v.d.i;
+        }
+    }
+
+    EvalContext ctx = {.mem = mem, .srcSheet = &plain, .outSheet = &plain};
+    CellStats stats;
+    CellStatsInit(&stats);
+    EvalRange(ctx, (v2u){0, 0}, (v2u){WIDTH - 1, ROWS / WIDTH - 1}, &stats);
+    assert(stats.isum == sum && stats.icount == ROWS);
+
+    ctx.srcSheet = ctx.outSheet = &columnar;
+    CellStatsInit(&stats);
+    EvalRange(ctx, (v2u){0, 0}, (v2u){WIDTH - 1, ROWS / WIDTH - 1}, &stats);
+    assert(stats.isum == sum && stats.icount == ROWS);
+
+    SpreadSheetFree(&sheet);
+    SpreadSheetFree(&typed);
+    SpreadSheetFree(&plain);
+    SpreadSheetFree(&columnar);
+    return 0;
+}
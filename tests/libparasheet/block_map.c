@@ -0,0 +1,113 @@
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SIDE 64
+#define OPS 400000
+
+static u32 seed = 31337;
+
+static u32 rnd(u32 n) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+}
+
+// the walkable keys agree with the control bytes and the counts
+static void checkSlots(SpreadSheet* sheet) {
+    u32 size = 0, tomb = 0;
+    for (u32 i = 0; i < sheet->cap; i++) {
+        v2u key = sheet->keys[i];
+        if (sheet->ctrl[i] == 0x80) {
+            assert(key.x == UINT32_MAX && key.y == UINT32_MAX);
+        } else if (sheet->ctrl[i] == 0xFE) {
+            assert(key.x == UINT32_MAX && key.y == 0);
+            tomb++;
+        } else {
+            assert(sheet->ctrl[i] < 0x80 && key.x != UINT32_MAX);
+            assert(SheetBlockGet(sheet, key) == sheet->values[i]);
+            size++;
+        }
+    }
+    assert(size == sheet->size && tomb == sheet->tomb);
+    assert((sheet->cap & (sheet->cap - 1)) == 0);
+}
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    // random inserts and deletes against a plain array
+    SpreadSheet sheet = {.mem = mem};
+    assert(SheetBlockGet(&sheet, (v2u){0, 0}) == UINT32_MAX);
+    SheetBlockDelete(&sheet, (v2u){0, 0});
+
+    static u32 want[SIDE][SIDE];
+    memset(want, 0xFF, sizeof(want));
+    for (u32 i = 0; i < OPS; i++) {
+        v2u pos = {rnd(SIDE), rnd(SIDE)};
+        if (rnd(3)) {
+            u32 bid = SheetBlockInsert(&sheet, pos, UINT32_MAX);
+            assert(want[pos.x][pos.y] == UINT32_MAX || want[pos.x][pos.y] == bid);
+            want[pos.x][pos.y] = bid;
+        } else {
+            SheetBlockDelete(&sheet, pos);
+            want[pos.x][pos.y] = UINT32_MAX;
+        }
+    }
+    checkSlots(&sheet);
+    for (u32 x = 0; x < SIDE; x++) {
+        for (u32 y = 0; y < SIDE; y++) {
+            assert(SheetBlockGet(&sheet, (v2u){x, y}) == want[x][y]);
+        }
+    }
+
+    // a clone gets its own copy of the map
+    SpreadSheet clone;
+    SpreadSheetClone(&clone, &sheet);
+    checkSlots(&clone);
+    SheetBlockDelete(&clone, (v2u){0, 0});
+    SheetBlockDelete(&clone, (v2u){1, 1});
+    assert(SheetBlockGet(&sheet, (v2u){0, 0}) == want[0][0]);
+    SpreadSheetFree(&clone);
+    SpreadSheetFree(&sheet);
+
+    // a fixed set of blocks churning through deletes and inserts
+    // reuses tombstones instead of growing the map
+    SpreadSheet churn = {.mem = mem};
+    for (u32 i = 0; i < 3000; i++) SheetBlockInsert(&churn, (v2u){i, i * 7}, UINT32_MAX);
+    u32 cap = churn.cap;
+    for (u32 i = 0; i < OPS; i++) {
+        u32 k = rnd(3000);
+        SheetBlockDelete(&churn, (v2u){k, k * 7});
+        SheetBlockInsert(&churn, (v2u){k, k * 7}, UINT32_MAX);
+        assert((churn.size + churn.tomb) * 8 <= churn.cap * 7);
+    }
+    assert(churn.cap == cap && churn.size == 3000);
+    checkSlots(&churn);
+    SpreadSheetFree(&churn);
+
+    // lookups with the map just under its resize, half of them
+    // misses. The ids don't need blocks behind them for this.
+    SpreadSheet full = {.mem = mem};
+    u32 rows = 0;
+    for (;; rows++) {
+        u32 x = 0;
+        for (; x < 1024; x++) {
+            if (full.cap >= 1 << 16 && (full.size + 2) * 8 > full.cap * 7) break;
+            SheetBlockInsert(&full, (v2u){x, rows}, full.size);
+        }
+        if (x < 1024) break;
+    }
+    assert((full.size + 2) * 8 > full.cap * 7);
+    checkSlots(&full);
+
+    u32 hits = 0;
+    for (u32 i = 0; i < OPS; i++) {
+        hits += SheetBlockGet(&full, (v2u){rnd(1024), rnd(rows * 2)}) != UINT32_MAX;
+    }
+    assert(hits > OPS / 4 && hits < OPS / 4 * 3);
+    SpreadSheetFree(&full);
+    return 0;
+}
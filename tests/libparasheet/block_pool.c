@@ -0,0 +1,137 @@
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define HELD 64
+#define THREADS 4
+
+static void setInt(SpreadSheet* sheet, u32 x, u32 y, i32 v) {
+    SpreadSheetSetCell(sheet, (v2u){x, y}, (CellValue){.t = CT_INT, .d.i = v});
+}
+
+typedef struct Worker {
+    u32 seed;
+    u32 blocks;
+} Worker;
+
+static u32 rnd(u32* seed, u32 n) {
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 8) % n;
+}
+
+// each thread churns blocks in its own sheet, all from the one pool
+static void* churn(void* arg) {
+    Worker* w = arg;
+    SpreadSheet sheet = {.mem = GlobalAllocatorCreate()};
+    static _Thread_local i32 want[128][128];
+    memset(want, 0, sizeof(want));
+
+    for (u32 i = 0; i < 200000; i++) {
+        u32 x = rnd(&w->seed, 128), y = rnd(&w->seed, 128);
+        if (rnd(&w->seed, 2)) {
+            want[x][y] = (i32)i + 1;
+            setInt(&sheet, x, y, want[x][y]);
+        } else {
+            want[x][y] = 0;
+            SpreadSheetClearCell(&sheet, (v2u){x, y});
+        }
+    }
+    for (u32 x = 0; x < 128; x++) {
+        for (u32 y = 0; y < 128; y++) {
+            CellValue* v = SpreadSheetGetCell(&sheet, (v2u){x, y});
+            assert(want[x][y] ? v && v->d.i == want[x][y] : !v || v->t == CT_EMPTY);
+        }
+    }
+    w->blocks = sheet.size;
+    SpreadSheetFree(&sheet);
+    return NULL;
+}
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+    BlockPoolUsage start = BlockPoolGetUsage();
+    assert(start.blocks == 0 && start.pageBlocks > 100);
+
+    // Block pointers held across enough inserts to grow the block
+    // table and the map many times over
+    SpreadSheet sheet = {.mem = mem};
+    Block* held[HELD];
+    for (u32 i = 0; i < HELD; i++) {
+        setInt(&sheet, i * BLOCK_SIZE, 0, (i32)i);
+        held[i] = sheet.blockpool[SheetBlockGet(&sheet, (v2u){i, 0})];
+    }
+    u32 bcap = sheet.bcap;
+
+    for (u32 y = 1; y < 400; y++) {
+        for (u32 x = 0; x < 100; x++) setInt(&sheet, x * BLOCK_SIZE, y * BLOCK_SIZE, (i32)(x + y));
+    }
+    assert(sheet.bcap >= bcap * 256);
+
+    for (u32 i = 0; i < HELD; i++) {
+        // same block, same place, same cells
+        assert(sheet.blockpool[SheetBlockGet(&sheet, (v2u){i, 0})] == held[i]);
+        CellValue v = CellUnbox(held[i]->cells[0]);
+        assert(v.t == CT_INT && v.d.i == (i32)i && held[i]->nonempty == 1);
+        // and writes show up through the held pointer
+        setInt(&sheet, i * BLOCK_SIZE + 1, 1, 77);
+        v = CellUnbox(held[i]->cells[CELL_TO_INDEX(((v2u){1, 1}))]);
+        assert(v.t == CT_INT && v.d.i == 77);
+    }
+
+    BlockPoolUsage full = BlockPoolGetUsage();
+    assert(full.blocks == sheet.size);
+    assert(full.resident * (u64)full.pageBlocks >= full.blocks);
+    assert((full.resident - 1) * (u64)full.pageBlocks < full.blocks);
+
+    // a clone shares the blocks, freeing the original leaves them be
+    SpreadSheet clone;
+    SpreadSheetClone(&clone, &sheet);
+    assert(BlockPoolGetUsage().blocks == full.blocks);
+    setInt(&clone, 0, 0, -1);
+    assert(BlockPoolGetUsage().blocks == full.blocks + 1);
+    SpreadSheetFree(&sheet);
+    assert(BlockPoolGetUsage().blocks == full.blocks);
+    assert(SpreadSheetGetCell(&clone, (v2u){0, 0})->d.i == -1);
+    assert(SpreadSheetGetCell(&clone, (v2u){5 * BLOCK_SIZE, 7 * BLOCK_SIZE})->d.i == 12);
+
+    // emptying a sheet hands every page it used back
+    for (u32 y = 0; y < 400; y++) {
+        for (u32 x = 0; x < 100; x++) {
+            for (u32 k = 0; k < 2; k++) SpreadSheetClearCell(&clone, (v2u){x * BLOCK_SIZE + k, y * BLOCK_SIZE + k});
+        }
+    }
+    assert(!clone.size);
+    BlockPoolUsage empty = BlockPoolGetUsage();
+    assert(empty.blocks == 0 && empty.resident == 0 && empty.pages == full.pages);
+
+    // and the pages come back zeroed when needed again
+    for (u32 i = 0; i < 1000; i++) setInt(&clone, i * BLOCK_SIZE + 3, 5, 1);
+    for (u32 i = 0; i < 1000; i++) {
+        Block* block = clone.blockpool[SheetBlockGet(&clone, (v2u){i, 0})];
+        assert(block->nonempty == 1 && block->refs == 1);
+        for (u32 j = 0; j < BLOCK_SIZE * BLOCK_SIZE; j++) {
+            assert(CellSlotType(block->cells[j]) == (j == CELL_TO_INDEX(((v2u){3, 5})) ? CT_INT : CT_EMPTY));
+        }
+    }
+    assert(BlockPoolGetUsage().pages == full.pages);
+    SpreadSheetFree(&clone);
+
+    // threads taking and giving back blocks at the same time
+    pthread_t threads[THREADS];
+    Worker workers[THREADS];
+    for (u32 i = 0; i < THREADS; i++) {
+        workers[i] = (Worker){.seed = i * 7919 + 1};
+        pthread_create(&threads[i], NULL, churn, &workers[i]);
+    }
+    for (u32 i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        assert(workers[i].blocks == 64);
+    }
+    empty = BlockPoolGetUsage();
+    assert(empty.blocks == 0 && empty.resident == 0);
+    return 0;
+}
@@ -0,0 +1,202 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#define COLS 64
+#define ROWS 16384
+#define EDITS 200000
+
+static u32 seed = 4242;
+
+static u32 rnd(u32 n) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+}
+
+static CellValue randomCell(void) {
+    switch (rnd(6)) {
+        case 0: return (CellValue){.t = CT_EMPTY};
+        case 1: return (CellValue){.t = CT_FLOAT, .d.f = (i32)rnd(1000) / 4.0f - 100};
+        case 2: return (CellValue){.t = CT_ERROR, .d.i = CE_DIV0};
+        default: return (CellValue){.t = CT_INT, .d.i = (i32)rnd(100000) - 50000};
+    }
+}
+
+// every summary against its block's cells, with loose extremes only
+// having to be bounds
+static void checkSummaries(SpreadSheet* sheet) {
+    u32 loose = 0;
+    for (u32 i = 0; i < sheet->cap; i++) {
+        v2u key = sheet->keys[i];
+        if (key.x == UINT32_MAX) continue;
+
+        Block* block = sheet->blockpool[sheet->values[i]];
+        BlockSummary* s = &block->summary;
+        u32 counts[CELL_TYPES] = {0};
+        i32 imin = INT32_MAX, imax = INT32_MIN;
+        f32 fmin = 1e30f, fmax = -1e30f;
+        for (u32 j = 0; j < BLOCK_SIZE * BLOCK_SIZE; j++) {
+            CellValue v = CellUnbox(block->cells[j]);
+            counts[v.t]++;
+            if (v.t == CT_INT) imin = MIN(imin, v.d.i), imax = MAX(imax, v.d.i);
+            if (v.t == CT_FLOAT) fmin = MIN(fmin, v.d.f), fmax = MAX(fmax, v.d.f);
+        }
+
+        for (u32 t = CT_EMPTY + 1; t < CELL_TYPES; t++) {
+            assert(s->counts[t] == counts[t]);
+            assert(!(s->types & CELL_TYPE_BIT(t)) == !counts[t]);
+        }
+        assert(!(s->types & CELL_TYPE_BIT(CT_EMPTY)));
+        loose += s->loose;
+
+        if (counts[CT_INT]) {
+            assert(s->imin <= imin && s->imax >= imax);
+            assert(s->loose || (s->imin == imin && s->imax == imax));
+        }
+        if (counts[CT_FLOAT]) {
+            assert(s->fmin <= fmin && s->fmax >= fmax);
+            assert(s->loose || (s->fmin == fmin && s->fmax == fmax));
+        }
+    }
+    assert(loose == sheet->loose);
+}
+
+static void randomEdits(SpreadSheet* sheet, u32 count) {
+    for (u32 e = 0; e < count; e++) {
+        v2u pos = {rnd(COLS), rnd(ROWS)};
+        SpreadSheetSetCell(sheet, pos, randomCell());
+    }
+}
+
+// a predicate scan: how many ints in lo..hi, skipping the blocks
+// whose summary rules them out
+static u32 countBetween(SpreadSheet* sheet, i32 lo, i32 hi, bool prune, u32* visited) {
+    u32 found = 0;
+    *visited = 0;
+    for (u32 i = 0; i < sheet->cap; i++) {
+        v2u key = sheet->keys[i];
+        if (key.x == UINT32_MAX) continue;
+
+        u32 bid = sheet->values[i];
+        if (prune && !SheetBlockMayHold(sheet, bid, CELL_TYPE_BIT(CT_INT), lo, hi)) continue;
+        (*visited)++;
+        Block* block = sheet->blockpool[bid];
+        for (u32 j = 0; j < BLOCK_SIZE * BLOCK_SIZE; j++) {
+            CellValue v = CellUnbox(block->cells[j]);
+            found += v.t == CT_INT && v.d.i >= lo && v.d.i <= hi;
+        }
+    }
+    return found;
+}
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    // random sets, overwrites and clears
+    SpreadSheet sheet = {.mem = mem};
+    randomEdits(&sheet, EDITS);
+    checkSummaries(&sheet);
+    assert(sheet.loose);
+    SheetSummariesTighten(&sheet);
+    assert(!sheet.loose);
+    checkSummaries(&sheet);
+
+    // a clone shares the summaries with the blocks, tightening one
+    // side copies the block and leaves the other loose
+    randomEdits(&sheet, EDITS / 10);
+    SpreadSheet clone;
+    SpreadSheetClone(&clone, &sheet);
+    assert(clone.loose == sheet.loose && sheet.loose);
+    SheetSummariesTighten(&clone);
+    checkSummaries(&clone);
+    checkSummaries(&sheet);
+    assert(!clone.loose && sheet.loose && clone.copies);
+    randomEdits(&clone, EDITS / 10);
+    checkSummaries(&clone);
+    checkSummaries(&sheet);
+    SpreadSheetFree(&clone);
+    SpreadSheetFree(&sheet);
+
+    // ints sorted down the rows: a narrow predicate only has to look
+    // at the blocks its values can be in
+    SpreadSheet sorted = {.mem = mem};
+    for (u32 x = 0; x < COLS; x++) {
+        for (u32 y = 0; y < ROWS; y++) {
+            SpreadSheetSetCell(&sorted, (v2u){x, y}, (CellValue){.t = CT_INT, .d.i = y * COLS + x});
+        }
+    }
+    SpreadSheetSetCell(&sorted, (v2u){1, 1}, (CellValue){.t = CT_FLOAT, .d.f = 1.5f});
+
+    u32 visited, pruned;
+    u32 want = countBetween(&sorted, 50000, 50999, false, &visited);
+    assert(countBetween(&sorted, 50000, 50999, true, &pruned) == want);
+    assert(want == 1000 && pruned < visited / 100);
+
+    // types prune too: one block holds a float, none an error
+    u32 floats = 0, errors = 0;
+    for (u32 i = 0; i < sorted.cap; i++) {
+        if (sorted.keys[i].x == UINT32_MAX) continue;
+        floats += SheetBlockMayHold(&sorted, sorted.values[i], CELL_TYPE_BIT(CT_FLOAT), -1e9, 1e9);
+        errors += SheetBlockMayHold(&sorted, sorted.values[i], CELL_TYPE_BIT(CT_ERROR), 0, 0);
+    }
+    assert(floats == 1 && errors == 0);
+
+    // MIN/MAX/COUNT over whole blocks read the summaries
+    {
+        StringTable str = {.mem = mem};
+        SymbolTable sym = {.mem = mem};
+        SpreadSheet out = {.mem = mem};
+        EvalContext ctx = {
+            .mem = mem,
+            .srcSheet = &sorted,
+            .inSheet = &sorted,
+            .outSheet = &out,
+            .str = &str,
+            .table = &sym,
+        };
+
+        static const char* formulas[] = {
+            "=MIN([0, 0]:[63, 16383]);",
+            "=MAX([0, 0]:[63, 16383]);",
+            "=COUNT([3, 5]:[60, 16000]);",
+            "=MAX([2, 2]:[2, 3], [5, 100]:[40, 200]);",
+        };
+        for (u32 i = 0; i < 4; i++) {
+            StrID id = StringAdd(&str, (i8*)formulas[i]);
+            SpreadSheetSetCell(&sorted, (v2u){100, i}, (CellValue){.t = CT_TEXT, .d.index = id});
+        }
+
+        EvaluateDirty(ctx);
+
+        // the edit makes a block loose, the recalc tightens it first
+        SpreadSheetSetCell(&sorted, (v2u){0, 0}, (CellValue){.t = CT_INT, .d.i = 7});
+        assert(sorted.loose == 1);
+        assert(EvaluateDirty(ctx) == 3);
+        assert(!sorted.loose);
+
+        // the same ranges through EvalRange, which reads every cell
+        CellStats stats;
+        CellStatsInit(&stats);
+        ctx.ordered = true;
+        EvalRange(ctx, (v2u){0, 0}, (v2u){63, 16383}, &stats);
+
+        CellValue* v = SpreadSheetGetCell(&out, (v2u){100, 0});
+        assert(v->t == CT_INT && v->d.i == stats.imin && v->d.i == 1);
+        v = SpreadSheetGetCell(&out, (v2u){100, 1});
+        assert(v->t == CT_INT && v->d.i == stats.imax && v->d.i == 16383 * COLS + 63);
+        v = SpreadSheetGetCell(&out, (v2u){100, 2});
+        assert(v->t == CT_INT && v->d.i == 58 * 15996);
+        v = SpreadSheetGetCell(&out, (v2u){100, 3});
+        assert(v->t == CT_INT && v->d.i == 200 * COLS + 40);
+
+        SymbolTableFree(&sym);
+        SpreadSheetFree(&out);
+        StringFree(&str);
+    }
+
+    SpreadSheetFree(&sorted);
+    return 0;
+}
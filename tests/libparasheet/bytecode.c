@@ -0,0 +1,134 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <libparasheet/tokenizer.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fixture.h"
+
+// formulas from the other evaluator tests plus the control flow and
+// scoping cases, every one of them has to compile
+static const char* formulas[] = {
+    "=2+2;",
+    "=2+2;3+3;",
+    "=1 + 2 / 3 * 4;",
+    "=1.5 * 4 - 2;",
+    "=let x : int = 2; let y : int = 2; x + y;",
+    "=let x : int = 3; let y: int = 4; 2 * (x + y);",
+    "=let x : float = 3; let y : int = 2.75; x / y;",
+    "=let x : int = 1; { x = x + 41; } x;",
+    "=let x : int = 1; { let x : int = 7; x = 9; } x;",
+    "=if (1) 10; else 20;",
+    "=7; if (0) 10; ;",
+    "=let x : int = 5; if (x - 5) { x = 1; } else { x = 2.5; } x * 3;",
+    "=[0, 0] * 2;",
+    "=[0, 0] + [0, 1];",
+    "=[0, 1] / 2;",
+    "=[0, 0 + 1] * [0, 2];",
+    "=let x : int = [0, 2]; x + [0, 2 * 0];",
+    "=if ([0, 3]) [0, 0]; else [0, 1];",
+};
+
+#define COUNT (sizeof(formulas) / sizeof(formulas[0]))
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+
+    SpreadSheetSetCell(&src, (v2u){0, 0}, (CellValue){.t = CT_INT, .d.i = 21});
+    SpreadSheetSetCell(&src, (v2u){0, 1}, (CellValue){.t = CT_FLOAT, .d.f = 5.0f});
+    SpreadSheetSetCell(&src, (v2u){0, 2}, (CellValue){.t = CT_INT, .d.i = -3});
+
+    EvalStack stack = {.mem = mem};
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+        .epoch = SheetNewEpoch(),
+        .stack = &stack,
+    };
+
+    AST asts[COUNT];
+    BCProgram progs[COUNT];
+
+    for (u32 i = 0; i < COUNT; i++) {
+        asts[i] = build(formulas[i], &str, mem);
+
+        progs[i] = (BCProgram){.mem = mem};
+        assert(BCCompile(&asts[i], &progs[i]));
+
+        CellValue a = walk(&asts[i], ctx);
+        CellValue b = BCRun(&progs[i], ctx);
+        print(stdout, "%n -> %d %d/%f\n", (i8*)formulas[i], a.t, a.d.i, a.d.f);
+        assert(a.t == b.t && a.d.i == b.d.i);
+    }
+
+    // a declaration only one branch makes is left to the tree walker
+    {
+        TokenList* tokens = Tokenize("=if (1) let x : int = 2; ;", &str, mem);
+        AST ast = BuildASTFromTokens(tokens, &str, mem);
+        DestroyTokenList(&tokens);
+
+        BCProgram prog = {.mem = mem};
+        assert(!BCCompile(&ast, &prog));
+        assert(!prog.size);
+        ASTFree(&ast);
+    }
+
+    // division by zero is #DIV/0! from the VM before and after
+    // ASTOptimize types the divisions
+    {
+        const char* divs[] = {
+            "=1 / 0 + [0, 0];",
+            "=let x : int = 7; let y : int = 0; x / y * 2;",
+            "=let x : float = 2.5; let y : float = 0; x / y - 1;",
+        };
+        BCOp ops[] = {BC_DIV_II, BC_DIV_II, BC_DIV_FF};
+
+        for (u32 i = 0; i < 3; i++) {
+            AST ast = build(divs[i], &str, mem);
+
+            BCProgram prog = {.mem = mem};
+            assert(BCCompile(&ast, &prog));
+            CellValue v = BCRun(&prog, ctx);
+            assert(v.t == CT_ERROR && v.d.i == CE_DIV0);
+            BCFree(&prog);
+
+            ASTOptimize(&ast);
+            prog = (BCProgram){.mem = mem};
+            assert(BCCompile(&ast, &prog));
+            u32 found = 0;
+            for (u32 j = 0; j < prog.size; j++) {
+                found |= prog.code[j].op == ops[i];
+            }
+            assert(found);
+            v = BCRun(&prog, ctx);
+            assert(v.t == CT_ERROR && v.d.i == CE_DIV0);
+            BCFree(&prog);
+            ASTFree(&ast);
+        }
+    }
+
+    BCPrint(stdout, &progs[11]);
+
+    for (u32 i = 0; i < COUNT; i++) {
+        ASTFree(&asts[i]);
+        BCFree(&progs[i]);
+    }
+    Free(stack.mem, stack.data, stack.cap * sizeof(v2u));
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    StringFree(&str);
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+static u32 seed = 99;
+
+static u32 rnd(void) {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static bool isNaN(CellFloat f) {
+    return f != f;
+}
+
+// same type and same bits, except that any NaN matches any other
+static bool same(CellValue a, CellValue b) {
+    if (a.t != b.t) return false;
+    switch (a.t) {
+        case CT_FLOAT:
+            if (isNaN(a.d.f)) return isNaN(b.d.f);
+            return !memcmp(&a.d.f, &b.d.f, sizeof(a.d.f));
+        case CT_TEXT:
+        case CT_CODE:
+            return StringCmp(a.d.index, b.d.index);
+        case CT_EMPTY:
+            return true;
+        default:
+            return a.d.i == b.d.i;
+    }
+}
+
+static CellValue randomCell(void) {
+    switch (rnd() % 6) {
+        case 0: return (CellValue){.t = CT_EMPTY};
+        case 1: return (CellValue){.t = CT_INT, .d.i = (i32)(rnd() * 2654435761u)};
+        case 2: return (CellValue){.t = CT_ERROR, .d.i = rnd() % 5};
+        case 3: {
+            // any bits at all, NaNs and infinities included
+            union { CellFloat f; u64 u; } bits = {.u = ((u64)rnd() << 40) ^ ((u64)rnd() << 16) ^ rnd()};
+            return (CellValue){.t = CT_FLOAT, .d.f = bits.f};
+        }
+        case 4: return (CellValue){.t = CT_FLOAT, .d.f = (CellFloat)(i32)rnd() / 100};
+        default: return (CellValue){.t = CT_TEXT, .d.index = {.idx = rnd(), .gen = rnd() % 1000}};
+    }
+}
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    // the edges of every type come back out the same
+    CellFloat zero = 0;
+    CellValue edges[] = {
+        {.t = CT_EMPTY},
+        {.t = CT_INT, .d.i = 0},
+        {.t = CT_INT, .d.i = -1},
+        {.t = CT_INT, .d.i = INT32_MIN},
+        {.t = CT_INT, .d.i = INT32_MAX},
+        {.t = CT_FLOAT, .d.f = 0},
+        {.t = CT_FLOAT, .d.f = -zero},
+        {.t = CT_FLOAT, .d.f = 1 / zero},
+        {.t = CT_FLOAT, .d.f = -1 / zero},
+        {.t = CT_FLOAT, .d.f = zero / zero},
+        {.t = CT_FLOAT, .d.f = -(zero / zero)},
+        {.t = CT_FLOAT, .d.f = 1e-40},
+        {.t = CT_FLOAT, .d.f = -3e38},
+        {.t = CT_TEXT, .d.index = {.idx = UINT32_MAX, .gen = 0}},
+        {.t = CT_CODE, .d.index = {.idx = 0, .gen = 7}},
+        {.t = CT_ERROR, .d.i = CE_DIV0},
+    };
+    for (u32 i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        CellSlot slot = CellBox(edges[i]);
+        assert(CellSlotType(slot) == edges[i].t);
+        assert(same(CellUnbox(slot), edges[i]));
+    }
+
+    // zeroed memory is empty cells, which is what new blocks are
+    CellSlot blank;
+    memset(&blank, 0, sizeof(blank));
+    assert(CellSlotType(blank) == CT_EMPTY);
+
+    // random values through a sheet and back
+    SpreadSheet sheet = {.mem = mem};
+    static CellValue want[64][64];
+    for (u32 i = 0; i < 20000; i++) {
+        v2u pos = {rnd() % 64, rnd() % 64};
+        CellValue v = randomCell();
+#if defined(CELL_NANBOX)
+        // boxed cells keep the low bits of a generation
+        if (v.t == CT_TEXT) v.d.index.gen &= CELL_BOX_GEN;
+#endif
+        assert(same(CellUnbox(CellBox(v)), v));
+        SpreadSheetSetCell(&sheet, pos, v);
+        want[pos.x][pos.y] = v;
+    }
+    for (u32 x = 0; x < 64; x++) {
+        for (u32 y = 0; y < 64; y++) {
+            CellValue* v = SpreadSheetGetCell(&sheet, (v2u){x, y});
+            assert(v ? same(*v, want[x][y]) : want[x][y].t == CT_EMPTY);
+        }
+    }
+    SpreadSheetFree(&sheet);
+
+#if defined(CELL_NANBOX)
+    assert(sizeof(CellSlot) == 8);
+
+    // a string whose generation wrapped still reads back from a cell
+    {
+        StringTable str = {.mem = mem};
+        StrID id = StringAdd(&str, (i8*)"=1;");
+        for (u32 i = 0; i <= CELL_BOX_GEN; i++) {
+            StringDel(&str, id);
+            id = StringAdd(&str, (i8*)"=1;");
+        }
+        CellValue v = CellUnbox(CellBox((CellValue){.t = CT_TEXT, .d.index = id}));
+        assert(StringGet(&str, v.d.index).data);
+        StringFree(&str);
+    }
+
+    // cents on top of ten million only fit in an f64, in a cell and
+    // through a formula
+    {
+        StringTable str = {.mem = mem};
+        SymbolTable sym = {.mem = mem};
+        SpreadSheet src = {.mem = mem};
+        SpreadSheet out = {.mem = mem};
+        EvalContext ctx = {
+            .mem = mem,
+            .srcSheet = &src,
+            .inSheet = &src,
+            .outSheet = &out,
+            .str = &str,
+            .table = &sym,
+        };
+
+        SpreadSheetSetCell(&src, (v2u){0, 0}, (CellValue){.t = CT_FLOAT, .d.f = 10000000.25});
+        StrID id = StringAdd(&str, (i8*)"=[0, 0] + 0.01;");
+        SpreadSheetSetCell(&src, (v2u){1, 0}, (CellValue){.t = CT_TEXT, .d.index = id});
+        EvaluateDirty(ctx);
+
+        assert(SpreadSheetGetCell(&src, (v2u){0, 0})->d.f == 10000000.25);
+        CellValue* v = SpreadSheetGetCell(&out, (v2u){1, 0});
+        assert(v && v->t == CT_FLOAT && v->d.f == 10000000.25 + 0.01);
+
+        SymbolTableFree(&sym);
+        SpreadSheetFree(&src);
+        SpreadSheetFree(&out);
+        StringFree(&str);
+    }
+#endif
+
+    print(stdout, "%d bytes per cell, %d bytes per block\n", (i32)sizeof(CellSlot),
+          (i32)sizeof(Block));
+    return 0;
+}
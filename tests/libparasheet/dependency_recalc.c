@@ -0,0 +1,68 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "fixture.h"
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+    };
+
+    // A -> B -> C chain plus an unrelated cell D
+    SpreadSheetSetCell(&src, (v2u){0, 0}, (CellValue){.t = CT_INT, .d.i = 1});
+    setFormula(&src, &str, (v2u){0, 1}, "=[0, 0] + 1;");
+    setFormula(&src, &str, (v2u){0, 2}, "=[0, 1] * 2;");
+    setFormula(&src, &str, (v2u){1, 0}, "=5;");
+
+    // first run evaluates everything
+    assert(EvaluateDirty(ctx) == 4);
+    assert(valueAt(&out, (v2u){0, 2}) == 4);
+    assert(valueAt(&out, (v2u){1, 0}) == 5);
+
+    // nothing changed, nothing to do
+    assert(EvaluateDirty(ctx) == 0);
+
+    // editing A only touches A, B and C
+    SpreadSheetSetCell(&src, (v2u){0, 0}, (CellValue){.t = CT_INT, .d.i = 10});
+    assert(EvaluateDirty(ctx) == 3);
+    assert(valueAt(&out, (v2u){0, 1}) == 11);
+    assert(valueAt(&out, (v2u){0, 2}) == 22);
+
+    // rewiring C to D drops the old edge from B
+    setFormula(&src, &str, (v2u){0, 2}, "=[1, 0] * 3;");
+    assert(EvaluateDirty(ctx) == 1);
+    assert(valueAt(&out, (v2u){0, 2}) == 15);
+
+    SpreadSheetSetCell(&src, (v2u){0, 0}, (CellValue){.t = CT_INT, .d.i = 2});
+    assert(EvaluateDirty(ctx) == 2);
+    assert(valueAt(&out, (v2u){0, 2}) == 15);
+
+    // clearing a cell clears its result and recomputes dependents
+    SpreadSheetClearCell(&src, (v2u){1, 0});
+    assert(EvaluateDirty(ctx) == 2);
+    assert(valueAt(&out, (v2u){0, 2}) == 0);
+
+    print(stdout, "nodes: %d\n", src.deps.nsize);
+
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    StringFree(&str);
+    return 0;
+}
@@ -22,7 +22,7 @@ void testString(char* input, StringTable* table, Allocator allocator){
 
 	EvalContext evalContext = (EvalContext){
         .table = &sym,
-        .str = &table,
+        .str = table,
 
     };
 	if (PRINT_TOKENS){
@@ -40,7 +40,7 @@ void testString(char* input, StringTable* table, Allocator allocator){
     while (sym.size){
         SymbolPopScope(&sym);
     }
-    Free(sym.mem, sym.scopes, sym.cap * sizeof(SymbolMap));
+    SymbolTableFree(&sym);
 
 	ASTFree(&ast);
 	DestroyTokenList(&tokens);
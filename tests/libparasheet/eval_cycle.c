@@ -0,0 +1,73 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fixture.h"
+
+#define CHAIN 100000
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+    };
+
+    // two cell cycle, and a cell that depends on it
+    setFormula(&src, &str, (v2u){0, 0}, "=[0, 1] + 1;");
+    setFormula(&src, &str, (v2u){0, 1}, "=[0, 0] + 1;");
+    setFormula(&src, &str, (v2u){0, 2}, "=[0, 0] * 2;");
+    // a cell referencing itself through a computed reference (a
+    // constant expression would be folded into a plain reference)
+    SpreadSheetSetCell(&src, (v2u){3, 0}, (CellValue){.t = CT_INT, .d.i = 0});
+    setFormula(&src, &str, (v2u){1, 0}, "=[1, [3, 0] * 5] + 1;");
+
+    CellValue v = evalAt(ctx, (v2u){0, 2});
+    assert(v.t == CT_ERROR && v.d.i == CE_CYCLE);
+    v = *SpreadSheetGetCell(&out, (v2u){0, 0});
+    assert(v.t == CT_ERROR && v.d.i == CE_CYCLE);
+    v = *SpreadSheetGetCell(&out, (v2u){0, 1});
+    assert(v.t == CT_ERROR && v.d.i == CE_CYCLE);
+
+    v = evalAt(ctx, (v2u){1, 0});
+    assert(v.t == CT_ERROR && v.d.i == CE_CYCLE);
+
+    // breaking the cycle recovers
+    SpreadSheetSetCell(&src, (v2u){0, 1}, (CellValue){.t = CT_INT, .d.i = 4});
+    v = evalAt(ctx, (v2u){0, 2});
+    assert(v.t == CT_INT && v.d.i == 10);
+
+    // a chain far longer than the C stack could hold if every reference
+    // was a nested call
+    char* bufs = malloc(CHAIN * 32);
+    SpreadSheetSetCell(&src, (v2u){2, 0}, (CellValue){.t = CT_INT, .d.i = 0});
+    for (u32 i = 1; i < CHAIN; i++) {
+        char* buf = &bufs[i * 32];
+        snprintf(buf, 32, "=[2, %u] + 1;", i - 1);
+        setFormula(&src, &str, (v2u){2, i}, buf);
+    }
+
+    v = evalAt(ctx, (v2u){2, CHAIN - 1});
+    assert(v.t == CT_INT && v.d.i == CHAIN - 1);
+
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    StringFree(&str);
+    free(bufs);
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "fixture.h"
+
+#define CHAIN 30
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+    };
+
+    // every cell references the previous one twice, without
+    // memoization the last cell takes 2^CHAIN evaluations. The second
+    // reference to each formula is the one avoided, the plain value
+    // at the start never needs evaluating.
+    SpreadSheetSetCell(&src, (v2u){0, 0}, (CellValue){.t = CT_INT, .d.i = 1});
+    for (u32 i = 1; i < CHAIN; i++) {
+        setFormula(&src, &str, (v2u){0, i}, "=[0, %u] + [0, %u];", i - 1, i - 1);
+    }
+
+    ctx.currentX = 0;
+    ctx.currentY = CHAIN - 1;
+    EvaluateCell(ctx);
+
+    CellValue* v = SpreadSheetGetCell(&out, (v2u){0, CHAIN - 1});
+    assert(v && v->t == CT_INT && v->d.i == 1 << (CHAIN - 1));
+    assert(src.avoided == CHAIN - 2);
+
+    // a new pass evaluates again instead of trusting old results
+    SpreadSheetSetCell(&src, (v2u){0, 0}, (CellValue){.t = CT_INT, .d.i = 0});
+    EvaluateCell(ctx);
+    v = SpreadSheetGetCell(&out, (v2u){0, CHAIN - 1});
+    assert(v && v->t == CT_INT && v->d.i == 0);
+    assert(src.avoided == 2 * (CHAIN - 2));
+
+    // diamond: two paths to the same precedent inside one pass
+    StrID b = StringAdd(&str, (i8*)"=[0, 1] + 1;");
+    StrID d = StringAdd(&str, (i8*)"=[1, 1] + [1, 2];");
+    SpreadSheetSetCell(&src, (v2u){1, 1}, (CellValue){.t = CT_TEXT, .d.index = b});
+    SpreadSheetSetCell(&src, (v2u){1, 2}, (CellValue){.t = CT_TEXT, .d.index = b});
+    SpreadSheetSetCell(&src, (v2u){1, 3}, (CellValue){.t = CT_TEXT, .d.index = d});
+
+    u64 before = src.avoided;
+    ctx.currentX = 1;
+    ctx.currentY = 3;
+    EvaluateCell(ctx);
+    v = SpreadSheetGetCell(&out, (v2u){1, 3});
+    assert(v && v->t == CT_INT && v->d.i == 2);
+    assert(src.avoided == before + 1);
+
+    print(stdout, "avoided: %d\n", (u32)src.avoided);
+
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    StringFree(&str);
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "fixture.h"
+
+#define ROWS 2000
+
+// three columns: values, a wide independent level, then a
+// column reading two cells of the level before it
+static void buildSheet(SpreadSheet* sheet, StringTable* str) {
+    for (u32 i = 0; i < ROWS; i++) {
+        SpreadSheetSetCell(sheet, (v2u){0, i}, (CellValue){.t = CT_INT, .d.i = i});
+
+        setFormula(sheet, str, (v2u){1, i}, "=[0, %u] * 2;", i);
+        setFormula(sheet, str, (v2u){2, i}, "=[1, %u] + [1, %u];", i, (i + 1) % ROWS);
+    }
+
+    // a computed reference makes it volatile, it runs after the level
+    // it's in
+    setFormula(sheet, str, (v2u){3, 0}, "=let x : int = 5; [2, x] + [1, x];");
+}
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet serialSrc = {.mem = mem};
+    SpreadSheet serialOut = {.mem = mem};
+    SpreadSheet parSrc = {.mem = mem};
+    SpreadSheet parOut = {.mem = mem};
+
+    buildSheet(&serialSrc, &str);
+    buildSheet(&parSrc, &str);
+
+    JobPool* pool = JobPoolCreate(mem, 4, MB(1));
+
+    EvalContext serial = {
+        .mem = mem,
+        .srcSheet = &serialSrc,
+        .inSheet = &serialSrc,
+        .outSheet = &serialOut,
+        .str = &str,
+        .table = &sym,
+    };
+    EvalContext parallel = serial;
+    parallel.srcSheet = &parSrc;
+    parallel.inSheet = &parSrc;
+    parallel.outSheet = &parOut;
+
+    assert(EvaluateDirty(serial) == ROWS * 3 + 1);
+    assert(EvaluateDirtyParallel(parallel, pool) == ROWS * 3 + 1);
+
+    for (u32 x = 0; x < 3; x++) {
+        for (u32 y = 0; y < ROWS; y++) {
+            CellValue* a = SpreadSheetGetCell(&serialOut, (v2u){x, y});
+            CellValue* b = SpreadSheetGetCell(&parOut, (v2u){x, y});
+            assert(a && b && a->t == CT_INT && b->t == a->t && b->d.i == a->d.i);
+        }
+    }
+    assert(SpreadSheetGetCell(&parOut, (v2u){2, 5})->d.i == 4 * 5 + 2);
+    assert(SpreadSheetGetCell(&parOut, (v2u){3, 0})->d.i == 22 + 10);
+
+    // incremental: one edit only recomputes its cone
+    SpreadSheetSetCell(&parSrc, (v2u){0, 7}, (CellValue){.t = CT_INT, .d.i = 100});
+    assert(EvaluateDirtyParallel(parallel, pool) == 4 + 1);
+    assert(SpreadSheetGetCell(&parOut, (v2u){2, 7})->d.i == 200 + 16);
+    assert(SpreadSheetGetCell(&parOut, (v2u){2, 6})->d.i == 12 + 200);
+
+    JobPoolDestroy(pool);
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&serialSrc);
+    SpreadSheetFree(&serialOut);
+    SpreadSheetFree(&parSrc);
+    SpreadSheetFree(&parOut);
+    StringFree(&str);
+    return 0;
+}
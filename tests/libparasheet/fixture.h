@@ -0,0 +1,93 @@
+#ifndef FIXTURE_H
+#define FIXTURE_H
+
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <libparasheet/tokenizer.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Helpers the evaluator tests and benches share
+
+#define FIXTURE_CHUNK (1 << 20)
+
+// A formatted copy of a formula text. The string table keeps the
+// pointer it's given, so the copies go into chunks that are never
+// moved, each one pointing back at the one before.
+static inline const char* formulaTextV(const char* fmt, va_list args) {
+    static char* chunk;
+    static u32 used = FIXTURE_CHUNK;
+
+    va_list again;
+    va_copy(again, args);
+    u32 size = vsnprintf(NULL, 0, fmt, args) + 1;
+    assert(size + sizeof(char*) <= FIXTURE_CHUNK);
+
+    if (used + size > FIXTURE_CHUNK) {
+        char* next = malloc(FIXTURE_CHUNK);
+        *(char**)next = chunk;
+        chunk = next;
+        used = sizeof(char*);
+    }
+
+    char* s = chunk + used;
+    vsnprintf(s, size, fmt, again);
+    va_end(again);
+    used += size;
+    return s;
+}
+
+static inline const char* formulaText(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    const char* s = formulaTextV(fmt, args);
+    va_end(args);
+    return s;
+}
+
+static inline void setFormula(SpreadSheet* sheet, StringTable* str, v2u pos, const char* fmt,
+                              ...) {
+    va_list args;
+    va_start(args, fmt);
+    StrID f = StringAdd(str, (i8*)formulaTextV(fmt, args));
+    va_end(args);
+    SpreadSheetSetCell(sheet, pos, (CellValue){.t = CT_TEXT, .d.index = f});
+}
+
+static inline i32 valueAt(SpreadSheet* sheet, v2u pos) {
+    CellValue* v = SpreadSheetGetCell(sheet, pos);
+    assert(v && v->t == CT_INT);
+    return v->d.i;
+}
+
+static inline CellValue evalAt(EvalContext ctx, v2u pos) {
+    ctx.currentX = pos.x;
+    ctx.currentY = pos.y;
+    EvaluateCell(ctx);
+
+    CellValue* v = SpreadSheetGetCell(ctx.outSheet, pos);
+    assert(v);
+    return *v;
+}
+
+static inline AST build(const char* src, StringTable* str, Allocator mem) {
+    TokenList* tokens = Tokenize(src, str, mem);
+    AST ast = BuildASTFromTokens(tokens, str, mem);
+    DestroyTokenList(&tokens);
+    assert(ast.size);
+    return ast;
+}
+
+// The tree walker on its own, outside of EvaluateCell
+static inline CellValue walk(AST* ast, EvalContext ctx) {
+    SymbolPushScope(ctx.table);
+    CellValue v = evaluateNode(ast, ast->size - 1, ctx);
+    while (ctx.table->size) SymbolPopScope(ctx.table);
+    return v;
+}
+
+#endif
@@ -0,0 +1,79 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "fixture.h"
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+    };
+
+    // two cells with the same source share one interned StrID
+    StrID f = StringAdd(&str, (i8*)"=2+3;");
+    SpreadSheetSetCell(&src, (v2u){0, 0}, (CellValue){.t = CT_TEXT, .d.index = f});
+    SpreadSheetSetCell(&src, (v2u){1, 0}, (CellValue){.t = CT_TEXT, .d.index = f});
+    SpreadSheetSetCell(&src, (v2u){2, 0}, (CellValue){.t = CT_INT, .d.i = 7});
+
+    CellValue v = evalAt(ctx, (v2u){0, 0});
+    assert(v.t == CT_INT && v.d.i == 5);
+    assert(src.formulas.misses == 1 && src.formulas.hits == 0);
+
+    v = evalAt(ctx, (v2u){1, 0});
+    assert(v.t == CT_INT && v.d.i == 5);
+    assert(src.formulas.misses == 1 && src.formulas.hits == 1);
+
+    // plain values never touch the cache
+    v = evalAt(ctx, (v2u){2, 0});
+    assert(v.t == CT_INT && v.d.i == 7);
+    assert(src.formulas.misses == 1 && src.formulas.hits == 1);
+
+    for (u32 i = 0; i < 10; i++) {
+        evalAt(ctx, (v2u){0, 0});
+    }
+    assert(src.formulas.hits == 11);
+    assert(src.formulas.size == 1);
+
+    // replacing the source of one cell keeps the entry (1,0) still uses
+    StrID g = StringAdd(&str, (i8*)"=4*5;");
+    SpreadSheetSetCell(&src, (v2u){0, 0}, (CellValue){.t = CT_TEXT, .d.index = g});
+    assert(src.formulas.size == 1);
+
+    v = evalAt(ctx, (v2u){0, 0});
+    assert(v.t == CT_INT && v.d.i == 20);
+    assert(src.formulas.misses == 2);
+    v = evalAt(ctx, (v2u){1, 0});
+    assert(v.t == CT_INT && v.d.i == 5);
+    assert(src.formulas.misses == 2 && src.formulas.size == 2);
+
+    // clearing a cell drops its entry with the last cell holding it
+    SpreadSheetClearCell(&src, (v2u){0, 0});
+    assert(src.formulas.size == 1);
+    assert(SpreadSheetGetCell(&src, (v2u){0, 0})->t == CT_EMPTY);
+    SpreadSheetClearCell(&src, (v2u){1, 0});
+    assert(src.formulas.size == 0 && src.formulas.usize == 0);
+
+    print(stdout, "hits: %d misses: %d\n", (u32)src.formulas.hits,
+          (u32)src.formulas.misses);
+
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    StringFree(&str);
+    return 0;
+}
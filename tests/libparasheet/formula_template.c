@@ -0,0 +1,120 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "fixture.h"
+
+#define ROWS 200000
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+    };
+    FormulaCache* cache = &src.formulas;
+
+    // `#` is relative to the cell being evaluated
+    SpreadSheetSetCell(&src, (v2u){4, 7}, (CellValue){.t = CT_INT, .d.i = 5});
+    setFormula(&src, &str, (v2u){3, 7}, "=[#1, #0] * 3;");
+    setFormula(&src, &str, (v2u){4, 8}, "=[#0, #(0 - 1)] + [#(2 - 3), #(0 - 1)];");
+    assert(EvaluateDirty(ctx) == 3);
+    assert(valueAt(&out, (v2u){3, 7}) == 15);
+    assert(valueAt(&out, (v2u){4, 8}) == 20);
+    SpreadSheetClearCell(&src, (v2u){3, 7});
+    SpreadSheetClearCell(&src, (v2u){4, 8});
+    SpreadSheetClearCell(&src, (v2u){4, 7});
+    assert(cache->size == 0 && cache->tcount == 0);
+    EvaluateDirty(ctx);
+
+    // a filled down column: every source is different, but they all
+    // point one column to the left
+    for (u32 y = 0; y < ROWS; y++) {
+        SpreadSheetSetCell(&src, (v2u){0, y}, (CellValue){.t = CT_INT, .d.i = y % 1000});
+        setFormula(&src, &str, (v2u){1, y}, "=[0, %u] * 2 + 1;", y);
+    }
+    assert(EvaluateDirty(ctx) == 2 * ROWS);
+
+    assert(cache->size == ROWS && cache->tcount == 1);
+    for (u32 y = 0; y < ROWS; y += 997) {
+        assert(valueAt(&out, (v2u){1, y}) == (i32)(y % 1000) * 2 + 1);
+    }
+
+    // a running total written with `#` is one source for the whole column
+    SpreadSheetSetCell(&src, (v2u){2, 0}, (CellValue){.t = CT_INT, .d.i = 0});
+    for (u32 y = 1; y < ROWS; y++) {
+        setFormula(&src, &str, (v2u){2, y}, "=[#0, #(0 - 1)] + [#(0 - 1), #0];");
+    }
+    assert(EvaluateDirty(ctx) == ROWS);
+    assert(cache->size == ROWS + 1 && cache->tcount == 2);
+
+    i32 total = 0;
+    for (u32 y = 1; y < ROWS; y++) {
+        total += valueAt(&out, (v2u){1, y});
+        if (y % 1009 == 0) assert(valueAt(&out, (v2u){2, y}) == total);
+    }
+
+    // ranges are anchored as well, one more template for all of them
+    for (u32 y = 0; y < 100; y++) {
+        setFormula(&src, &str, (v2u){3, y}, "=SUM([0, %u]:[1, %u]);", y, y + 9);
+    }
+    assert(EvaluateDirty(ctx) == 100);
+    assert(cache->tcount == 3);
+    for (u32 y = 0; y < 100; y++) {
+        i32 sum = 0;
+        for (u32 r = y; r <= y + 9; r++) sum += (r % 1000) * 3 + 1;
+        assert(valueAt(&out, (v2u){3, y}) == sum);
+    }
+
+    // a fixed cell next to a moving one gives every row its own tree
+    for (u32 y = 0; y < 4; y++) {
+        setFormula(&src, &str, (v2u){4, y}, "=[0, %u] + [0, 0];", y);
+    }
+    // the range formulas don't cover them, so they stay as they are
+    assert(EvaluateDirty(ctx) == 4);
+    assert(cache->tcount == 7);
+    assert(valueAt(&out, (v2u){4, 3}) == 3);
+
+    // the JIT runs the shared code with each source's anchor, checked
+    // against the tree walker
+    JitConfigure(2, true);
+    SpreadSheetSetCell(&src, (v2u){0, 5}, (CellValue){.t = CT_INT, .d.i = 100});
+    for (u32 r = 0; r < 3; r++) {
+        for (u32 y = 0; y < 100; y++) {
+            ctx.currentX = 1;
+            ctx.currentY = y;
+            ctx.epoch = 0;
+            EvaluateCell(ctx);
+        }
+    }
+    FormulaSource* source = FormulaCacheGet(cache, SpreadSheetGetCell(&src, (v2u){1, 5})->d.index);
+    // builds without the JIT (JitThreshold 0) run the bytecode instead
+    assert(cache->templates[source->template].jit.code || !JitThreshold());
+    assert(valueAt(&out, (v2u){1, 5}) == 201);
+    JitConfigure(100, false);
+
+    // templates go away with their last source
+    for (u32 y = 0; y < 4; y++) SpreadSheetClearCell(&src, (v2u){4, y});
+    assert(cache->tcount == 3);
+    for (u32 y = 0; y < ROWS; y++) SpreadSheetClearCell(&src, (v2u){1, y});
+    assert(cache->tcount == 2 && cache->size == 1 + 100);
+
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    StringFree(&str);
+    return 0;
+}
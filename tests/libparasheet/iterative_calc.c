@@ -0,0 +1,158 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+// an input, a formula reading it, a two cell cycle on top of that, a
+// cell behind the cycle and a cell reading itself
+static const char* formulas[][2] = {
+    {"=[3, 0] * 2;", "[4, 0]"},
+    {"=[1, 0] * 0.5 + [4, 0];", "[0, 0]"},
+    {"=[0, 0] * 0.5 + 1;", "[1, 0]"},
+    {"=[0, 0] + [1, 0];", "[2, 0]"},
+    {"=[0, 5] + [3, 0];", "[0, 5]"},
+};
+
+static const v2u cells[] = {{4, 0}, {0, 0}, {1, 0}, {2, 0}, {0, 5}};
+
+#define FORMULAS (sizeof(cells) / sizeof(cells[0]))
+
+static f64 valueAt(SpreadSheet* sheet, v2u pos) {
+    CellValue* v = SpreadSheetGetCell(sheet, pos);
+    assert(v && (v->t == CT_INT || v->t == CT_FLOAT));
+    return v->t == CT_INT ? v->d.i : v->d.f;
+}
+
+static bool near(f64 a, f64 b) {
+    return a - b < 1e-3 && b - a < 1e-3;
+}
+
+static void buildSheet(SpreadSheet* sheet, StringTable* str, i32 input) {
+    SpreadSheetSetCell(sheet, (v2u){3, 0}, (CellValue){.t = CT_INT, .d.i = input});
+    for (u32 i = 0; i < FORMULAS; i++) {
+        StrID id = StringAdd(str, (i8*)formulas[i][0]);
+        SpreadSheetSetCell(sheet, cells[i], (CellValue){.t = CT_TEXT, .d.index = id});
+    }
+}
+
+// A = B / 2 + 2 * input and B = A / 2 + 1 settle at A = (8 * input +
+// 2) / 3 and B = (4 * input + 4) / 3
+static void checkValues(SpreadSheet* out, i32 input, u32 maxIterations) {
+    f64 a = (8.0 * input + 2) / 3, b = (4.0 * input + 4) / 3;
+    assert(near(valueAt(out, (v2u){0, 0}), a));
+    assert(near(valueAt(out, (v2u){1, 0}), b));
+    assert(near(valueAt(out, (v2u){2, 0}), a + b));
+    assert(valueAt(out, (v2u){4, 0}) == 2 * input);
+    assert(valueAt(out, (v2u){0, 5}) >= maxIterations);
+}
+
+static void checkStats(IterativeCalc* iter) {
+    // the self reference never settles, the pair does and gets closer
+    // every time around
+    assert(iter->cycles == 2 && iter->unconverged == 1);
+    u32 pair = iter->iterations[0] < iter->iterations[1] ? 0 : 1;
+    assert(iter->iterations[1 - pair] == iter->maxIterations);
+    assert(iter->iterations[pair] > 2 && iter->iterations[pair] < iter->maxIterations);
+
+    u32 first = pair ? iter->iterations[0] : 0;
+    f64* residuals = iter->residuals + first;
+    for (u32 i = 1; i < iter->iterations[pair]; i++) assert(residuals[i] < residuals[i - 1]);
+    assert(residuals[iter->iterations[pair] - 1] <= iter->epsilon);
+    assert(iter->rsize == iter->iterations[0] + iter->iterations[1]);
+}
+
+// compileFormula counts every time it hands a template out
+static u32 runs(SpreadSheet* sheet, StringTable* str, u32 i) {
+    StrID id = StringAdd(str, (i8*)formulas[i][0]);
+    FormulaSource* source = FormulaCacheGet(&sheet->formulas, id);
+    return sheet->formulas.templates[source->template].runs;
+}
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+    JitConfigure(UINT32_MAX, false);
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+    IterativeCalc iter = {.mem = mem, .maxIterations = 100, .epsilon = 1e-4};
+
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+    };
+
+    // without iterate the cycles are errors, as before
+    buildSheet(&src, &str, 3);
+    EvaluateDirty(ctx);
+    for (u32 i = 1; i < FORMULAS; i++) {
+        CellValue* v = SpreadSheetGetCell(&out, cells[i]);
+        assert(v && v->t == CT_ERROR && v->d.i == CE_CYCLE);
+    }
+
+    // with it they settle, and the cell behind them runs only once
+    // after that
+    ctx.iterate = &iter;
+    SpreadSheetSetCell(&src, (v2u){3, 0}, (CellValue){.t = CT_INT, .d.i = 4});
+    u32 behind = runs(&src, &str, 3);
+    EvaluateDirty(ctx);
+    checkValues(&out, 4, iter.maxIterations);
+    checkStats(&iter);
+    assert(runs(&src, &str, 3) == behind + 1);
+
+    // the sliced recalc gets the same, whatever the slice size
+    for (u32 slice = 1; slice <= 8; slice *= 2) {
+        i32 input = 10 + slice;
+        SpreadSheetSetCell(&src, (v2u){3, 0}, (CellValue){.t = CT_INT, .d.i = input});
+        Recalc rc;
+        RecalcBegin(&rc, ctx);
+        while (!RecalcStep(&rc, slice)) {}
+        checkValues(&out, input, iter.maxIterations);
+        checkStats(&iter);
+        RecalcFree(&rc);
+    }
+
+    // so does the parallel one
+    {
+        SpreadSheet psrc = {.mem = mem};
+        SpreadSheet pout = {.mem = mem};
+        EvalContext pctx = ctx;
+        pctx.srcSheet = pctx.inSheet = &psrc;
+        pctx.outSheet = &pout;
+        JobPool* pool = JobPoolCreate(mem, 4, MB(1));
+
+        buildSheet(&psrc, &str, 7);
+        EvaluateDirtyParallel(pctx, pool);
+        checkValues(&pout, 7, iter.maxIterations);
+        checkStats(&iter);
+
+        JobPoolDestroy(pool);
+        SpreadSheetFree(&psrc);
+        SpreadSheetFree(&pout);
+    }
+
+    // turning it back off gives the errors again
+    ctx.iterate = NULL;
+    SpreadSheetSetCell(&src, (v2u){3, 0}, (CellValue){.t = CT_INT, .d.i = 5});
+    EvaluateDirty(ctx);
+    CellValue* v = SpreadSheetGetCell(&out, (v2u){2, 0});
+    assert(v && v->t == CT_ERROR && v->d.i == CE_CYCLE);
+    assert(valueAt(&out, (v2u){4, 0}) == 10);
+
+    print(stdout, "cycle settled after %d iterations\n",
+          MIN(iter.iterations[0], iter.iterations[1]));
+
+    IterativeCalcFree(&iter);
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    StringFree(&str);
+    return 0;
+}
@@ -0,0 +1,236 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <libparasheet/tokenizer.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fixture.h"
+
+#define EPS UINT32_MAX
+
+// every one of these is run on the JIT and the tree walker, both as
+// parsed and after ASTOptimize
+static const char* formulas[] = {
+    "=2+2;",
+    "=2+2;3+3;",
+    "=1 + 2 / 3 * 4;",
+    "=1.5 * 4 - 2;",
+    "=7 / 2 - 9 / 4 + 2.5 / 0.5;",
+    "=let x : int = 2; let y : int = 2; x + y;",
+    "=let x : float = 3; let y : int = 2.75; x / y;",
+    "=let i : int = 3; let f : float = 0.5; i * f;",
+    "=let x : float = 1; x * 2 + 1 - x / 4;",
+    "=let x : int = 1; { x = x + 41; } x;",
+    "=let x : int = 1; { let x : int = 7; x = 9; } x;",
+    "=if (1) 10; else 20;",
+    "=7; if (0) 10; ;",
+    "=if (0.5) 1.5; else 2;",
+    "=if ([0, 4]) 1; else 2;",
+    "=if ([0, 1] - 5) 1; else 2;",
+    "=if ([0, 3]) 1; else 2;",
+    "=let x : int = 5; if (x - 5) { x = 1; } else { x = 2.5; } x * 3;",
+    "=[0, 0] * 2;",
+    "=[0, 0] + [0, 1];",
+    "=[0, 1] / 2;",
+    "=[0, 1] * [0, 1] - [0, 1] / 4;",
+    "=[0, 0] / [0, 2] - [0, 2] / [0, 0];",
+    "=[0, 0 + 1] * [0, 2];",
+    "=[0, 4] + 1;",
+    "=[0, 3] * 2;",
+    "=return [0, 0] + 1;",
+    "=SUM([0, 0]:[0, 2]) * 2;",
+    "=let f : float = [0, 0]; f * 0.5 + [0, 2];",
+    "=let i : int = [0, 1]; i * 3;",
+    "=let f : float = 2.5; let i : int = f * 3; i + 1;",
+    "=let a : int = 0 - 7; let b : int = 2; a / b - b * a;",
+    // division by zero gives #DIV/0! on every path
+    "=1 / 0 + [0, 0];",
+    "=1.5 / 0 * 2;",
+    "=[0, 0] / ([0, 2] + 3);",
+    "=[0, 1] / 0.0 - 1;",
+    "=if (2 / (1 - 1)) 1; else 2;",
+    // more nodes than JitRun keeps on the stack
+    "=2 * ([0, 0] * 3 + [0, 1]) * ([0, 2] - 1) / 2 + ([0, 0] - [0, 2]) * 4.5"
+    " - [0, 1] / ([0, 0] + 1) + ([0, 2] * [0, 2] - 6) * ([0, 1] + 0.25)"
+    " + ([0, 0] * 3 + [0, 1]) * ([0, 2] - 1) / 2 - ([0, 0] - [0, 2]) * 4.5"
+    " + (1 + 2) * [0, 0] - 3 / [0, 1];",
+};
+
+#define COUNT (sizeof(formulas) / sizeof(formulas[0]))
+
+static u32 covered[AST_OP_COUNT];
+
+static void diff(AST* ast, EvalContext ctx, const char* src) {
+    JitCode jit;
+    assert(JitCompile(ast, &jit));
+
+    CellValue a = walk(ast, ctx);
+    CellValue b = JitRun(&jit, ast, ctx);
+    print(stdout, "%n -> %d %d/%f, %d walked\n", (i8*)src, b.t, b.d.i, b.d.f, jit.walks);
+    assert(a.t == b.t && a.d.i == b.d.i);
+    assert(ctx.table->size == 0);
+
+    for (u32 i = 0; i < ast->size; i++) covered[ASTGet(ast, i).op]++;
+    JitFree(&jit);
+}
+
+int main() {
+    // nothing to compare on builds without the JIT
+    if (!JitThreshold()) return 0;
+
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+
+    SpreadSheetSetCell(&src, (v2u){0, 0}, (CellValue){.t = CT_INT, .d.i = 21});
+    SpreadSheetSetCell(&src, (v2u){0, 1}, (CellValue){.t = CT_FLOAT, .d.f = 5.0f});
+    SpreadSheetSetCell(&src, (v2u){0, 2}, (CellValue){.t = CT_INT, .d.i = -3});
+    SpreadSheetSetCell(&src, (v2u){0, 3}, (CellValue){.t = CT_ERROR, .d.i = CE_NAME});
+
+    EvalStack stack = {.mem = mem};
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+        .epoch = SheetNewEpoch(),
+        .stack = &stack,
+    };
+
+    for (u32 i = 0; i < COUNT; i++) {
+        AST plain = build(formulas[i], &str, mem);
+        AST opt = build(formulas[i], &str, mem);
+        ASTOptimize(&opt);
+
+        diff(&plain, ctx, formulas[i]);
+        diff(&opt, ctx, formulas[i]);
+        ASTFree(&plain);
+        ASTFree(&opt);
+    }
+
+    // conversions outside of declarations only come from hand built
+    // trees, the optimizer leaves them inside the walked subtree
+    {
+        AST ast = {.mem = mem};
+        u32 f = ASTCreateNode(&ast, AST_FLOAT_LITERAL, EPS, EPS, EPS);
+        ASTGet(&ast, f).data.f = -7.9f;
+        u32 i = ASTCreateNode(&ast, AST_FLOAT_TO_INT, f, EPS, EPS);
+        u32 two = ASTCreateNode(&ast, AST_INT_LITERAL, EPS, EPS, EPS);
+        ASTGet(&ast, two).data.i = 2;
+        u32 div = ASTCreateNode(&ast, AST_DIV_INT, i, two, EPS);
+        u32 back = ASTCreateNode(&ast, AST_INT_TO_FLOAT, div, EPS, EPS);
+        u32 half = ASTCreateNode(&ast, AST_FLOAT_LITERAL, EPS, EPS, EPS);
+        ASTGet(&ast, half).data.f = 0.5f;
+        ASTCreateNode(&ast, AST_MUL_FLOAT, back, half, EPS);
+        diff(&ast, ctx, "(float)((int)-7.9 / 2) * 0.5");
+        ASTFree(&ast);
+    }
+
+    // arithmetic on literals and constant cells needs no walker
+    {
+        AST ast = build("=if ([0, 0]) [0, 1] * 2 + 1; else [0, 2] / 2;", &str, mem);
+        JitCode jit;
+        assert(JitCompile(&ast, &jit) && jit.walks == 0);
+        CellValue want = JitRun(&jit, &ast, ctx);
+
+        // compiled code shares arena chunks and outlives the code freed
+        // around it
+        JitCode more[64];
+        for (u32 i = 0; i < 64; i++) {
+            assert(JitCompile(&ast, &more[i]));
+            assert(more[i].code != jit.code && (i == 0 || more[i].code != more[i - 1].code));
+        }
+        assert(more[63].chunk == jit.chunk);
+        for (u32 i = 0; i < 64; i += 2) JitFree(&more[i]);
+        for (u32 i = 1; i < 64; i += 2) {
+            CellValue v = JitRun(&more[i], &ast, ctx);
+            assert(v.t == want.t && v.d.i == want.d.i);
+            JitFree(&more[i]);
+        }
+        CellValue v = JitRun(&jit, &ast, ctx);
+        assert(v.t == want.t && v.d.i == want.d.i);
+        JitFree(&jit);
+        ASTFree(&ast);
+    }
+
+    // ops the walker can't run at all sit in the branch that isn't
+    // taken, the JIT has to leave them to it without running them
+    ASTNodeOp unsupported[] = {
+        AST_INVALID, AST_INT_TYPE, AST_FLOAT_TYPE, AST_COORD_TRANSFORM, AST_WHILE,
+        AST_FOR, AST_HEADER, AST_HEADER_ARGS, AST_FUNC_ARGS, AST_RANGE,
+    };
+    for (u32 i = 0; i < sizeof(unsupported) / sizeof(unsupported[0]); i++) {
+        AST ast = {.mem = mem};
+        u32 cond = ASTCreateNode(&ast, AST_INT_LITERAL, EPS, EPS, EPS);
+        ASTGet(&ast, cond).data.i = 0;
+        u32 skipped = ASTCreateNode(&ast, unsupported[i], EPS, EPS, EPS);
+        u32 taken = ASTCreateNode(&ast, AST_INT_LITERAL, EPS, EPS, EPS);
+        ASTGet(&ast, taken).data.i = 5;
+        ASTCreateNode(&ast, AST_IF_ELSE, cond, skipped, taken);
+
+        JitCode jit;
+        assert(JitCompile(&ast, &jit) && jit.walks == 1);
+        CellValue v = JitRun(&jit, &ast, ctx);
+        assert(v.t == CT_INT && v.d.i == 5);
+        covered[unsupported[i]]++;
+
+        JitFree(&jit);
+        ASTFree(&ast);
+    }
+
+    for (u32 op = 0; op < AST_OP_COUNT; op++) {
+        if (!covered[op]) print(stderr, "op %d never checked\n", op);
+        assert(covered[op]);
+    }
+
+    // through EvaluateCell with the JIT checked against the walker,
+    // the second lookup of every formula compiles it
+    JitConfigure(2, true);
+    for (u32 i = 0; i < COUNT; i++) {
+        StrID f = StringAdd(&str, (i8*)formulas[i]);
+        v2u pos = {4, i};
+        SpreadSheetSetCell(&src, pos, (CellValue){.t = CT_TEXT, .d.index = f});
+
+        for (u32 r = 0; r < 3; r++) {
+            ctx.currentX = pos.x;
+            ctx.currentY = pos.y;
+            ctx.epoch = 0;
+            EvaluateCell(ctx);
+        }
+        FormulaSource* cached = FormulaCacheGet(&src.formulas, f);
+        assert(cached && src.formulas.templates[cached->template].jit.code);
+    }
+    JitConfigure(100, false);
+
+    // a formula on literals and constant references runs without the
+    // walker, and all three evaluators agree on it
+    const char* hot = formulas[COUNT - 1];
+    AST ast = build(hot, &str, mem);
+    ASTOptimize(&ast);
+
+    BCProgram prog = {.mem = mem};
+    JitCode jit;
+    assert(BCCompile(&ast, &prog) && JitCompile(&ast, &jit) && jit.walks == 0);
+    CellValue a = walk(&ast, ctx);
+    CellValue b = BCRun(&prog, ctx);
+    CellValue c = JitRun(&jit, &ast, ctx);
+    assert(a.t == b.t && a.d.i == b.d.i && b.t == c.t && b.d.i == c.d.i);
+
+    JitFree(&jit);
+    BCFree(&prog);
+    ASTFree(&ast);
+    Free(stack.mem, stack.data, stack.cap * sizeof(v2u));
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    StringFree(&str);
+    return 0;
+}
@@ -0,0 +1,168 @@
+#include <math.h> // before util.h, which defines log
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fixture.h"
+
+#define ROWS (1 << 20)
+
+static CellValue randomCell(void) {
+    switch (rand() % 6) {
+        case 0: return (CellValue){0};
+        case 1: return (CellValue){.t = CT_TEXT};
+        case 2:
+        case 3: return (CellValue){.t = CT_FLOAT, .d.f = (rand() % 2001 - 1000) / 8.0f};
+        default: return (CellValue){.t = CT_INT, .d.i = rand() - RAND_MAX / 2};
+    }
+}
+
+// the vector kernels against one CellStatsAdd per cell, at every
+// length and alignment a block run can have
+static void checkKernels(void) {
+    CellValue cells[BLOCK_SIZE * BLOCK_SIZE + 8];
+    CellSlot slots[BLOCK_SIZE * BLOCK_SIZE + 8];
+    for (u32 i = 0; i < sizeof(cells) / sizeof(cells[0]); i++) {
+        cells[i] = randomCell();
+        slots[i] = CellBox(cells[i]);
+    }
+
+    for (u32 start = 0; start < 8; start++) {
+        for (u32 count = 0; count <= BLOCK_SIZE * BLOCK_SIZE; count++) {
+            CellStats want, got;
+            CellStatsInit(&want);
+            CellStatsInit(&got);
+            for (u32 i = 0; i < count; i++) CellStatsAdd(&want, cells[start + i]);
+            CellStatsAccumulate(&got, &slots[start], count);
+
+            assert(want.isum == got.isum && want.icount == got.icount);
+            assert(want.fcount == got.fcount && want.formulas == got.formulas);
+            assert(want.imin == got.imin && want.imax == got.imax);
+            assert(want.fmin == got.fmin && want.fmax == got.fmax);
+            assert(fabs(want.fsum - got.fsum) < 1e-6);
+        }
+    }
+}
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    checkKernels();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+    };
+
+    // column 0: ints with a hole of missing blocks in the middle
+    i64 sum = 0;
+    i32 lo = INT32_MAX, hi = INT32_MIN;
+    u32 count = 0;
+    for (u32 y = 0; y < ROWS; y++) {
+        if (y >= 1000 && y < 5000) continue;
+        i32 v = (i32)(y % 1000) - 300;
+        SpreadSheetSetCell(&src, (v2u){0, y}, (CellValue){.t = CT_INT, .d.i = v});
+        sum += v;
+        lo = MIN(lo, v);
+        hi = MAX(hi, v);
+        count++;
+    }
+
+    CellValue v;
+    setFormula(&src, &str, (v2u){8, 0}, "=SUM([0, 0]:[0, 1048575]);");
+    v = evalAt(ctx, (v2u){8, 0});
+    assert(v.t == CT_INT && v.d.i == sum);
+
+    setFormula(&src, &str, (v2u){8, 1}, "=min([0, 1048575]:[0, 0]);");
+    v = evalAt(ctx, (v2u){8, 1});
+    assert(v.t == CT_INT && v.d.i == lo);
+
+    setFormula(&src, &str, (v2u){8, 2}, "=MAX([0, 0]:[0, 1048575]);");
+    v = evalAt(ctx, (v2u){8, 2});
+    assert(v.t == CT_INT && v.d.i == hi);
+
+    setFormula(&src, &str, (v2u){8, 3}, "=COUNT([0, 0]:[0, 1048575]);");
+    v = evalAt(ctx, (v2u){8, 3});
+    assert(v.t == CT_INT && v.d.i == (i32)count);
+
+    setFormula(&src, &str, (v2u){8, 4}, "=AVERAGE([0, 0]:[0, 1048575]);");
+    v = evalAt(ctx, (v2u){8, 4});
+    assert(v.t == CT_FLOAT && fabs(v.d.f - (f64)sum / count) < 1e-3);
+
+    // a small rectangle with mixed types, empty cells and formulas
+    // that still have to be evaluated
+    SpreadSheetSetCell(&src, (v2u){2, 3}, (CellValue){.t = CT_INT, .d.i = 4});
+    SpreadSheetSetCell(&src, (v2u){3, 3}, (CellValue){.t = CT_FLOAT, .d.f = -2.5f});
+    SpreadSheetSetCell(&src, (v2u){3, 17}, (CellValue){.t = CT_INT, .d.i = 10});
+    setFormula(&src, &str, (v2u){2, 16}, "=[2, 3] * 3;");
+    setFormula(&src, &str, (v2u){2, 17}, "=[2, 16] + 1;");
+
+    setFormula(&src, &str, (v2u){9, 0}, "=SUM([2, 3]:[3, 17]);");
+    v = evalAt(ctx, (v2u){9, 0});
+    assert(v.t == CT_FLOAT && v.d.f == 4 - 2.5f + 10 + 12 + 13);
+
+    setFormula(&src, &str, (v2u){9, 1}, "=MIN([2, 3]:[3, 17], 7);");
+    v = evalAt(ctx, (v2u){9, 1});
+    assert(v.t == CT_FLOAT && v.d.f == -2.5f);
+
+    setFormula(&src, &str, (v2u){9, 2}, "=MAX([3, 17]:[2, 3]) + 1;");
+    v = evalAt(ctx, (v2u){9, 2});
+    assert(v.t == CT_INT && v.d.i == 14);
+
+    setFormula(&src, &str, (v2u){9, 3}, "=COUNT([2, 0]:[3, 20], 1, 2.5);");
+    v = evalAt(ctx, (v2u){9, 3});
+    assert(v.t == CT_INT && v.d.i == 7);
+
+    // an int sum past i32 comes back as a float, not wrapped
+    for (u32 y = 0; y < 3; y++) {
+        SpreadSheetSetCell(&src, (v2u){4, y}, (CellValue){.t = CT_INT, .d.i = 2000000000});
+    }
+    setFormula(&src, &str, (v2u){9, 7}, "=SUM([4, 0]:[4, 2]);");
+    v = evalAt(ctx, (v2u){9, 7});
+    assert(v.t == CT_FLOAT && v.d.f == (CellFloat)6e9);
+
+    // errors
+    setFormula(&src, &str, (v2u){9, 4}, "=AVERAGE([5, 0]:[6, 9]);");
+    v = evalAt(ctx, (v2u){9, 4});
+    assert(v.t == CT_ERROR && v.d.i == CE_DIV0);
+
+    setFormula(&src, &str, (v2u){9, 5}, "=NOPE([0, 0]:[0, 3]);");
+    v = evalAt(ctx, (v2u){9, 5});
+    assert(v.t == CT_ERROR && v.d.i == CE_NAME);
+
+    setFormula(&src, &str, (v2u){9, 6}, "=SUM([9, 5]:[9, 7]);");
+    v = evalAt(ctx, (v2u){9, 6});
+    assert(v.t == CT_ERROR && v.d.i == CE_CYCLE);
+
+    // the range against reading every cell on its own
+    CellStats stats;
+    CellStatsInit(&stats);
+    for (u32 y = 0; y < ROWS; y++) {
+        CellValue* c = SpreadSheetGetCell(&src, (v2u){0, y});
+        if (c) CellStatsAdd(&stats, *c);
+    }
+    assert(stats.isum == sum);
+
+    CellStatsInit(&stats);
+    v = EvalRange(ctx, (v2u){0, 0}, (v2u){0, ROWS - 1}, &stats);
+    assert(v.t != CT_ERROR && stats.isum == sum);
+
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    SymbolTableFree(&sym);
+    StringFree(&str);
+    return 0;
+}
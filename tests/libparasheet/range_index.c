@@ -0,0 +1,192 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fixture.h"
+
+#define OWNERS 3000
+#define POINTS 5000
+#define ROWS 100000
+#define WINDOW 10
+
+static u32 seed = 12345;
+
+static u32 rnd(u32 n) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+}
+
+static int compareID(const void* a, const void* b) {
+    u32 x = *(const u32*)a, y = *(const u32*)b;
+    return (x > y) - (x < y);
+}
+
+// random ranges, some of them whole columns, checked against a scan
+// over all of them at random points
+static void checkIndex(Allocator mem) {
+    DepGraph graph = {.mem = mem};
+    static v2u want[OWNERS][2];
+    static u32 ids[OWNERS];
+
+    for (u32 i = 0; i < OWNERS; i++) {
+        ids[i] = DepGraphNode(&graph, (v2u){1000 + i, 0});
+    }
+
+    for (u32 round = 0; round < 4; round++) {
+        for (u32 i = 0; i < OWNERS; i++) {
+            // the first round sets everything, later ones replace or
+            // drop some of them. The last one changes few enough that
+            // they are only scanned, next to a tree with dead entries.
+            if (round && rnd(round == 3 ? 200 : 4)) continue;
+
+            if (round && !rnd(3)) {
+                DepGraphSetRanges(&graph, ids[i], NULL, 0);
+                want[i][0] = (v2u){1, 1};
+                want[i][1] = (v2u){0, 0};
+                continue;
+            }
+
+            u32 x = rnd(64), y = rnd(ROWS);
+            u32 h = rnd(8) ? rnd(200) : ROWS;
+            want[i][0] = (v2u){x, y};
+            want[i][1] = (v2u){x + rnd(4), y + h};
+            DepGraphSetRanges(&graph, ids[i], want[i], 1);
+        }
+
+        u32* found = NULL;
+        u32 size = 0, cap = 0;
+        for (u32 p = 0; p < POINTS; p++) {
+            v2u pos = {rnd(68), rnd(ROWS + 300)};
+            size = 0;
+            DepGraphCovering(&graph, pos, &found, &size, &cap);
+            if (size) qsort(found, size, sizeof(u32), compareID);
+
+            u32 n = 0;
+            for (u32 i = 0; i < OWNERS; i++) {
+                v2u lo = want[i][0], hi = want[i][1];
+                if (pos.x < lo.x || pos.x > hi.x || pos.y < lo.y || pos.y > hi.y) continue;
+                assert(n < size && found[n] == ids[i]);
+                n++;
+            }
+            assert(n == size);
+        }
+        if (round == 3) assert(graph.rbuilt < graph.rsize);
+        Free(mem, found, cap * sizeof(u32));
+    }
+
+    DepGraphFree(&graph);
+}
+
+// a value column, a formula column reading it, sums over both and a
+// sum per WINDOW rows
+static void buildSheet(SpreadSheet* sheet, StringTable* str) {
+    for (u32 y = 0; y < ROWS; y++) {
+        SpreadSheetSetCell(sheet, (v2u){0, y}, (CellValue){.t = CT_INT, .d.i = y % 100});
+        setFormula(sheet, str, (v2u){1, y}, "=[0, %u] * 2;", y, 0);
+    }
+    setFormula(sheet, str, (v2u){3, 0}, "=SUM([0, 0]:[0, %u]);", ROWS - 1, 0);
+    setFormula(sheet, str, (v2u){3, 1}, "=SUM([1, %u]:[1, 0]);", ROWS - 1, 0);
+    setFormula(sheet, str, (v2u){3, 2}, "=[3, 1] + 1;", 0, 0);
+    // the end row comes from a cell, which can't be indexed
+    setFormula(sheet, str, (v2u){3, 3}, "=SUM([0, 0]:[0, [0, 3]]);", 0, 0);
+    for (u32 y = 0; y < ROWS; y += WINDOW) {
+        setFormula(sheet, str, (v2u){5, y}, "=SUM([0, %u]:[0, %u]);", y, y + WINDOW - 1);
+    }
+}
+
+static void checkTotals(SpreadSheet* out) {
+    i32 total = 0;
+    for (u32 y = 0; y < ROWS; y++) total += valueAt(out, (v2u){0, y});
+    assert(valueAt(out, (v2u){3, 0}) == total);
+    assert(valueAt(out, (v2u){3, 1}) == total * 2);
+    assert(valueAt(out, (v2u){3, 2}) == total * 2 + 1);
+
+    i32 head = 0;
+    for (u32 y = 0; y <= (u32)valueAt(out, (v2u){0, 3}); y++) head += valueAt(out, (v2u){0, y});
+    assert(valueAt(out, (v2u){3, 3}) == head);
+
+    for (u32 y = 0; y < ROWS; y += WINDOW * 97) {
+        i32 sum = 0;
+        for (u32 r = y; r < y + WINDOW; r++) sum += valueAt(out, (v2u){0, r});
+        assert(valueAt(out, (v2u){5, y}) == sum);
+    }
+}
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+    checkIndex(mem);
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+    };
+
+    buildSheet(&src, &str);
+    EvaluateDirty(ctx);
+    checkTotals(&out);
+
+    // the cell, the formula reading it, both column sums, the cell
+    // after them, its window and the computed range
+    SpreadSheetSetCell(&src, (v2u){0, 5003}, (CellValue){.t = CT_INT, .d.i = 1000});
+    assert(EvaluateDirty(ctx) == 7);
+    checkTotals(&out);
+
+    // nothing covers this one
+    SpreadSheetSetCell(&src, (v2u){7, 7}, (CellValue){.t = CT_INT, .d.i = 1});
+    assert(EvaluateDirty(ctx) == 2);
+
+    // clearing a cell in a range counts as a change too
+    SpreadSheetClearCell(&src, (v2u){0, 77});
+    SpreadSheetSetCell(&src, (v2u){0, 77}, (CellValue){.t = CT_INT, .d.i = 0});
+    assert(EvaluateDirty(ctx) == 7);
+    checkTotals(&out);
+
+    // a replaced formula stops listening to its old range
+    setFormula(&src, &str, (v2u){3, 0}, "=SUM([0, 0]:[0, %u]);", 9, 0);
+    EvaluateDirty(ctx);
+    SpreadSheetSetCell(&src, (v2u){0, 5003}, (CellValue){.t = CT_INT, .d.i = 3});
+    assert(EvaluateDirty(ctx) == 6);
+    setFormula(&src, &str, (v2u){3, 0}, "=SUM([0, 0]:[0, %u]);", ROWS - 1, 0);
+    assert(EvaluateDirty(ctx) == 2);
+    checkTotals(&out);
+
+    // the parallel recalc orders ranges the same way
+    {
+        SpreadSheet psrc = {.mem = mem};
+        SpreadSheet pout = {.mem = mem};
+        EvalContext pctx = ctx;
+        pctx.srcSheet = pctx.inSheet = &psrc;
+        pctx.outSheet = &pout;
+        JobPool* pool = JobPoolCreate(mem, 4, MB(1));
+
+        buildSheet(&psrc, &str);
+        EvaluateDirtyParallel(pctx, pool);
+        checkTotals(&pout);
+        SpreadSheetSetCell(&psrc, (v2u){0, 60000}, (CellValue){.t = CT_INT, .d.i = 500});
+        assert(EvaluateDirtyParallel(pctx, pool) == 7);
+        checkTotals(&pout);
+
+        JobPoolDestroy(pool);
+        SpreadSheetFree(&psrc);
+        SpreadSheetFree(&pout);
+    }
+
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    StringFree(&str);
+    return 0;
+}
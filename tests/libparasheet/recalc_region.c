@@ -0,0 +1,154 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "fixture.h"
+
+#define ROWS 50000
+#define SLICE 1000
+
+// values, a formula per row and a running total down the column
+static void buildSheet(SpreadSheet* sheet, StringTable* str) {
+    for (u32 y = 0; y < ROWS; y++) {
+        SpreadSheetSetCell(sheet, (v2u){0, y}, (CellValue){.t = CT_INT, .d.i = y % 10});
+        setFormula(sheet, str, (v2u){1, y}, "=[0, %u] * 3;", y, 0);
+        if (y) setFormula(sheet, str, (v2u){2, y}, "=[2, %u] + [1, %u];", y - 1, y);
+    }
+    setFormula(sheet, str, (v2u){2, 0}, "=[1, %u];", 0, 0);
+}
+
+static void checkRows(SpreadSheet* out, SpreadSheet* want, u32 from, u32 to) {
+    for (u32 y = from; y < to; y++) {
+        for (u32 x = 0; x < 3; x++) {
+            CellValue* a = SpreadSheetGetCell(out, (v2u){x, y});
+            CellValue* b = SpreadSheetGetCell(want, (v2u){x, y});
+            assert(a && b && a->t == b->t && a->d.i == b->d.i);
+        }
+    }
+}
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+    SpreadSheet refSrc = {.mem = mem};
+    SpreadSheet refOut = {.mem = mem};
+
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+    };
+    EvalContext refCtx = ctx;
+    refCtx.srcSheet = refCtx.inSheet = &refSrc;
+    refCtx.outSheet = &refOut;
+
+    buildSheet(&src, &str);
+    buildSheet(&refSrc, &str);
+
+    EvaluateDirty(refCtx);
+
+    // a freshly loaded sheet: the first screen and what it reads, and
+    // nothing else gets compiled
+    Recalc rc;
+    RecalcBegin(&rc, ctx);
+    assert(RecalcRegion(&rc, (v2u){0, 0}, (v2u){7, 39}) == 3 * 40);
+    checkRows(&out, &refOut, 0, 40);
+    assert(src.formulas.size < 100);
+    assert(!SpreadSheetGetCell(&out, (v2u){1, 1000}));
+
+    // the same screen again has nothing left to do
+    assert(RecalcRegion(&rc, (v2u){0, 0}, (v2u){7, 39}) == 0);
+
+    // scrolling somewhere else while the slices run, progress only
+    // ever moves forward within a phase. Finding the cone takes
+    // slices too, no step goes over the whole sheet.
+    u32 steps = 0, last = 0, done = 0, total = 0;
+    u32 phases[RECALC_DONE + 1] = {0};
+    RecalcPhase phase = rc.phase;
+    while (!RecalcStep(&rc, SLICE)) {
+        RecalcProgress(&rc, &done, &total);
+        assert(done <= total && (rc.phase != phase || done >= last));
+        phase = rc.phase;
+        last = done;
+        phases[phase]++;
+        if (++steps == 3) {
+            RecalcRegion(&rc, (v2u){0, 30000}, (v2u){7, 30039});
+            checkRows(&out, &refOut, 30000, 30040);
+        }
+    }
+    assert(steps > 3);
+    for (u32 p = RECALC_TRACK; p < RECALC_CYCLES; p++) assert(phases[p] > 1);
+    RecalcProgress(&rc, &done, &total);
+    assert(done == total && total == src.deps.osize);
+    checkRows(&out, &refOut, 0, ROWS);
+    assert(rc.phase == RECALC_DONE && !src.deps.dirtysize);
+    RecalcFree(&rc);
+
+    // an edit halfway down: the screen below it is right before any
+    // slice runs, and the rows above the edit aren't touched
+    SpreadSheetSetCell(&src, (v2u){0, 20000}, (CellValue){.t = CT_INT, .d.i = 100});
+    SpreadSheetSetCell(&refSrc, (v2u){0, 20000}, (CellValue){.t = CT_INT, .d.i = 100});
+    EvaluateDirty(refCtx);
+
+    RecalcBegin(&rc, ctx);
+    assert(RecalcRegion(&rc, (v2u){0, 0}, (v2u){7, 39}) == 0);
+    assert(RecalcRegion(&rc, (v2u){0, 20100}, (v2u){7, 20139}) == 40);
+    checkRows(&out, &refOut, 20100, 20140);
+    assert(!SheetCellDone(&src, (v2u){2, 20200}, rc.ctx.epoch));
+    // the cone is too long to order in one go, the regions only
+    // walked back from their own cells
+    assert(rc.phase < RECALC_LEVELS);
+
+    while (!RecalcStep(&rc, SLICE)) {}
+    checkRows(&out, &refOut, 0, ROWS);
+    // everything after row 20000 in the running total and the edited row
+    assert(src.deps.osize == (ROWS - 20000) + 2);
+    RecalcFree(&rc);
+
+    // edits while the refresh is under way: the recalc begun over
+    // keeps the cells refreshed so far, and a formula edited again
+    // after its refresh gets a new one
+    CellValue reread = *SpreadSheetGetCell(&src, (v2u){1, 200});
+    for (u32 y = 0; y < 5000; y++) {
+        SpreadSheetSetCell(&src, (v2u){1, y}, *SpreadSheetGetCell(&src, (v2u){1, y}));
+    }
+    RecalcBegin(&rc, ctx);
+    while (src.deps.refreshed < 2000) RecalcStep(&rc, SLICE);
+    assert(rc.phase == RECALC_REFRESH);
+    u32 refreshed = src.deps.refreshed;
+
+    SpreadSheetSetCell(&src, (v2u){1, 100}, reread);
+    SpreadSheetSetCell(&refSrc, (v2u){1, 100}, reread);
+    EvaluateDirty(refCtx);
+    RecalcFree(&rc);
+    RecalcBegin(&rc, ctx);
+    assert(rc.phase == RECALC_REFRESH && src.deps.refreshed == refreshed);
+    while (!RecalcStep(&rc, SLICE)) {}
+    checkRows(&out, &refOut, 0, ROWS);
+    RecalcFree(&rc);
+
+    // now reading [0, 200] instead of [0, 100]
+    SpreadSheetSetCell(&src, (v2u){0, 200}, (CellValue){.t = CT_INT, .d.i = 7});
+    SpreadSheetSetCell(&refSrc, (v2u){0, 200}, (CellValue){.t = CT_INT, .d.i = 7});
+    EvaluateDirty(refCtx);
+    EvaluateDirty(ctx);
+    checkRows(&out, &refOut, 0, ROWS);
+
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    SpreadSheetFree(&refSrc);
+    SpreadSheetFree(&refOut);
+    StringFree(&str);
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "fixture.h"
+
+// sixteen inputs spread over four blocks
+static const char* heavy =
+    "=[0, 0] + [1, 0] + [2, 0] + [3, 0] + [0, 20] + [1, 20] + [2, 20] + [3, 20]"
+    " + [20, 0] + [21, 0] + [22, 0] + [23, 0] + [20, 20] + [21, 20] + [22, 20] + [23, 20];";
+
+static const v2u inputs[] = {
+    {0, 0},  {1, 0},  {2, 0},  {3, 0},  {0, 20},  {1, 20},  {2, 20},  {3, 20},
+    {20, 0}, {21, 0}, {22, 0}, {23, 0}, {20, 20}, {21, 20}, {22, 20}, {23, 20},
+};
+
+#define INPUTS (sizeof(inputs) / sizeof(inputs[0]))
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    StringTable str = {.mem = mem};
+    SymbolTable sym = {.mem = mem};
+    SpreadSheet src = {.mem = mem};
+    SpreadSheet out = {.mem = mem};
+
+    EvalContext ctx = {
+        .mem = mem,
+        .srcSheet = &src,
+        .inSheet = &src,
+        .outSheet = &out,
+        .str = &str,
+        .table = &sym,
+    };
+
+    i32 sum = 0;
+    for (u32 i = 0; i < INPUTS; i++) {
+        SpreadSheetSetCell(&src, inputs[i], (CellValue){.t = CT_INT, .d.i = i + 1});
+        sum += i + 1;
+    }
+    StrID id = StringAdd(&str, (i8*)heavy);
+    v2u cell = {40, 40};
+    SpreadSheetSetCell(&src, cell, (CellValue){.t = CT_TEXT, .d.index = id});
+    EvaluateDirty(ctx);
+    assert(valueAt(&out, cell) == sum);
+
+    FormulaSource* source = FormulaCacheGet(&src.formulas, id);
+    assert(source->handles && src.formulas.templates[source->template].refs == INPUTS);
+
+    // the first passes resolve every handle, once the blocks are all
+    // there recalcs don't look anything up again
+    for (u32 r = 0; r < 3; r++) {
+        SpreadSheetSetCell(&src, inputs[0], (CellValue){.t = CT_INT, .d.i = 1 + r});
+        EvaluateDirty(ctx);
+    }
+    u64 resolved = out.resolved;
+    for (u32 r = 0; r < 100; r++) {
+        SpreadSheetSetCell(&src, inputs[r % INPUTS], (CellValue){.t = CT_INT, .d.i = 1000 + r});
+        EvaluateDirty(ctx);
+        assert(valueAt(&out, (v2u){inputs[r % INPUTS].x, inputs[r % INPUTS].y}) == 1000 + (i32)r);
+    }
+    assert(out.resolved == resolved);
+
+    sum = 0;
+    for (u32 i = 0; i < INPUTS; i++) sum += valueAt(&out, inputs[i]);
+    assert(valueAt(&out, cell) == sum);
+
+    // emptying a block frees it in outSheet as well, the handles into it
+    // go stale and read empty cells from then on
+    u32 version = out.version;
+    for (u32 i = 0; i < 4; i++) {
+        sum -= valueAt(&out, inputs[i]);
+        SpreadSheetClearCell(&src, inputs[i]);
+    }
+    EvaluateDirty(ctx);
+    assert(out.version != version && out.resolved > resolved);
+    assert(valueAt(&out, cell) == sum);
+
+    // and a new block in its place is found again
+    SpreadSheetSetCell(&src, inputs[2], (CellValue){.t = CT_INT, .d.i = 7});
+    EvaluateDirty(ctx);
+    assert(valueAt(&out, cell) == sum + 7);
+    sum += 7;
+
+    // the walker and the JIT read through the same handles
+    JitConfigure(2, true);
+    sum -= valueAt(&out, inputs[5]);
+    for (u32 r = 0; r < 3; r++) {
+        SpreadSheetSetCell(&src, inputs[5], (CellValue){.t = CT_INT, .d.i = 50 + r});
+        EvaluateDirty(ctx);
+    }
+    assert(src.formulas.templates[source->template].jit.code || !JitThreshold());
+    assert(valueAt(&out, cell) == sum + 52);
+    JitConfigure(100, false);
+
+    // a `#` formula filled down a column has one source for every cell
+    // and nothing to anchor on, it gets no handles and reads each
+    // cell's own neighbours
+    StrID rel = StringAdd(&str, (i8*)"=[#(0 - 1), #0] * 2;");
+    for (u32 y = 0; y < 50; y++) {
+        SpreadSheetSetCell(&src, (v2u){60, y}, (CellValue){.t = CT_INT, .d.i = (i32)y});
+        SpreadSheetSetCell(&src, (v2u){61, y}, (CellValue){.t = CT_TEXT, .d.index = rel});
+    }
+    EvaluateDirty(ctx);
+    FormulaSource* relative = FormulaCacheGet(&src.formulas, rel);
+    assert(!relative->anchored && !relative->handles);
+    resolved = out.resolved;
+    SpreadSheetSetCell(&src, (v2u){60, 7}, (CellValue){.t = CT_INT, .d.i = 100});
+    EvaluateDirty(ctx);
+    assert(out.resolved == resolved);
+    for (u32 y = 0; y < 50; y++) assert(valueAt(&out, (v2u){61, y}) == (y == 7 ? 200 : (i32)y * 2));
+    // the new source can have moved the cache's entries
+    source = FormulaCacheGet(&src.formulas, id);
+
+    // the same program with and without handles
+    EvalStack stack = {.mem = mem};
+    ctx.stack = &stack;
+    ctx.ordered = true;
+    ctx.anchor = source->anchor;
+    BCProgram* prog = &src.formulas.templates[source->template].code;
+    assert(prog->size);
+
+    CellValue plain = BCRun(prog, ctx);
+    ctx.handles = source->handles;
+    CellValue fast = BCRun(prog, ctx);
+    assert(plain.t == fast.t && plain.d.i == fast.d.i);
+    assert(fast.d.i == valueAt(&out, cell));
+
+    Free(stack.mem, stack.data, stack.cap * sizeof(v2u));
+    SymbolTableFree(&sym);
+    SpreadSheetFree(&src);
+    SpreadSheetFree(&out);
+    StringFree(&str);
+    return 0;
+}
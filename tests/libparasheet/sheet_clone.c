@@ -0,0 +1,127 @@
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "fixture.h"
+
+#define COLS 64
+#define ROWS 16384
+
+static void fill(SpreadSheet* sheet) {
+    for (u32 x = 0; x < COLS; x++) {
+        for (u32 y = 0; y < ROWS; y++) {
+            SpreadSheetSetCell(sheet, (v2u){x, y}, (CellValue){.t = CT_INT, .d.i = x * ROWS + y});
+        }
+    }
+}
+
+static void checkAll(SpreadSheet* sheet) {
+    for (u32 x = 0; x < COLS; x++) {
+        for (u32 y = 0; y < ROWS; y += 7) assert(valueAt(sheet, (v2u){x, y}) == (i32)(x * ROWS + y));
+    }
+}
+
+// a column of values, one formula per row and a total at the top
+static void formulas(SpreadSheet* sheet, StringTable* str) {
+    for (u32 y = 0; y < 1000; y++) {
+        SpreadSheetSetCell(sheet, (v2u){0, y}, (CellValue){.t = CT_INT, .d.i = y});
+        setFormula(sheet, str, (v2u){1, y}, "=[0, %u] * 2;", y);
+    }
+    setFormula(sheet, str, (v2u){2, 0}, "=SUM([1, 0]:[1, 999]);");
+}
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    SpreadSheet src = {.mem = mem};
+    fill(&src);
+    u32 blocks = src.size;
+
+    // a million cells cloned without copying a block
+    SpreadSheet clone;
+    SpreadSheetClone(&clone, &src);
+    checkAll(&clone);
+    assert(clone.copies == 0 && clone.version != src.version);
+
+    // a write copies the one block it lands in, the other side keeps
+    // the old value
+    SpreadSheetSetCell(&clone, (v2u){3, 5}, (CellValue){.t = CT_INT, .d.i = -1});
+    assert(clone.copies == 1 && valueAt(&clone, (v2u){3, 5}) == -1);
+    assert(valueAt(&src, (v2u){3, 5}) == 3 * ROWS + 5);
+    SpreadSheetSetCell(&clone, (v2u){3, 6}, (CellValue){.t = CT_INT, .d.i = -2});
+    assert(clone.copies == 1);
+
+    // that block is src's alone now, another one is still shared
+    SpreadSheetSetCell(&src, (v2u){3, 7}, (CellValue){.t = CT_INT, .d.i = -3});
+    assert(src.copies == 0 && valueAt(&clone, (v2u){3, 7}) == 3 * ROWS + 7);
+    SpreadSheetSetCell(&src, (v2u){40, 4000}, (CellValue){.t = CT_INT, .d.i = -4});
+    assert(src.copies == 1 && valueAt(&clone, (v2u){40, 4000}) == 40 * ROWS + 4000);
+
+    // emptying a shared block frees it on one side only
+    for (u32 x = 16; x < 32; x++) {
+        for (u32 y = 32; y < 48; y++) SpreadSheetClearCell(&clone, (v2u){x, y});
+    }
+    assert(clone.size == blocks - 1 && src.size == blocks);
+    assert(valueAt(&src, (v2u){20, 40}) == 20 * ROWS + 40);
+    assert(!SpreadSheetGetCell(&clone, (v2u){20, 40}));
+
+    // handles into a copied block stay good
+    CellHandle handle = {.version = UINT32_MAX};
+    assert(SheetHandleGet(&clone, &handle, (v2u){50, 50})->d.i == 50 * ROWS + 50);
+    u64 resolved = clone.resolved;
+    SpreadSheetSetCell(&clone, (v2u){50, 51}, (CellValue){.t = CT_INT, .d.i = 0});
+    SpreadSheetSetCell(&clone, (v2u){50, 50}, (CellValue){.t = CT_INT, .d.i = 9});
+    assert(SheetHandleGet(&clone, &handle, (v2u){50, 50})->d.i == 9);
+    assert(clone.resolved == resolved);
+
+    // swapping is just the structs
+    SpreadSheetSwap(&src, &clone);
+    assert(valueAt(&src, (v2u){3, 5}) == -1 && valueAt(&clone, (v2u){3, 5}) == 3 * ROWS + 5);
+
+    // either side can go first, the other keeps every shared block
+    SpreadSheetFree(&clone);
+    assert(valueAt(&src, (v2u){60, 16000}) == 60 * ROWS + 16000);
+    SpreadSheetFree(&src);
+
+    // a snapshot of the results before an edit, only the blocks the
+    // edit reaches get copied
+    {
+        StringTable str = {.mem = mem};
+        SymbolTable sym = {.mem = mem};
+        SpreadSheet sheet = {.mem = mem};
+        SpreadSheet out = {.mem = mem};
+        EvalContext ctx = {
+            .mem = mem,
+            .srcSheet = &sheet,
+            .inSheet = &sheet,
+            .outSheet = &out,
+            .str = &str,
+            .table = &sym,
+        };
+
+        formulas(&sheet, &str);
+        EvaluateDirty(ctx);
+        i32 total = valueAt(&out, (v2u){2, 0});
+
+        SpreadSheet before;
+        SpreadSheetClone(&before, &out);
+        SpreadSheetSetCell(&sheet, (v2u){0, 500}, (CellValue){.t = CT_INT, .d.i = 10000});
+        EvaluateDirty(ctx);
+
+        assert(valueAt(&out, (v2u){2, 0}) == total + (10000 - 500) * 2);
+        assert(valueAt(&before, (v2u){2, 0}) == total);
+        assert(valueAt(&before, (v2u){1, 500}) == 1000);
+        // the edited cell, its row formula and the total
+        assert(out.copies <= 3);
+
+        SpreadSheetFree(&before);
+        SymbolTableFree(&sym);
+        SpreadSheetFree(&sheet);
+        SpreadSheetFree(&out);
+        StringFree(&str);
+    }
+    return 0;
+}
@@ -0,0 +1,176 @@
+#include <libparasheet/csv.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SIDE 200
+#define EDITS 60000
+
+static u32 seed = 2024;
+
+static u32 rnd(u32 n) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+}
+
+static i32 want[SIDE][SIDE]; // 0 for empty
+
+static void set(SpreadSheet* sheet, u32 x, u32 y, i32 v) {
+    if (v) SpreadSheetSetCell(sheet, (v2u){x, y}, (CellValue){.t = CT_INT, .d.i = v});
+    else SpreadSheetClearCell(sheet, (v2u){x, y});
+    want[x][y] = v;
+}
+
+static void checkRange(SpreadSheet* sheet) {
+    u32 cells = 0;
+    v2u lo = {UINT32_MAX, UINT32_MAX}, hi = {0, 0};
+    for (u32 x = 0; x < SIDE; x++) {
+        for (u32 y = 0; y < SIDE; y++) {
+            if (!want[x][y]) continue;
+            cells++;
+            lo = (v2u){MIN(lo.x, x), MIN(lo.y, y)};
+            hi = (v2u){MAX(hi.x, x), MAX(hi.y, y)};
+        }
+    }
+    assert(sheet->cells == cells);
+
+    // loose bounds still hold every cell
+    if (cells) {
+        assert(sheet->usedLo.x <= lo.x && sheet->usedLo.y <= lo.y);
+        assert(sheet->usedHi.x >= hi.x && sheet->usedHi.y >= hi.y);
+    }
+
+    v2u glo, ghi;
+    assert(SpreadSheetUsedRange(sheet, &glo, &ghi) == (cells != 0));
+    if (cells) assert(CMPV2(glo, lo) && CMPV2(ghi, hi) && !sheet->usedLoose);
+}
+
+// every cell once, blocks in order and cells in order inside them
+static void checkIter(SpreadSheet* sheet, SheetOrder order) {
+    static u8 seen[SIDE][SIDE];
+    memset(seen, 0, sizeof(seen));
+
+    SheetIter it;
+    SheetIterBegin(&it, sheet, order);
+    assert(it.count == sheet->size);
+    u32 count = 0;
+    v2u block = {0, 0}, last = {0, 0};
+    while (SheetIterNext(&it)) {
+        v2u b = CELL_TO_BLOCK(it.pos);
+        assert(CMPV2(b, it.at.pos));
+        if (count && CMPV2(b, block)) {
+            // inside a block
+            if (order == SHEET_ROWS)
+                assert(it.pos.y > last.y || (it.pos.y == last.y && it.pos.x > last.x));
+            else
+                assert(it.pos.x > last.x || (it.pos.x == last.x && it.pos.y > last.y));
+        } else if (count) {
+            if (order == SHEET_ROWS)
+                assert(b.y > block.y || (b.y == block.y && b.x > block.x));
+            else
+                assert(b.x > block.x || (b.x == block.x && b.y > block.y));
+        }
+        assert(it.value.t == CT_INT && it.value.d.i == want[it.pos.x][it.pos.y]);
+        assert(!seen[it.pos.x][it.pos.y]);
+        seen[it.pos.x][it.pos.y] = 1;
+        block = b;
+        last = it.pos;
+        count++;
+    }
+    SheetIterEnd(&it);
+    assert(count == sheet->cells);
+}
+
+// the export against writing every cell of the used range out
+static void checkExport(SpreadSheet* sheet, StringTable* str, Allocator mem) {
+    const char* file = "sheet_iter.csv";
+    csv_export_file(mem, file, sheet, str);
+    SString got = DumpFile(mem, file);
+    remove(file);
+
+    static char text[SIDE * SIDE * 8];
+    char* cursor = text;
+    v2u lo, hi;
+    if (SpreadSheetUsedRange(sheet, &lo, &hi)) {
+        for (u32 y = 0; y <= hi.y; y++) {
+            for (u32 x = 0; x <= hi.x; x++) {
+                if (want[x][y]) cursor += sprintf(cursor, "%d", want[x][y]);
+                if (x < hi.x) *cursor++ = ',';
+            }
+            *cursor++ = '\n';
+        }
+    }
+    assert(got.size == (u32)(cursor - text));
+    assert(!got.size || !memcmp(got.data, text, got.size));
+    Free(mem, got.data, got.size);
+}
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+    StringTable str = {.mem = mem};
+
+    SpreadSheet sheet = {.mem = mem};
+    v2u lo, hi;
+    assert(!SpreadSheetUsedRange(&sheet, &lo, &hi));
+    checkIter(&sheet, SHEET_ROWS);
+
+    for (u32 i = 0; i < EDITS; i++) {
+        set(&sheet, rnd(SIDE), rnd(SIDE), rnd(3) ? (i32)rnd(1000) + 1 : 0);
+        if (i % 10000 == 0) checkRange(&sheet);
+    }
+    checkRange(&sheet);
+    checkIter(&sheet, SHEET_ROWS);
+    checkIter(&sheet, SHEET_COLUMNS);
+    checkExport(&sheet, &str, mem);
+
+    // clearing from the outside in keeps shrinking the range, down to
+    // nothing at all
+    for (u32 ring = 0; ring < SIDE / 2; ring += 7) {
+        for (u32 k = ring; k < SIDE - ring; k++) {
+            set(&sheet, ring, k, 0);
+            set(&sheet, SIDE - 1 - ring, k, 0);
+            set(&sheet, k, ring, 0);
+            set(&sheet, k, SIDE - 1 - ring, 0);
+        }
+        checkRange(&sheet);
+    }
+    checkIter(&sheet, SHEET_COLUMNS);
+    checkExport(&sheet, &str, mem);
+    for (u32 x = 0; x < SIDE; x++) {
+        for (u32 y = 0; y < SIDE; y++) set(&sheet, x, y, 0);
+    }
+    checkRange(&sheet);
+    assert(!sheet.size);
+    checkExport(&sheet, &str, mem);
+
+    // a clone has the same range
+    set(&sheet, 3, 150, 9);
+    set(&sheet, 120, 4, 8);
+    SpreadSheet clone;
+    SpreadSheetClone(&clone, &sheet);
+    assert(SpreadSheetUsedRange(&clone, &lo, &hi));
+    assert(CMPV2(lo, ((v2u){3, 4})) && CMPV2(hi, ((v2u){120, 150})));
+    SpreadSheetFree(&clone);
+    SpreadSheetFree(&sheet);
+
+    // a long sparse column: the iterator only visits the cells set,
+    // not the empty area of the blocks around them
+    SpreadSheet sparse = {.mem = mem};
+    u32 cells = 0;
+    for (u32 y = 0; y < 1 << 16; y += 331) {
+        SpreadSheetSetCell(&sparse, (v2u){y % 3 * 40, y}, (CellValue){.t = CT_INT, .d.i = 1});
+        cells++;
+    }
+    SheetIter it;
+    SheetIterBegin(&it, &sparse, SHEET_ROWS);
+    u32 walked = 0;
+    while (SheetIterNext(&it)) walked++;
+    SheetIterEnd(&it);
+    assert(walked == sparse.cells && walked == cells);
+    SpreadSheetFree(&sparse);
+    StringFree(&str);
+    return 0;
+}
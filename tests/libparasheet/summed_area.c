@@ -0,0 +1,238 @@
+#include <math.h> // before util.h, which defines log
+#include <libparasheet/evaluator.h>
+#include <libparasheet/lib_internal.h>
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "fixture.h"
+
+#define COLS 128
+#define ROWS 2048
+#define QUERIES 400
+#define REPORTS 400
+
+static u32 seed = 777;
+
+static u32 rnd(u32 n) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+}
+
+static CellValue randomCell(void) {
+    switch (rnd(4)) {
+        case 0: return (CellValue){.t = CT_EMPTY};
+        case 1: return (CellValue){.t = CT_FLOAT, .d.f = rnd(1000) / 8.0f};
+        default: return (CellValue){.t = CT_INT, .d.i = (i32)rnd(2000) - 1000};
+    }
+}
+
+static void fill(SpreadSheet* sheet) {
+    for (u32 x = 0; x < COLS; x++) {
+        for (u32 y = 0; y < ROWS; y++) {
+            CellValue v = randomCell();
+            if (v.t != CT_EMPTY) SpreadSheetSetCell(sheet, (v2u){x, y}, v);
+        }
+    }
+}
+
+// the same totals one cell at a time
+static CellStats scan(SpreadSheet* sheet, v2u lo, v2u hi) {
+    CellStats stats;
+    CellStatsInit(&stats);
+    for (u32 x = lo.x; x <= hi.x; x++) {
+        for (u32 y = lo.y; y <= hi.y; y++) {
+            CellValue* v = SpreadSheetGetCell(sheet, (v2u){x, y});
+            if (v) CellStatsAdd(&stats, *v);
+        }
+    }
+    return stats;
+}
+
+static void check(SpreadSheet* sheet, v2u lo, v2u hi, v2u scanHi) {
+    CellStats got;
+    CellStatsInit(&got);
+    assert(SheetRangeSums(sheet, lo, hi, &got));
+    CellStats want = scan(sheet, lo, scanHi);
+
+    assert(got.isum == want.isum);
+    assert(got.icount == want.icount && got.fcount == want.fcount);
+    assert(got.formulas == want.formulas);
+    // floats are only counted
+    assert(got.fsum == 0);
+}
+
+static void randomRect(v2u* lo, v2u* hi, u32 cols, u32 rows) {
+    u32 x0 = rnd(cols), x1 = rnd(cols), y0 = rnd(rows), y1 = rnd(rows);
+    *lo = (v2u){MIN(x0, x1), MIN(y0, y1)};
+    *hi = (v2u){MAX(x0, x1), MAX(y0, y1)};
+}
+
+static void checkRandom(SpreadSheet* sheet, u32 count) {
+    for (u32 q = 0; q < count; q++) {
+        v2u lo, hi;
+        // some stick out past the cells, which don't exist there
+        randomRect(&lo, &hi, COLS + 40, ROWS + 40);
+        check(sheet, lo, hi, hi);
+    }
+}
+
+// a dashboard: overlapping totals over a data sheet, all of them
+// over the middle cell. The same formulas go in both sheets.
+static void reports(SpreadSheet* sheet, SpreadSheet* ref, StringTable* str) {
+    for (u32 i = 0; i < REPORTS; i++) {
+        v2u lo = {rnd(COLS / 2), rnd(ROWS / 2)};
+        v2u hi = {COLS / 2 + rnd(COLS / 2), ROWS / 2 + rnd(ROWS / 2)};
+        const char* fn = i % 3 == 0 ? "SUM" : i % 3 == 1 ? "COUNT" : "AVERAGE";
+        const char* text = formulaText("=%s([%u, %u]:[%u, %u]);", fn, lo.x, lo.y, hi.x, hi.y);
+        CellValue v = {.t = CT_TEXT, .d.index = StringAdd(str, (i8*)text)};
+        SpreadSheetSetCell(sheet, (v2u){COLS + 100, i}, v);
+        SpreadSheetSetCell(ref, (v2u){COLS + 100, i}, v);
+    }
+}
+
+static void checkReports(SpreadSheet* out, SpreadSheet* want) {
+    for (u32 i = 0; i < REPORTS; i++) {
+        CellValue* a = SpreadSheetGetCell(out, (v2u){COLS + 100, i});
+        CellValue* b = SpreadSheetGetCell(want, (v2u){COLS + 100, i});
+        assert(a && b && a->t == b->t && a->d.i == b->d.i);
+    }
+}
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+
+    SpreadSheet sheet = {.mem = mem};
+    CellStats none;
+    CellStatsInit(&none);
+    assert(!SheetRangeSums(&sheet, (v2u){0, 0}, (v2u){1, 1}, &none));
+
+    fill(&sheet);
+    SpreadSheetSummed(&sheet);
+    checkRandom(&sheet, QUERIES);
+    assert(sheet.sums.coarse && sheet.sums.rebuilt == sheet.size);
+
+    // single cells, single blocks and whole columns
+    check(&sheet, (v2u){17, 33}, (v2u){17, 33}, (v2u){17, 33});
+    check(&sheet, (v2u){32, 48}, (v2u){47, 63}, (v2u){47, 63});
+    check(&sheet, (v2u){5, 0}, (v2u){70, UINT32_MAX}, (v2u){70, ROWS - 1});
+
+    // an edit only marks its block, which is built again once
+    u64 rebuilt = sheet.sums.rebuilt;
+    SpreadSheetSetCell(&sheet, (v2u){100, 1000}, (CellValue){.t = CT_INT, .d.i = 123456});
+    SpreadSheetSetCell(&sheet, (v2u){101, 1001}, (CellValue){.t = CT_FLOAT, .d.f = 0.5f});
+    assert(sheet.sums.rebuilt == rebuilt);
+    check(&sheet, (v2u){90, 990}, (v2u){110, 1010}, (v2u){110, 1010});
+    assert(sheet.sums.rebuilt == rebuilt + 1);
+
+    // emptied blocks disappear from the tables
+    for (u32 x = 32; x < 48; x++) {
+        for (u32 y = 0; y < 64; y++) SpreadSheetClearCell(&sheet, (v2u){x, y});
+    }
+    checkRandom(&sheet, QUERIES / 4);
+
+    // formula cells are only counted
+    SpreadSheetSetCell(&sheet, (v2u){3, 3}, (CellValue){.t = CT_TEXT, .d.index = {0}});
+    check(&sheet, (v2u){0, 0}, (v2u){8, 8}, (v2u){8, 8});
+
+    // a block far away makes the bounding box too sparse for the
+    // coarse table, the block prefixes still answer everything
+    SpreadSheetSetCell(&sheet, (v2u){1 << 20, 1 << 20}, (CellValue){.t = CT_INT, .d.i = 9});
+    checkRandom(&sheet, QUERIES / 4);
+    assert(!sheet.sums.coarse);
+    CellStats far;
+    CellStatsInit(&far);
+    assert(SheetRangeSums(&sheet, (v2u){1000, 1000}, (v2u){(1 << 20) + 5, (1 << 20) + 5}, &far));
+    assert(far.isum == 9 && far.icount == 1 && !far.fcount);
+    SpreadSheetClearCell(&sheet, (v2u){1 << 20, 1 << 20});
+    checkRandom(&sheet, QUERIES / 4);
+    assert(sheet.sums.coarse);
+
+    // clones don't bring the tables along
+    SpreadSheet clone;
+    SpreadSheetClone(&clone, &sheet);
+    assert(!SheetRangeSums(&clone, (v2u){0, 0}, (v2u){1, 1}, &none));
+    SpreadSheetFree(&clone);
+    SpreadSheetFree(&sheet);
+
+    // the evaluator answers SUM/COUNT/AVERAGE off the tables
+    {
+        StringTable str = {.mem = mem};
+        SymbolTable sym = {.mem = mem};
+        SpreadSheet src = {.mem = mem};
+        SpreadSheet out = {.mem = mem};
+        SpreadSheet refSrc = {.mem = mem};
+        SpreadSheet refOut = {.mem = mem};
+        EvalContext ctx = {
+            .mem = mem,
+            .srcSheet = &src,
+            .inSheet = &src,
+            .outSheet = &out,
+            .str = &str,
+            .table = &sym,
+        };
+        EvalContext refCtx = ctx;
+        refCtx.srcSheet = refCtx.inSheet = &refSrc;
+        refCtx.outSheet = &refOut;
+
+        u32 s = seed;
+        fill(&src);
+        seed = s;
+        fill(&refSrc);
+        reports(&src, &refSrc, &str);
+        SpreadSheetSummed(&src);
+
+        EvaluateDirty(refCtx);
+        EvaluateDirty(ctx);
+        checkReports(&out, &refOut);
+
+        // an edit in the middle recalculates every report
+        v2u middle = {COLS / 2, ROWS / 2};
+        SpreadSheetSetCell(&src, middle, (CellValue){.t = CT_INT, .d.i = 5000});
+        SpreadSheetSetCell(&refSrc, middle, (CellValue){.t = CT_INT, .d.i = 5000});
+        assert(EvaluateDirty(refCtx) == REPORTS + 1);
+        assert(EvaluateDirty(ctx) == REPORTS + 1);
+        checkReports(&out, &refOut);
+
+        // and so does the parallel recalc
+        JobPool* pool = JobPoolCreate(mem, 4, MB(1));
+        SpreadSheetSetCell(&src, (v2u){100, 1500}, (CellValue){.t = CT_FLOAT, .d.f = 2.5f});
+        SpreadSheetSetCell(&refSrc, (v2u){100, 1500}, (CellValue){.t = CT_FLOAT, .d.f = 2.5f});
+        EvaluateDirty(refCtx);
+        EvaluateDirtyParallel(ctx, pool);
+        checkReports(&out, &refOut);
+        JobPoolDestroy(pool);
+
+        // a float total is what adding up the cells gives, even next
+        // to an inf or a float big enough to swallow the rest
+        CellFloat big[] = {INFINITY, 3e38f, 1e17f};
+        v2u at = {COLS + 101, 0};
+        CellValue sum = {.t = CT_TEXT, .d.index = StringAdd(&str, (i8*)"=SUM([200, 5]:[200, 6]);")};
+        SpreadSheetSetCell(&src, (v2u){200, 5}, (CellValue){.t = CT_FLOAT, .d.f = 1.25f});
+        SpreadSheetSetCell(&src, at, sum);
+        for (u32 i = 0; i < 3; i++) {
+            SpreadSheetSetCell(&src, (v2u){200, 6}, (CellValue){.t = CT_FLOAT, .d.f = big[i]});
+            EvaluateDirty(ctx);
+            CellValue* v = SpreadSheetGetCell(&out, at);
+            assert(v && v->t == CT_FLOAT && v->d.f == (CellFloat)(1.25 + big[i]));
+        }
+
+        // ints still come off the tables, even past what an int cell holds
+        sum.d.index = StringAdd(&str, (i8*)"=SUM([200, 7]:[200, 8]);");
+        SpreadSheetSetCell(&src, (v2u){200, 7}, (CellValue){.t = CT_INT, .d.i = INT32_MAX});
+        SpreadSheetSetCell(&src, (v2u){200, 8}, (CellValue){.t = CT_INT, .d.i = INT32_MAX});
+        SpreadSheetSetCell(&src, at, sum);
+        EvaluateDirty(ctx);
+        CellValue* v = SpreadSheetGetCell(&out, at);
+        assert(v && v->t == CT_FLOAT && v->d.f == (CellFloat)(2.0 * INT32_MAX));
+
+        SymbolTableFree(&sym);
+        SpreadSheetFree(&src);
+        SpreadSheetFree(&out);
+        SpreadSheetFree(&refSrc);
+        SpreadSheetFree(&refOut);
+        StringFree(&str);
+    }
+    return 0;
+}
@@ -1,6 +1,8 @@
 #include <libparasheet/lib_internal.h>
 #include <util/util.h>
 
+#include <assert.h>
+
 int main() {
 
 	SymbolMap map = {
@@ -68,9 +70,9 @@ int main() {
 		print(stdout, "\t(%d %d %d)\n", i, e.type, e.data.d.i);
 	}
 
-    SymbolPopScope(&t);
-
-    Free(t.mem, t.scopes, t.cap * sizeof(SymbolMap));
+    // the last scope is popped by SymbolTableFree
+    SymbolTableFree(&t);
+    assert(!t.size && !t.scopes && !t.cap);
 
 	return 0;
 }
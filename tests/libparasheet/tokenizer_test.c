@@ -128,9 +128,7 @@ int main() {
 	// Verify literals
 	assert(tokens->tokens[4].data.i == 42);
 	assert(tokens->tokens[6].data.i == 25);
-	// My float parsing is apparently different from how C does it, so I need a
-	// threshold
-	assert(ABS(tokens->tokens[14].data.f - 2.1) < 0.0001);
+	assert(tokens->tokens[14].data.f == (CellFloat)2.1);
 
 	SString output = StringGet(&stringTable, tokens->tokens[23].data.s);
 	assert(
@@ -0,0 +1,115 @@
+#include <util/util.h>
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+#define JOBS 1000
+#define CHILDREN 16
+
+static atomic_uint total;
+
+static void addJob(void* arg, Allocator scratch) {
+    u32* value = arg;
+
+    // scratch is usable for the length of the job
+    u32* tmp = Alloc(scratch, sizeof(u32));
+    *tmp = *value;
+    atomic_fetch_add(&total, *tmp);
+}
+
+// more than the whole arena, which spills over to the parent allocator
+static void bigJob(void* arg, Allocator scratch) {
+    u8* buf = Alloc(scratch, KB(64));
+    memset(buf, 1, KB(64));
+    buf = Realloc(scratch, buf, KB(64), KB(128));
+    memset(buf + KB(64), 1, KB(64));
+    u32 sum = 0;
+    for (u32 i = 0; i < KB(128); i += 1024) sum += buf[i];
+    atomic_fetch_add(&total, sum);
+}
+
+// keeps the other workers busy while the waiter has nothing to take
+static void slowJob(void* arg, Allocator scratch) {
+    usleep(20000);
+    atomic_fetch_add(&total, 1);
+}
+
+typedef struct Parent {
+    JobPool* pool;
+    u32 values[CHILDREN];
+} Parent;
+
+// submits children and joins on them from inside a job
+static void parentJob(void* arg, Allocator scratch) {
+    Parent* p = arg;
+    JobGroup group = {0};
+
+    for (u32 i = 0; i < CHILDREN; i++) {
+        JobSubmit(p->pool, &group, addJob, &p->values[i]);
+    }
+    JobWait(p->pool, &group);
+}
+
+int main() {
+    Allocator mem = GlobalAllocatorCreate();
+    JobPool* pool = JobPoolCreate(mem, 4, KB(4));
+    assert(JobPoolThreads(pool) == 4);
+
+    static u32 values[JOBS];
+    u32 expected = 0;
+    for (u32 i = 0; i < JOBS; i++) {
+        values[i] = i;
+        expected += i;
+    }
+
+    JobGroup group = {0};
+    for (u32 i = 0; i < JOBS; i++) {
+        JobSubmit(pool, &group, addJob, &values[i]);
+    }
+    JobWait(pool, &group);
+    assert(group.pending == 0);
+    assert(atomic_load(&total) == expected);
+
+    // nested groups
+    atomic_store(&total, 0);
+    static Parent parents[32];
+    JobGroup outer = {0};
+    for (u32 i = 0; i < 32; i++) {
+        parents[i].pool = pool;
+        for (u32 j = 0; j < CHILDREN; j++) parents[i].values[j] = 1;
+        JobSubmit(pool, &outer, parentJob, &parents[i]);
+    }
+    JobWait(pool, &outer);
+    assert(atomic_load(&total) == 32 * CHILDREN);
+
+    // jobs whose scratch doesn't fit the arena
+    atomic_store(&total, 0);
+    group = (JobGroup){0};
+    for (u32 i = 0; i < 8; i++) JobSubmit(pool, &group, bigJob, NULL);
+    JobWait(pool, &group);
+    assert(atomic_load(&total) == 8 * 128);
+
+    // the waiter sleeps until the last of these is done
+    atomic_store(&total, 0);
+    group = (JobGroup){0};
+    for (u32 i = 0; i < 3; i++) JobSubmit(pool, &group, slowJob, NULL);
+    JobWait(pool, &group);
+    assert(atomic_load(&total) == 3);
+
+    JobPoolDestroy(pool);
+
+    // a single thread pool runs everything from JobWait
+    pool = JobPoolCreate(mem, 1, KB(4));
+    atomic_store(&total, 0);
+    group = (JobGroup){0};
+    for (u32 i = 0; i < JOBS; i++) {
+        JobSubmit(pool, &group, addJob, &values[i]);
+    }
+    JobWait(pool, &group);
+    assert(atomic_load(&total) == expected);
+    JobPoolDestroy(pool);
+
+    return 0;
+}